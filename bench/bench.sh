@@ -0,0 +1,169 @@
+#!/bin/bash
+# Loopback benchmark: starts a server on an unprivileged port in a temporary storage folder,
+# and drives read, write and delete workloads against it, sweeping file sizes, block sizes and concurrency levels.
+# Every run appends one JSON line to the output file (and prints it), for diffing results between commits:
+#   {"impair":"none","workload":"read","size":1048576,"blksize":1468,"concurrency":8,"requests":64,"failures":0,
+#    "seconds":0.412,"mb_per_s":162.84,"requests_per_s":155.34,"p50_ms":41.2,"p99_ms":60.3,"p999_ms":61.0}
+# Latencies are those of whole client processes, each serving one request, so they include process startup.
+# Each impairment (see impair.h) is applied to the server and clients alike, with the server restarted for it,
+# e.g. BENCH_IMPAIR="none loss=1,seed=1 loss=5,seed=1" to see how throughput degrades with loss.
+#
+# usage: bench.sh <stftpu binary> <output file>
+# settings (environment): BENCH_PORT, BENCH_SIZES, BENCH_BLKSIZES, BENCH_CONCURRENCY, BENCH_REQUESTS, BENCH_SERVER_ARGS, BENCH_IMPAIR
+
+set -u
+
+BINARY=$(realpath "$1")
+OUTPUT=$(realpath "$2")
+PORT=${BENCH_PORT:-6969}
+SIZES=${BENCH_SIZES:-"4096 1048576 16777216"}
+BLKSIZES=${BENCH_BLKSIZES:-"512 1468 8192"}
+CONCURRENCY=${BENCH_CONCURRENCY:-"1 8 32"}
+REQUESTS=${BENCH_REQUESTS:-64}
+SERVER_ARGS=${BENCH_SERVER_ARGS:-}
+IMPAIRMENTS=${BENCH_IMPAIR:-none}
+
+WORK_DIR=$(mktemp -d)
+SERVER_PID=
+
+stop_server()
+{
+    [ -n "$SERVER_PID" ] && kill -INT "$SERVER_PID" 2>/dev/null && wait "$SERVER_PID"
+    SERVER_PID=
+}
+
+cleanup()
+{
+    stop_server
+    rm -rf "$WORK_DIR"
+}
+
+trap cleanup EXIT
+
+# percentile <sorted latencies file> <fraction>: the nearest-rank percentile, in milliseconds
+percentile()
+{
+    awk -v fraction="$2" '{ values[NR] = $1 } END { if (NR == 0) { print 0; exit }
+        rank = int(NR * fraction + 0.999999); if (rank < 1) rank = 1; printf "%.3f", values[rank] / 1000000 }' "$1"
+}
+
+# client <worker> <index> <workload> <size> <blksize>: runs a single request, and prints its latency in nanoseconds
+client()
+{
+    local name=bench-$4.bin
+    local start end
+
+    case $3 in
+        write) name=bench-$1-$2-$4.bin; cp "$WORK_DIR/source-$4.bin" "$name" ;;
+        delete) name=bench-$1-$2-$4.bin; cp "$WORK_DIR/source-$4.bin" "$WORK_DIR/server/storage/$name" ;;
+    esac
+
+    start=$(date +%s%N)
+
+    if [ "$3" = delete ]; then
+        "$BINARY" delete "127.0.0.1:$PORT" "$name" > /dev/null 2>&1
+    else
+        "$BINARY" "$3" "127.0.0.1:$PORT" "$name" octet "$5" > /dev/null 2>&1
+    fi
+
+    local status=$?
+    end=$(date +%s%N)
+    rm -f "$name"
+    [ $status -eq 0 ] && echo $((end - start)) || echo failed
+}
+
+# run <workload> <size> <blksize> <concurrency>: runs the given number of requests spread over concurrent workers
+run()
+{
+    local workload=$1 size=$2 blksize=$3 concurrency=$4
+    local per_worker=$(( (REQUESTS + concurrency - 1) / concurrency ))
+    local results=$WORK_DIR/results
+    local start end
+
+    rm -f "$results".*
+    start=$(date +%s%N)
+
+    for worker in $(seq 1 "$concurrency"); do
+        (
+            mkdir -p "$WORK_DIR/client-$worker" && cd "$WORK_DIR/client-$worker" || exit 1
+
+            for index in $(seq 1 "$per_worker"); do
+                client "$worker" "$index" "$workload" "$size" "$blksize"
+            done > "$results.$worker"
+        ) &
+    done
+
+    wait $(jobs -p | grep -v "^$SERVER_PID\$")
+    end=$(date +%s%N)
+
+    # files written by the run are left to the next ones' index lookups otherwise
+    rm -f "$WORK_DIR"/server/storage/bench-*-*-*.bin
+
+    cat "$results".[0-9]* | grep -v failed | sort -n > "$results.sorted"
+    local requests failures seconds
+    requests=$(cat "$results".[0-9]* | wc -l)
+    failures=$(cat "$results".[0-9]* | grep -c failed)
+    seconds=$(awk -v ns=$((end - start)) 'BEGIN { printf "%.3f", ns / 1e9 }')
+
+    local bytes=$(( (requests - failures) * size ))
+    [ "$workload" = delete ] && bytes=0
+
+    awk -v workload="$workload" -v size="$size" -v blksize="$blksize" -v concurrency="$concurrency" \
+        -v requests="$requests" -v failures="$failures" -v seconds="$seconds" -v bytes="$bytes" \
+        -v p50="$(percentile "$results.sorted" 0.5)" -v p99="$(percentile "$results.sorted" 0.99)" -v p999="$(percentile "$results.sorted" 0.999)" \
+        -v impair="${STFTPU_IMPAIR:-none}" \
+        'BEGIN { printf "{\"impair\":\"%s\",\"workload\":\"%s\",\"size\":%d,\"blksize\":%d,\"concurrency\":%d,\"requests\":%d,\"failures\":%d,\"seconds\":%s,", \
+                impair, workload, size, blksize, concurrency, requests, failures, seconds;
+            printf "\"mb_per_s\":%.2f,\"requests_per_s\":%.2f,\"p50_ms\":%s,\"p99_ms\":%s,\"p999_ms\":%s}\n", \
+                bytes / 1e6 / seconds, (requests - failures) / seconds, p50, p99, p999 }' | tee -a "$OUTPUT"
+}
+
+mkdir -p "$WORK_DIR/server/storage"
+
+for size in $SIZES; do
+    head -c "$size" /dev/urandom > "$WORK_DIR/source-$size.bin"
+    cp "$WORK_DIR/source-$size.bin" "$WORK_DIR/server/storage/bench-$size.bin"
+done
+
+# start_server: runs the server in the background, with the current impairment
+start_server()
+{
+    cd "$WORK_DIR/server" || exit 1
+    # shellcheck disable=SC2086
+    "$BINARY" serve port="$PORT" log=warn $SERVER_ARGS > "$WORK_DIR/server.log" 2>&1 &
+    SERVER_PID=$!
+    cd - > /dev/null || exit 1
+    sleep 0.5
+
+    if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+        echo "Server failed to start:" >&2
+        cat "$WORK_DIR/server.log" >&2
+        SERVER_PID=
+        exit 1
+    fi
+}
+
+echo "Benchmarking $BINARY on port $PORT, results appended to $OUTPUT." >&2
+
+for impairment in $IMPAIRMENTS; do
+    if [ "$impairment" = none ]; then
+        unset STFTPU_IMPAIR
+    else
+        export STFTPU_IMPAIR=$impairment
+    fi
+
+    start_server
+
+    for concurrency in $CONCURRENCY; do
+        for size in $SIZES; do
+            for blksize in $BLKSIZES; do
+                run read "$size" "$blksize" "$concurrency"
+                run write "$size" "$blksize" "$concurrency"
+            done
+        done
+
+        run delete "${SIZES%% *}" 0 "$concurrency"
+    done
+
+    stop_server
+done
@@ -1,21 +1,19 @@
 #include "client.h"
 
+#include <poll.h>
+
 /**
  * Generates a request packet from input OperationData_t
  * and sends it to the given TFTP server.
  */
 static bool send_request_packet(OperationData_t *data)
 {
-    static const uint8_t blocksize_blksize_str_len = 8;
-    static const uint8_t blocksize_octets_str_len = 6;
-
     uint16_t contents_idx = 0;
     char *filename_in_path;
     size_t filename_len;
     size_t contents_size;
     size_t full_packet_size;
     size_t transfer_mode_len;
-    char blocksize_octets_str[6] = {0};
 
     filename_in_path = strrchr(data->path, '/');
 
@@ -42,20 +40,14 @@ static bool send_request_packet(OperationData_t *data)
             exit(EXIT_FAILURE);
         }
 
-         transfer_mode_len = strlen(tftp_common.transfer_mode_strings[data->transfer_mode]);
-
-        if (data->block_size > 0 && data->block_size != TFTP_BLKSIZE_DEFAULT)
-        {
-            sprintf(blocksize_octets_str, "%05u", data->block_size);
-        }
+        transfer_mode_len = strlen(tftp_common.transfer_mode_strings[data->transfer_mode]) + 1;
 
         // calculating required space for the additional data fields
         contents_size +=
             // space for transfer mode + terminator
             + transfer_mode_len 
-            // optional space for blksize & octet fields + terminators
-            + ((data->block_size > 0 && data->block_size != TFTP_BLKSIZE_DEFAULT)
-                ? blocksize_blksize_str_len + blocksize_octets_str_len : 0);
+            // optional space for option name & value fields + terminators
+            + tftp_append_options(NULL, data);
     }
 
     // summing up the packet size
@@ -97,20 +89,11 @@ static bool send_request_packet(OperationData_t *data)
         memcpy(request_packet_ptr->request.contents + contents_idx, tftp_common.transfer_mode_strings[data->transfer_mode], transfer_mode_len); 
         contents_idx += transfer_mode_len;
 
-        // if custom blocksize specified, we must add those fields as well
-        if (data->block_size > 0 && data->block_size != TFTP_BLKSIZE_DEFAULT)
-        {
-            contents_idx++;
-            // identifying "blksize" string field + terminator
-            memcpy(request_packet_ptr->request.contents + contents_idx, TFTP_BLKSIZE_STRING, blocksize_blksize_str_len); 
-            contents_idx += blocksize_blksize_str_len;
-            // ascii representation of the requested blocksize + terminator
-            memcpy(request_packet_ptr->request.contents + contents_idx, blocksize_octets_str, blocksize_octets_str_len); 
-            contents_idx += blocksize_octets_str_len;
-        }
+        // if any options are requested, we must add those fields as well
+        contents_idx += tftp_append_options(request_packet_ptr->request.contents + contents_idx, data);
     }
 
-    ssize_t bytes_sent = sendto(data->data_socket, request_packet_ptr, sizeof(Packet_t) + contents_size, 0, (struct sockaddr *)&(data->peer_address), data->peer_address_length);
+    ssize_t bytes_sent = impair_sendto(data->data_socket, request_packet_ptr, sizeof(Packet_t) + contents_size, 0, (struct sockaddr *)&(data->peer_address), data->peer_address_length);
 
     // blanking and freeing the request buffer here regardless of outcome
     explicit_bzero(request_packet_ptr, full_packet_size);
@@ -125,6 +108,448 @@ static bool send_request_packet(OperationData_t *data)
     return true;
 }
 
+/**
+ * Asks for the file size along with a read or write request (RFC 2349): a write request tells the server
+ * the size of the file about to be sent, while a read request asks the server to fill it in.
+ */
+static void client_request_transfer_size(OperationData_t *op_data)
+{
+    struct stat file_attr;
+
+    if (op_data->operation_id == TFTP_OPERATION_RECEIVE)
+    {
+        op_data->transfer_size = 0;
+        op_data->option_flags |= TFTP_OPTION_TSIZE;
+    }
+    else if (op_data->operation_id == TFTP_OPERATION_SEND && stat(op_data->path, &file_attr) == 0)
+    {
+        op_data->transfer_size = file_attr.st_size;
+        op_data->option_flags |= TFTP_OPTION_TSIZE;
+    }
+}
+
+/**
+ * Takes up the options a server acknowledged in its OACK, which must be among those requested,
+ * with block and window sizes no larger than requested, and the timeout unchanged (RFC 2347).
+ * Options left out of the OACK revert to their protocol defaults.
+ * An unacceptable OACK is declined with an error, as the RFC prescribes.
+ */
+static bool client_accept_option_acknowledgement(OperationData_t *op_data, const char *fields, size_t length)
+{
+    OperationData_t requested = *op_data;
+    TFTPOptionList_t acknowledged;
+    bool acceptable = tftp_parse_options(fields, length, &acknowledged);
+
+    op_data->option_flags = 0;
+    op_data->block_size = TFTP_BLKSIZE_DEFAULT;
+    op_data->window_size = TFTP_WINDOWSIZE_DEFAULT;
+
+    for (uint8_t idx = 0; acceptable && idx < acknowledged.count; idx++)
+    {
+        // negotiating clamps the window to what this side supports, which an acknowledged window must not need
+        acceptable = tftp_negotiate_option(op_data, &acknowledged.options[idx])
+            && (0 != strcasecmp(acknowledged.options[idx].name, TFTP_WINDOWSIZE_STRING) || strtoul(acknowledged.options[idx].value, NULL, 10) <= TFTP_WINDOWSIZE_MAX);
+        printf("Server acknowledged option %s=%s.\n", acknowledged.options[idx].name, acknowledged.options[idx].value);
+    }
+
+    acceptable = acceptable
+        && (op_data->option_flags & ~requested.option_flags) == 0
+        && op_data->block_size <= requested.block_size
+        && op_data->window_size <= requested.window_size
+        && (!(op_data->option_flags & TFTP_OPTION_TIMEOUT) || op_data->timeout_seconds == requested.timeout_seconds);
+
+    if (!acceptable)
+    {
+        printf("Server acknowledged options that were not requested, or with unacceptable values.\n");
+        tftp_send_error(TFTP_ERROR_OPTION_NEGOTIATION, "unacceptable option acknowledgement", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        return false;
+    }
+
+    printf("Negotiated block size %u bytes, window size %u blocks.\n", op_data->block_size, op_data->window_size);
+
+    if (op_data->option_flags & TFTP_OPTION_MULTICAST)
+    {
+        printf("Receiving from multicast group %s:%u as %s.\n", inet_ntoa(op_data->multicast_address.sin_addr),
+                ntohs(op_data->multicast_address.sin_port), op_data->multicast_master ? "master client" : "passive member");
+    }
+
+    // a read only starts once the OACK is acknowledged, while a write starts right away;
+    // a multicast read only once the group was joined, if this is the master client at all
+    return op_data->operation_id != TFTP_OPERATION_RECEIVE
+        || (op_data->option_flags & TFTP_OPTION_MULTICAST)
+        || tftp_send_ack(0, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+}
+
+/**
+ * Awaits the server's first response to a read or write request, which tells whether it supports options:
+ * an OACK is checked and taken up, while a server ignoring options answers with the first DATA packet (read)
+ * or ACK 0 (write), in which case the protocol defaults apply.
+ * That first DATA packet is only peeked at, and left queued for the transfer to receive.
+ * Returns false if the server answered with an error, sent an unacceptable OACK, or did not answer at all.
+ */
+static bool client_await_request_response(OperationData_t *op_data)
+{
+    // large enough for any OACK, and for a peek at the headers of anything else
+    uint8_t packet_buffer[sizeof(Packet_t) + TFTP_BLKSIZE_DEFAULT + 1];
+    Packet_t *response = (Packet_t *)packet_buffer;
+
+    for (uint8_t attempt = 1; attempt <= tftp_common.max_retry_count; attempt++)
+    {
+        printf("Awaiting response to %s request (attempt #%d).\n", op_data->request_description, attempt);
+        explicit_bzero(packet_buffer, sizeof(packet_buffer));
+        ssize_t bytes_received = recvfrom(op_data->data_socket, response, sizeof(packet_buffer) - 1, MSG_PEEK, (struct sockaddr *)&op_data->peer_address, &op_data->peer_address_length);
+
+        if (bytes_received < 0)
+        {
+            continue;
+        }
+
+        uint16_t opcode = bytes_received >= (ssize_t)sizeof(Packet_t) ? ntohs(response->opcode) : TFTP_NONE;
+        bool first_data_packet = (opcode == TFTP_DATA && ntohs(response->data.block_number) == 1);
+
+        if (!first_data_packet)
+        {
+            recv(op_data->data_socket, packet_buffer, 0, 0);
+        }
+
+        if (opcode == TFTP_OACK)
+        {
+            return client_accept_option_acknowledgement(op_data, response->oack.options, bytes_received - sizeof(response->opcode));
+        }
+        else if ((first_data_packet && op_data->operation_id == TFTP_OPERATION_RECEIVE)
+            || (opcode == TFTP_ACK && ntohs(response->ack.block_number) == 0 && op_data->operation_id == TFTP_OPERATION_SEND))
+        {
+            if (op_data->option_flags != 0)
+            {
+                printf("Server ignored the requested options, falling back to defaults.\n");
+            }
+
+            op_data->option_flags = 0;
+            op_data->block_size = TFTP_BLKSIZE_DEFAULT;
+            op_data->window_size = TFTP_WINDOWSIZE_DEFAULT;
+            return true;
+        }
+        else if (opcode == TFTP_ERROR)
+        {
+            printf("Received error message (code %u) from peer with message: %s\n", ntohs(response->error.error_code), response->error.error_message);
+            return false;
+        }
+
+        printf("Received packet with unexpected opcode %u in response to request.\n", opcode);
+    }
+
+    printf("Request response retry limit (%u) reached.\n", tftp_common.max_retry_count);
+    return false;
+}
+
+/**
+ * Joins the multicast group the server told us to receive the file from.
+ * The group's port is shared with any other clients of the group on this host.
+ * Returns the group socket, or -1 on failure.
+ */
+static int client_join_multicast_group(const OperationData_t *op_data)
+{
+    static const int enable_flag = 1;
+    struct ip_mreq membership = { .imr_multiaddr = op_data->multicast_address.sin_addr, .imr_interface.s_addr = INADDR_ANY };
+    int group_socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (group_socket < 0
+        || 0 > setsockopt(group_socket, SOL_SOCKET, SO_REUSEADDR, &enable_flag, sizeof(enable_flag))
+        || 0 > bind(group_socket, (const struct sockaddr *)&op_data->multicast_address, sizeof(op_data->multicast_address))
+        || 0 > setsockopt(group_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)))
+    {
+        perror("Failed to join multicast group");
+
+        if (group_socket >= 0)
+        {
+            close(group_socket);
+        }
+
+        return -1;
+    }
+
+    return group_socket;
+}
+
+/**
+ * Acknowledges the blocks received so far, naming the last one in sequence,
+ * right after which the server starts its next window.
+ */
+static bool client_multicast_send_ack(OperationData_t *op_data, ClientMulticastState_t *state)
+{
+    state->window_first_block = state->blocks_in_sequence + 1;
+    return tftp_send_ack(state->blocks_in_sequence, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+}
+
+/**
+ * Acknowledges a block that arrived while master client, the way a unicast receiver would (RFC 7440):
+ * once the last block of the window arrived, or as soon as a block went missing (once per gap).
+ * Blocks of the previous window only arrive again if its ACK was lost, which is then resent.
+ */
+static bool client_multicast_acknowledge(OperationData_t *op_data, ClientMulticastState_t *state, uint64_t block)
+{
+    uint64_t window_last_block = state->window_first_block + op_data->window_size - 1;
+
+    if (block + 1 == state->window_first_block)
+    {
+        return client_multicast_send_ack(op_data, state);
+    }
+    else if (block < state->window_first_block)
+    {
+        return true;
+    }
+    else if (block >= window_last_block || block == state->total_block_count)
+    {
+        state->gap_acknowledged = false;
+        return client_multicast_send_ack(op_data, state);
+    }
+    else if (block > state->blocks_in_sequence && !state->gap_acknowledged)
+    {
+        printf("Block #%lu missing, acknowledging up to block #%lu.\n", state->blocks_in_sequence + 1, state->blocks_in_sequence);
+        state->gap_acknowledged = true;
+        return client_multicast_send_ack(op_data, state);
+    }
+
+    return true;
+}
+
+/**
+ * Stores a DATA packet received from the group at its place in the file, unless it arrived before.
+ * Its absolute block number is taken to be the one closest to the last block received.
+ * Returns false if the block could not be written.
+ */
+static bool client_multicast_handle_data(OperationData_t *op_data, TransferData_t *tx_data, ClientMulticastState_t *state, const Packet_t *packet, size_t length)
+{
+    uint64_t block = state->last_block + (int16_t)(ntohs(packet->data.block_number) - (uint16_t)state->last_block);
+    size_t data_length = length - sizeof(Packet_t);
+
+    // the final block holds whatever is left of the file, and every other block a full block
+    if (block < 1 || block > state->total_block_count
+        || data_length != (block == state->total_block_count ? op_data->transfer_size - (block - 1) * op_data->block_size : op_data->block_size))
+    {
+        return true;
+    }
+
+    state->last_block = block;
+    state->idle_timeouts = 0;
+
+    if (!(state->received_bitmap[(block - 1) / 8] & (1 << ((block - 1) % 8))))
+    {
+        if (0 > pwrite(fileno(tx_data->file), packet->data.data, data_length, (block - 1) * op_data->block_size))
+        {
+            perror("Failed to write block");
+            tftp_send_error(TFTP_ERROR_UNDEFINED, "Client failed to write block, details: ", strerror(errno), op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+            return false;
+        }
+
+        state->received_bitmap[(block - 1) / 8] |= 1 << ((block - 1) % 8);
+        state->blocks_received++;
+        tx_data->total_file_bytes_transmitted += data_length;
+
+        while (state->blocks_in_sequence < state->total_block_count
+            && (state->received_bitmap[state->blocks_in_sequence / 8] & (1 << (state->blocks_in_sequence % 8))))
+        {
+            state->blocks_in_sequence++;
+            state->gap_acknowledged = false;
+        }
+    }
+
+    if (state->master && state->blocks_in_sequence < state->total_block_count)
+    {
+        return client_multicast_acknowledge(op_data, state, block);
+    }
+
+    return true;
+}
+
+/**
+ * Handles a packet sent by the server to the client itself rather than to the group:
+ * an OACK making the client master (possibly resent, if its ACK was lost), or an ERROR.
+ * Becoming master, the client acknowledges the last block it has in sequence, for the server to go on from there.
+ * Returns false if the server gave up on us.
+ */
+static bool client_multicast_handle_unicast(OperationData_t *op_data, ClientMulticastState_t *state, const Packet_t *packet, size_t length, const struct sockaddr_in *sender_address)
+{
+    uint16_t opcode = ntohs(packet->opcode);
+
+    if (opcode == TFTP_ERROR)
+    {
+        printf("\nReceived error message (code %u) from server with message: %s\n", ntohs(packet->error.error_code), packet->error.error_message);
+        return false;
+    }
+    else if (opcode != TFTP_OACK)
+    {
+        return true;
+    }
+
+    OperationData_t offer = *op_data;
+    TFTPOptionList_t acknowledged;
+
+    offer.multicast_master = false;
+
+    if (tftp_parse_options(packet->oack.options, length - sizeof(packet->opcode), &acknowledged))
+    {
+        for (uint8_t idx = 0; idx < acknowledged.count; idx++)
+        {
+            tftp_negotiate_option(&offer, &acknowledged.options[idx]);
+        }
+    }
+
+    if (!offer.multicast_master)
+    {
+        return true;
+    }
+
+    if (!state->master)
+    {
+        printf("\nPromoted to master client with %lu/%lu blocks received, %lu in sequence.\n", state->blocks_received, state->total_block_count, state->blocks_in_sequence);
+        state->master = true;
+        state->gap_acknowledged = false;
+        op_data->peer_address = *sender_address;
+    }
+
+    state->idle_timeouts = 0;
+    return client_multicast_send_ack(op_data, state);
+}
+
+/**
+ * Receives a file from the multicast group the server assigned (RFC 2090), along with every other client of the group.
+ * Blocks are written wherever they belong as they arrive, while only the master client acknowledges them.
+ * A passive member waits until it is promoted to master, to ask for the blocks it missed,
+ * and tells the server once it has the whole file either way.
+ * Timeouts resend the master's ACK; a passive member only gives up after a long time without any packets.
+ */
+static bool client_receive_multicast(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    ClientMulticastState_t state;
+    uint8_t *packet_buffer = malloc(sizeof(Packet_t) + op_data->block_size + 1);
+    bool success = false;
+
+    if (packet_buffer == NULL)
+    {
+        perror("Failed to allocate packet buffer");
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "Client out of memory", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        return false;
+    }
+
+    if (!(op_data->option_flags & TFTP_OPTION_TSIZE))
+    {
+        printf("Server did not tell the file size, which a multicast read relies on.\n");
+        tftp_send_error(TFTP_ERROR_OPTION_NEGOTIATION, "multicast read requires the tsize option", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        free(packet_buffer);
+        return false;
+    }
+
+    explicit_bzero(&state, sizeof(state));
+    state.master = op_data->multicast_master;
+    state.window_first_block = 1;
+    state.total_block_count = op_data->transfer_size / op_data->block_size + 1;
+
+    // the bitmap is sized from the server's word alone, which may well be more than this side can hold
+    uint64_t bitmap_bytes = (state.total_block_count + 7) / 8;
+    state.received_bitmap = bitmap_bytes <= SIZE_MAX ? calloc(bitmap_bytes, 1) : NULL;
+
+    if (state.received_bitmap == NULL)
+    {
+        printf("Cannot keep track of the %lu blocks of a %lu byte file.\n", state.total_block_count, op_data->transfer_size);
+        tftp_send_error(TFTP_ERROR_OPTION_NEGOTIATION, "tsize too large for a multicast read", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        free(packet_buffer);
+        return false;
+    }
+
+    int group_socket = client_join_multicast_group(op_data);
+    struct pollfd poll_fds[2] = { { .fd = group_socket, .events = POLLIN }, { .fd = op_data->data_socket, .events = POLLIN } };
+    clock_gettime(CLOCK_MONOTONIC, &tx_data->start_clock);
+
+    // the master client acknowledges its OACK only now, since the server starts sending to the group right away
+    if (group_socket >= 0 && state.master && !client_multicast_send_ack(op_data, &state))
+    {
+        close(group_socket);
+        group_socket = -1;
+    }
+
+    while (group_socket >= 0 && !should_terminate)
+    {
+        int ready_count = poll(poll_fds, 2, TFTP_TIMEOUT_SECONDS * 1000);
+
+        if (ready_count < 0 && errno != EINTR)
+        {
+            perror("Failed to poll sockets");
+            break;
+        }
+        else if (ready_count <= 0)
+        {
+            state.idle_timeouts++;
+
+            if (state.master ? state.idle_timeouts > tftp_common.max_retry_count : state.idle_timeouts > CLIENT_MULTICAST_IDLE_TIMEOUT_SECONDS / TFTP_TIMEOUT_SECONDS)
+            {
+                printf("\nNothing received from the server for too long. Aborting.\n");
+                tftp_send_error(TFTP_ERROR_UNDEFINED, "Timed out waiting for data", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+                break;
+            }
+
+            if (state.master && !client_multicast_send_ack(op_data, &state))
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        if (poll_fds[1].revents & POLLIN)
+        {
+            struct sockaddr_in sender_address;
+            socklen_t sender_address_length = sizeof(sender_address);
+            ssize_t length = recvfrom(op_data->data_socket, packet_buffer, sizeof(Packet_t) + op_data->block_size, 0, (struct sockaddr *)&sender_address, &sender_address_length);
+
+            if (length >= (ssize_t)sizeof(Packet_t))
+            {
+                packet_buffer[length] = '\0';
+
+                if (!client_multicast_handle_unicast(op_data, &state, (Packet_t *)packet_buffer, length, &sender_address))
+                {
+                    break;
+                }
+            }
+        }
+
+        if (poll_fds[0].revents & POLLIN)
+        {
+            ssize_t length = recv(group_socket, packet_buffer, sizeof(Packet_t) + op_data->block_size, 0);
+
+            if (length >= (ssize_t)sizeof(Packet_t) && ntohs(((Packet_t *)packet_buffer)->opcode) == TFTP_ERROR)
+            {
+                packet_buffer[length] = '\0';
+                printf("\nReceived error message (code %u) from the group with message: %s\n", ntohs(((Packet_t *)packet_buffer)->error.error_code), ((Packet_t *)packet_buffer)->error.error_message);
+                break;
+            }
+            else if (length >= (ssize_t)sizeof(Packet_t) && ntohs(((Packet_t *)packet_buffer)->opcode) == TFTP_DATA
+                && !client_multicast_handle_data(op_data, tx_data, &state, (Packet_t *)packet_buffer, length))
+            {
+                break;
+            }
+        }
+
+        if (state.blocks_in_sequence == state.total_block_count)
+        {
+            // a passive member tells the server too, so that it is never promoted
+            tftp_send_ack(state.total_block_count, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+            printf("\nMulticast reception complete in %0.2fs, %lu bytes in %lu blocks.\n", seconds_since_clock(tx_data->start_clock), tx_data->total_file_bytes_transmitted, state.total_block_count);
+            success = true;
+            break;
+        }
+    }
+
+    if (group_socket >= 0)
+    {
+        close(group_socket);
+    }
+
+    free(state.received_bitmap);
+    free(packet_buffer);
+    return success;
+}
+
 /**
  * Entry point for the TFTP client.
  * Handles the request, acknowledgement and actual operation
@@ -134,6 +559,11 @@ bool client_start_operation(OperationData_t *op_data)
 {
     bool operation_outcome = false;
 
+    if (op_data->operation_id != TFTP_OPERATION_REQUEST_DELETE)
+    {
+        client_request_transfer_size(op_data);
+    }
+
     // send operation request and await acknowledgement
     if (send_request_packet(op_data))
     {
@@ -145,10 +575,11 @@ bool client_start_operation(OperationData_t *op_data)
         return operation_outcome;
     }
 
-    // WRITE and DELETE operations must await an ACK response here;
-    // READ operations skip ahead and await the first DATA packet
-    if (op_data->operation_id != TFTP_OPERATION_RECEIVE
-        && tftp_await_acknowledgement(0, op_data) == false)
+    // DELETE operations must await an ACK response here;
+    // READ and WRITE operations await an OACK, or whatever a server without option support answers with
+    if (op_data->operation_id == TFTP_OPERATION_REQUEST_DELETE
+        ? tftp_await_acknowledgement(0, op_data) == false
+        : client_await_request_response(op_data) == false)
     {
         printf("%s request unacknowledged.\n", op_data->request_description);
         return operation_outcome;
@@ -173,17 +604,25 @@ bool client_start_operation(OperationData_t *op_data)
     else
     {
         TransferData_t *transfer_data = malloc(sizeof(TransferData_t));
+        IoRing_t ring;
+
+        if (io_ring_init(&ring))
+        {
+            io_ring_attach(&ring);
+        }
 
         switch (op_data->operation_id)
         {
             case TFTP_OPERATION_RECEIVE:
-                if(tftp_fill_transfer_data(op_data, transfer_data, true))
+                if(tftp_fill_transfer_data(op_data, transfer_data, true, NULL))
                 {
-                    operation_outcome = tftp_receive_file(op_data, transfer_data);
+                    operation_outcome = (op_data->option_flags & TFTP_OPTION_MULTICAST)
+                        ? client_receive_multicast(op_data, transfer_data)
+                        : tftp_receive_file(op_data, transfer_data);
                 }
                 break;
             case TFTP_OPERATION_SEND:
-                if(tftp_fill_transfer_data(op_data, transfer_data, false))
+                if(tftp_fill_transfer_data(op_data, transfer_data, false, NULL))
                 {
                     operation_outcome = tftp_transmit_file(op_data, transfer_data);
                 }
@@ -193,6 +632,8 @@ bool client_start_operation(OperationData_t *op_data)
         }
 
         tftp_free_transfer_data(transfer_data);
+        io_ring_print_counters(&ring.counters, "io_uring requests");
+        io_ring_deinit(&ring);
     }
 
     return operation_outcome;
@@ -4,6 +4,28 @@
 #include "common.h"
 #include "networking_common.h"
 #include "tftp_common.h"
+#include "io_ring.h"
+#include "impair.h"
+
+#define CLIENT_MULTICAST_IDLE_TIMEOUT_SECONDS 60
+
+/**
+ * The state of a multicast read (RFC 2090): which blocks arrived so far, in whatever order,
+ * since the client may have joined the group halfway through the file,
+ * and while it is the master client, where the window it acknowledges starts.
+ */
+typedef struct ClientMulticastState
+{
+    bool master;
+    bool gap_acknowledged;
+    uint32_t idle_timeouts;
+    uint64_t total_block_count;
+    uint64_t blocks_in_sequence; // every block up to this one arrived
+    uint64_t blocks_received;
+    uint64_t last_block; // the latest block to arrive, which the next block's 16 bit number is taken relative to
+    uint64_t window_first_block;
+    uint8_t *received_bitmap;
+} ClientMulticastState_t;
 
 /**
  * Entry point for the TFTP client.
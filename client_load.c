@@ -0,0 +1,864 @@
+#include "client_load.h"
+#include "log.h"
+
+#include <stddef.h>
+#include <sys/epoll.h>
+
+static ClientLoadConfig_t client_load_config =
+{
+    .clients = CLIENT_LOAD_CLIENTS_DEFAULT,
+    .duration_s = CLIENT_LOAD_DURATION_S_DEFAULT,
+    .block_size = TFTP_BLKSIZE_DEFAULT,
+    .window_size = TFTP_WINDOWSIZE_DEFAULT,
+    .timeout_ms = CLIENT_LOAD_TIMEOUT_MS_DEFAULT,
+    .retries = TFTP_RETRIES_DEFAULT,
+};
+
+/**
+ * State of the current run: the virtual clients, a stack of the idle ones for open loop arrivals,
+ * and the single packet buffer every client receives into and sends from in turn.
+ */
+static struct
+{
+    int epoll_fd;
+    struct sockaddr_in requests_address;
+    ClientLoadSession_t *sessions;
+    uint32_t *idle_stack;
+    uint32_t idle_count;
+    uint32_t busy_count; // clients neither idle nor done
+    uint64_t end_us;
+    char *packet_buffer;
+    ClientLoadResults_t results;
+} client_load = { .epoll_fd = -1 };
+
+/**
+ * Prints the options the "load" operation mode accepts.
+ */
+static void client_load_print_config_usage(void)
+{
+    printf(" Load options:\n");
+    printf("   clients=<count>      - concurrent virtual clients, each with a socket of its own (default %d)\n", CLIENT_LOAD_CLIENTS_DEFAULT);
+    printf("   rate=<per second>    - open loop: average request arrivals per second, spread as a Poisson process,\n");
+    printf("                          skipped while every client is busy (default 0: closed loop, clients request back to back)\n");
+    printf("   think=<ms>           - closed loop: pause of each client between the end of a request and its next one (default 0)\n");
+    printf("   duration=<seconds>   - stop issuing requests after this long (default %d, 0 for no limit)\n", CLIENT_LOAD_DURATION_S_DEFAULT);
+    printf("   requests=<count>     - stop issuing requests after this many (default 0: no limit)\n");
+    printf("   blksize=<bytes>      - block size to request (default %d)\n", TFTP_BLKSIZE_DEFAULT);
+    printf("   windowsize=<blocks>  - window size to request (default %d)\n", TFTP_WINDOWSIZE_DEFAULT);
+    printf("   timeout=<ms>         - time to wait for the server before sending the request or last ACK again (default %d)\n", CLIENT_LOAD_TIMEOUT_MS_DEFAULT);
+    printf("   retries=<count>      - timeouts in a row after which a request fails (default %d)\n", TFTP_RETRIES_DEFAULT);
+}
+
+/**
+ * Parses the file mix: comma separated file names, each optionally followed by a relative weight, e.g. "a.bin:3,b.bin".
+ */
+static bool client_load_parse_files(char *mix)
+{
+    char *saveptr = NULL;
+
+    for (char *entry = strtok_r(mix, ",", &saveptr); entry != NULL; entry = strtok_r(NULL, ",", &saveptr))
+    {
+        if (client_load_config.files_count == CLIENT_LOAD_FILES_MAX)
+        {
+            fprintf(stderr, "Too many files in the mix, at most %d are supported.\n", CLIENT_LOAD_FILES_MAX);
+            return false;
+        }
+
+        char *weight_string = strrchr(entry, ':');
+        int weight = 1;
+
+        if (weight_string != NULL)
+        {
+            *weight_string++ = '\0';
+            weight = atoi(weight_string);
+        }
+
+        if (weight <= 0 || *entry == '\0' || strlen(entry) > TFTP_FILENAME_MAX)
+        {
+            fprintf(stderr, "Invalid file mix entry '%s'.\n", entry);
+            return false;
+        }
+
+        client_load_config.files[client_load_config.files_count] = entry;
+        client_load_config.file_weights[client_load_config.files_count] = weight;
+        client_load_config.total_weight += weight;
+        client_load_config.files_count++;
+    }
+
+    return client_load_config.files_count > 0;
+}
+
+/**
+ * Parses the "load" operation mode arguments: the file mix, then option=value pairs.
+ * Returns false on any malformed or unknown option.
+ */
+static bool client_load_parse_config(int argc, char *argv[])
+{
+    if (argc < 1 || !client_load_parse_files(argv[0]))
+    {
+        fprintf(stderr, "Missing or invalid file mix.\n");
+        return false;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        char *value = strchr(argv[i], '=');
+
+        if (value == NULL)
+        {
+            fprintf(stderr, "Malformed load option '%s', expected name=value.\n", argv[i]);
+            return false;
+        }
+
+        value++;
+        long number = atol(value);
+
+        if (0 == strncmp(argv[i], "clients=", value - argv[i]))
+        {
+            if (number <= 0 || number > CLIENT_LOAD_CLIENTS_MAX)
+            {
+                fprintf(stderr, "Invalid client count '%s', valid range is 1-%d.\n", value, CLIENT_LOAD_CLIENTS_MAX);
+                return false;
+            }
+
+            client_load_config.clients = number;
+        }
+        else if (0 == strncmp(argv[i], "rate=", value - argv[i]))
+        {
+            client_load_config.rate = atof(value);
+
+            if (client_load_config.rate < 0)
+            {
+                fprintf(stderr, "Invalid arrival rate '%s'.\n", value);
+                return false;
+            }
+        }
+        else if (0 == strncmp(argv[i], "think=", value - argv[i]))
+        {
+            if (number < 0)
+            {
+                fprintf(stderr, "Invalid think time '%s'.\n", value);
+                return false;
+            }
+
+            client_load_config.think_ms = number;
+        }
+        else if (0 == strncmp(argv[i], "duration=", value - argv[i]))
+        {
+            if (number < 0)
+            {
+                fprintf(stderr, "Invalid duration '%s'.\n", value);
+                return false;
+            }
+
+            client_load_config.duration_s = number;
+        }
+        else if (0 == strncmp(argv[i], "requests=", value - argv[i]))
+        {
+            if (number < 0)
+            {
+                fprintf(stderr, "Invalid request count '%s'.\n", value);
+                return false;
+            }
+
+            client_load_config.requests = number;
+        }
+        else if (0 == strncmp(argv[i], "blksize=", value - argv[i]))
+        {
+            if (number < TFTP_BLKSIZE_MIN || number > TFTP_BLKSIZE_MAX)
+            {
+                fprintf(stderr, "Invalid block size '%s', valid range is %d-%d.\n", value, TFTP_BLKSIZE_MIN, TFTP_BLKSIZE_MAX);
+                return false;
+            }
+
+            client_load_config.block_size = number;
+        }
+        else if (0 == strncmp(argv[i], "windowsize=", value - argv[i]))
+        {
+            if (number < TFTP_WINDOWSIZE_MIN || number > TFTP_WINDOWSIZE_MAX)
+            {
+                fprintf(stderr, "Invalid window size '%s', valid range is %d-%d.\n", value, TFTP_WINDOWSIZE_MIN, TFTP_WINDOWSIZE_MAX);
+                return false;
+            }
+
+            client_load_config.window_size = number;
+        }
+        else if (0 == strncmp(argv[i], "timeout=", value - argv[i]))
+        {
+            if (number <= 0)
+            {
+                fprintf(stderr, "Invalid timeout '%s'.\n", value);
+                return false;
+            }
+
+            client_load_config.timeout_ms = number;
+        }
+        else if (0 == strncmp(argv[i], "retries=", value - argv[i]))
+        {
+            if (number < 0 || number > UINT8_MAX)
+            {
+                fprintf(stderr, "Invalid retry count '%s'.\n", value);
+                return false;
+            }
+
+            client_load_config.retries = number;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown load option '%s'.\n", argv[i]);
+            return false;
+        }
+    }
+
+    if (client_load_config.duration_s == 0 && client_load_config.requests == 0)
+    {
+        fprintf(stderr, "Either a duration or a request count is needed to end the run.\n");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Returns a uniformly distributed random number in [0, 1).
+ */
+static double client_load_random_fraction(void)
+{
+    return rand() / (RAND_MAX + 1.0);
+}
+
+/**
+ * Returns the time until the next open loop arrival, exponentially distributed around the mean interval,
+ * so that arrivals form a Poisson process. The natural logarithm is worked out here rather than linking libm:
+ * the fraction is halved down to [0.5, 1), whose logarithm the atanh series converges on within a few terms.
+ */
+static uint64_t client_load_interarrival_us(void)
+{
+    static const double ln2 = 0.69314718055994530942;
+    double fraction = 1.0 - client_load_random_fraction(); // (0, 1]
+    double log_fraction = 0;
+
+    while (fraction < 0.5)
+    {
+        fraction *= 2;
+        log_fraction -= ln2;
+    }
+
+    double z = (fraction - 1) / (fraction + 1);
+    double z_squared = z * z;
+    double term = z;
+
+    for (int power = 1; power < 20; power += 2)
+    {
+        log_fraction += 2 * term / power;
+        term *= z_squared;
+    }
+
+    return (uint64_t)(-log_fraction / client_load_config.rate * 1000000.0);
+}
+
+/**
+ * Picks the index of a file from the mix, with a probability proportional to its weight.
+ */
+static uint8_t client_load_pick_file(void)
+{
+    uint64_t point = (uint64_t)(client_load_random_fraction() * client_load_config.total_weight);
+
+    for (uint8_t i = 0; i < client_load_config.files_count; i++)
+    {
+        if (point < client_load_config.file_weights[i])
+        {
+            return i;
+        }
+
+        point -= client_load_config.file_weights[i];
+    }
+
+    return client_load_config.files_count - 1;
+}
+
+/**
+ * Whether new requests are still due: the run neither reached its duration nor its request count,
+ * nor was it interrupted.
+ */
+static bool client_load_issuing(uint64_t now_us)
+{
+    return !should_terminate
+            && (client_load_config.duration_s == 0 || now_us < client_load.end_us)
+            && (client_load_config.requests == 0 || client_load.results.started < client_load_config.requests);
+}
+
+/**
+ * Sends the read request of a client, asking for the configured block and window sizes if not the defaults.
+ */
+static bool client_load_send_request(ClientLoadSession_t *session)
+{
+    Packet_t *packet = (Packet_t *)client_load.packet_buffer;
+    char *fields = packet->request.contents;
+    int length = sprintf(fields, "%s%c%s%c", client_load_config.files[session->file_index], '\0',
+            tftp_common.transfer_mode_strings[TFTP_MODE_OCTET], '\0');
+
+    if (client_load_config.block_size != TFTP_BLKSIZE_DEFAULT)
+    {
+        length += sprintf(fields + length, "%s%c%u%c", TFTP_BLKSIZE_STRING, '\0', client_load_config.block_size, '\0');
+    }
+
+    if (client_load_config.window_size != TFTP_WINDOWSIZE_DEFAULT)
+    {
+        length += sprintf(fields + length, "%s%c%u%c", TFTP_WINDOWSIZE_STRING, '\0', client_load_config.window_size, '\0');
+    }
+
+    packet->opcode = htons(TFTP_RRQ);
+    return 0 <= impair_sendto(session->socket, packet, sizeof(packet->opcode) + length, 0,
+            (struct sockaddr *)&client_load.requests_address, sizeof(client_load.requests_address));
+}
+
+static bool client_load_send_ack(ClientLoadSession_t *session, uint16_t block_number)
+{
+    Packet_t packet = { .ack = { .opcode = htons(TFTP_ACK), .block_number = htons(block_number) } };
+
+    return 0 <= impair_sendto(session->socket, &packet, sizeof(packet.ack), 0,
+            (struct sockaddr *)&session->server_address, sizeof(session->server_address));
+}
+
+static void client_load_start(ClientLoadSession_t *session, uint64_t now_us);
+
+/**
+ * Has a client that is done with a request think for the given time before its next one (closed loop),
+ * issuing it right away if that is 0, or makes it idle.
+ */
+static void client_load_rest(ClientLoadSession_t *session, uint64_t think_us, uint64_t now_us)
+{
+    uint32_t index = session - client_load.sessions;
+
+    if (client_load_config.rate == 0 && client_load_issuing(now_us))
+    {
+        if (think_us == 0)
+        {
+            client_load_start(session, now_us);
+            return;
+        }
+
+        session->phase = CLIENT_LOAD_THINKING;
+        session->deadline_us = now_us + think_us;
+        return;
+    }
+
+    session->phase = CLIENT_LOAD_IDLE;
+    client_load.idle_stack[client_load.idle_count++] = index;
+    client_load.busy_count--;
+}
+
+/**
+ * Ends the current request of a client, recording its latency if it succeeded,
+ * and either has it think about its next request (closed loop) or makes it idle.
+ */
+static void client_load_finish(ClientLoadSession_t *session, bool success, uint64_t now_us)
+{
+    ClientLoadResults_t *results = &client_load.results;
+
+    if (session->socket >= 0)
+    {
+        close(session->socket);
+        session->socket = -1;
+    }
+
+    if (success)
+    {
+        uint64_t latency_us = now_us - session->started_us;
+
+        if (results->completed == results->latencies_capacity)
+        {
+            size_t capacity = results->latencies_capacity ? results->latencies_capacity * 2 : 4096;
+            uint64_t *latencies = realloc(results->latencies_us, capacity * sizeof(uint64_t));
+
+            if (latencies != NULL)
+            {
+                results->latencies_us = latencies;
+                results->latencies_capacity = capacity;
+            }
+        }
+
+        if (results->completed < results->latencies_capacity)
+        {
+            results->latencies_us[results->completed] = latency_us;
+        }
+
+        results->completed++;
+        results->bytes_received += session->bytes_received;
+        log2_histogram_add(&results->latency_histogram_us, latency_us);
+    }
+
+    client_load_rest(session, (uint64_t)client_load_config.think_ms * 1000, now_us);
+}
+
+/**
+ * Issues a new request from a client, on a fresh socket so that no packet of an earlier transfer can interfere.
+ */
+static void client_load_start(ClientLoadSession_t *session, uint64_t now_us)
+{
+    uint32_t index = session - client_load.sessions;
+
+    if (session->phase == CLIENT_LOAD_IDLE)
+    {
+        client_load.busy_count++;
+    }
+
+    client_load.results.started++;
+    session->phase = CLIENT_LOAD_REQUESTING;
+    session->file_index = client_load_pick_file();
+    session->retries = 0;
+    session->block_size = TFTP_BLKSIZE_DEFAULT;
+    session->window_size = TFTP_WINDOWSIZE_DEFAULT;
+    session->expected_block = 1;
+    session->window_blocks = 0;
+    session->gap_acknowledged = false;
+    session->bytes_received = 0;
+    session->started_us = now_us;
+    session->deadline_us = now_us + (uint64_t)client_load_config.timeout_ms * 1000;
+    session->socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    struct epoll_event event = { .events = EPOLLIN, .data.u32 = index };
+
+    if (session->socket < 0
+            || 0 > epoll_ctl(client_load.epoll_fd, EPOLL_CTL_ADD, session->socket, &event)
+            || !client_load_send_request(session))
+    {
+        client_load.results.socket_failures++;
+
+        if (session->socket >= 0)
+        {
+            close(session->socket);
+            session->socket = -1;
+        }
+
+        // retried from the main loop after a moment, since restarting right away would recurse for as long as
+        // the failure lasts (e.g. out of file descriptors) with no think time
+        uint64_t think_us = (uint64_t)client_load_config.think_ms * 1000;
+        client_load_rest(session, think_us > CLIENT_LOAD_RETRY_DELAY_MS * 1000 ? think_us : CLIENT_LOAD_RETRY_DELAY_MS * 1000, now_us);
+    }
+}
+
+/**
+ * Takes the block and window sizes the server acknowledged, which may be lower than the requested ones.
+ */
+static void client_load_apply_oack(ClientLoadSession_t *session, const Packet_t *packet, ssize_t length)
+{
+    TFTPOptionList_t options;
+
+    if (!tftp_parse_options(packet->oack.options, length - sizeof(packet->opcode), &options))
+    {
+        return;
+    }
+
+    for (uint8_t i = 0; i < options.count; i++)
+    {
+        long value = atol(options.options[i].value);
+
+        if (0 == strcasecmp(options.options[i].name, TFTP_BLKSIZE_STRING) && value >= TFTP_BLKSIZE_MIN && value <= TFTP_BLKSIZE_MAX)
+        {
+            session->block_size = value;
+        }
+        else if (0 == strcasecmp(options.options[i].name, TFTP_WINDOWSIZE_STRING) && value >= TFTP_WINDOWSIZE_MIN && value <= TFTP_WINDOWSIZE_MAX)
+        {
+            session->window_size = value;
+        }
+    }
+}
+
+/**
+ * Handles a single packet from the server. Returns false once the request ended, either way.
+ * DATA blocks are acknowledged at the end of each window and on the last block;
+ * a block out of sequence has the last one in sequence acknowledged again, once, for the server to resend from there.
+ */
+static bool client_load_handle_packet(ClientLoadSession_t *session, const Packet_t *packet, ssize_t length, uint64_t now_us)
+{
+    switch (ntohs(packet->opcode))
+    {
+        case TFTP_OACK:
+            if (session->expected_block == 1 && session->bytes_received == 0)
+            {
+                client_load_apply_oack(session, packet, length);
+                client_load_send_ack(session, 0);
+            }
+
+            break;
+
+        case TFTP_DATA:
+        {
+            uint16_t block_number = ntohs(packet->data.block_number);
+
+            if (block_number != session->expected_block)
+            {
+                // a gap is acknowledged once, blocks received already until any of the next window comes in
+                bool stale = (uint16_t)(session->expected_block - 1 - block_number) < 0x8000;
+
+                if (stale ? session->window_blocks == 0 : !session->gap_acknowledged)
+                {
+                    client_load_send_ack(session, session->expected_block - 1);
+                    session->gap_acknowledged = true;
+                    session->window_blocks = 0;
+                }
+
+                return true;
+            }
+
+            size_t data_length = length - offsetof(Packet_t, data.data);
+            session->bytes_received += data_length;
+            session->expected_block++;
+            session->window_blocks++;
+            session->gap_acknowledged = false;
+
+            if (data_length < session->block_size)
+            {
+                client_load_send_ack(session, block_number);
+                client_load_finish(session, true, now_us);
+                return false;
+            }
+
+            if (session->window_blocks >= session->window_size)
+            {
+                client_load_send_ack(session, block_number);
+                session->window_blocks = 0;
+            }
+
+            break;
+        }
+
+        case TFTP_ERROR:
+        {
+            uint16_t error_code = ntohs(packet->error.error_code);
+            uint16_t last_code = (sizeof(client_load.results.errors) / sizeof(uint64_t)) - 1;
+            client_load.results.errors[error_code < last_code ? error_code : last_code]++;
+            client_load_finish(session, false, now_us);
+            return false;
+        }
+
+        default:
+            return true;
+    }
+
+    session->retries = 0;
+    session->deadline_us = now_us + (uint64_t)client_load_config.timeout_ms * 1000;
+    return true;
+}
+
+/**
+ * Reads every packet pending on a client's socket.
+ * The first reply tells the server's transfer port, and packets from any other one are ignored.
+ */
+static void client_load_receive(ClientLoadSession_t *session, uint64_t now_us)
+{
+    Packet_t *packet = (Packet_t *)client_load.packet_buffer;
+
+    while (session->phase == CLIENT_LOAD_REQUESTING || session->phase == CLIENT_LOAD_RECEIVING)
+    {
+        struct sockaddr_in from;
+        socklen_t from_length = sizeof(from);
+        ssize_t length = recvfrom(session->socket, packet, TFTP_BLKSIZE_MAX + offsetof(Packet_t, data.data), 0,
+                (struct sockaddr *)&from, &from_length);
+
+        if (length < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                // e.g. ECONNREFUSED, as reported by ICMP for a server that is not running
+                client_load.results.socket_failures++;
+                client_load_finish(session, false, now_us);
+            }
+
+            return;
+        }
+
+        if (length < (ssize_t)offsetof(Packet_t, data.data) || from.sin_addr.s_addr != client_load.requests_address.sin_addr.s_addr)
+        {
+            continue;
+        }
+
+        if (session->phase == CLIENT_LOAD_REQUESTING)
+        {
+            session->server_address = from;
+            session->phase = CLIENT_LOAD_RECEIVING;
+        }
+        else if (from.sin_port != session->server_address.sin_port)
+        {
+            continue;
+        }
+
+        if (!client_load_handle_packet(session, packet, length, now_us))
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * Checks every client's deadline: thinking clients issue their next request,
+ * and waiting ones send their request or last ACK again, or give up after too many retries.
+ */
+static void client_load_check_deadlines(uint64_t now_us)
+{
+    for (uint32_t i = 0; i < client_load_config.clients; i++)
+    {
+        ClientLoadSession_t *session = &client_load.sessions[i];
+
+        if (session->phase == CLIENT_LOAD_IDLE || session->deadline_us > now_us)
+        {
+            continue;
+        }
+
+        if (session->phase == CLIENT_LOAD_THINKING)
+        {
+            if (client_load_issuing(now_us))
+            {
+                client_load_start(session, now_us);
+            }
+            else
+            {
+                session->phase = CLIENT_LOAD_IDLE;
+                client_load.idle_stack[client_load.idle_count++] = i;
+                client_load.busy_count--;
+            }
+
+            continue;
+        }
+
+        if (++session->retries > client_load_config.retries)
+        {
+            client_load.results.timed_out++;
+            client_load_finish(session, false, now_us);
+            continue;
+        }
+
+        client_load.results.retransmissions++;
+        session->window_blocks = 0;
+        session->deadline_us = now_us + (uint64_t)client_load_config.timeout_ms * 1000;
+
+        if (session->phase == CLIENT_LOAD_REQUESTING)
+        {
+            client_load_send_request(session);
+        }
+        else
+        {
+            client_load_send_ack(session, session->expected_block - 1);
+        }
+    }
+}
+
+static int client_load_compare_latencies(const void *a, const void *b)
+{
+    uint64_t first = *(const uint64_t *)a;
+    uint64_t second = *(const uint64_t *)b;
+    return (first > second) - (first < second);
+}
+
+/**
+ * Returns the nearest-rank percentile of the sorted latencies, in milliseconds.
+ */
+static double client_load_percentile_ms(const uint64_t *sorted, size_t count, double fraction)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    size_t rank = (size_t)(count * fraction + 0.999999);
+    return sorted[(rank > 0 ? rank : 1) - 1] / 1000.0;
+}
+
+static void client_load_print_results(float seconds)
+{
+    ClientLoadResults_t *results = &client_load.results;
+    uint64_t errors = 0;
+    uint64_t aborted = 0;
+    size_t latencies_count = results->completed < results->latencies_capacity ? results->completed : results->latencies_capacity;
+
+    for (size_t i = 0; i < sizeof(results->errors) / sizeof(uint64_t); i++)
+    {
+        errors += results->errors[i];
+    }
+
+    uint64_t failed = results->timed_out + results->socket_failures + errors;
+
+    if (results->started > results->completed + failed)
+    {
+        aborted = results->started - results->completed - failed;
+    }
+
+    printf("Load run ended after %.2fs.\n", seconds);
+    printf(" Requests: %lu started, %lu completed (%.2f%%), %lu failed, %lu aborted.\n",
+            results->started, results->completed, results->started ? results->completed * 100.0 / results->started : 0.0,
+            failed, aborted);
+    printf("   timed out: %lu, socket errors: %lu, ERROR packets: %lu\n", results->timed_out, results->socket_failures, errors);
+
+    for (size_t i = 0; i < sizeof(results->errors) / sizeof(uint64_t); i++)
+    {
+        if (results->errors[i] > 0)
+        {
+            printf("     code %zu%s: %lu\n", i, i == (sizeof(results->errors) / sizeof(uint64_t)) - 1 ? " or above" : "", results->errors[i]);
+        }
+    }
+
+    if (client_load_config.rate > 0)
+    {
+        printf("   arrivals skipped with all %u clients busy: %lu\n", client_load_config.clients, results->arrivals_skipped);
+    }
+
+    printf(" Requests and ACKs sent again after a timeout: %lu\n", results->retransmissions);
+    printf(" Throughput: %.1f requests/s, %.2f MB/s\n",
+            seconds > 0 ? results->completed / seconds : 0.0, seconds > 0 ? results->bytes_received / 1e6 / seconds : 0.0);
+
+    qsort(results->latencies_us, latencies_count, sizeof(uint64_t), client_load_compare_latencies);
+    printf(" Latency of completed requests: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n",
+            client_load_percentile_ms(results->latencies_us, latencies_count, 0.5),
+            client_load_percentile_ms(results->latencies_us, latencies_count, 0.9),
+            client_load_percentile_ms(results->latencies_us, latencies_count, 0.99),
+            client_load_percentile_ms(results->latencies_us, latencies_count, 0.999),
+            client_load_percentile_ms(results->latencies_us, latencies_count, 1.0));
+    log2_histogram_print(&results->latency_histogram_us, "Request latency", "us");
+}
+
+static bool client_load_init(struct in_addr server_address_bin)
+{
+    uint32_t clients = client_load_config.clients;
+
+    // every client holds a socket open, on top of the usual few descriptors
+    raise_open_file_limit((uint64_t)clients + 64);
+
+    client_load.requests_address = init_peer_socket_address(server_address_bin, htons(tftp_common.requests_port));
+    client_load.sessions = calloc(clients, sizeof(ClientLoadSession_t));
+    client_load.idle_stack = calloc(clients, sizeof(uint32_t));
+    client_load.packet_buffer = malloc(TFTP_BLKSIZE_MAX + offsetof(Packet_t, data.data));
+    client_load.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (client_load.sessions == NULL || client_load.idle_stack == NULL || client_load.packet_buffer == NULL || client_load.epoll_fd < 0)
+    {
+        perror("Failed to initialize load generator");
+        return false;
+    }
+
+    // popped from the top, so that the first clients are the ones reused
+    for (uint32_t i = 0; i < clients; i++)
+    {
+        client_load.sessions[i].socket = -1;
+        client_load.idle_stack[i] = clients - 1 - i;
+    }
+
+    client_load.idle_count = clients;
+    return true;
+}
+
+static void client_load_deinit(void)
+{
+    for (uint32_t i = 0; client_load.sessions != NULL && i < client_load_config.clients; i++)
+    {
+        if (client_load.sessions[i].socket >= 0)
+        {
+            close(client_load.sessions[i].socket);
+        }
+    }
+
+    if (client_load.epoll_fd >= 0)
+    {
+        close(client_load.epoll_fd);
+    }
+
+    free(client_load.sessions);
+    free(client_load.idle_stack);
+    free(client_load.packet_buffer);
+    free(client_load.results.latencies_us);
+}
+
+/**
+ * Runs the load until its duration or request count is reached (or the process is interrupted),
+ * then waits for requests in flight to end, and reports. Returns whether every request completed.
+ */
+bool client_load_run(struct in_addr server_address_bin, int argc, char *argv[])
+{
+    if (!client_load_parse_config(argc, argv))
+    {
+        client_load_print_config_usage();
+        return false;
+    }
+
+    if (!client_load_init(server_address_bin))
+    {
+        client_load_deinit();
+        return false;
+    }
+
+    printf("Driving %u clients over %u files in a %s loop", client_load_config.clients, client_load_config.files_count,
+            client_load_config.rate > 0 ? "open" : "closed");
+
+    if (client_load_config.duration_s > 0)
+    {
+        printf(", for %us", client_load_config.duration_s);
+    }
+
+    if (client_load_config.requests > 0)
+    {
+        printf(", up to %lu requests", client_load_config.requests);
+    }
+
+    printf(".\n");
+
+    struct timespec start_clock;
+    clock_gettime(CLOCK_MONOTONIC, &start_clock);
+    uint64_t now_us = monotonic_microseconds();
+    uint64_t next_arrival_us = now_us;
+    uint64_t next_check_us = now_us;
+    client_load.end_us = now_us + (uint64_t)client_load_config.duration_s * 1000000;
+
+    // a closed loop starts every client at once, as in a boot storm
+    while (client_load_config.rate == 0 && client_load.idle_count > 0 && client_load_issuing(now_us))
+    {
+        client_load_start(&client_load.sessions[client_load.idle_stack[--client_load.idle_count]], now_us);
+    }
+
+    while (!should_terminate && (client_load.busy_count > 0 || client_load_issuing(now_us)))
+    {
+        int wait_ms = CLIENT_LOAD_TICK_MS;
+
+        if (client_load_config.rate > 0)
+        {
+            for (; next_arrival_us <= now_us && client_load_issuing(now_us); next_arrival_us += client_load_interarrival_us())
+            {
+                if (client_load.idle_count == 0)
+                {
+                    client_load.results.arrivals_skipped++;
+                    continue;
+                }
+
+                client_load_start(&client_load.sessions[client_load.idle_stack[--client_load.idle_count]], now_us);
+            }
+
+            if (next_arrival_us - now_us < (uint64_t)wait_ms * 1000)
+            {
+                wait_ms = (next_arrival_us - now_us + 999) / 1000;
+            }
+        }
+
+        // scanning thousands of clients on every packet would cost more than the packets themselves
+        if (now_us >= next_check_us)
+        {
+            client_load_check_deadlines(now_us);
+            next_check_us = now_us + 1000;
+        }
+
+        struct epoll_event events[CLIENT_LOAD_EPOLL_EVENTS];
+        int events_count = epoll_wait(client_load.epoll_fd, events, CLIENT_LOAD_EPOLL_EVENTS, wait_ms);
+        now_us = monotonic_microseconds();
+
+        for (int i = 0; i < events_count; i++)
+        {
+            client_load_receive(&client_load.sessions[events[i].data.u32], now_us);
+        }
+    }
+
+    client_load_print_results(seconds_since_clock(start_clock));
+
+    ClientLoadResults_t *results = &client_load.results;
+    bool success = results->started > 0 && results->completed == results->started;
+    client_load_deinit();
+    return success;
+}
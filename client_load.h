@@ -0,0 +1,98 @@
+/**
+ * The Client-Load header declares the load generator: a single process driving many concurrent virtual clients
+ * against a server, each reading files over a non-blocking socket of its own, all multiplexed by one epoll loop.
+ * Requests arrive either as an open loop, at a given average rate (Poisson arrivals, whether or not the server keeps up),
+ * or as a closed loop, in which every client issues its next request a think time after its previous one ended.
+ * Files are picked from a weighted mix. The report lists success rates, failures by cause and the latency distribution.
+ */
+
+#ifndef CLIENT_LOAD_H
+#define CLIENT_LOAD_H
+
+#include "common.h"
+#include "networking_common.h"
+#include "tftp_common.h"
+#include "impair.h"
+
+#define CLIENT_LOAD_FILES_MAX 64
+#define CLIENT_LOAD_CLIENTS_DEFAULT 100
+#define CLIENT_LOAD_CLIENTS_MAX 60000
+#define CLIENT_LOAD_DURATION_S_DEFAULT 10
+#define CLIENT_LOAD_TIMEOUT_MS_DEFAULT 1000
+#define CLIENT_LOAD_TICK_MS 10
+#define CLIENT_LOAD_RETRY_DELAY_MS 10 // before a client whose request could not be sent tries again
+#define CLIENT_LOAD_EPOLL_EVENTS 256
+
+typedef enum ClientLoadPhase
+{
+    CLIENT_LOAD_IDLE = 0, // free for the next arrival
+    CLIENT_LOAD_THINKING = 1, // closed loop only: waiting out the think time before the next request
+    CLIENT_LOAD_REQUESTING = 2, // request sent, nothing heard back yet
+    CLIENT_LOAD_RECEIVING = 3, // OACK or DATA received from the server's transfer port
+} ClientLoadPhase_t;
+
+/**
+ * A virtual client, reading one file at a time.
+ * Block numbers are the 16 bit ones on the wire, since only the next expected block is ever of interest.
+ */
+typedef struct ClientLoadSession
+{
+    ClientLoadPhase_t phase;
+    int socket;
+    uint8_t file_index;
+    uint8_t retries;
+    uint16_t block_size;
+    uint16_t window_size;
+    uint16_t expected_block;
+    uint16_t window_blocks; // in-sequence blocks received since the last ACK
+    bool gap_acknowledged; // the last in-sequence block was acknowledged again, for the out-of-sequence one that followed
+    struct sockaddr_in server_address; // the server's transfer port, once known
+    uint64_t bytes_received;
+    uint64_t started_us;
+    uint64_t deadline_us; // of the current timeout, or think time
+} ClientLoadSession_t;
+
+/**
+ * Settings, parsed from the "load" operation mode arguments by client_load_parse_config().
+ */
+typedef struct ClientLoadConfig
+{
+    uint32_t clients; // concurrent virtual clients
+    double rate; // average request arrivals per second, or 0 for a closed loop
+    uint32_t think_ms;
+    uint32_t duration_s;
+    uint64_t requests; // stop after issuing this many requests, if not 0
+    uint16_t block_size;
+    uint16_t window_size;
+    uint32_t timeout_ms;
+    uint8_t retries;
+    uint8_t files_count;
+    char *files[CLIENT_LOAD_FILES_MAX];
+    uint32_t file_weights[CLIENT_LOAD_FILES_MAX];
+    uint64_t total_weight;
+} ClientLoadConfig_t;
+
+/**
+ * Outcome counts of a run, and the latency of every successful request.
+ */
+typedef struct ClientLoadResults
+{
+    uint64_t started;
+    uint64_t completed;
+    uint64_t timed_out;
+    uint64_t socket_failures;
+    uint64_t errors[TFTP_ERROR_OPTION_NEGOTIATION + 2]; // ERROR packets by code, unknown codes counted last
+    uint64_t arrivals_skipped; // open loop arrivals that found every client busy
+    uint64_t retransmissions;
+    uint64_t bytes_received;
+    uint64_t *latencies_us;
+    size_t latencies_capacity;
+    Log2Histogram_t latency_histogram_us;
+} ClientLoadResults_t;
+
+/**
+ * Entry point for the load generator. Arguments are the file mix (name[:weight],...) followed by option=value pairs.
+ */
+bool client_load_run(struct in_addr server_address_bin, int argc, char *argv[]);
+
+#endif
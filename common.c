@@ -1,4 +1,7 @@
 #include "common.h"
+#include "log.h"
+
+#include <sys/resource.h>
 
 /**
  * Global flag set by OS termination signals
@@ -6,6 +9,12 @@
  */
 bool should_terminate = false;
 
+/**
+ * Global flag set by the SIGUSR1 signal
+ * and polled (and cleared) by whoever has statistics to report.
+ */
+bool should_report_statistics = false;
+
 /**
  * The random_range() function uses this to determine
  * whether rand() was already seeded or not.
@@ -25,6 +34,7 @@ void initialize_signal_handler(void)
     sigaction(SIGINT, &action, NULL);
     sigaction(SIGTERM, &action, NULL);
     sigaction(SIGHUP, &action, NULL);
+    sigaction(SIGUSR1, &action, NULL);
 }
 
 // calling random_range once to ensure that random is seeded
@@ -37,6 +47,7 @@ void initialize_random_seed(void)
  * Handles selected OS signals.
  * Termination signals are caught to set the should_terminate flag
  * which signals running functions that they should attempt graceful termination.
+ * SIGUSR1 is caught to set the should_report_statistics flag.
  */
 void signal_handler(int signum)
 {
@@ -47,6 +58,9 @@ void signal_handler(int signum)
         case SIGHUP:
             should_terminate = true;
             break;
+        case SIGUSR1:
+            should_report_statistics = true;
+            break;
     }
 }
 
@@ -80,3 +94,141 @@ float seconds_since_clock(struct timespec start_clock)
     elapsed_float += (now_clock.tv_sec - start_clock.tv_sec);
     return elapsed_float;
 }
+
+/**
+ * Returns the current monotonic clock value in milliseconds.
+ * Used for scheduling timeouts!
+ */
+uint64_t monotonic_milliseconds(void)
+{
+    struct timespec now_clock;
+    clock_gettime(CLOCK_MONOTONIC, &now_clock);
+    return ((uint64_t)now_clock.tv_sec * 1000) + (now_clock.tv_nsec / 1000000);
+}
+
+/**
+ * Returns the current monotonic clock value in microseconds.
+ * Used for measuring round-trip times, which may be well under a millisecond.
+ */
+uint64_t monotonic_microseconds(void)
+{
+    struct timespec now_clock;
+    clock_gettime(CLOCK_MONOTONIC, &now_clock);
+    return ((uint64_t)now_clock.tv_sec * 1000000) + (now_clock.tv_nsec / 1000);
+}
+
+/**
+ * Returns the CPU time consumed by the calling thread so far, in nanoseconds.
+ */
+uint64_t thread_cpu_nanoseconds(void)
+{
+    struct timespec clock;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &clock);
+    return (uint64_t)clock.tv_sec * 1000000000 + clock.tv_nsec;
+}
+
+/**
+ * Returns the clock value a given number of milliseconds after the given one.
+ * Used for absolute timed waits!
+ */
+struct timespec clock_after_milliseconds(struct timespec clock, uint64_t milliseconds)
+{
+    clock.tv_sec += milliseconds / 1000;
+    clock.tv_nsec += (milliseconds % 1000) * 1000000;
+
+    if (clock.tv_nsec >= 1000000000)
+    {
+        clock.tv_sec++;
+        clock.tv_nsec -= 1000000000;
+    }
+
+    return clock;
+}
+
+/**
+ * Raises the soft limit on open files to the given number of descriptors,
+ * or as far as the hard limit allows. Never lowers it.
+ */
+void raise_open_file_limit(uint64_t descriptors_count)
+{
+    struct rlimit limit;
+    rlim_t required = descriptors_count;
+
+    if (0 > getrlimit(RLIMIT_NOFILE, &limit) || limit.rlim_cur >= required)
+    {
+        return;
+    }
+
+    limit.rlim_cur = (limit.rlim_max == RLIM_INFINITY || required < limit.rlim_max) ? required : limit.rlim_max;
+
+    if (0 > setrlimit(RLIMIT_NOFILE, &limit))
+    {
+        LOG_ERRNO("Failed to raise open file limit");
+        return;
+    }
+
+    LOG_DEBUG("Raised open file limit to %lu.\n", (unsigned long)limit.rlim_cur);
+}
+
+/**
+ * Records a single value in a power-of-two bucketed histogram.
+ */
+void log2_histogram_add(Log2Histogram_t *histogram, uint64_t value)
+{
+    uint8_t bucket = 0;
+
+    while (bucket < LOG2_HISTOGRAM_BUCKETS - 1 && (value >> bucket) > 0)
+    {
+        bucket++;
+    }
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum += value;
+
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+/**
+ * Adds all values recorded in a histogram to another, e.g. to total them over all threads.
+ */
+void log2_histogram_merge(Log2Histogram_t *total, const Log2Histogram_t *histogram)
+{
+    for (uint8_t bucket = 0; bucket < LOG2_HISTOGRAM_BUCKETS; bucket++)
+    {
+        total->buckets[bucket] += histogram->buckets[bucket];
+    }
+
+    total->count += histogram->count;
+    total->sum += histogram->sum;
+
+    if (histogram->max > total->max)
+    {
+        total->max = histogram->max;
+    }
+}
+
+/**
+ * Prints the non-empty buckets of a power-of-two bucketed histogram, along with its average and maximum.
+ */
+void log2_histogram_print(const Log2Histogram_t *histogram, const char *title, const char *unit)
+{
+    LOG_INFO(" %s: %lu samples, average %.1f %s, max %lu %s\n", title, histogram->count,
+            histogram->count == 0 ? 0.0 : (double)histogram->sum / histogram->count, unit, histogram->max, unit);
+
+    for (uint8_t bucket = 0; bucket < LOG2_HISTOGRAM_BUCKETS; bucket++)
+    {
+        if (histogram->buckets[bucket] == 0)
+        {
+            continue;
+        }
+
+        uint64_t bucket_min = bucket == 0 ? 0 : (1UL << (bucket - 1));
+        uint64_t bucket_max = bucket == 0 ? 0 : (1UL << bucket) - 1;
+
+        LOG_INFO("   %8lu - %-8lu %s: %lu\n", bucket_min, bucket_max, unit, histogram->buckets[bucket]);
+    }
+}
@@ -18,16 +18,45 @@
 #include <signal.h>
 #include <pthread.h>
 
+#define LOG2_HISTOGRAM_BUCKETS 32
+
 /**
  * Global flag set by OS termination signals
  * and polled by functions to allow graceful termination.
  */
 extern bool should_terminate;
 
+/**
+ * Global flag set by the SIGUSR1 signal
+ * and polled (and cleared) by whoever has statistics to report.
+ */
+extern bool should_report_statistics;
+
+/**
+ * A histogram with power-of-two sized buckets, for cheaply recording distributions
+ * of values that span several orders of magnitude (latencies, queue depths).
+ * Bucket 0 counts zeroes, and bucket N counts values from 2^(N-1) to 2^N - 1.
+ */
+typedef struct Log2Histogram
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[LOG2_HISTOGRAM_BUCKETS];
+} Log2Histogram_t;
+
 void initialize_signal_handler(void);
 void initialize_random_seed(void);
 void signal_handler(int signum);
 int random_range(int min, int max);
 float seconds_since_clock(struct timespec start_clock);
+uint64_t monotonic_milliseconds(void);
+uint64_t monotonic_microseconds(void);
+uint64_t thread_cpu_nanoseconds(void);
+struct timespec clock_after_milliseconds(struct timespec clock, uint64_t milliseconds);
+void raise_open_file_limit(uint64_t descriptors_count);
+void log2_histogram_add(Log2Histogram_t *histogram, uint64_t value);
+void log2_histogram_merge(Log2Histogram_t *total, const Log2Histogram_t *histogram);
+void log2_histogram_print(const Log2Histogram_t *histogram, const char *title, const char *unit);
 
 #endif
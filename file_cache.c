@@ -0,0 +1,356 @@
+#include "file_cache.h"
+#include "log.h"
+
+#include <sys/mman.h>
+
+/**
+ * The cache itself: entries in a list ordered from the most to the least recently used, guarded by a single mutex.
+ * Lookups walk the list, which is fine for the handful of hot files a sensible budget holds.
+ */
+static struct
+{
+    pthread_mutex_t mutex;
+    uint64_t budget_bytes;
+    uint64_t used_bytes;
+    uint32_t entries_count;
+    FileCacheEntry_t *most_recent;
+    FileCacheEntry_t *least_recent;
+    FileCacheCounters_t counters;
+} file_cache =
+{
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * Sets the memory budget of the cache, in bytes of file contents. Call before any transfer starts.
+ */
+void file_cache_init(uint64_t budget_bytes)
+{
+    file_cache.budget_bytes = budget_bytes;
+}
+
+bool file_cache_enabled(void)
+{
+    return file_cache.budget_bytes > 0;
+}
+
+static void file_cache_free_entry(FileCacheEntry_t *entry)
+{
+    munmap(entry->contents, entry->size);
+    free(entry);
+}
+
+/**
+ * Takes an entry out of the LRU list, and out of the budget. The caller holds the mutex.
+ */
+static void file_cache_unlink(FileCacheEntry_t *entry)
+{
+    if (entry->prev != NULL)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        file_cache.most_recent = entry->next;
+    }
+
+    if (entry->next != NULL)
+    {
+        entry->next->prev = entry->prev;
+    }
+    else
+    {
+        file_cache.least_recent = entry->prev;
+    }
+
+    entry->prev = NULL;
+    entry->next = NULL;
+    file_cache.used_bytes -= entry->size;
+    file_cache.entries_count--;
+}
+
+/**
+ * Puts an entry at the most recently used end of the LRU list. The caller holds the mutex.
+ */
+static void file_cache_link_front(FileCacheEntry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = file_cache.most_recent;
+
+    if (file_cache.most_recent != NULL)
+    {
+        file_cache.most_recent->prev = entry;
+    }
+    else
+    {
+        file_cache.least_recent = entry;
+    }
+
+    file_cache.most_recent = entry;
+    file_cache.used_bytes += entry->size;
+    file_cache.entries_count++;
+}
+
+/**
+ * Drops an entry whose file changed since it was cached. Transfers still sending it keep it until they release it.
+ * The caller holds the mutex.
+ */
+static void file_cache_invalidate(FileCacheEntry_t *entry)
+{
+    file_cache_unlink(entry);
+    entry->stale = true;
+    file_cache.counters.invalidations++;
+
+    if (entry->references == 0)
+    {
+        file_cache_free_entry(entry);
+    }
+}
+
+static FileCacheEntry_t *file_cache_find(const char *path)
+{
+    for (FileCacheEntry_t *entry = file_cache.most_recent; entry != NULL; entry = entry->next)
+    {
+        if (0 == strcmp(entry->path, path))
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static bool file_cache_entry_matches(const FileCacheEntry_t *entry, const struct stat *file_attr)
+{
+    return entry->device == file_attr->st_dev && entry->inode == file_attr->st_ino && entry->size == (uint64_t)file_attr->st_size
+        && entry->modification_time.tv_sec == file_attr->st_mtim.tv_sec && entry->modification_time.tv_nsec == file_attr->st_mtim.tv_nsec;
+}
+
+/**
+ * Evicts the least recently used entries no transfer refers to, until the given number of bytes fits the budget.
+ * Returns false if they do not fit even so. The caller holds the mutex.
+ */
+static bool file_cache_make_room(uint64_t bytes)
+{
+    FileCacheEntry_t *entry = file_cache.least_recent;
+
+    while (file_cache.used_bytes + bytes > file_cache.budget_bytes && entry != NULL)
+    {
+        FileCacheEntry_t *more_recent = entry->prev;
+
+        if (entry->references == 0)
+        {
+            file_cache_unlink(entry);
+            file_cache_free_entry(entry);
+            file_cache.counters.evictions++;
+        }
+
+        entry = more_recent;
+    }
+
+    return file_cache.used_bytes + bytes <= file_cache.budget_bytes;
+}
+
+/**
+ * Reads the whole of an open file into a new, read-only entry, outside of the mutex.
+ * Returns NULL if reading fails, or if the file changed while being read.
+ */
+static FileCacheEntry_t *file_cache_load(const char *path, int fd, const struct stat *file_attr)
+{
+    size_t path_length = strlen(path);
+    FileCacheEntry_t *entry = malloc(sizeof(FileCacheEntry_t) + path_length + 1);
+
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    explicit_bzero(entry, sizeof(FileCacheEntry_t));
+    memcpy(entry->path, path, path_length + 1);
+    entry->device = file_attr->st_dev;
+    entry->inode = file_attr->st_ino;
+    entry->modification_time = file_attr->st_mtim;
+    entry->size = file_attr->st_size;
+    entry->contents = mmap(NULL, entry->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (entry->contents == MAP_FAILED)
+    {
+        LOG_ERRNO("Failed to allocate file cache entry");
+        free(entry);
+        return NULL;
+    }
+
+    uint64_t offset = 0;
+
+    while (offset < entry->size)
+    {
+        ssize_t bytes_read = pread(fd, entry->contents + offset, entry->size - offset, offset);
+
+        if (bytes_read <= 0)
+        {
+            if (bytes_read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        offset += bytes_read;
+    }
+
+    struct stat file_attr_after;
+
+    if (offset != entry->size || 0 > fstat(fd, &file_attr_after) || !file_cache_entry_matches(entry, &file_attr_after))
+    {
+        LOG_INFO("File '%s' could not be read whole into the cache, or changed meanwhile.\n", path);
+        file_cache_free_entry(entry);
+        return NULL;
+    }
+
+    mprotect(entry->contents, entry->size, PROT_READ);
+    return entry;
+}
+
+/**
+ * Looks up the contents of an open file to be transmitted, loading them into the cache on a miss if they fit the budget.
+ * Returns an entry referenced by the caller, to be released with file_cache_release() once it is done sending it,
+ * or NULL if the file is to be read from disk instead (including whenever the cache is disabled).
+ */
+FileCacheEntry_t *file_cache_acquire(const char *path, int fd)
+{
+    struct stat file_attr;
+
+    if (!file_cache_enabled() || 0 > fstat(fd, &file_attr) || !S_ISREG(file_attr.st_mode))
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&file_cache.mutex);
+    FileCacheEntry_t *entry = file_cache_find(path);
+
+    if (entry != NULL && file_cache_entry_matches(entry, &file_attr))
+    {
+        file_cache_unlink(entry);
+        file_cache_link_front(entry);
+        entry->references++;
+        file_cache.counters.hits++;
+        pthread_mutex_unlock(&file_cache.mutex);
+        return entry;
+    }
+
+    if (entry != NULL)
+    {
+        file_cache_invalidate(entry);
+    }
+
+    file_cache.counters.misses++;
+
+    if (file_attr.st_size == 0 || (uint64_t)file_attr.st_size > file_cache.budget_bytes)
+    {
+        file_cache.counters.uncacheable++;
+        pthread_mutex_unlock(&file_cache.mutex);
+        return NULL;
+    }
+
+    pthread_mutex_unlock(&file_cache.mutex);
+
+    // the file is read without holding up other transfers, which may well end up loading it concurrently
+    FileCacheEntry_t *loaded_entry = file_cache_load(path, fd, &file_attr);
+
+    if (loaded_entry == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&file_cache.mutex);
+    entry = file_cache_find(path);
+
+    if (entry != NULL && file_cache_entry_matches(entry, &file_attr))
+    {
+        file_cache_unlink(entry);
+        file_cache_link_front(entry);
+        entry->references++;
+        pthread_mutex_unlock(&file_cache.mutex);
+        file_cache_free_entry(loaded_entry);
+        return entry;
+    }
+
+    if (entry != NULL)
+    {
+        file_cache_invalidate(entry);
+    }
+
+    if (!file_cache_make_room(loaded_entry->size))
+    {
+        file_cache.counters.uncacheable++;
+        pthread_mutex_unlock(&file_cache.mutex);
+        file_cache_free_entry(loaded_entry);
+        return NULL;
+    }
+
+    loaded_entry->references = 1;
+    file_cache_link_front(loaded_entry);
+    file_cache.counters.insertions++;
+    pthread_mutex_unlock(&file_cache.mutex);
+
+    LOG_INFO("Cached file '%s' (%lu bytes).\n", path, loaded_entry->size);
+    return loaded_entry;
+}
+
+/**
+ * Drops the caller's reference to an entry, counting the bytes it sent out of it.
+ * The entry stays cached for later transfers, unless its file changed meanwhile.
+ */
+void file_cache_release(FileCacheEntry_t *entry, uint64_t bytes_served)
+{
+    pthread_mutex_lock(&file_cache.mutex);
+    entry->references--;
+    file_cache.counters.bytes_served += bytes_served;
+
+    if (entry->stale && entry->references == 0)
+    {
+        file_cache_free_entry(entry);
+    }
+
+    pthread_mutex_unlock(&file_cache.mutex);
+}
+
+/**
+ * Frees every cached entry. Call once no transfer is running anymore.
+ */
+void file_cache_deinit(void)
+{
+    pthread_mutex_lock(&file_cache.mutex);
+
+    while (file_cache.most_recent != NULL)
+    {
+        FileCacheEntry_t *entry = file_cache.most_recent;
+        file_cache_unlink(entry);
+        file_cache_free_entry(entry);
+    }
+
+    pthread_mutex_unlock(&file_cache.mutex);
+}
+
+/**
+ * Prints the hit and miss counters of the cache and what it holds, unless it is disabled.
+ */
+void file_cache_print_counters(void)
+{
+    if (!file_cache_enabled())
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&file_cache.mutex);
+    FileCacheCounters_t counters = file_cache.counters;
+    uint64_t lookups = counters.hits + counters.misses;
+
+    LOG_INFO(" File cache: %lu hits, %lu misses (%.1f%% hit rate), %lu bytes served from memory.\n",
+            counters.hits, counters.misses, lookups == 0 ? 0.0 : (100.0 * counters.hits) / lookups, counters.bytes_served);
+    LOG_INFO(" File cache: %u entries holding %lu/%lu bytes, %lu inserted, %lu evicted, %lu invalidated, %lu misses not cached.\n",
+            file_cache.entries_count, file_cache.used_bytes, file_cache.budget_bytes,
+            counters.insertions, counters.evictions, counters.invalidations, counters.uncacheable);
+    pthread_mutex_unlock(&file_cache.mutex);
+}
@@ -0,0 +1,52 @@
+/**
+ * The File-Cache header declares a process-wide cache of file contents, shared by all transfers sending the same file.
+ * Entries are keyed by path, and hold a read-only snapshot of the file as of its modification time (and inode and size),
+ * so a file changed on disk is read anew by the next transfer, while those already under way keep their snapshot.
+ * Entries are reference counted, and transfers send blocks straight out of them, just like out of a file mapping.
+ * The cache holds up to a memory budget: the least recently used entries no transfer refers to make room for new ones,
+ * and files that do not fit are simply read from disk as usual. A budget of 0 (the default) disables the cache.
+ */
+
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include "common.h"
+
+/**
+ * A cached file. Its contents never change once loaded; an entry superseded by a newer version of its file
+ * is unlinked from the cache right away, and freed once the last transfer sending it releases it.
+ */
+typedef struct FileCacheEntry
+{
+    struct FileCacheEntry *prev; // towards the most recently used entry
+    struct FileCacheEntry *next; // towards the least recently used entry
+    bool stale;
+    uint32_t references;
+    dev_t device;
+    ino_t inode;
+    struct timespec modification_time;
+    uint64_t size;
+    uint8_t *contents;
+    char path[];
+} FileCacheEntry_t;
+
+typedef struct FileCacheCounters
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+    uint64_t invalidations; // entries superseded by a newer version of their file
+    uint64_t uncacheable; // misses not worth caching or not fitting the budget, served from disk instead
+    uint64_t bytes_served; // file bytes sent out of cached contents, by every transfer sending them
+} FileCacheCounters_t;
+
+void file_cache_init(uint64_t budget_bytes);
+void file_cache_deinit(void);
+bool file_cache_enabled(void);
+
+FileCacheEntry_t *file_cache_acquire(const char *path, int fd);
+void file_cache_release(FileCacheEntry_t *entry, uint64_t bytes_served);
+void file_cache_print_counters(void);
+
+#endif
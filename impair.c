@@ -0,0 +1,523 @@
+#include "impair.h"
+#include "log.h"
+
+/**
+ * The impairment settings and state: the random generator and loss burst state, the delay queue
+ * (a binary min-heap on due time) and the thread sending it. The mutex guards all of them.
+ */
+static struct
+{
+    bool enabled;
+    ImpairConfig_t config;
+    pthread_mutex_t mutex;
+    pthread_cond_t queue_changed;
+    pthread_t thread_handle;
+    bool thread_started;
+    bool stop_requested;
+    uint64_t random_state;
+    bool in_loss_burst;
+    uint64_t sequence;
+    ImpairPacket_t **queue;
+    uint32_t queue_count;
+    uint32_t queue_capacity;
+    ImpairCounters_t counters;
+} impair =
+{
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * Returns a uniformly distributed random number in [0, 1), from a xorshift64* generator,
+ * so that a given seed always makes the same decisions.
+ */
+static double impair_random_fraction(void)
+{
+    impair.random_state ^= impair.random_state >> 12;
+    impair.random_state ^= impair.random_state << 25;
+    impair.random_state ^= impair.random_state >> 27;
+    return ((impair.random_state * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+/**
+ * Parses a share given in percent, e.g. "2.5" for 2.5% of packets.
+ */
+static bool impair_parse_percentage(const char *value, double *share)
+{
+    char *end = NULL;
+    double percentage = strtod(value, &end);
+
+    if (end == value || *end != '\0' || percentage < 0 || percentage > 100)
+    {
+        return false;
+    }
+
+    *share = percentage / 100;
+    return true;
+}
+
+/**
+ * Parses a duration given in (possibly fractional) milliseconds, into microseconds.
+ */
+static bool impair_parse_milliseconds(const char *value, uint64_t *microseconds)
+{
+    char *end = NULL;
+    double milliseconds = strtod(value, &end);
+
+    if (end == value || *end != '\0' || milliseconds < 0)
+    {
+        return false;
+    }
+
+    *microseconds = (uint64_t)(milliseconds * 1000);
+    return true;
+}
+
+/**
+ * Sets the impairments up from a comma separated list of name=value pairs:
+ * loss, duplicate and reorder in percent of packets, burst as the mean loss burst length in packets,
+ * delay and jitter in milliseconds, and the random seed. A NULL or empty list leaves impairment off.
+ * Returns false on any malformed or unknown setting.
+ */
+bool impair_configure(const char *specification)
+{
+    ImpairConfig_t config = { .burst = 1, .seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32) };
+
+    if (specification == NULL || *specification == '\0')
+    {
+        return true;
+    }
+
+    char *list = strdup(specification);
+    char *saveptr = NULL;
+    bool valid = list != NULL;
+
+    for (char *setting = valid ? strtok_r(list, ",", &saveptr) : NULL; valid && setting != NULL; setting = strtok_r(NULL, ",", &saveptr))
+    {
+        char *value = strchr(setting, '=');
+
+        if (value == NULL)
+        {
+            LOG_ERROR("Malformed impairment '%s', expected name=value.\n", setting);
+            valid = false;
+            break;
+        }
+
+        *value++ = '\0';
+
+        if (0 == strcmp(setting, "loss"))
+        {
+            valid = impair_parse_percentage(value, &config.loss);
+        }
+        else if (0 == strcmp(setting, "duplicate"))
+        {
+            valid = impair_parse_percentage(value, &config.duplicate);
+        }
+        else if (0 == strcmp(setting, "reorder"))
+        {
+            valid = impair_parse_percentage(value, &config.reorder);
+        }
+        else if (0 == strcmp(setting, "burst"))
+        {
+            config.burst = atof(value);
+            valid = config.burst >= 1;
+        }
+        else if (0 == strcmp(setting, "delay"))
+        {
+            valid = impair_parse_milliseconds(value, &config.delay_us);
+        }
+        else if (0 == strcmp(setting, "jitter"))
+        {
+            valid = impair_parse_milliseconds(value, &config.jitter_us);
+        }
+        else if (0 == strcmp(setting, "seed"))
+        {
+            config.seed = strtoull(value, NULL, 10);
+        }
+        else
+        {
+            LOG_ERROR("Unknown impairment '%s'.\n", setting);
+            valid = false;
+            break;
+        }
+
+        if (!valid)
+        {
+            LOG_ERROR("Invalid %s impairment '%s'.\n", setting, value);
+        }
+    }
+
+    free(list);
+
+    if (!valid)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&impair.mutex);
+    impair.config = config;
+    // xorshift never leaves a zero state
+    impair.random_state = config.seed != 0 ? config.seed : 1;
+    impair.in_loss_burst = false;
+    impair.enabled = true;
+    pthread_mutex_unlock(&impair.mutex);
+
+    LOG_INFO("Impairing sent packets: %.2f%% loss in bursts of %.1f, %.3f ms delay with %.3f ms jitter, %.2f%% duplicated, %.2f%% reordered (seed %lu).\n",
+            config.loss * 100, config.burst, config.delay_us / 1000.0, config.jitter_us / 1000.0,
+            config.duplicate * 100, config.reorder * 100, config.seed);
+    return true;
+}
+
+bool impair_enabled(void)
+{
+    return impair.enabled;
+}
+
+/**
+ * Decides whether the next packet is lost, with a two-state (Gilbert) model:
+ * packets are lost while in a burst, which is entered and left at rates that make bursts
+ * the configured length on average, and the configured share of all packets lost.
+ */
+static bool impair_lose_packet(void)
+{
+    double loss = impair.config.loss;
+
+    if (loss <= 0)
+    {
+        return false;
+    }
+
+    if (loss >= 1)
+    {
+        return true;
+    }
+
+    double leave_rate = 1 / impair.config.burst;
+    double enter_rate = loss * leave_rate / (1 - loss);
+    double fraction = impair_random_fraction();
+
+    impair.in_loss_burst = impair.in_loss_burst ? (fraction >= leave_rate) : (fraction < enter_rate);
+    return impair.in_loss_burst;
+}
+
+/**
+ * Picks how long the next copy of a packet is held back: the delay, varied by the jitter,
+ * plus the reordering hold for the share of packets picked to be overtaken.
+ */
+static uint64_t impair_packet_delay_us(void)
+{
+    int64_t delay_us = impair.config.delay_us;
+
+    if (impair.config.jitter_us > 0)
+    {
+        delay_us += (int64_t)((impair_random_fraction() * 2 - 1) * impair.config.jitter_us);
+    }
+
+    if (impair.config.reorder > 0 && impair_random_fraction() < impair.config.reorder)
+    {
+        delay_us += IMPAIR_REORDER_HOLD_US;
+        impair.counters.reordered++;
+    }
+
+    return delay_us > 0 ? delay_us : 0;
+}
+
+static bool impair_packet_due_before(const ImpairPacket_t *a, const ImpairPacket_t *b)
+{
+    return a->due_us < b->due_us || (a->due_us == b->due_us && a->sequence < b->sequence);
+}
+
+static ImpairPacket_t *impair_queue_pop(void)
+{
+    ImpairPacket_t *first = impair.queue[0];
+    ImpairPacket_t *last = impair.queue[--impair.queue_count];
+    uint32_t index = 0;
+
+    while (index * 2 + 1 < impair.queue_count)
+    {
+        uint32_t child = index * 2 + 1;
+
+        if (child + 1 < impair.queue_count && impair_packet_due_before(impair.queue[child + 1], impair.queue[child]))
+        {
+            child++;
+        }
+
+        if (!impair_packet_due_before(impair.queue[child], last))
+        {
+            break;
+        }
+
+        impair.queue[index] = impair.queue[child];
+        index = child;
+    }
+
+    if (impair.queue_count > 0)
+    {
+        impair.queue[index] = last;
+    }
+
+    return first;
+}
+
+/**
+ * Sends queued packets as they fall due. A packet whose socket was closed meanwhile is simply lost,
+ * as it would have been on the network; should the descriptor have been reused by then, it goes out from the new socket,
+ * to be ignored by the peer as coming from an unknown transfer ID.
+ */
+static void *impair_thread_start(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&impair.mutex);
+
+    while (!impair.stop_requested)
+    {
+        uint64_t now_us = monotonic_microseconds();
+
+        if (impair.queue_count == 0)
+        {
+            pthread_cond_wait(&impair.queue_changed, &impair.mutex);
+            continue;
+        }
+
+        if (impair.queue[0]->due_us > now_us)
+        {
+            struct timespec deadline = { .tv_sec = impair.queue[0]->due_us / 1000000, .tv_nsec = (impair.queue[0]->due_us % 1000000) * 1000 };
+            pthread_cond_timedwait(&impair.queue_changed, &impair.mutex, &deadline);
+            continue;
+        }
+
+        ImpairPacket_t *packet = impair_queue_pop();
+        pthread_mutex_unlock(&impair.mutex);
+
+        sendto(packet->socket, packet->data, packet->length, MSG_DONTWAIT, (struct sockaddr *)&packet->address, packet->address_length);
+        free(packet);
+
+        pthread_mutex_lock(&impair.mutex);
+    }
+
+    pthread_mutex_unlock(&impair.mutex);
+    return NULL;
+}
+
+/**
+ * Starts the sending thread on the first delayed packet. Called with the mutex held.
+ */
+static bool impair_start_thread(void)
+{
+    pthread_condattr_t condition_attributes;
+    pthread_condattr_init(&condition_attributes);
+    pthread_condattr_setclock(&condition_attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&impair.queue_changed, &condition_attributes);
+    pthread_condattr_destroy(&condition_attributes);
+
+    if (0 != pthread_create(&impair.thread_handle, NULL, impair_thread_start, NULL))
+    {
+        LOG_ERRNO("Failed to start impairment thread");
+        pthread_cond_destroy(&impair.queue_changed);
+        return false;
+    }
+
+    impair.thread_started = true;
+    return true;
+}
+
+/**
+ * Queues a copy of a packet, gathered from its buffers, to be sent after the given delay.
+ * Called with the mutex held. The packet is dropped if the queue is full or cannot grow.
+ */
+static void impair_queue_packet(int socket, const struct iovec *iovecs, size_t iovecs_count, size_t length,
+        const struct sockaddr_in *address, socklen_t address_length, uint64_t delay_us)
+{
+    if ((!impair.thread_started && !impair_start_thread()) || impair.queue_count == IMPAIR_QUEUE_MAX)
+    {
+        impair.counters.queue_overflows++;
+        return;
+    }
+
+    if (impair.queue_count == impair.queue_capacity)
+    {
+        uint32_t capacity = impair.queue_capacity ? impair.queue_capacity * 2 : 256;
+        ImpairPacket_t **queue = realloc(impair.queue, capacity * sizeof(ImpairPacket_t *));
+
+        if (queue == NULL)
+        {
+            impair.counters.queue_overflows++;
+            return;
+        }
+
+        impair.queue = queue;
+        impair.queue_capacity = capacity;
+    }
+
+    ImpairPacket_t *packet = malloc(sizeof(ImpairPacket_t) + length);
+
+    if (packet == NULL)
+    {
+        impair.counters.queue_overflows++;
+        return;
+    }
+
+    packet->due_us = monotonic_microseconds() + delay_us;
+    packet->sequence = impair.sequence++;
+    packet->socket = socket;
+    packet->address = *address;
+    packet->address_length = address_length;
+    packet->length = length;
+
+    for (size_t i = 0, offset = 0; i < iovecs_count; offset += iovecs[i].iov_len, i++)
+    {
+        memcpy(packet->data + offset, iovecs[i].iov_base, iovecs[i].iov_len);
+    }
+
+    // sifting the new packet up from the bottom of the heap
+    uint32_t index = impair.queue_count++;
+
+    while (index > 0 && impair_packet_due_before(packet, impair.queue[(index - 1) / 2]))
+    {
+        impair.queue[index] = impair.queue[(index - 1) / 2];
+        index = (index - 1) / 2;
+    }
+
+    impair.queue[index] = packet;
+
+    if (index == 0)
+    {
+        pthread_cond_signal(&impair.queue_changed);
+    }
+
+    impair.counters.delayed++;
+}
+
+/**
+ * Puts a single outgoing datagram through the impairments: it is either lost,
+ * or sent once or twice, each copy right away or queued for later.
+ * Returns the result of the send made right away, or the packet length if there was none, as if it had been sent.
+ */
+static ssize_t impair_send_message(int socket, const struct msghdr *message, int flags)
+{
+    size_t length = 0;
+    ssize_t result = 0;
+    uint8_t copies = 1;
+
+    for (size_t i = 0; i < message->msg_iovlen; i++)
+    {
+        length += message->msg_iov[i].iov_len;
+    }
+
+    pthread_mutex_lock(&impair.mutex);
+    impair.counters.packets++;
+
+    if (impair_lose_packet())
+    {
+        impair.counters.lost++;
+        copies = 0;
+    }
+    else if (impair.config.duplicate > 0 && impair_random_fraction() < impair.config.duplicate)
+    {
+        impair.counters.duplicated++;
+        copies = 2;
+    }
+
+    result = length;
+
+    for (uint8_t copy = 0; copy < copies; copy++)
+    {
+        uint64_t delay_us = impair_packet_delay_us();
+
+        if (delay_us > 0 && message->msg_name != NULL)
+        {
+            impair_queue_packet(socket, message->msg_iov, message->msg_iovlen, length, message->msg_name, message->msg_namelen, delay_us);
+        }
+        else
+        {
+            // sent under the mutex, so that no copy due right away can overtake another
+            result = sendmsg(socket, message, flags);
+        }
+    }
+
+    pthread_mutex_unlock(&impair.mutex);
+    return result;
+}
+
+/**
+ * Drop-in replacement for sendto(), impairing the packet if impairment is enabled.
+ */
+ssize_t impair_sendto(int socket, const void *buffer, size_t length, int flags, const struct sockaddr *address, socklen_t address_length)
+{
+    if (!impair.enabled)
+    {
+        return sendto(socket, buffer, length, flags, address, address_length);
+    }
+
+    struct iovec iovec = { .iov_base = (void *)buffer, .iov_len = length };
+    struct msghdr message = { .msg_name = (void *)address, .msg_namelen = address_length, .msg_iov = &iovec, .msg_iovlen = 1 };
+    return impair_send_message(socket, &message, flags);
+}
+
+/**
+ * Drop-in replacement for sendmmsg(), impairing each packet separately if impairment is enabled.
+ * Messages must hold a single datagram each, i.e. not use segmentation offload, which is left off while impairing.
+ */
+int impair_sendmmsg(int socket, struct mmsghdr *messages, unsigned int count, int flags)
+{
+    if (!impair.enabled)
+    {
+        return sendmmsg(socket, messages, count, flags);
+    }
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        ssize_t sent = impair_send_message(socket, &messages[i].msg_hdr, flags);
+
+        if (sent < 0)
+        {
+            return i > 0 ? (int)i : -1;
+        }
+
+        messages[i].msg_len = sent;
+    }
+
+    return count;
+}
+
+/**
+ * Stops the sending thread, dropping packets still queued, and reports what the impairments did.
+ */
+void impair_stop(void)
+{
+    if (!impair.enabled)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&impair.mutex);
+    impair.stop_requested = true;
+    bool thread_started = impair.thread_started;
+
+    if (thread_started)
+    {
+        pthread_cond_signal(&impair.queue_changed);
+    }
+
+    pthread_mutex_unlock(&impair.mutex);
+
+    if (thread_started)
+    {
+        pthread_join(impair.thread_handle, NULL);
+        pthread_cond_destroy(&impair.queue_changed);
+        impair.thread_started = false;
+    }
+
+    for (uint32_t i = 0; i < impair.queue_count; i++)
+    {
+        free(impair.queue[i]);
+    }
+
+    free(impair.queue);
+    impair.queue = NULL;
+    impair.queue_count = impair.queue_capacity = 0;
+
+    LOG_INFO("Impairment: %lu packets, %lu lost, %lu duplicated, %lu delayed, %lu reordered, %lu dropped with the delay queue full.\n",
+            impair.counters.packets, impair.counters.lost, impair.counters.duplicated,
+            impair.counters.delayed, impair.counters.reordered, impair.counters.queue_overflows);
+    impair.enabled = false;
+}
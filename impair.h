@@ -0,0 +1,62 @@
+/**
+ * The Impair header declares an in-process impairment layer for testing transfers on a lossy network
+ * without root privileges or tc netem: every packet the process sends goes through it,
+ * and may be lost (at random, or in bursts), delayed with jitter, duplicated, or held back for later ones to overtake.
+ * Like netem, it only acts on outgoing packets, so impairing both directions takes impairing both peers.
+ * Random decisions come from a seeded generator, so that a run can be repeated.
+ * It is set up from the STFTPU_IMPAIR environment variable, or the server's impair= option, e.g. "loss=2,burst=3,delay=10,jitter=5,seed=1".
+ * Delayed packets are copied and sent by a thread of its own when due.
+ */
+
+#ifndef IMPAIR_H
+#define IMPAIR_H
+
+#include "common.h"
+#include "networking_common.h"
+
+#define IMPAIR_ENVIRONMENT_VARIABLE "STFTPU_IMPAIR"
+#define IMPAIR_REORDER_HOLD_US 1000
+#define IMPAIR_QUEUE_MAX 65536
+
+typedef struct ImpairConfig
+{
+    double loss; // share of packets lost, 0-1
+    double burst; // mean length of loss bursts, in packets
+    double duplicate; // share of packets sent twice, 0-1
+    double reorder; // share of packets held back for IMPAIR_REORDER_HOLD_US more than the others
+    uint64_t delay_us;
+    uint64_t jitter_us; // delays vary uniformly by up to this much either way
+    uint64_t seed;
+} ImpairConfig_t;
+
+/**
+ * A packet waiting out its delay, in the queue of the sending thread.
+ */
+typedef struct ImpairPacket
+{
+    uint64_t due_us;
+    uint64_t sequence; // packets due at the same time go out in the order they were sent
+    int socket;
+    struct sockaddr_in address;
+    socklen_t address_length;
+    size_t length;
+    uint8_t data[];
+} ImpairPacket_t;
+
+typedef struct ImpairCounters
+{
+    uint64_t packets;
+    uint64_t lost;
+    uint64_t duplicated;
+    uint64_t delayed;
+    uint64_t reordered;
+    uint64_t queue_overflows; // delayed packets dropped with the queue full
+} ImpairCounters_t;
+
+bool impair_configure(const char *specification);
+bool impair_enabled(void);
+void impair_stop(void);
+ssize_t impair_sendto(int socket, const void *buffer, size_t length, int flags, const struct sockaddr *address, socklen_t address_length);
+int impair_sendmmsg(int socket, struct mmsghdr *messages, unsigned int count, int flags);
+
+#endif
@@ -0,0 +1,358 @@
+#include "io_ring.h"
+#include "log.h"
+#include "impair.h"
+
+#ifdef TFTP_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+/**
+ * The ring attached to the calling thread, or NULL if it has none.
+ */
+static __thread IoRing_t *io_ring_thread_ring = NULL;
+
+/**
+ * Makes the given ring serve the transfers of the calling thread. NULL detaches the current one.
+ */
+void io_ring_attach(IoRing_t *ring)
+{
+    io_ring_thread_ring = ring;
+}
+
+IoRing_t *io_ring_attached(void)
+{
+    return io_ring_thread_ring;
+}
+
+/**
+ * Adds the counters of a ring to a total, e.g. to total them over all worker threads.
+ */
+void io_ring_accumulate(IoRingCounters_t *total, const IoRing_t *ring)
+{
+    total->submissions += ring->counters.submissions;
+    total->requests += ring->counters.requests;
+    total->failed_requests += ring->counters.failed_requests;
+}
+
+/**
+ * Prints ring counters, unless no requests were ever made (e.g. the backend is not built in).
+ */
+void io_ring_print_counters(const IoRingCounters_t *counters, const char *title)
+{
+    if (counters->requests == 0)
+    {
+        return;
+    }
+
+    LOG_INFO(" %s: %lu requests in %lu submissions, %.1f requests per submission, %lu failed.\n", title,
+            counters->requests, counters->submissions, (double)counters->requests / counters->submissions, counters->failed_requests);
+}
+
+#ifdef TFTP_IO_URING
+
+/**
+ * Sets up a ring of IO_RING_ENTRIES entries, and maps its queues into memory.
+ * Returns false if the kernel does not support (or permit) io_uring, in which case the caller simply goes without,
+ * and also while impairing sent packets, since sends submitted on the ring would bypass the impairments.
+ */
+bool io_ring_init(IoRing_t *ring)
+{
+    struct io_uring_params params;
+
+    explicit_bzero(ring, sizeof(IoRing_t));
+    explicit_bzero(&params, sizeof(params));
+    ring->ring_fd = -1;
+
+    if (impair_enabled())
+    {
+        return false;
+    }
+
+    ring->ring_fd = syscall(__NR_io_uring_setup, IO_RING_ENTRIES, &params);
+
+    if (ring->ring_fd < 0)
+    {
+        LOG_ERRNO("Failed to set up io_uring");
+        return false;
+    }
+
+    ring->entries_count = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // newer kernels map both queue rings at once
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sq_ring_size = ring->cq_ring_size > ring->sq_ring_size ? ring->cq_ring_size : ring->sq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring_ptr = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+    ring->cq_ring_ptr = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_ring_ptr
+        : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+
+    if (ring->sq_ring_ptr == MAP_FAILED || ring->cq_ring_ptr == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        LOG_ERRNO("Failed to map io_uring queues");
+        io_ring_deinit(ring);
+        return false;
+    }
+
+    uint8_t *sq_ring = ring->sq_ring_ptr;
+    uint8_t *cq_ring = ring->cq_ring_ptr;
+
+    ring->sq_head = (uint32_t *)(sq_ring + params.sq_off.head);
+    ring->sq_tail = (uint32_t *)(sq_ring + params.sq_off.tail);
+    ring->sq_mask = (uint32_t *)(sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t *)(sq_ring + params.sq_off.array);
+    ring->cq_head = (uint32_t *)(cq_ring + params.cq_off.head);
+    ring->cq_tail = (uint32_t *)(cq_ring + params.cq_off.tail);
+    ring->cq_mask = (uint32_t *)(cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+
+    return true;
+}
+
+/**
+ * Unmaps the queues and closes the ring. Counters are left intact for reporting.
+ */
+void io_ring_deinit(IoRing_t *ring)
+{
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+
+    if (ring->cq_ring_ptr != NULL && ring->cq_ring_ptr != MAP_FAILED && ring->cq_ring_ptr != ring->sq_ring_ptr)
+    {
+        munmap(ring->cq_ring_ptr, ring->cq_ring_size);
+    }
+
+    if (ring->sq_ring_ptr != NULL && ring->sq_ring_ptr != MAP_FAILED)
+    {
+        munmap(ring->sq_ring_ptr, ring->sq_ring_size);
+    }
+
+    if (ring->ring_fd > 0)
+    {
+        close(ring->ring_fd);
+    }
+
+    if (io_ring_thread_ring == ring)
+    {
+        io_ring_thread_ring = NULL;
+    }
+
+    ring->ring_fd = -1;
+    ring->sq_ring_ptr = NULL;
+    ring->cq_ring_ptr = NULL;
+    ring->sqes = NULL;
+}
+
+/**
+ * Claims the next free submission queue entry, to be filled in by the caller.
+ * The entry's user data is its position in the submission, which is where its result will be found.
+ * With 'link' set, the next request queued only starts once this one completed successfully, and is cancelled otherwise.
+ */
+static struct io_uring_sqe *io_ring_next_sqe(IoRing_t *ring, bool link)
+{
+    if (ring->queued_count >= ring->entries_count)
+    {
+        return NULL;
+    }
+
+    // the kernel only consumes entries once they are submitted, so the tail is private until then
+    uint32_t index = (*ring->sq_tail + ring->queued_count) & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    explicit_bzero(sqe, sizeof(struct io_uring_sqe));
+    sqe->user_data = ring->queued_count;
+    sqe->flags = link ? IOSQE_IO_LINK : 0;
+    ring->sq_array[index] = index;
+    ring->last_sqe = sqe;
+    ring->queued_count++;
+
+    return sqe;
+}
+
+/**
+ * Queues a vectored read at the given file offset.
+ * Returns the request's position in the submission, or -1 if the ring is full.
+ */
+int32_t io_ring_queue_readv(IoRing_t *ring, int fd, const struct iovec *iovecs, uint32_t iovecs_count, uint64_t offset, bool link)
+{
+    struct io_uring_sqe *sqe = io_ring_next_sqe(ring, link);
+
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)iovecs;
+    sqe->len = iovecs_count;
+    sqe->off = offset;
+    return sqe->user_data;
+}
+
+/**
+ * Queues a write at the given file offset.
+ * Returns the request's position in the submission, or -1 if the ring is full.
+ */
+int32_t io_ring_queue_write(IoRing_t *ring, int fd, const void *buffer, uint32_t length, uint64_t offset, bool link)
+{
+    struct io_uring_sqe *sqe = io_ring_next_sqe(ring, link);
+
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = offset;
+    return sqe->user_data;
+}
+
+/**
+ * Queues a sendmsg() on a socket. The message, and everything it points to, must stay valid until submitted.
+ * Returns the request's position in the submission, or -1 if the ring is full.
+ */
+int32_t io_ring_queue_sendmsg(IoRing_t *ring, int fd, const struct msghdr *message, int flags, bool link)
+{
+    struct io_uring_sqe *sqe = io_ring_next_sqe(ring, link);
+
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)message;
+    sqe->len = 1;
+    sqe->msg_flags = flags;
+    return sqe->user_data;
+}
+
+/**
+ * Moves all available completions off the completion queue, storing each result at its request's position.
+ * Returns the number of completions reaped.
+ */
+static uint32_t io_ring_reap_completions(IoRing_t *ring)
+{
+    uint32_t head = *ring->cq_head;
+    uint32_t tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    uint32_t reaped = 0;
+
+    for (; head != tail; head++, reaped++)
+    {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+        if (cqe->user_data < IO_RING_ENTRIES)
+        {
+            ring->results[cqe->user_data] = cqe->res;
+        }
+
+        if (cqe->res < 0)
+        {
+            ring->counters.failed_requests++;
+        }
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    ring->counters.requests += reaped;
+    return reaped;
+}
+
+/**
+ * Hands all queued requests to the kernel and waits for every one of them to complete,
+ * usually with a single system call. Each request's result (as a system call would return it, or -errno)
+ * is then found in ring->results at the position it was queued at; requests cancelled because
+ * an earlier request they were linked to failed report -ECANCELED.
+ * A link never reaches past the last request of a submission.
+ * Returns false if the kernel refused the submission altogether.
+ */
+bool io_ring_submit_and_wait(IoRing_t *ring)
+{
+    uint32_t requests_count = ring->queued_count;
+    uint32_t to_submit = requests_count;
+    uint32_t completed = 0;
+
+    if (requests_count == 0)
+    {
+        return true;
+    }
+
+    ring->last_sqe->flags &= ~IOSQE_IO_LINK;
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + requests_count, __ATOMIC_RELEASE);
+    ring->queued_count = 0;
+
+    while (completed < requests_count)
+    {
+        int submitted = syscall(__NR_io_uring_enter, ring->ring_fd, to_submit, requests_count - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+        ring->counters.submissions++;
+
+        if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            LOG_ERRNO("Failed to submit io_uring requests");
+            return false;
+        }
+
+        if (submitted > 0)
+        {
+            to_submit -= submitted;
+        }
+
+        completed += io_ring_reap_completions(ring);
+    }
+
+    return true;
+}
+
+#else
+
+bool io_ring_init(IoRing_t *ring)
+{
+    explicit_bzero(ring, sizeof(IoRing_t));
+    ring->ring_fd = -1;
+    return false;
+}
+
+void io_ring_deinit(IoRing_t *ring)
+{
+    ring->ring_fd = -1;
+}
+
+int32_t io_ring_queue_readv(IoRing_t *ring, int fd, const struct iovec *iovecs, uint32_t iovecs_count, uint64_t offset, bool link)
+{
+    (void)ring; (void)fd; (void)iovecs; (void)iovecs_count; (void)offset; (void)link;
+    return -1;
+}
+
+int32_t io_ring_queue_write(IoRing_t *ring, int fd, const void *buffer, uint32_t length, uint64_t offset, bool link)
+{
+    (void)ring; (void)fd; (void)buffer; (void)length; (void)offset; (void)link;
+    return -1;
+}
+
+int32_t io_ring_queue_sendmsg(IoRing_t *ring, int fd, const struct msghdr *message, int flags, bool link)
+{
+    (void)ring; (void)fd; (void)message; (void)flags; (void)link;
+    return -1;
+}
+
+bool io_ring_submit_and_wait(IoRing_t *ring)
+{
+    (void)ring;
+    return false;
+}
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * The IO-Ring header declares a minimal io_uring wrapper, talking to the kernel through the raw system calls.
+ * A long-living thread sets up its own ring and attaches it, after which transfers running on that thread
+ * queue their file reads and writes along with their socket sends, and submit them together,
+ * linked where one has to wait for another, instead of making a system call for each.
+ * The backend is selected at build time (make IO_URING=1, i.e. -DTFTP_IO_URING);
+ * otherwise rings cannot be set up, no thread ever has one attached, and transfers use plain system calls.
+ * Rings are not thread-safe: only the thread a ring is attached to may queue requests on it.
+ */
+
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include "common.h"
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define IO_RING_ENTRIES 256
+
+/**
+ * Counters of a single ring: system calls made to submit and await requests, and requests completed.
+ */
+typedef struct IoRingCounters
+{
+    uint64_t submissions;
+    uint64_t requests;
+    uint64_t failed_requests;
+} IoRingCounters_t;
+
+/**
+ * A submission and completion queue pair shared with the kernel, along with the results of the last submission.
+ * Requests are only handed to the kernel by io_ring_submit_and_wait(), which waits for all of them,
+ * so the ring is empty again whenever control leaves whoever queued them.
+ */
+typedef struct IoRing
+{
+    int ring_fd;
+    uint32_t entries_count;
+    uint32_t queued_count;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    struct io_uring_sqe *last_sqe;
+    void *sq_ring_ptr;
+    size_t sq_ring_size;
+    void *cq_ring_ptr;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    int32_t results[IO_RING_ENTRIES]; // of the last submission, in the order the requests were queued
+    IoRingCounters_t counters;
+} IoRing_t;
+
+bool io_ring_init(IoRing_t *ring);
+void io_ring_deinit(IoRing_t *ring);
+void io_ring_attach(IoRing_t *ring);
+IoRing_t *io_ring_attached(void);
+void io_ring_accumulate(IoRingCounters_t *total, const IoRing_t *ring);
+void io_ring_print_counters(const IoRingCounters_t *counters, const char *title);
+
+int32_t io_ring_queue_readv(IoRing_t *ring, int fd, const struct iovec *iovecs, uint32_t iovecs_count, uint64_t offset, bool link);
+int32_t io_ring_queue_write(IoRing_t *ring, int fd, const void *buffer, uint32_t length, uint64_t offset, bool link);
+int32_t io_ring_queue_sendmsg(IoRing_t *ring, int fd, const struct msghdr *message, int flags, bool link);
+bool io_ring_submit_and_wait(IoRing_t *ring);
+
+#endif
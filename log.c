@@ -0,0 +1,352 @@
+#include "log.h"
+
+#include <stdarg.h>
+
+#define LOG_RECORD_WRAP 0xFF // a record level marking the rest of the ring as unused, the next record being at its start
+
+/**
+ * Precedes the text of every record in a ring. Records are padded to keep headers aligned.
+ * The sequence number orders records across rings, so that the console reads in the order messages were logged.
+ */
+typedef struct LogRecordHeader
+{
+    uint32_t sequence;
+    uint16_t length;
+    uint8_t level;
+    uint8_t reserved;
+} LogRecordHeader_t;
+
+#define LOG_RECORD_SIZE(length) ((sizeof(LogRecordHeader_t) + (length) + 7) & ~(uint32_t)7)
+
+LogLevel_t log_level = LOG_LEVEL_INFO;
+
+/**
+ * The logger itself: the list of all rings and the thread draining them.
+ * The list is only locked to add rings and to walk it, never to write messages.
+ */
+static struct
+{
+    bool running;
+    bool stop_requested;
+    pthread_t drainer_handle;
+    pthread_mutex_t rings_mutex;
+    pthread_key_t ring_key;
+    uint32_t sequence;
+    LogRing_t *rings;
+} logger =
+{
+    .rings_mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * The ring of the calling thread, or NULL if it has none yet.
+ */
+static __thread LogRing_t *log_thread_ring = NULL;
+
+static const char *log_level_strings[] = { "error", "warn", "info", "debug", "trace" };
+
+/**
+ * Parses a level name, as in "log=debug". Returns false if there is no such level.
+ */
+bool log_parse_level(const char *level_string, LogLevel_t *level)
+{
+    for (int i = LOG_LEVEL_ERROR; i <= LOG_LEVEL_TRACE; i++)
+    {
+        if (0 == strcmp(level_string, log_level_strings[i]))
+        {
+            *level = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Called as a thread exits, to leave its ring to the draining thread to free once it is empty.
+ */
+static void log_abandon_ring(void *ring)
+{
+    __atomic_store_n(&((LogRing_t *)ring)->abandoned, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns the ring of the calling thread, setting it up on the thread's first message,
+ * or NULL if the logger is not running (or the ring cannot be allocated) and messages are to be written directly.
+ */
+static LogRing_t *log_get_thread_ring(void)
+{
+    if (!__atomic_load_n(&logger.running, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+
+    if (log_thread_ring != NULL)
+    {
+        return log_thread_ring;
+    }
+
+    LogRing_t *ring = malloc(sizeof(LogRing_t));
+
+    if (ring == NULL)
+    {
+        return NULL;
+    }
+
+    explicit_bzero(ring, sizeof(LogRing_t));
+    pthread_setspecific(logger.ring_key, ring);
+
+    pthread_mutex_lock(&logger.rings_mutex);
+    ring->next = logger.rings;
+    logger.rings = ring;
+    pthread_mutex_unlock(&logger.rings_mutex);
+
+    log_thread_ring = ring;
+    return ring;
+}
+
+/**
+ * Copies a message into the calling thread's ring, wrapping around to its start if the message does not fit before its end.
+ * Returns false if the ring has no room for it.
+ */
+static bool log_ring_push(LogRing_t *ring, LogLevel_t level, uint32_t sequence, const char *text, uint16_t length)
+{
+    uint32_t record_size = LOG_RECORD_SIZE(length);
+    uint32_t head = ring->head;
+    uint32_t free_bytes = LOG_RING_BYTES - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+    uint32_t offset = head & (LOG_RING_BYTES - 1);
+    uint32_t bytes_to_end = LOG_RING_BYTES - offset;
+
+    if (free_bytes < (record_size <= bytes_to_end ? record_size : bytes_to_end + record_size))
+    {
+        return false;
+    }
+
+    // records are aligned to their headers, so there is always room for a wrap marker at the end
+    if (record_size > bytes_to_end)
+    {
+        ((LogRecordHeader_t *)(ring->buffer + offset))->level = LOG_RECORD_WRAP;
+        head += bytes_to_end;
+        offset = 0;
+    }
+
+    LogRecordHeader_t *header = (LogRecordHeader_t *)(ring->buffer + offset);
+    header->sequence = sequence;
+    header->length = length;
+    header->level = level;
+    memcpy(ring->buffer + offset + sizeof(LogRecordHeader_t), text, length);
+
+    __atomic_store_n(&ring->head, head + record_size, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * Formats a message, and queues it on the calling thread's ring, or writes it directly (as errors always are).
+ * Called through the LOG_* macros, which skip it altogether for disabled levels.
+ */
+void log_write(LogLevel_t level, const char *format, ...)
+{
+    char text[LOG_RECORD_MAX];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (length < 0)
+    {
+        return;
+    }
+
+    if (length >= LOG_RECORD_MAX)
+    {
+        length = LOG_RECORD_MAX - 1;
+        text[length - 1] = '\n';
+    }
+
+    // errors bypass the ring, so that none is lost to the process exiting before the next drain
+    LogRing_t *ring = level == LOG_LEVEL_ERROR ? NULL : log_get_thread_ring();
+
+    if (ring != NULL && log_ring_push(ring, level, __atomic_fetch_add(&logger.sequence, 1, __ATOMIC_RELAXED), text, length))
+    {
+        return;
+    }
+
+    // warnings are never dropped either, even if that means writing them out of order
+    if (ring != NULL && level > LOG_LEVEL_WARN)
+    {
+        __atomic_store_n(&ring->dropped_count, ring->dropped_count + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    fwrite(text, sizeof(char), length, level <= LOG_LEVEL_WARN ? stderr : stdout);
+}
+
+/**
+ * Returns the next record queued on a ring up to its drain head, skipping a wrap marker, or NULL if there is none.
+ */
+static const LogRecordHeader_t *log_ring_peek(LogRing_t *ring)
+{
+    if (ring->tail == ring->drain_head)
+    {
+        return NULL;
+    }
+
+    uint32_t offset = ring->tail & (LOG_RING_BYTES - 1);
+    const LogRecordHeader_t *header = (const LogRecordHeader_t *)(ring->buffer + offset);
+
+    if (header->level == LOG_RECORD_WRAP)
+    {
+        __atomic_store_n(&ring->tail, ring->tail + LOG_RING_BYTES - offset, __ATOMIC_RELEASE);
+        return ring->tail == ring->drain_head ? NULL : (const LogRecordHeader_t *)ring->buffer;
+    }
+
+    return header;
+}
+
+/**
+ * Writes out every record queued on any ring so far, merged by sequence number, and reports any messages threads dropped.
+ * Frees the rings of threads that exited once they are empty. Returns whether there was anything to write.
+ */
+static bool log_drain_rings(void)
+{
+    bool drained = false;
+
+    pthread_mutex_lock(&logger.rings_mutex);
+
+    // the abandoned flag is read before the head, so that nothing can be queued on a ring after it is found abandoned
+    for (LogRing_t *ring = logger.rings; ring != NULL; ring = ring->next)
+    {
+        ring->drain_abandoned = __atomic_load_n(&ring->abandoned, __ATOMIC_ACQUIRE);
+        ring->drain_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    }
+
+    while (true)
+    {
+        LogRing_t *earliest_ring = NULL;
+        const LogRecordHeader_t *earliest = NULL;
+
+        for (LogRing_t *ring = logger.rings; ring != NULL; ring = ring->next)
+        {
+            const LogRecordHeader_t *header = log_ring_peek(ring);
+
+            if (header != NULL && (earliest == NULL || (int32_t)(header->sequence - earliest->sequence) < 0))
+            {
+                earliest_ring = ring;
+                earliest = header;
+            }
+        }
+
+        if (earliest == NULL)
+        {
+            break;
+        }
+
+        fwrite(earliest + 1, sizeof(char), earliest->length, earliest->level <= LOG_LEVEL_WARN ? stderr : stdout);
+        __atomic_store_n(&earliest_ring->tail, earliest_ring->tail + LOG_RECORD_SIZE(earliest->length), __ATOMIC_RELEASE);
+        drained = true;
+    }
+
+    for (LogRing_t **link = &logger.rings; *link != NULL; )
+    {
+        LogRing_t *ring = *link;
+        uint64_t dropped_count = __atomic_load_n(&ring->dropped_count, __ATOMIC_RELAXED);
+
+        if (dropped_count != ring->dropped_reported)
+        {
+            fprintf(stdout, "[%lu log messages dropped, the console could not keep up]\n", dropped_count - ring->dropped_reported);
+            ring->dropped_reported = dropped_count;
+            drained = true;
+        }
+
+        if (ring->drain_abandoned)
+        {
+            *link = ring->next;
+            free(ring);
+            continue;
+        }
+
+        link = &ring->next;
+    }
+
+    pthread_mutex_unlock(&logger.rings_mutex);
+
+    if (drained)
+    {
+        fflush(stdout);
+    }
+
+    return drained;
+}
+
+static void* log_drainer_start(void *args)
+{
+    (void)args;
+    struct timespec interval = { .tv_sec = 0, .tv_nsec = LOG_DRAIN_INTERVAL_MS * 1000000L };
+
+    while (!__atomic_load_n(&logger.stop_requested, __ATOMIC_ACQUIRE))
+    {
+        if (!log_drain_rings())
+        {
+            nanosleep(&interval, NULL);
+        }
+    }
+
+    log_drain_rings();
+    return NULL;
+}
+
+/**
+ * Starts draining per-thread rings to the console on a background thread.
+ * Messages keep being written directly if the thread cannot be started.
+ */
+void log_start(void)
+{
+    if (0 != pthread_key_create(&logger.ring_key, log_abandon_ring))
+    {
+        perror("Failed to create logger thread key");
+        return;
+    }
+
+    __atomic_store_n(&logger.stop_requested, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&logger.running, true, __ATOMIC_RELEASE);
+
+    if (0 != pthread_create(&logger.drainer_handle, NULL, log_drainer_start, NULL))
+    {
+        perror("Failed to start logger thread");
+        __atomic_store_n(&logger.running, false, __ATOMIC_RELEASE);
+        pthread_key_delete(logger.ring_key);
+    }
+}
+
+/**
+ * Writes out everything queued so far, and goes back to writing messages directly.
+ * Call once every other thread that logged was joined.
+ */
+void log_stop(void)
+{
+    if (!__atomic_load_n(&logger.running, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    __atomic_store_n(&logger.running, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&logger.stop_requested, true, __ATOMIC_RELEASE);
+    pthread_join(logger.drainer_handle, NULL);
+
+    // the remaining rings belong to threads still alive (e.g. this one), which from now on write directly
+    pthread_mutex_lock(&logger.rings_mutex);
+
+    while (logger.rings != NULL)
+    {
+        LogRing_t *ring = logger.rings;
+        logger.rings = ring->next;
+        free(ring);
+    }
+
+    pthread_mutex_unlock(&logger.rings_mutex);
+
+    pthread_key_delete(logger.ring_key);
+    log_thread_ring = NULL;
+    fflush(stdout);
+}
@@ -0,0 +1,72 @@
+/**
+ * The Log header declares leveled logging that keeps console output off the transfer hot path.
+ * Once started, each thread formats its messages into a ring buffer of its own, without taking any lock,
+ * and a background thread drains all rings to the console (warnings to stderr, the rest to stdout).
+ * Errors are always written to stderr directly, since they often precede the process exiting.
+ * A thread whose ring is full drops informational messages (they are counted, and the count is reported),
+ * but writes warnings directly. Before the logger is started (e.g. in the client), messages are written directly.
+ * Calls above LOG_LEVEL_COMPILED are compiled out altogether, arguments included: trace calls are, unless built with LOG_TRACE=1.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include "common.h"
+
+#define LOG_RING_BYTES (16 * 1024) // must be a power of two
+#define LOG_RECORD_MAX 1024 // longer messages are truncated
+#define LOG_DRAIN_INTERVAL_MS 10
+
+typedef enum LogLevel
+{
+    LOG_LEVEL_ERROR = 0,
+    LOG_LEVEL_WARN = 1,
+    LOG_LEVEL_INFO = 2,
+    LOG_LEVEL_DEBUG = 3,
+    LOG_LEVEL_TRACE = 4,
+} LogLevel_t;
+
+#ifndef LOG_LEVEL_COMPILED
+#define LOG_LEVEL_COMPILED LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_AT(level, ...) \
+        do { if ((level) <= LOG_LEVEL_COMPILED && (level) <= log_level) { log_write((level), __VA_ARGS__); } } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+
+/**
+ * Logs a message along with the description of the current errno, like perror() does.
+ */
+#define LOG_ERRNO(message) LOG_AT(LOG_LEVEL_ERROR, "%s: %s\n", (message), strerror(errno))
+
+/**
+ * A single thread's ring of variable-length records, each a header followed by the message text.
+ * Positions only ever grow (wrapping around at 2^32), so the ring holds head - tail bytes.
+ * The owning thread alone advances the head, and the draining thread alone advances the tail.
+ */
+typedef struct LogRing
+{
+    struct LogRing *next; // in the list of all rings, walked by the draining thread
+    bool abandoned; // the owning thread exited, so the ring is freed once drained
+    bool drain_abandoned; // the abandoned flag as of the current drain, which frees the ring at its end
+    uint32_t head;
+    uint32_t tail;
+    uint32_t drain_head; // the head as of the current drain, which writes no further
+    uint64_t dropped_count;
+    uint64_t dropped_reported;
+    uint8_t buffer[LOG_RING_BYTES];
+} LogRing_t;
+
+extern LogLevel_t log_level;
+
+bool log_parse_level(const char *level_string, LogLevel_t *level);
+void log_start(void);
+void log_stop(void);
+void log_write(LogLevel_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
@@ -2,6 +2,7 @@
 #include "networking_common.h"
 #include "tftp_common.h"
 #include "client.h"
+#include "client_load.h"
 #include "server.h"
 
 static int8_t get_selection_from_args(int argc, char *argv[]);
@@ -19,6 +20,12 @@ int main(int argc, char *argv[])
     initialize_signal_handler();
     initialize_random_seed();
 
+    // packet impairment for testing, which the server may also set up with an option
+    if (!impair_configure(getenv(IMPAIR_ENVIRONMENT_VARIABLE)))
+    {
+        return EXIT_FAILURE;
+    }
+
     int8_t selection = get_selection_from_args(argc, argv);
     tftp_common.is_server = false;
 
@@ -29,13 +36,31 @@ int main(int argc, char *argv[])
     else if (selection == 0)
     {
         tftp_common.is_server = true;
-        server_start();
+        server_start(argc - 2, argv + 2);
     }
     else if (argc > 3)
     {
         OperationId_t op_id;
         struct in_addr peer_address_bin;
         OperationData_t *data;
+        TFTPOptionList_t options = { .count = 0 };
+
+        // the server's port may follow its address, e.g. for a server not running as root
+        char *port_string = strchr(argv[2], ':');
+
+        if (port_string != NULL)
+        {
+            *port_string++ = '\0';
+            int port = atoi(port_string);
+
+            if (port <= 0 || port > UINT16_MAX)
+            {
+                fprintf(stderr, "Invalid server port (%s).\n", port_string);
+                return EXIT_FAILURE;
+            }
+
+            tftp_common.requests_port = port;
+        }
 
         if (!parse_address(argv[2], &peer_address_bin))
         {
@@ -45,6 +70,13 @@ int main(int argc, char *argv[])
 
         printf("Parsed peer address (%s).\n", argv[2]);
 
+        if (selection == 5)
+        {
+            bool load_success = client_load_run(peer_address_bin, argc - 3, argv + 3);
+            impair_stop();
+            return load_success ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
         switch (selection)
         {
             case 1:
@@ -56,16 +88,32 @@ int main(int argc, char *argv[])
             case 3:
                 op_id = TFTP_OPERATION_REQUEST_DELETE;
                 break;
+            case 4:
+                op_id = TFTP_OPERATION_RECEIVE;
+                // an empty value asks the server for a group to receive the file from (RFC 2090)
+                options.options[options.count++] = (TFTPOption_t){ .name = TFTP_MULTICAST_STRING, .value = "" };
+                break;
             default:
                 fputs("client parsed invalid operation id", stderr);
                 return EXIT_FAILURE;
         }
 
+        // the optional block and window sizes are requested as options (RFC 2348, RFC 7440)
+        if (argc > 5)
+        {
+            options.options[options.count++] = (TFTPOption_t){ .name = TFTP_BLKSIZE_STRING, .value = argv[5] };
+        }
+
+        if (argc > 6)
+        {
+            options.options[options.count++] = (TFTPOption_t){ .name = TFTP_WINDOWSIZE_STRING, .value = argv[6] };
+        }
+
         data = tftp_init_operation_data(op_id,
-                init_peer_socket_address(peer_address_bin, htons(69)),
+                init_peer_socket_address(peer_address_bin, htons(tftp_common.requests_port)),
                 argv[3],
                 argc > 4 ? argv[4] : NULL,
-                argc > 5 ? argv[5] : NULL);
+                &options);
 
         if (data == NULL)
         {
@@ -77,6 +125,8 @@ int main(int argc, char *argv[])
             bool operation_success = client_start_operation(data);
             printf("Operation %s.\n", operation_success ? "completed" : "aborted");
             tftp_free_operation_data(data);
+            impair_stop();
+            return operation_success ? EXIT_SUCCESS : EXIT_FAILURE;
         }
     }
     else
@@ -0,0 +1,149 @@
+#include "metrics.h"
+
+#include <stddef.h>
+
+// the counters proper, which are all uint64_t, come before the histograms
+#define METRICS_COUNTS_COUNT (offsetof(MetricsCounters_t, transfer_rtt_us) / sizeof(uint64_t))
+
+/**
+ * The list of every thread's counters, along with the totals of threads that exited.
+ * The mutex is only taken to add a thread, to retire one, and to aggregate them all.
+ */
+static struct
+{
+    pthread_mutex_t mutex;
+    pthread_once_t key_once;
+    pthread_key_t thread_key;
+    bool key_created;
+    uint64_t session_capacity;
+    MetricsThread_t *threads;
+    MetricsCounters_t retired;
+    MetricsThread_t fallback; // shared by threads whose own counters could not be allocated
+} metrics =
+{
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .key_once = PTHREAD_ONCE_INIT,
+};
+
+/**
+ * The counters of the calling thread, or NULL if it has none yet.
+ */
+static __thread MetricsThread_t *metrics_thread = NULL;
+
+/**
+ * Adds all counts of a thread to a total, reading them as they are being written.
+ */
+static void metrics_add_counters(MetricsCounters_t *total, const MetricsCounters_t *counters)
+{
+    uint64_t *total_counts = (uint64_t *)total;
+    const uint64_t *counts = (const uint64_t *)counters;
+
+    for (size_t i = 0; i < METRICS_COUNTS_COUNT; i++)
+    {
+        total_counts[i] += __atomic_load_n(&counts[i], __ATOMIC_RELAXED);
+    }
+
+    log2_histogram_merge(&total->transfer_rtt_us, &counters->transfer_rtt_us);
+    log2_histogram_merge(&total->transfer_throughput_kbps, &counters->transfer_throughput_kbps);
+}
+
+/**
+ * Called as a thread exits, to keep its counts and free its counters.
+ */
+static void metrics_retire_thread(void *thread)
+{
+    pthread_mutex_lock(&metrics.mutex);
+
+    for (MetricsThread_t **link = &metrics.threads; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == thread)
+        {
+            *link = (*link)->next;
+            break;
+        }
+    }
+
+    metrics_add_counters(&metrics.retired, &((MetricsThread_t *)thread)->counters);
+    pthread_mutex_unlock(&metrics.mutex);
+    free(thread);
+}
+
+static void metrics_create_key(void)
+{
+    metrics.key_created = (0 == pthread_key_create(&metrics.thread_key, metrics_retire_thread));
+}
+
+/**
+ * Returns the counters of the calling thread, setting them up on the thread's first count.
+ */
+MetricsCounters_t *metrics_thread_counters(void)
+{
+    if (metrics_thread != NULL)
+    {
+        return &metrics_thread->counters;
+    }
+
+    pthread_once(&metrics.key_once, metrics_create_key);
+    MetricsThread_t *thread = metrics.key_created ? aligned_alloc(METRICS_CACHE_LINE_BYTES, sizeof(MetricsThread_t)) : NULL;
+
+    if (thread == NULL)
+    {
+        return &metrics.fallback.counters;
+    }
+
+    explicit_bzero(thread, sizeof(MetricsThread_t));
+    pthread_setspecific(metrics.thread_key, thread);
+
+    pthread_mutex_lock(&metrics.mutex);
+    thread->next = metrics.threads;
+    metrics.threads = thread;
+    pthread_mutex_unlock(&metrics.mutex);
+
+    metrics_thread = thread;
+    return &thread->counters;
+}
+
+/**
+ * Counts a transfer that completed, along with its round-trip time and average rate.
+ */
+void metrics_record_transfer(uint32_t srtt_us, uint64_t bytes, float seconds)
+{
+    MetricsCounters_t *counters = metrics_thread_counters();
+
+    METRICS_ADD(transfers_completed, 1);
+    log2_histogram_add(&counters->transfer_rtt_us, srtt_us);
+    log2_histogram_add(&counters->transfer_throughput_kbps, seconds > 0 ? (uint64_t)(bytes / 1000.0 / seconds) : 0);
+}
+
+/**
+ * Sums up the counters of every thread, past and present, into the given total.
+ * Counts being written meanwhile may or may not be included yet.
+ */
+void metrics_aggregate(MetricsCounters_t *total)
+{
+    explicit_bzero(total, sizeof(MetricsCounters_t));
+
+    pthread_mutex_lock(&metrics.mutex);
+    metrics_add_counters(total, &metrics.retired);
+    metrics_add_counters(total, &metrics.fallback.counters);
+
+    for (MetricsThread_t *thread = metrics.threads; thread != NULL; thread = thread->next)
+    {
+        metrics_add_counters(total, &thread->counters);
+    }
+
+    pthread_mutex_unlock(&metrics.mutex);
+}
+
+/**
+ * Sets how many transfers the server can run at once, to put the number of active ones in perspective.
+ */
+void metrics_set_session_capacity(uint64_t capacity)
+{
+    __atomic_store_n(&metrics.session_capacity, capacity, __ATOMIC_RELAXED);
+}
+
+uint64_t metrics_session_capacity(void)
+{
+    return __atomic_load_n(&metrics.session_capacity, __ATOMIC_RELAXED);
+}
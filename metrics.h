@@ -0,0 +1,58 @@
+/**
+ * The Metrics header declares counters kept by every thread that handles requests or transfers,
+ * for the server to expose while it runs (see server_metrics.h).
+ * Each thread counts into a struct of its own, padded to whole cache lines so that threads never share one,
+ * with plain stores: only reading them all, on demand, takes a lock. Counts of threads that exited are kept.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "common.h"
+
+#define METRICS_CACHE_LINE_BYTES 64
+
+/**
+ * Adds to a counter of the calling thread. Only the owning thread writes its counters,
+ * so the store needs no lock prefix, merely to be atomic for the thread aggregating them.
+ */
+#define METRICS_ADD(counter, amount) \
+        do { MetricsCounters_t *metrics_counters = metrics_thread_counters(); \
+             __atomic_store_n(&metrics_counters->counter, metrics_counters->counter + (amount), __ATOMIC_RELAXED); } while (0)
+
+typedef struct MetricsCounters
+{
+    uint64_t read_requests;
+    uint64_t write_requests;
+    uint64_t delete_requests;
+    uint64_t invalid_requests; // packets of any other opcode on the requests socket
+    uint64_t requests_rejected_busy; // no free slot, session or queue entry
+    uint64_t requests_rejected_timed_out; // waited too long for a free slot
+    uint64_t requests_answered_from_index;
+    uint64_t transfers_started;
+    uint64_t transfers_finished; // completed or not
+    uint64_t transfers_completed;
+    uint64_t file_bytes_sent;
+    uint64_t file_bytes_received;
+    uint64_t retransmissions; // windows, ACKs and OACKs sent again after a timeout
+    uint64_t timeouts;
+    uint64_t error_packets_sent;
+    uint64_t duplicate_packets; // ACKs and DATA blocks received again, and ignored
+    uint64_t dropped_packets; // other packets ignored, including those from unknown transfer IDs
+    Log2Histogram_t transfer_rtt_us; // smoothed round-trip time of each completed transfer
+    Log2Histogram_t transfer_throughput_kbps; // average rate of each completed transfer, in KB/s
+} MetricsCounters_t;
+
+typedef struct MetricsThread
+{
+    MetricsCounters_t counters;
+    struct MetricsThread *next; // in the list of all threads' counters
+} __attribute__((aligned(METRICS_CACHE_LINE_BYTES))) MetricsThread_t;
+
+MetricsCounters_t *metrics_thread_counters(void);
+void metrics_record_transfer(uint32_t srtt_us, uint64_t bytes, float seconds);
+void metrics_aggregate(MetricsCounters_t *total);
+void metrics_set_session_capacity(uint64_t capacity);
+uint64_t metrics_session_capacity(void);
+
+#endif
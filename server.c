@@ -1,4 +1,361 @@
 #include "server.h"
+#include "log.h"
+#include "server_events.h"
+
+#include <stddef.h>
+
+/**
+ * Server settings, parsed from the "serve" operation mode arguments by server_parse_config().
+ */
+ServerConfig_t server_config =
+{
+    .mode = SERVER_MODE_THREADS,
+    .admission_policy = SERVER_ADMISSION_FIFO,
+    .max_sessions = SERVER_EVENTS_MAX_SESSIONS_DEFAULT,
+    .slots_count = SERVER_MAX_CONNECTIONS,
+    .queue_capacity = SERVER_REQUEST_QUEUE_CAPACITY_DEFAULT,
+    .queue_max_wait_ms = SERVER_REQUEST_QUEUE_MAX_WAIT_MS_DEFAULT,
+    .workers_count = 0,
+    .multicast_port = SERVER_MULTICAST_PORT_DEFAULT,
+    .multicast_group = { .s_addr = INADDR_ANY },
+    .cache_budget_mb = 0,
+    .storage_index = true,
+};
+
+/**
+ * Prints the "name=value" options accepted by the "serve" operation mode.
+ */
+static void server_print_config_usage(void)
+{
+    printf(" Server options:\n");
+    printf("   port=<port>          - the port to receive requests on (default %d)\n", TFTP_REQUESTS_PORT_DEFAULT);
+    printf("   mode=threads|events  - one thread per operation (default), or an epoll event loop\n");
+    printf("   sessions=<count>     - max concurrent sessions per events mode worker (default %d)\n", SERVER_EVENTS_MAX_SESSIONS_DEFAULT);
+    printf("   workers=<count>      - events mode worker threads, each with its own requests socket (default: core count)\n");
+    printf("   transmit=copy|mmap|zerocopy - read blocks into packets (default), send them straight out of a file mapping,\n");
+    printf("                          or also with MSG_ZEROCOPY for block sizes of at least %d\n", TFTP_ZEROCOPY_MIN_BLKSIZE);
+    printf("   offload=on|off       - coalesce runs of DATA packets with UDP segmentation and receive offload (default on)\n");
+    printf("   blksize_cap=mtu|off  - cap requested block sizes to what fits unfragmented on the route to each client (default mtu)\n");
+    printf("   rto_min=<ms>         - lower bound of the retransmission timeout estimated from round-trip times (default %d)\n", TFTP_RTO_MIN_MS_DEFAULT);
+    printf("   rto_max=<ms>         - upper bound of the retransmission timeout, also when backing off (default %d)\n", TFTP_RTO_MAX_MS_DEFAULT);
+    printf("   retries=<count>      - consecutive timeouts before a transfer is aborted (default %d)\n", TFTP_RETRIES_DEFAULT);
+    printf("   slots=<count>        - threads mode max concurrent operations (default %d)\n", SERVER_MAX_CONNECTIONS);
+    printf("   queue=<count>        - threads mode requests waiting for a free slot before being rejected (default %d)\n", SERVER_REQUEST_QUEUE_CAPACITY_DEFAULT);
+    printf("   queue_wait=<ms>      - threads mode max time a request may wait for a free slot (default %d)\n", SERVER_REQUEST_QUEUE_MAX_WAIT_MS_DEFAULT);
+    printf("   admission=fifo|priority - threads mode admission order: arrival (default), or reads, deletes, then writes\n");
+    printf("   multicast=<address>  - serve reads asking for the 'multicast' option (RFC 2090) to groups from this one up (default off)\n");
+    printf("   multicast_port=<port> - the port of multicast groups (default %d)\n", SERVER_MULTICAST_PORT_DEFAULT);
+    printf("   cache=<MB>           - memory budget for keeping the contents of files being read, shared by all sessions (default 0: off)\n");
+    printf("   index=on|off         - answer requests for missing files from an inotify-maintained index of the storage folder (default on)\n");
+    printf("   metrics=<path|port>  - serve metrics in the Prometheus text format on a Unix socket, or over HTTP on a localhost port (default off)\n");
+    printf("   impair=<name=value,...> - impair sent packets for testing: loss, burst, delay, jitter, duplicate, reorder, seed\n");
+    printf("                          (see impair.h; default: the %s environment variable, if set)\n", IMPAIR_ENVIRONMENT_VARIABLE);
+    printf("   log=error|warn|info|debug|trace - most verbose messages logged (default info; trace needs a LOG_TRACE=1 build)\n");
+}
+
+/**
+ * Parses the optional "name=value" arguments of the "serve" operation mode into server_config.
+ * Returns false if any argument is malformed or unknown.
+ */
+static bool server_parse_config(int argc, char *argv[])
+{
+    for (int i = 0; i < argc; i++)
+    {
+        char *value = strchr(argv[i], '=');
+
+        if (value == NULL)
+        {
+            LOG_ERROR("Malformed server option '%s', expected name=value.\n", argv[i]);
+            return false;
+        }
+
+        value++;
+
+        if (0 == strncmp(argv[i], "mode=", value - argv[i]))
+        {
+            if (0 == strcmp(value, "threads"))
+            {
+                server_config.mode = SERVER_MODE_THREADS;
+            }
+            else if (0 == strcmp(value, "events"))
+            {
+                server_config.mode = SERVER_MODE_EVENTS;
+            }
+            else
+            {
+                LOG_ERROR("Unknown server mode '%s'.\n", value);
+                return false;
+            }
+        }
+        else if (0 == strncmp(argv[i], "sessions=", value - argv[i]))
+        {
+            int max_sessions = atoi(value);
+
+            if (max_sessions <= 0)
+            {
+                LOG_ERROR("Invalid session count '%s'.\n", value);
+                return false;
+            }
+
+            server_config.max_sessions = max_sessions;
+        }
+        else if (0 == strncmp(argv[i], "workers=", value - argv[i]))
+        {
+            int workers_count = atoi(value);
+
+            if (workers_count <= 0 || workers_count > SERVER_EVENTS_MAX_WORKERS)
+            {
+                LOG_ERROR("Invalid worker count '%s', valid range is 1-%d.\n", value, SERVER_EVENTS_MAX_WORKERS);
+                return false;
+            }
+
+            server_config.workers_count = workers_count;
+        }
+        else if (0 == strncmp(argv[i], "transmit=", value - argv[i]))
+        {
+            if (0 == strcmp(value, "copy"))
+            {
+                tftp_common.transmit_method = TFTP_TRANSMIT_COPY;
+            }
+            else if (0 == strcmp(value, "mmap"))
+            {
+                tftp_common.transmit_method = TFTP_TRANSMIT_MMAP;
+            }
+            else if (0 == strcmp(value, "zerocopy"))
+            {
+                tftp_common.transmit_method = TFTP_TRANSMIT_ZEROCOPY;
+            }
+            else
+            {
+                LOG_ERROR("Unknown transmit method '%s'.\n", value);
+                return false;
+            }
+        }
+        else if (0 == strncmp(argv[i], "offload=", value - argv[i]))
+        {
+            if (0 == strcmp(value, "on"))
+            {
+                tftp_common.segmentation_offload = true;
+            }
+            else if (0 == strcmp(value, "off"))
+            {
+                tftp_common.segmentation_offload = false;
+            }
+            else
+            {
+                LOG_ERROR("Unknown offload setting '%s'.\n", value);
+                return false;
+            }
+        }
+        else if (0 == strncmp(argv[i], "blksize_cap=", value - argv[i]))
+        {
+            if (0 == strcmp(value, "mtu"))
+            {
+                tftp_common.path_mtu_blksize = true;
+            }
+            else if (0 == strcmp(value, "off"))
+            {
+                tftp_common.path_mtu_blksize = false;
+            }
+            else
+            {
+                LOG_ERROR("Unknown block size cap '%s'.\n", value);
+                return false;
+            }
+        }
+        else if (0 == strncmp(argv[i], "rto_min=", value - argv[i]))
+        {
+            int rto_min_ms = atoi(value);
+
+            if (rto_min_ms <= 0)
+            {
+                LOG_ERROR("Invalid minimum retransmission timeout '%s'.\n", value);
+                return false;
+            }
+
+            tftp_common.rto_min_ms = rto_min_ms;
+        }
+        else if (0 == strncmp(argv[i], "rto_max=", value - argv[i]))
+        {
+            int rto_max_ms = atoi(value);
+
+            if (rto_max_ms <= 0)
+            {
+                LOG_ERROR("Invalid maximum retransmission timeout '%s'.\n", value);
+                return false;
+            }
+
+            tftp_common.rto_max_ms = rto_max_ms;
+        }
+        else if (0 == strncmp(argv[i], "retries=", value - argv[i]))
+        {
+            int retry_count = atoi(value);
+
+            if (retry_count <= 0 || retry_count > UINT8_MAX)
+            {
+                LOG_ERROR("Invalid retry count '%s', valid range is 1-%d.\n", value, UINT8_MAX);
+                return false;
+            }
+
+            tftp_common.max_retry_count = retry_count;
+        }
+        else if (0 == strncmp(argv[i], "slots=", value - argv[i]))
+        {
+            int slots_count = atoi(value);
+
+            if (slots_count <= 0 || slots_count > SERVER_SLOTS_MAX)
+            {
+                LOG_ERROR("Invalid slot count '%s', valid range is 1-%d.\n", value, SERVER_SLOTS_MAX);
+                return false;
+            }
+
+            server_config.slots_count = slots_count;
+        }
+        else if (0 == strncmp(argv[i], "queue=", value - argv[i]))
+        {
+            int queue_capacity = atoi(value);
+
+            if (queue_capacity <= 0)
+            {
+                LOG_ERROR("Invalid queue capacity '%s'.\n", value);
+                return false;
+            }
+
+            server_config.queue_capacity = queue_capacity;
+        }
+        else if (0 == strncmp(argv[i], "queue_wait=", value - argv[i]))
+        {
+            int queue_max_wait_ms = atoi(value);
+
+            if (queue_max_wait_ms <= 0)
+            {
+                LOG_ERROR("Invalid queue wait time '%s'.\n", value);
+                return false;
+            }
+
+            server_config.queue_max_wait_ms = queue_max_wait_ms;
+        }
+        else if (0 == strncmp(argv[i], "admission=", value - argv[i]))
+        {
+            if (0 == strcmp(value, "fifo"))
+            {
+                server_config.admission_policy = SERVER_ADMISSION_FIFO;
+            }
+            else if (0 == strcmp(value, "priority"))
+            {
+                server_config.admission_policy = SERVER_ADMISSION_PRIORITY;
+            }
+            else
+            {
+                LOG_ERROR("Unknown admission policy '%s'.\n", value);
+                return false;
+            }
+        }
+        else if (0 == strncmp(argv[i], "multicast=", value - argv[i]))
+        {
+            if (!parse_address(value, &server_config.multicast_group) || !IN_MULTICAST(ntohl(server_config.multicast_group.s_addr)))
+            {
+                LOG_ERROR("Invalid multicast group address '%s'.\n", value);
+                return false;
+            }
+        }
+        else if (0 == strncmp(argv[i], "multicast_port=", value - argv[i]))
+        {
+            int port = atoi(value);
+
+            if (port <= 0 || port > UINT16_MAX)
+            {
+                LOG_ERROR("Invalid multicast port '%s'.\n", value);
+                return false;
+            }
+
+            server_config.multicast_port = port;
+        }
+        else if (0 == strncmp(argv[i], "cache=", value - argv[i]))
+        {
+            char *value_end = NULL;
+            unsigned long cache_budget_mb = strtoul(value, &value_end, 10);
+
+            if (*value == '\0' || *value_end != '\0' || cache_budget_mb > SERVER_CACHE_BUDGET_MB_MAX)
+            {
+                LOG_ERROR("Invalid file cache budget '%s', valid range is 0-%d MB.\n", value, SERVER_CACHE_BUDGET_MB_MAX);
+                return false;
+            }
+
+            server_config.cache_budget_mb = cache_budget_mb;
+        }
+        else if (0 == strncmp(argv[i], "index=", value - argv[i]))
+        {
+            if (0 == strcmp(value, "on"))
+            {
+                server_config.storage_index = true;
+            }
+            else if (0 == strcmp(value, "off"))
+            {
+                server_config.storage_index = false;
+            }
+            else
+            {
+                LOG_ERROR("Unknown storage index setting '%s'.\n", value);
+                return false;
+            }
+        }
+        else if (0 == strncmp(argv[i], "port=", value - argv[i]))
+        {
+            int port = atoi(value);
+
+            if (port <= 0 || port > UINT16_MAX)
+            {
+                LOG_ERROR("Invalid requests port '%s'.\n", value);
+                return false;
+            }
+
+            tftp_common.requests_port = port;
+        }
+        else if (0 == strncmp(argv[i], "metrics=", value - argv[i]))
+        {
+            server_config.metrics_endpoint = value;
+        }
+        else if (0 == strncmp(argv[i], "impair=", value - argv[i]))
+        {
+            if (!impair_configure(value))
+            {
+                return false;
+            }
+        }
+        else if (0 == strncmp(argv[i], "log=", value - argv[i]))
+        {
+            if (!log_parse_level(value, &log_level))
+            {
+                LOG_ERROR("Unknown log level '%s'.\n", value);
+                return false;
+            }
+        }
+        else
+        {
+            LOG_ERROR("Unknown server option '%s'.\n", argv[i]);
+            return false;
+        }
+    }
+
+    if (tftp_common.rto_min_ms > tftp_common.rto_max_ms)
+    {
+        LOG_ERROR("Minimum retransmission timeout (%u ms) exceeds the maximum (%u ms).\n", tftp_common.rto_min_ms, tftp_common.rto_max_ms);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Every active session or operation holds a data socket and a file descriptor open,
+ * so the default soft limit on open files would cap the session count well below its configured maximum.
+ * This raises the soft limit as far as needed, or as far as the hard limit allows.
+ */
+void server_raise_file_limit(uint32_t sessions_count)
+{
+    raise_open_file_limit(((uint64_t)sessions_count * 2) + 64);
+}
 
 /**
  * This function ensures the existence of a server-side storage location,
@@ -9,17 +366,17 @@ static bool server_init_storage_location(void)
 {
     if (mkdir(SERVER_STORAGE_PATH, 0777) == 0)
     {
-        printf("Initialized storage directory at path '%s'.\n", SERVER_STORAGE_PATH);
+        LOG_INFO("Initialized storage directory at path '%s'.\n", SERVER_STORAGE_PATH);
     }
     else
     {
         if (errno == EEXIST)
         {
-            printf("Existing storage directory detected at path '%s'.\n", SERVER_STORAGE_PATH);
+            LOG_INFO("Existing storage directory detected at path '%s'.\n", SERVER_STORAGE_PATH);
         }
         else
         {
-            perror("Error creating/finding storage directory");
+            LOG_ERRNO("Error creating/finding storage directory");
             return false;
         }
     }
@@ -31,33 +388,29 @@ static bool server_init_storage_location(void)
  * This function implements a server-side client-requested file deletion operation,
  * implemented in the server file since it is a uniquely assymetrical operation.
  */
-static bool server_delete_file(OperationData_t *op_data)
+bool server_delete_file(OperationData_t *op_data)
 {
     // acknowledge request
     tftp_send_ack(0, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
 
-    FILE *file = fopen(op_data->path, "r");
-
-    if (file == NULL)
-    {
-        printf("Requested file not found: %s\n", op_data->path);
-        tftp_send_error(TFTP_ERROR_FILE_NOT_FOUND, "file not found: ", &op_data->path[strlen(SERVER_STORAGE_PATH)], op_data->data_socket, &op_data->peer_address, op_data->peer_address_length); 
-        return false;
-    }
-
-    printf("File exists and will be deleted: %s\n", op_data->path);
-    fclose(file);
-
     if (0 > remove(op_data->path))
     {
-        perror("Failed to delete file");
+        // the file not existing is just one way for removing it to fail, so it needs no check of its own up front
+        if (errno == ENOENT)
+        {
+            LOG_INFO("Requested file not found: %s\n", op_data->path);
+            tftp_send_error(TFTP_ERROR_FILE_NOT_FOUND, "file not found: ", &op_data->path[strlen(SERVER_STORAGE_PATH)], op_data->data_socket, &op_data->peer_address, op_data->peer_address_length); 
+            return false;
+        }
+
+        LOG_ERRNO("Failed to delete file");
         tftp_send_error(TFTP_ERROR_UNDEFINED, "failed to delete, server error: ", strerror(errno), op_data->data_socket, &op_data->peer_address, op_data->peer_address_length); 
         return false;
     }
 
     // confirm deletion
     tftp_send_ack(1, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
-    printf("File deleted successfully: %s\n", op_data->path);
+    LOG_INFO("File deleted successfully: %s\n", op_data->path);
     return true;
 }
 
@@ -65,104 +418,192 @@ static bool server_delete_file(OperationData_t *op_data)
  * This function attempts to acquire a server connection slot,
  * locking it down and returning it to the caller for exclusive use.
  * It returns -1 if no free slots are available.
+ * A free slot is reserved by decrementing the free slots count first,
+ * which guarantees that the following bitmap search finds an unoccupied bit to claim.
  */
 static int server_acquire_connection_slot(ServerSlots_t *data)
 {
-    int retval = -1;
-    pthread_mutex_lock(&data->slots_mutex);
+    int32_t free_slots_count = __atomic_load_n(&data->free_slots_count, __ATOMIC_ACQUIRE);
+
+    do
+    {
+        if (free_slots_count <= 0)
+        {
+            return -1;
+        }
+    }
+    while (!__atomic_compare_exchange_n(&data->free_slots_count, &free_slots_count, free_slots_count - 1, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
 
-    if (data->free_slots_count > 0)
+    // start searching where the previous search succeeded, rather than rescanning the occupied prefix every time
+    uint32_t word_idx = __atomic_load_n(&data->next_search_word, __ATOMIC_RELAXED);
+
+    while (true)
     {
-        for (int i = 0; i < SERVER_MAX_CONNECTIONS; i++)
+        word_idx %= data->bitmap_words_count;
+        uint64_t word = __atomic_load_n(&data->occupied_bitmap[word_idx], __ATOMIC_ACQUIRE);
+
+        while (~word != 0)
         {
-            if (!data->slot_occupied_flags[i])
+            int bit_idx = __builtin_ctzll(~word);
+
+            if (__atomic_compare_exchange_n(&data->occupied_bitmap[word_idx], &word, word | (1ULL << bit_idx), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
             {
-                data->slot_occupied_flags[i] = true;
-                data->free_slots_count--;
-                retval = i;
-                break;
+                __atomic_store_n(&data->next_search_word, word_idx, __ATOMIC_RELAXED);
+                return word_idx * 64 + bit_idx;
             }
         }
-    }
 
-    pthread_mutex_unlock(&data->slots_mutex);
-    return retval;
+        word_idx++;
+    }
 }
 
 /**
  * This function releases a server connection slot,
  * allowing it to be used by a future operation.
+ * The dispatcher is only woken up (which does take a lock) if it is waiting for a slot.
  */
 static void server_release_connection_slot(ServerSlots_t *data, int slot_index)
 {
-    printf("[Slot #%d] Releasing connection slot...\n", slot_index);
-    pthread_mutex_lock(&data->slots_mutex);
-    data->slot_occupied_flags[slot_index] = false;
-    data->free_slots_count++;
-    pthread_mutex_unlock(&data->slots_mutex);
+    LOG_DEBUG("[Slot #%d] Releasing connection slot...\n", slot_index);
+    __atomic_fetch_and(&data->occupied_bitmap[slot_index / 64], ~(1ULL << (slot_index % 64)), __ATOMIC_RELEASE);
+    __atomic_fetch_add(&data->free_slots_count, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&data->dispatcher_waiting, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&data->wakeup_mutex);
+        pthread_cond_signal(&data->slot_released);
+        pthread_mutex_unlock(&data->wakeup_mutex);
+    }
 }
 
 /**
- * This function is called by an operation thread when it is about to terminate.
- * At this point, any operation or file transfer data structs have already been freed;
- * this only frees the thread args struct, releases the connection slot, and detaches the thread.
+ * Blocks the dispatcher until at least one connection slot is free,
+ * or until the (monotonic clock) deadline passes.
+ * Returns whether a slot is free.
+ */
+static bool server_wait_for_free_slot(ServerSlots_t *data, const struct timespec *deadline)
+{
+    if (__atomic_load_n(&data->free_slots_count, __ATOMIC_ACQUIRE) > 0)
+    {
+        return true;
+    }
+
+    pthread_mutex_lock(&data->wakeup_mutex);
+
+    // announce waiting before checking the count again, while releasing threads increment the count before checking
+    // for a waiter, so that a slot released in between is never missed by both sides
+    __atomic_store_n(&data->dispatcher_waiting, true, __ATOMIC_SEQ_CST);
+
+    while (__atomic_load_n(&data->free_slots_count, __ATOMIC_SEQ_CST) <= 0 && !should_terminate)
+    {
+        if (pthread_cond_timedwait(&data->slot_released, &data->wakeup_mutex, deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+
+    __atomic_store_n(&data->dispatcher_waiting, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&data->wakeup_mutex);
+    return __atomic_load_n(&data->free_slots_count, __ATOMIC_ACQUIRE) > 0;
+}
+
+/**
+ * This function is called by a pool worker when it is done with an operation.
+ * At this point, any operation or file transfer data structs have already been released;
+ * this only clears the slot data and releases the connection slot.
  */
 static void server_task_release(ServerTaskArgs_t *task_args)
 {
-    printf("[Slot #%d] Terminating thread...\n", task_args->task_slot_idx);
-    pthread_detach(pthread_self());
+    LOG_INFO("[Slot #%d] Operation task finished.\n", task_args->task_slot_idx);
+    task_args->slots->slot_data[task_args->task_slot_idx].op_data_ptr = NULL;
+    task_args->slots->slot_data[task_args->task_slot_idx].tx_data_ptr = NULL;
     server_release_connection_slot(task_args->slots, task_args->task_slot_idx);
-    free(task_args);
 }
 
 /**
- * This function implements an ephemeral server operation thread,
+ * This function implements a single server operation task, run by a pool worker,
  * which interfaces with the common TFTP functions to handle an entire client-requested operation,
  * and subsequently cleans up its own data and releases its own server slot.
+ * File transfers borrow the worker's packet buffers rather than allocating their own.
  */
-static void* server_task_start(void *args)
+static void server_task_run(void *job, ServerPoolWorker_t *worker)
 {
-    ServerTaskArgs_t *task_args = (ServerTaskArgs_t *)args;
-    OperationData_t *op_data = task_args->slots->slot_data[task_args->task_slot_idx].op_data_ptr;
-    TransferData_t *tx_data = task_args->slots->slot_data[task_args->task_slot_idx].tx_data_ptr;
+    ServerTaskArgs_t *task_args = (ServerTaskArgs_t *)job;
+    ServerRequest_t *request = &task_args->request;
+    OperationData_t *op_data = NULL;
+    TransferData_t tx_data;
 
     if (should_terminate)
     {
-        printf("[Slot #%d] User requested termination - aborting.\n", task_args->task_slot_idx);
+        LOG_INFO("[Slot #%d] User requested termination - aborting.\n", task_args->task_slot_idx);
         server_task_release(task_args);
-        pthread_exit(NULL);
+        return;
+    }
+
+    // the request's fields are NUL-separated, which would cut the log line short
+    char request_contents[SERVER_REQUEST_BUFFER_SIZE + 1];
+    size_t contents_offset = offsetof(Packet_t, request.contents);
+    size_t contents_length = request->bytes_received - contents_offset;
+
+    for (size_t i = 0; i < contents_length; i++)
+    {
+        char c = request->packet_buffer[contents_offset + i];
+        request_contents[i] = c == '\0' ? ' ' : c;
+    }
+
+    request_contents[contents_length] = '\0';
+    LOG_INFO("[Slot #%d] Operation task started on worker #%u, %.2fms after request was received. Request contents: %s\n",
+            task_args->task_slot_idx, worker->worker_idx, seconds_since_clock(request->received_clock) * 1000, request_contents);
+
+    // request parsing and data socket setup happen here rather than on the listener thread,
+    // so that the listener is free to receive the next request in the meantime
+    op_data = server_parse_request_data((Packet_t *)request->packet_buffer, request->bytes_received, request->client_address);
+
+    if (op_data == NULL)
+    {
+        LOG_INFO("[Slot #%d] Operation data null - aborting.\n", task_args->task_slot_idx);
+        server_task_release(task_args);
+        return;
     }
 
-    printf("[Slot #%d] Operation task started.\n", task_args->task_slot_idx);
+    task_args->slots->slot_data[task_args->task_slot_idx].op_data_ptr = op_data;
+    LOG_DEBUG("[Slot #%d] Request parsed successfully.\n", task_args->task_slot_idx);
 
     switch(op_data->operation_id)
     {
         case TFTP_OPERATION_RECEIVE:
-            tx_data = malloc(sizeof(TransferData_t));
-            if (tftp_fill_transfer_data(op_data, tx_data, true)
-                // acknowledge request
-                && tftp_send_ack(0, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length))
+            task_args->slots->slot_data[task_args->task_slot_idx].tx_data_ptr = &tx_data;
+            if (tftp_fill_transfer_data(op_data, &tx_data, true, &worker->buffers)
+                // acknowledge request, or its options
+                && tftp_acknowledge_request(op_data))
             {
                 // receive file
-                if (false == tftp_receive_file(op_data, tx_data))
+                if (false == tftp_receive_file(op_data, &tx_data))
                 {
                     // if failed during transfer, nullify file handle and delete incomplete file
-                    printf("[Slot #%d] Deleting partial download.\n", task_args->task_slot_idx);
-                    fclose(tx_data->file);
-                    tx_data->file = NULL;
+                    LOG_INFO("[Slot #%d] Deleting partial download.\n", task_args->task_slot_idx);
+                    fclose(tx_data.file);
+                    tx_data.file = NULL;
                     remove(op_data->path);
                 }
             }
-            tftp_free_transfer_data(tx_data);
+            tftp_release_transfer_data(&tx_data);
             break;
         case TFTP_OPERATION_SEND:
-            tx_data = malloc(sizeof(TransferData_t));
-            if(tftp_fill_transfer_data(op_data, tx_data, false))
+            // a multicast read is handed over to the session sending the file to its group, along with its operation data
+            if ((op_data->option_flags & TFTP_OPTION_MULTICAST) && server_multicast_join(op_data))
+            {
+                server_task_release(task_args);
+                return;
+            }
+
+            task_args->slots->slot_data[task_args->task_slot_idx].tx_data_ptr = &tx_data;
+            if(tftp_fill_transfer_data(op_data, &tx_data, false, &worker->buffers))
             {
                 // send file
-                tftp_transmit_file(op_data, tx_data);
+                tftp_transmit_file(op_data, &tx_data);
             }
-            tftp_free_transfer_data(tx_data);
+            tftp_release_transfer_data(&tx_data);
             break;
         case TFTP_OPERATION_HANDLE_DELETE:
             server_delete_file(op_data);
@@ -174,26 +615,25 @@ static void* server_task_start(void *args)
 
     tftp_free_operation_data(op_data);
     server_task_release(task_args);
-    pthread_exit(NULL);
 }
 
 /**
  * Parses a received packet buffer into its individual fields
  * which are then passed to tftp_init_operation_data() to eventually
  * return a usable OperationData_t structure.
+ * Requests with malformed option fields are dismissed, the same as unknown request types.
  */
-static OperationData_t* server_parse_request_data(ServerListenerData_t *data)
+OperationData_t* server_parse_request_data(Packet_t *request_packet, ssize_t bytes_received, struct sockaddr_in client_address)
 {
     char file_path[TFTP_FILENAME_MAX * 2] = SERVER_STORAGE_PATH;
     char *mode_string = NULL;
-    char *blksize_string = NULL;
-    char *blksize_octets_string = NULL;
+    TFTPOptionList_t options = { .count = 0 };
     OperationId_t op_id = TFTP_OPERATION_UNDEFINED;
 
     // extract request strings
-    strncat(file_path, data->request_buffer->request.contents, TFTP_FILENAME_MAX);
+    strncat(file_path, request_packet->request.contents, TFTP_FILENAME_MAX);
 
-    switch(ntohs(data->request_buffer->opcode))
+    switch(ntohs(request_packet->opcode))
     {
         case TFTP_RRQ:
             op_id = TFTP_OPERATION_SEND;
@@ -210,24 +650,30 @@ static OperationData_t* server_parse_request_data(ServerListenerData_t *data)
 
     if (op_id != TFTP_OPERATION_HANDLE_DELETE)
     {
-        int contents_index = strlen(data->request_buffer->request.contents) + 1;
-        mode_string = data->request_buffer->request.contents + contents_index;
-
-        if ((contents_index + 4) < data->bytes_received)
+        // the contents are terminated right behind the received bytes, so the leading fields can be measured safely
+        int contents_length = bytes_received - sizeof(request_packet->opcode);
+        int contents_index = strlen(request_packet->request.contents) + 1;
+        mode_string = request_packet->request.contents + (contents_index < contents_length ? contents_index : contents_length);
+        contents_index += strlen(mode_string) + 1;
+
+        // any remaining fields are option name & value pairs, in no particular order
+        if (contents_index < contents_length
+            && !tftp_parse_options(request_packet->request.contents + contents_index, contents_length - contents_index, &options))
         {
-            contents_index += strlen(mode_string) + 1;
-            blksize_string = data->request_buffer->request.contents + contents_index;
-
-            if ((strcasecmp(blksize_string, TFTP_BLKSIZE_STRING) == 0)
-                && (contents_index + 4 < data->bytes_received))
-            {
-                contents_index += strlen(blksize_string) + 1;
-                blksize_octets_string = data->request_buffer->request.contents + contents_index;
-            }
+            LOG_INFO("Dismissing request with malformed options.\n");
+            return NULL;
         }
     }
 
-    return tftp_init_operation_data(op_id, data->client_address, file_path, mode_string, blksize_octets_string);
+    OperationData_t *op_data = tftp_init_operation_data(op_id, client_address, file_path, mode_string, &options);
+
+    // multicast only applies to reads, and only if the server has groups to send them to
+    if (op_data != NULL && (op_id != TFTP_OPERATION_SEND || server_config.multicast_group.s_addr == INADDR_ANY))
+    {
+        op_data->option_flags &= ~TFTP_OPTION_MULTICAST;
+    }
+
+    return op_data;
 }
 
 /**
@@ -235,7 +681,7 @@ static OperationData_t* server_parse_request_data(ServerListenerData_t *data)
  * temporary incoming data before it is processed further,
  * as well as the handle for the requests socket.
  */
-static bool server_init_listener_data(ServerListenerData_t *data)
+bool server_init_listener_data(ServerListenerData_t *data)
 {
     static const int reuse_flag = 1;
 
@@ -243,25 +689,25 @@ static bool server_init_listener_data(ServerListenerData_t *data)
 
     if (data->requests_socket < 0)
     {
-        perror("Failed to create requests socket");
+        LOG_ERRNO("Failed to create requests socket");
         return false;
     }
 
     if(0 > setsockopt(data->requests_socket, SOL_SOCKET, SO_REUSEADDR,  &reuse_flag, sizeof(reuse_flag)))
     {
-        perror("Failed to set socket 'reuse address' option");
+        LOG_ERRNO("Failed to set socket 'reuse address' option");
         return false;
     }
 
     if(0 > setsockopt(data->requests_socket, SOL_SOCKET, SO_REUSEPORT,  &reuse_flag, sizeof(reuse_flag)))
     {
-        perror("Failed to set socket 'reuse port' option");
+        LOG_ERRNO("Failed to set socket 'reuse port' option");
         return false;
     }
 
     data->requests_address.sin_family = AF_INET;
     data->requests_address.sin_addr.s_addr = INADDR_ANY;
-    data->requests_address.sin_port = htons(69);
+    data->requests_address.sin_port = htons(tftp_common.requests_port);
 
     data->client_address.sin_family = AF_INET;
     data->client_address_length = sizeof(data->client_address);
@@ -270,159 +716,378 @@ static bool server_init_listener_data(ServerListenerData_t *data)
 
     if (bind_result < 0)
     {
-        perror("Could not bind requests socket");
+        LOG_ERRNO("Could not bind requests socket");
         return false;
     }
 
-    data->buffer_size = sizeof(Packet_t) + TFTP_FILENAME_MAX * 2;
-    data->request_buffer = malloc(data->buffer_size);
+    // every slot has one byte more than is ever received, to terminate the request strings
+    data->buffer_size = SERVER_REQUEST_BUFFER_SIZE;
+    data->batch_buffer = malloc((data->buffer_size + 1) * SERVER_LISTENER_BATCH_SIZE);
 
-    if (data->request_buffer == NULL)
+    if (data->batch_buffer == NULL)
     {
-        perror("Failed to allocate buffer for incoming requests");
+        LOG_ERRNO("Failed to allocate buffer for incoming requests");
         return false;
     }
 
-    explicit_bzero(data->request_buffer, data->buffer_size);
+    explicit_bzero(data->batch_buffer, (data->buffer_size + 1) * SERVER_LISTENER_BATCH_SIZE);
+    data->request_buffer = (Packet_t *)data->batch_buffer;
     return true;
 }
 
-static void server_deinit_listener_data(ServerListenerData_t *data)
+void server_deinit_listener_data(ServerListenerData_t *data)
 {
     close(data->requests_socket);
-    explicit_bzero(data->request_buffer, data->buffer_size);
-    free(data->request_buffer);
+    explicit_bzero(data->batch_buffer, (data->buffer_size + 1) * SERVER_LISTENER_BATCH_SIZE);
+    free(data->batch_buffer);
     explicit_bzero(data, sizeof(ServerListenerData_t));
 }
 
+/**
+ * Hands out the next request received at the requests socket, receiving a new batch of up to max_count of them
+ * with a single recvmmsg() call once the previous batch is used up. Only the first request of a batch is waited for,
+ * and only if the socket is blocking. The sizes of all batches are recorded in the listener's histogram.
+ * Points request_buffer at the request and fills in its size and client address.
+ * Returns the size of the request, or -1 with errno set by recvmmsg() if nothing could be received.
+ */
+ssize_t server_listener_receive(ServerListenerData_t *listener, uint16_t max_count)
+{
+    size_t slot_size = listener->buffer_size + 1;
+
+    if (listener->batch_next >= listener->batch_count)
+    {
+        struct mmsghdr messages[SERVER_LISTENER_BATCH_SIZE];
+        struct iovec iovecs[SERVER_LISTENER_BATCH_SIZE];
+
+        if (max_count > SERVER_LISTENER_BATCH_SIZE)
+        {
+            max_count = SERVER_LISTENER_BATCH_SIZE;
+        }
+
+        explicit_bzero(messages, sizeof(struct mmsghdr) * max_count);
+
+        for (uint16_t i = 0; i < max_count; i++)
+        {
+            iovecs[i].iov_base = listener->batch_buffer + i * slot_size;
+            iovecs[i].iov_len = listener->buffer_size;
+            messages[i].msg_hdr.msg_name = &listener->batch_addresses[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(listener->batch_addresses[i]);
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int received = recvmmsg(listener->requests_socket, messages, max_count, MSG_WAITFORONE, NULL);
+        listener->batch_next = 0;
+        listener->batch_count = 0;
+
+        if (received <= 0)
+        {
+            listener->bytes_received = -1;
+            return -1;
+        }
+
+        log2_histogram_add(&listener->batch_histogram, received);
+        listener->batch_count = received;
+
+        for (int i = 0; i < received; i++)
+        {
+            listener->batch_lengths[i] = messages[i].msg_len;
+            listener->batch_buffer[i * slot_size + messages[i].msg_len] = 0;
+        }
+    }
+
+    uint16_t request_idx = listener->batch_next++;
+    listener->request_buffer = (Packet_t *)(listener->batch_buffer + request_idx * slot_size);
+    listener->bytes_received = listener->batch_lengths[request_idx];
+    listener->client_address = listener->batch_addresses[request_idx];
+    listener->client_address_length = sizeof(listener->client_address);
+
+    return listener->bytes_received;
+}
+
+/**
+ * Counts a packet received on a requests socket by its opcode, for the metrics endpoint.
+ */
+void server_count_request(uint16_t opcode)
+{
+    switch (opcode)
+    {
+        case TFTP_RRQ:
+            METRICS_ADD(read_requests, 1);
+            break;
+        case TFTP_WRQ:
+            METRICS_ADD(write_requests, 1);
+            break;
+        case TFTP_DRQ:
+            METRICS_ADD(delete_requests, 1);
+            break;
+        default:
+            METRICS_ADD(invalid_requests, 1);
+            break;
+    }
+}
+
+/**
+ * Answers the request currently held by the listener right away, if the storage index already tells how it ends:
+ * reads and deletes of missing files, and writes of existing ones, are refused from the requests socket,
+ * without the request ever being parsed, queued or given a data socket.
+ * Returns false if the request is to be served as usual.
+ */
+bool server_answer_from_index(ServerListenerData_t *listener)
+{
+    const char *filename = listener->request_buffer->request.contents;
+    ServerIndexEntry_t entry;
+
+    // requests are terminated right behind the received bytes, but names too long to be served whole are left to the usual path
+    if (strnlen(filename, TFTP_FILENAME_MAX + 1) > TFTP_FILENAME_MAX)
+    {
+        return false;
+    }
+
+    switch (server_index_lookup(filename, &entry))
+    {
+        case SERVER_INDEX_MISSING:
+            if (listener->incoming_opcode == TFTP_WRQ)
+            {
+                return false;
+            }
+
+            LOG_INFO("Requested file not found: %s\n", filename);
+            tftp_send_error(TFTP_ERROR_FILE_NOT_FOUND, "file not found: ", filename, listener->requests_socket, &listener->client_address, listener->client_address_length);
+            METRICS_ADD(requests_answered_from_index, 1);
+            return true;
+        case SERVER_INDEX_FOUND:
+            if (listener->incoming_opcode != TFTP_WRQ)
+            {
+                return false;
+            }
+
+            char timestamp[32];
+            struct tm tm;
+            localtime_r(&entry.change_time.tv_sec, &tm);
+            strftime(timestamp, 32, "%Y-%m-%d %H:%M:%S.", &tm);
+
+            LOG_INFO("Refusing write request, file already exists since %s\n", timestamp);
+            tftp_send_error(TFTP_ERROR_FILE_EXISTS, "File already exists! To overwrite, request deletion then try again. Creation date: ", timestamp,
+                listener->requests_socket, &listener->client_address, listener->client_address_length);
+            METRICS_ADD(requests_answered_from_index, 1);
+            return true;
+        case SERVER_INDEX_UNKNOWN:
+            break;
+    }
+
+    return false;
+}
+
 /**
  * Initializes the data structure responsible for
- * tracking all concurrent server operations.
+ * tracking all concurrent server operations, sized to the configured slot count.
+ * Bitmap bits past the slot count are marked as permanently occupied.
  */
-static void server_init_slots_data(ServerSlots_t *data)
+static bool server_init_slots_data(ServerSlots_t *data, uint32_t capacity)
 {
-    // initialize client slots data
-    data->free_slots_count = SERVER_MAX_CONNECTIONS;
-    pthread_mutex_init(&data->slots_mutex, NULL);
+    data->capacity = capacity;
+    data->bitmap_words_count = (capacity + 63) / 64;
+    data->free_slots_count = capacity;
+    data->next_search_word = 0;
+    data->dispatcher_waiting = false;
 
-    for (int i = 0; i < SERVER_MAX_CONNECTIONS; i++)
+    data->occupied_bitmap = malloc(sizeof(uint64_t) * data->bitmap_words_count);
+    data->slot_data = malloc(sizeof(ServerSlotData_t) * capacity);
+
+    if (data->occupied_bitmap == NULL || data->slot_data == NULL)
     {
-        data->slot_thread_handles[i] = 0;
-        data->slot_occupied_flags[i] = false;
-        data->slot_data[i].op_data_ptr = NULL;
-        data->slot_data[i].tx_data_ptr = NULL;
+        LOG_ERRNO("Failed to allocate connection slots");
+        free(data->occupied_bitmap);
+        free(data->slot_data);
+        return false;
     }
+
+    explicit_bzero(data->occupied_bitmap, sizeof(uint64_t) * data->bitmap_words_count);
+    explicit_bzero(data->slot_data, sizeof(ServerSlotData_t) * capacity);
+
+    if (capacity % 64 != 0)
+    {
+        data->occupied_bitmap[data->bitmap_words_count - 1] = ~0ULL << (capacity % 64);
+    }
+
+    pthread_mutex_init(&data->wakeup_mutex, NULL);
+
+    pthread_condattr_t condition_attributes;
+    pthread_condattr_init(&condition_attributes);
+    pthread_condattr_setclock(&condition_attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&data->slot_released, &condition_attributes);
+    pthread_condattr_destroy(&condition_attributes);
+
+    return true;
 }
 
 static void server_deinit_slots_data(ServerSlots_t *data)
 {
-    pthread_mutex_destroy(&data->slots_mutex);
+    pthread_mutex_destroy(&data->wakeup_mutex);
+    pthread_cond_destroy(&data->slot_released);
+    free(data->occupied_bitmap);
+    free(data->slot_data);
     explicit_bzero(data, sizeof(ServerSlots_t));
 }
 
 /**
- * This function is called by the listener thread,
- * and handles an incoming request in three stages:
+ * This function is called by the dispatcher thread,
+ * and hands a queued request over to the worker pool in two stages:
  * 1. Attempts to acquire a free connection slot.
- * 2. Parses the request into an OperationData_t structure.
- * 3. Creates a new operation thread to handle the actual operation.
+ * 2. Submits a task to the pool, for a worker to parse the request and handle the actual operation.
+ * The pool has as many workers and queued task entries as there are slots, so a slot always finds a worker.
  */
-static void server_try_create_operation_thread(ServerListenerData_t *listener, ServerSlots_t *slots)
+static void server_try_dispatch_task(ServerData_t *data, ServerRequest_t *request)
 {
-    int acquired_slot_idx = server_acquire_connection_slot(slots);
+    int acquired_slot_idx = server_acquire_connection_slot(&data->slots);
 
     if (acquired_slot_idx == -1)
     {
-        printf("Rejecting request - exceeded max connection count.\n");
+        LOG_INFO("Rejecting request - exceeded max connection count.\n");
+        METRICS_ADD(requests_rejected_busy, 1);
         tftp_send_error(TFTP_ERROR_OUT_OF_SPACE, "Server exceeded maximal connection count. Try again later!",
-            NULL, listener->requests_socket, &(listener->client_address), listener->client_address_length);
+            NULL, data->listener.requests_socket, &(request->client_address), request->client_address_length);
+        return;
     }
-    else
+
+    LOG_INFO("[Slot #%d] Accepted request and assigned connection slot, submitting operation task.\n", acquired_slot_idx);
+
+    ServerTaskArgs_t task_args;
+    task_args.task_slot_idx = acquired_slot_idx;
+    task_args.slots = &data->slots;
+    task_args.request = *request;
+
+    if (!server_pool_submit(&data->pool, &task_args))
     {
-        printf("[Slot #%d] Accepted request and assigned connection slot.\n", acquired_slot_idx);
+        LOG_ERROR("[Slot #%d] Failed to submit operation task.\n", acquired_slot_idx);
+        tftp_send_error(TFTP_ERROR_OUT_OF_SPACE, "Server failed to start operation. Try again later!",
+            NULL, data->listener.requests_socket, &(request->client_address), request->client_address_length);
+        server_release_connection_slot(&data->slots, acquired_slot_idx);
+    }
+}
 
-        OperationData_t *new_op_data_ptr = server_parse_request_data(listener);
+/**
+ * The dispatcher thread admits requests off the queue filled by the listener thread,
+ * in the order set by the admission policy, and hands each of them to the worker pool.
+ * Rather than rejecting requests outright when all slots are busy, it applies backpressure:
+ * a request is only admitted once a slot frees up, and rejected once it has waited longer than allowed.
+ * It terminates once the listener closes the queue.
+ */
+static void* server_dispatcher_start(void *args)
+{
+    ServerData_t *data = (ServerData_t *)args;
+    ServerRequest_t request;
+    struct timespec deadline;
 
-        if (new_op_data_ptr == NULL)
+    while (!server_queue_is_closed(&data->requests))
+    {
+        while (server_queue_pop_expired(&data->requests, &request))
         {
-            printf("[Slot #%d] Operation data null - aborting.\n", acquired_slot_idx);
-            server_release_connection_slot(slots, acquired_slot_idx);
+            LOG_INFO("Rejecting request - timed out waiting for a free connection slot.\n");
+            METRICS_ADD(requests_rejected_timed_out, 1);
+            tftp_send_error(TFTP_ERROR_OUT_OF_SPACE, "Server is busy, request timed out waiting in queue. Try again later!",
+                NULL, data->listener.requests_socket, &request.client_address, request.client_address_length);
         }
-        else
-        {
-            printf("[Slot #%d] Request parsed successfully, starting operation thread.\n", acquired_slot_idx);
-            slots->slot_data[acquired_slot_idx].op_data_ptr = new_op_data_ptr;
 
-            ServerTaskArgs_t *task_args = malloc(sizeof(ServerTaskArgs_t));
+        if (should_report_statistics)
+        {
+            should_report_statistics = false;
+            server_queue_print_statistics(&data->requests);
+            file_cache_print_counters();
+            server_index_print_counters();
+        }
 
-            task_args->task_slot_idx = acquired_slot_idx;
-            task_args->slots = slots;
+        // wake up no later than the oldest queued request expires
+        server_queue_next_deadline(&data->requests, &deadline, SERVER_DISPATCHER_MAX_WAIT_MS);
 
-            pthread_create(&(slots->slot_thread_handles[acquired_slot_idx]), NULL, server_task_start, task_args);
+        if (server_wait_for_free_slot(&data->slots, &deadline)
+            && server_queue_pop(&data->requests, &request, &deadline))
+        {
+            server_try_dispatch_task(data, &request);
         }
     }
+
+    LOG_INFO("Server dispatcher terminated.\n");
+    return NULL;
 }
 
 /**
- * The listener loop function awaits request packets at the TFTP requests port 69.
- * Valid request packets are parsed, assigned a server slot, and handed to a new operation thread.
- * Invalid packets are answered with an error packet and dismissed.
+ * The listener loop function awaits request packets at the TFTP requests port (69, unless configured otherwise).
+ * Its only job is to receive, classify and enqueue, so that it gets back to receiving as soon as possible:
+ * valid request packets are enqueued for the dispatcher thread as they are, without being parsed.
+ * Invalid packets, and requests that find the queue full, are answered with an error and dismissed.
  * The "should_terminate" flag may be set by an OS termination signal to allow graceful termination.
  */
-static void server_listener_loop(ServerListenerData_t *listener, ServerSlots_t *slots)
+static void server_listener_loop(ServerListenerData_t *listener, ServerRequestQueue_t *requests)
 {
     static const char *received_packet_message_format = "Received %s packet in requests socket.\n";
 
     while(!should_terminate)
     {
-        printf("Awaiting requests.\n");
-
-        listener->bytes_received = recvfrom(listener->requests_socket, listener->request_buffer, listener->buffer_size, 0, (struct sockaddr*)&(listener->client_address), &(listener->client_address_length));
+        server_listener_receive(listener, SERVER_LISTENER_BATCH_SIZE);
 
         if (should_terminate) break;
 
         if(listener->bytes_received < 0)
         {
             // TODO: extract error handling function plz
-            perror("Failed to receive bytes");
+            LOG_ERRNO("Failed to receive bytes");
             continue;
         }
-        else if (listener->bytes_received == 0)
+        else if (listener->bytes_received < (ssize_t)sizeof(listener->request_buffer->opcode))
         {
-            printf("Received zero bytes.\n");
+            LOG_INFO("Received runt packet in requests socket.\n");
             continue;
         }
 
-        printf("Received %lu bytes. Contents:\n", listener->bytes_received);
-        fwrite(listener->request_buffer->request.contents, sizeof(char), listener->bytes_received, stdout);
-        printf("\n");
-
         listener->incoming_opcode = ntohs(listener->request_buffer->opcode);
+        server_count_request(listener->incoming_opcode);
 
         switch (listener->incoming_opcode)
         {
-            // *** Invalid (non-request) opcodes: send an error and move on
-            case TFTP_DATA:
-            case TFTP_ACK:
-            case TFTP_ERROR:
-            default:
-                fprintf(stderr, received_packet_message_format, tftp_common.opcode_strings[listener->incoming_opcode]);
-                tftp_send_error(TFTP_ERROR_ILLEGAL_OPERATION, "received packet in requests socket with opcode ", tftp_common.opcode_strings[listener->incoming_opcode], listener->requests_socket, &listener->client_address, listener->client_address_length); 
-                break;
-            // *** Standard request opcodes: parse and begin operation
+            // *** Standard request opcodes: enqueue for the dispatcher
             case TFTP_RRQ:
             case TFTP_WRQ:
             case TFTP_DRQ:
-                printf(received_packet_message_format, tftp_common.opcode_strings[listener->incoming_opcode]);
-                server_try_create_operation_thread(listener, slots);
+                LOG_INFO(received_packet_message_format, tftp_common.opcode_strings[listener->incoming_opcode]);
+
+                if (server_answer_from_index(listener))
+                {
+                    break;
+                }
+
+                switch (server_queue_push(requests, listener->request_buffer, listener->bytes_received, &listener->client_address, listener->client_address_length))
+                {
+                    case SERVER_QUEUE_FULL:
+                        LOG_INFO("Rejecting request - request queue is full.\n");
+                        METRICS_ADD(requests_rejected_busy, 1);
+                        tftp_send_error(TFTP_ERROR_OUT_OF_SPACE, "Server request queue is full. Try again later!",
+                            NULL, listener->requests_socket, &listener->client_address, listener->client_address_length);
+                        break;
+                    case SERVER_QUEUE_DUPLICATE:
+                        // the client retransmitted a request that is still waiting in the queue
+                        LOG_INFO("Dropping duplicate of a queued request.\n");
+                        break;
+                    case SERVER_QUEUE_PUSHED:
+                    case SERVER_QUEUE_CLOSED:
+                        break;
+                }
                 break;
-        }
+            // *** Invalid (non-request) opcodes: send an error and move on
+            default:
+                if (listener->incoming_opcode >= TFTP_OPCODES_COUNT)
+                {
+                    listener->incoming_opcode = TFTP_NONE;
+                }
 
-        // buffer was used in this iteration - clear it to zero
-        explicit_bzero(listener->request_buffer, listener->buffer_size);
+                LOG_WARN(received_packet_message_format, tftp_common.opcode_strings[listener->incoming_opcode]);
+                tftp_send_error(TFTP_ERROR_ILLEGAL_OPERATION, "received packet in requests socket with opcode ", tftp_common.opcode_strings[listener->incoming_opcode], listener->requests_socket, &listener->client_address, listener->client_address_length); 
+                break;
+        }
     }
 
-    printf("\nServer listener loop terminated.\n");
+    LOG_INFO("Server listener loop terminated.\n");
 }
 
 /**
@@ -435,51 +1100,136 @@ static ServerData_t* server_init_data(void)
 
     if (!server_init_listener_data(&data->listener))
     {
-        printf("Failed to initialize server.\nDeallocating...\n");
+        LOG_ERROR("Failed to initialize server.\nDeallocating...\n");
         free(data);
         return NULL;
     }
 
-    server_init_slots_data(&data->slots);
+    if (!server_queue_init(&data->requests, server_config.queue_capacity, server_config.queue_max_wait_ms, server_config.admission_policy))
+    {
+        LOG_ERROR("Failed to initialize server.\nDeallocating...\n");
+        server_deinit_listener_data(&data->listener);
+        free(data);
+        return NULL;
+    }
+
+    if (!server_init_slots_data(&data->slots, server_config.slots_count))
+    {
+        LOG_ERROR("Failed to initialize server.\nDeallocating...\n");
+        server_queue_deinit(&data->requests);
+        server_deinit_listener_data(&data->listener);
+        free(data);
+        return NULL;
+    }
+
+    if (!server_pool_init(&data->pool, server_config.slots_count, server_config.slots_count, sizeof(ServerTaskArgs_t), server_task_run))
+    {
+        LOG_ERROR("Failed to initialize server.\nDeallocating...\n");
+        server_deinit_slots_data(&data->slots);
+        server_queue_deinit(&data->requests);
+        server_deinit_listener_data(&data->listener);
+        free(data);
+        return NULL;
+    }
 
     return data;
 }
 
 /**
- * Entry point for the TFTP server.
- * Initializes the server state and launches the listener loop function.
- * When the listener loop function returns, it cleans up the server data and returns to main.
+ * Runs the thread-per-operation server:
+ * a single listener thread enqueues incoming requests,
+ * and a dispatcher thread hands each of them to a pool worker thread.
  */
-void server_start(void)
+static void server_threads_run(void)
 {
+    server_raise_file_limit(server_config.slots_count);
+    metrics_set_session_capacity(server_config.slots_count);
     ServerData_t *data = server_init_data();
 
     if (data == NULL)
     {
-        printf("Server initialization failed! Terminating.\n");
+        LOG_ERROR("Server initialization failed! Terminating.\n");
         return;
     }
 
-    if (server_init_storage_location())
+    if (0 == pthread_create(&data->dispatcher_thread, NULL, server_dispatcher_start, data))
     {
-        server_listener_loop(&data->listener, &data->slots);
-
-        // Listener terminated - checking and waiting for any possibly lingering threads
-        printf("Awaiting termination of lingering threads...\n");
-
-        for (int i = 0; i < SERVER_MAX_CONNECTIONS; i++)
-        {
-            pthread_join(data->slots.slot_thread_handles[i], NULL);
-        }
+        LOG_INFO("Awaiting requests.\n");
+        server_listener_loop(&data->listener, &data->requests);
+        server_queue_close(&data->requests);
+        pthread_join(data->dispatcher_thread, NULL);
+        server_queue_print_statistics(&data->requests);
+        log2_histogram_print(&data->listener.batch_histogram, "Requests received per listener batch", "requests");
+    }
+    else
+    {
+        LOG_ERRNO("Failed to start dispatcher thread");
     }
 
+    // Listener terminated - waiting for pool workers to finish their current operations
+    LOG_INFO("Awaiting termination of pool workers...\n");
+    server_pool_shutdown(&data->pool);
+
     // Explicitly blanking and releasing all server data before returning to main.
     // Probably insignificant but seems like a good practice.
-    printf("Deallocating server data.\n");
+    LOG_INFO("Deallocating server data.\n");
     server_deinit_listener_data(&data->listener);
+    server_queue_deinit(&data->requests);
     server_deinit_slots_data(&data->slots);
     explicit_bzero(data, sizeof(ServerData_t));
     free(data);
+}
+
+/**
+ * Entry point for the TFTP server.
+ * Parses the server options, ensures the storage location exists,
+ * and runs the server in the configured mode until it is terminated.
+ */
+void server_start(int argc, char *argv[])
+{
+    if (!server_parse_config(argc, argv))
+    {
+        server_print_config_usage();
+        LOG_ERROR("Server initialization failed! Terminating.\n");
+        return;
+    }
+
+    if (!server_init_storage_location())
+    {
+        LOG_ERROR("Server initialization failed! Terminating.\n");
+        return;
+    }
+
+    log_start();
+    file_cache_init((uint64_t)server_config.cache_budget_mb << 20);
+
+    if (server_config.storage_index)
+    {
+        server_index_init(SERVER_STORAGE_PATH);
+    }
+
+    if (server_config.metrics_endpoint != NULL)
+    {
+        server_metrics_start(server_config.metrics_endpoint);
+    }
+
+    if (server_config.mode == SERVER_MODE_EVENTS)
+    {
+        server_events_run();
+    }
+    else
+    {
+        server_threads_run();
+    }
+
+    server_multicast_shutdown();
+    file_cache_print_counters();
+    file_cache_deinit();
+    server_index_print_counters();
+    server_index_shutdown();
+    server_metrics_shutdown();
+    impair_stop();
 
-    printf("Server terminating.\n");
+    LOG_INFO("Server terminating.\n");
+    log_stop();
 }
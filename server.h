@@ -4,9 +4,50 @@
 #include "common.h"
 #include "networking_common.h"
 #include "tftp_common.h"
+#include "server_queue.h"
+#include "server_pool.h"
+#include "server_multicast.h"
+#include "server_index.h"
+#include "server_metrics.h"
+#include "impair.h"
 
 #define SERVER_STORAGE_PATH "storage/"
 #define SERVER_MAX_CONNECTIONS 5
+#define SERVER_SLOTS_MAX 65536
+#define SERVER_EVENTS_MAX_SESSIONS_DEFAULT 4096
+#define SERVER_EVENTS_MAX_WORKERS 256
+#define SERVER_DISPATCHER_MAX_WAIT_MS 100
+#define SERVER_LISTENER_BATCH_SIZE 32
+#define SERVER_CACHE_BUDGET_MB_MAX 1048576
+
+/**
+ * Selects how the server runs client-requested operations:
+ * either one thread per operation, or many non-blocking sessions multiplexed by an epoll event loop.
+ */
+typedef enum ServerMode
+{
+    SERVER_MODE_THREADS = 0,
+    SERVER_MODE_EVENTS = 1,
+} ServerMode_t;
+
+/**
+ * Server settings, parsed from the optional "name=value" arguments of the "serve" operation mode.
+ */
+typedef struct ServerConfig
+{
+    ServerMode_t mode;
+    ServerAdmissionPolicy_t admission_policy;
+    uint32_t max_sessions;
+    uint32_t slots_count;
+    uint32_t queue_capacity;
+    uint32_t queue_max_wait_ms;
+    uint16_t workers_count;
+    uint16_t multicast_port;
+    struct in_addr multicast_group; // the first group of multicast sessions, or none at all to serve every read as unicast
+    uint32_t cache_budget_mb; // of the file cache shared by all sessions, disabled if 0
+    bool storage_index; // answer requests for missing (or, for writes, existing) files from an index of the storage directory
+    const char *metrics_endpoint; // a Unix socket path or a localhost TCP port to serve metrics on, or none at all
+} ServerConfig_t;
 
 /**
  * Holds pointers to operation-relevant structs
@@ -19,21 +60,31 @@ typedef struct ServerSlotData
 } ServerSlotData_t;
 
 /**
- * Shared between the listener thread and operation threads, via mutex.
- * Used to track concurrent operations.
+ * Shared between the dispatcher thread and operation threads, without locking.
+ * Used to track concurrent operations, up to a capacity set at startup.
+ * Slot occupancy is an atomic bitmap, and the free slots count is updated atomically as well,
+ * so acquiring and releasing a slot never contend on a lock.
+ * The mutex and condition variable only serve to wake up the dispatcher when it waits for a slot to be released,
+ * and are only touched by releasing threads while the dispatcher is actually waiting.
  */
 typedef struct ServerSlots
 {
-    int free_slots_count;
-    pthread_mutex_t slots_mutex;
-    bool slot_occupied_flags[SERVER_MAX_CONNECTIONS];
-    pthread_t slot_thread_handles[SERVER_MAX_CONNECTIONS];
-    ServerSlotData_t slot_data[SERVER_MAX_CONNECTIONS];
+    uint32_t capacity;
+    uint32_t bitmap_words_count;
+    int32_t free_slots_count;
+    uint32_t next_search_word;
+    bool dispatcher_waiting;
+    pthread_mutex_t wakeup_mutex;
+    pthread_cond_t slot_released;
+    uint64_t *occupied_bitmap;
+    ServerSlotData_t *slot_data;
 } ServerSlots_t;
 
 /**
  * Used by the listener thread.
  * Holds incoming request packet data and the requests socket handle.
+ * Requests are received in batches (recvmmsg), each into its own slot of the batch buffer,
+ * and handed out one at a time by pointing request_buffer at the current one.
  */
 typedef struct ServerListenerData
 {
@@ -45,32 +96,59 @@ typedef struct ServerListenerData
     ssize_t bytes_received;
     size_t buffer_size;
     Packet_t *request_buffer;
+    uint16_t batch_count;
+    uint16_t batch_next;
+    uint8_t *batch_buffer;
+    uint32_t batch_lengths[SERVER_LISTENER_BATCH_SIZE];
+    struct sockaddr_in batch_addresses[SERVER_LISTENER_BATCH_SIZE];
+    Log2Histogram_t batch_histogram;
 } ServerListenerData_t;
 
 /**
- * Struct encapsulating the two long-living server-side data structures.
+ * Struct encapsulating the long-living server-side data structures:
+ * the listener enqueues incoming requests, and the dispatcher thread
+ * assigns each of them a slot and a pool worker to set it up and serve it.
  */
 typedef struct ServerData
 {
     ServerListenerData_t listener;
+    ServerRequestQueue_t requests;
+    pthread_t dispatcher_thread;
     ServerSlots_t slots;
+    ServerPool_t pool;
 } ServerData_t;
 
 /**
- * Struct encapsulating all data required by a server-side operation thread ("task")
- * to handle an entire client-requested operation and clean after itself.
+ * Struct encapsulating all data required by a pool worker to run a server-side operation ("task")
+ * handling an entire client-requested operation and cleaning after itself,
+ * starting from the raw request packet.
  */
 typedef struct ServerTaskArgs
 {
     int task_slot_idx;
     ServerSlots_t *slots;
+    ServerRequest_t request;
 } ServerTaskArgs_t;
 
+extern ServerConfig_t server_config;
+
 /**
  * Entry point for the TFTP server.
- * Initializes the server state and launches the listener loop function.
- * When the listener loop function returns, it cleans up the server data and returns to main.
+ * Parses the server options, ensures the storage location exists,
+ * and runs the server in the configured mode until it is terminated.
+ */
+void server_start(int argc, char *argv[]);
+
+/**
+ * Server internals shared between the thread-per-operation server and the event loop server.
  */
-void server_start(void);
+void server_raise_file_limit(uint32_t sessions_count);
+bool server_init_listener_data(ServerListenerData_t *data);
+void server_deinit_listener_data(ServerListenerData_t *data);
+ssize_t server_listener_receive(ServerListenerData_t *listener, uint16_t max_count);
+void server_count_request(uint16_t opcode);
+bool server_answer_from_index(ServerListenerData_t *listener);
+bool server_delete_file(OperationData_t *op_data);
+OperationData_t* server_parse_request_data(Packet_t *request_packet, ssize_t bytes_received, struct sockaddr_in client_address);
 
 #endif
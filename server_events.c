@@ -0,0 +1,685 @@
+#include "server_events.h"
+#include "log.h"
+
+/**
+ * Marks a session that is not currently scheduled in the timer heap.
+ */
+#define SERVER_EVENTS_NOT_SCHEDULED UINT32_MAX
+
+static void server_events_timer_swap(ServerEventLoop_t *loop, uint32_t a, uint32_t b)
+{
+    ServerSession_t *temp = loop->timer_heap[a];
+    loop->timer_heap[a] = loop->timer_heap[b];
+    loop->timer_heap[b] = temp;
+    loop->timer_heap[a]->timer_heap_idx = a;
+    loop->timer_heap[b]->timer_heap_idx = b;
+}
+
+static void server_events_timer_sift_up(ServerEventLoop_t *loop, uint32_t idx)
+{
+    while (idx > 0)
+    {
+        uint32_t parent = (idx - 1) / 2;
+
+        if (loop->timer_heap[parent]->deadline_ms <= loop->timer_heap[idx]->deadline_ms)
+        {
+            break;
+        }
+
+        server_events_timer_swap(loop, idx, parent);
+        idx = parent;
+    }
+}
+
+static void server_events_timer_sift_down(ServerEventLoop_t *loop, uint32_t idx)
+{
+    for (;;)
+    {
+        uint32_t smallest = idx;
+        uint32_t left = (idx * 2) + 1;
+        uint32_t right = left + 1;
+
+        if (left < loop->timer_heap_size && loop->timer_heap[left]->deadline_ms < loop->timer_heap[smallest]->deadline_ms)
+        {
+            smallest = left;
+        }
+
+        if (right < loop->timer_heap_size && loop->timer_heap[right]->deadline_ms < loop->timer_heap[smallest]->deadline_ms)
+        {
+            smallest = right;
+        }
+
+        if (smallest == idx)
+        {
+            break;
+        }
+
+        server_events_timer_swap(loop, idx, smallest);
+        idx = smallest;
+    }
+}
+
+/**
+ * Removes a session from the timer heap, if it is scheduled there at all.
+ */
+static void server_events_timer_cancel(ServerEventLoop_t *loop, ServerSession_t *session)
+{
+    uint32_t idx = session->timer_heap_idx;
+
+    if (idx == SERVER_EVENTS_NOT_SCHEDULED)
+    {
+        return;
+    }
+
+    loop->timer_heap_size--;
+
+    if (idx != loop->timer_heap_size)
+    {
+        server_events_timer_swap(loop, idx, loop->timer_heap_size);
+        server_events_timer_sift_down(loop, idx);
+        server_events_timer_sift_up(loop, idx);
+    }
+
+    session->timer_heap_idx = SERVER_EVENTS_NOT_SCHEDULED;
+}
+
+/**
+ * (Re)schedules a session to time out at its transfer's retransmission deadline.
+ */
+static void server_events_timer_schedule(ServerEventLoop_t *loop, ServerSession_t *session)
+{
+    server_events_timer_cancel(loop, session);
+
+    session->deadline_ms = monotonic_milliseconds() + tftp_transfer_timeout_ms(session->tx_data_ptr);
+    session->timer_heap_idx = loop->timer_heap_size;
+    loop->timer_heap[loop->timer_heap_size] = session;
+    loop->timer_heap_size++;
+    server_events_timer_sift_up(loop, session->timer_heap_idx);
+}
+
+/**
+ * Returns how long the event loop may wait for socket events before the earliest session deadline.
+ */
+static int server_events_next_wait_ms(ServerEventLoop_t *loop)
+{
+    if (loop->timer_heap_size == 0)
+    {
+        return SERVER_EVENTS_MAX_WAIT_MS;
+    }
+
+    uint64_t now_ms = monotonic_milliseconds();
+    uint64_t deadline_ms = loop->timer_heap[0]->deadline_ms;
+
+    if (deadline_ms <= now_ms)
+    {
+        return 0;
+    }
+
+    return (deadline_ms - now_ms) < SERVER_EVENTS_MAX_WAIT_MS ? (int)(deadline_ms - now_ms) : SERVER_EVENTS_MAX_WAIT_MS;
+}
+
+/**
+ * Ends a session, cleaning up after it and returning its entry to the session free-list.
+ * If a file reception did not complete, the partially received file is deleted.
+ */
+static void server_events_close_session(ServerEventLoop_t *loop, ServerSession_t *session, TransferStatus_t status)
+{
+    OperationData_t *op_data = session->op_data_ptr;
+    TransferData_t *tx_data = session->tx_data_ptr;
+
+    LOG_INFO("[Worker #%u | Session #%u] Closing session (%s).\n", loop->worker_idx, session->session_idx, status == TFTP_TRANSFER_COMPLETE ? "completed" : "aborted");
+
+    if (status == TFTP_TRANSFER_COMPLETE)
+    {
+        loop->counters.sessions_completed++;
+    }
+    else
+    {
+        loop->counters.sessions_failed++;
+    }
+
+    loop->counters.file_bytes_transferred += tx_data->total_file_bytes_transmitted;
+
+    if (status != TFTP_TRANSFER_COMPLETE && tx_data->is_receiver)
+    {
+        LOG_INFO("[Worker #%u | Session #%u] Deleting partial download.\n", loop->worker_idx, session->session_idx);
+        fclose(tx_data->file);
+        tx_data->file = NULL;
+        remove(op_data->path);
+    }
+
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, op_data->data_socket, NULL);
+    server_events_timer_cancel(loop, session);
+
+    tftp_free_transfer_data(tx_data);
+    tftp_free_operation_data(op_data);
+    session->op_data_ptr = NULL;
+    session->tx_data_ptr = NULL;
+
+    loop->free_session_indices[loop->free_sessions_count] = session->session_idx;
+    loop->free_sessions_count++;
+}
+
+/**
+ * Turns the request currently held by the listener into a new session.
+ * Delete requests never need to wait for the peer, so they are handled on the spot instead.
+ */
+static void server_events_accept_request(ServerEventLoop_t *loop)
+{
+    ServerListenerData_t *listener = loop->listener;
+
+    loop->counters.requests_received++;
+
+    if (server_answer_from_index(listener))
+    {
+        loop->counters.requests_answered_from_index++;
+        return;
+    }
+
+    if (loop->free_sessions_count == 0)
+    {
+        LOG_INFO("[Worker #%u] Rejecting request - exceeded max session count.\n", loop->worker_idx);
+        METRICS_ADD(requests_rejected_busy, 1);
+        loop->counters.requests_rejected++;
+        tftp_send_error(TFTP_ERROR_OUT_OF_SPACE, "Server exceeded maximal connection count. Try again later!",
+            NULL, listener->requests_socket, &(listener->client_address), listener->client_address_length);
+        return;
+    }
+
+    OperationData_t *op_data = server_parse_request_data(listener->request_buffer, listener->bytes_received, listener->client_address);
+
+    if (op_data == NULL)
+    {
+        LOG_INFO("[Worker #%u] Operation data null - dismissing request.\n", loop->worker_idx);
+        loop->counters.requests_rejected++;
+        return;
+    }
+
+    if (op_data->operation_id == TFTP_OPERATION_HANDLE_DELETE)
+    {
+        server_delete_file(op_data);
+        tftp_free_operation_data(op_data);
+        loop->counters.deletes_handled++;
+        return;
+    }
+
+    // multicast reads are served by sessions of their own, outside of the event loops
+    if ((op_data->option_flags & TFTP_OPTION_MULTICAST) && server_multicast_join(op_data))
+    {
+        loop->counters.sessions_accepted++;
+        return;
+    }
+
+    bool receiver = (op_data->operation_id == TFTP_OPERATION_RECEIVE);
+    TransferData_t *tx_data = slab_allocate(SLAB_TRANSFER_DATA, sizeof(TransferData_t));
+
+    if (tx_data == NULL)
+    {
+        LOG_ERRNO("Failed to allocate transfer data");
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "Internal server error", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        tftp_free_operation_data(op_data);
+        loop->counters.requests_rejected++;
+        return;
+    }
+
+    if (!tftp_fill_transfer_data(op_data, tx_data, receiver, NULL)
+        // a write request is acknowledged (or its options are) before the peer starts sending
+        || (receiver && !tftp_acknowledge_request(op_data)))
+    {
+        tftp_free_transfer_data(tx_data);
+        tftp_free_operation_data(op_data);
+        loop->counters.requests_rejected++;
+        return;
+    }
+
+    loop->free_sessions_count--;
+    loop->counters.sessions_accepted++;
+
+    if (loop->capacity - loop->free_sessions_count > loop->counters.peak_active_sessions)
+    {
+        loop->counters.peak_active_sessions = loop->capacity - loop->free_sessions_count;
+    }
+
+    ServerSession_t *session = &loop->sessions[loop->free_session_indices[loop->free_sessions_count]];
+    session->op_data_ptr = op_data;
+    session->tx_data_ptr = tx_data;
+
+    fcntl(op_data->data_socket, F_SETFL, fcntl(op_data->data_socket, F_GETFL) | O_NONBLOCK);
+
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = session->session_idx };
+
+    if (0 > epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, op_data->data_socket, &event))
+    {
+        LOG_ERRNO("Failed to register data socket");
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "Internal server error", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        server_events_close_session(loop, session, TFTP_TRANSFER_FAILED);
+        return;
+    }
+
+    LOG_INFO("[Worker #%u | Session #%u] Accepted %s request, %u sessions active.\n", loop->worker_idx, session->session_idx, op_data->request_description, loop->capacity - loop->free_sessions_count);
+
+    if (!tftp_transfer_begin(op_data, tx_data))
+    {
+        server_events_close_session(loop, session, TFTP_TRANSFER_FAILED);
+        return;
+    }
+
+    server_events_timer_schedule(loop, session);
+}
+
+/**
+ * Drains pending requests from the (non-blocking) requests socket,
+ * up to a limit per wakeup so that a burst of requests cannot starve the running sessions.
+ * Valid requests become sessions, invalid packets are answered with an error and dismissed.
+ */
+static void server_events_drain_requests(ServerEventLoop_t *loop)
+{
+    static const char *received_packet_message_format = "Received %s packet in requests socket.\n";
+    ServerListenerData_t *listener = loop->listener;
+
+    // batches never reach past the per-wakeup limit, so that no received request is left waiting for the next wakeup
+    for (int i = 0; i < SERVER_EVENTS_MAX_REQUESTS_PER_WAKEUP; i++)
+    {
+        if (server_listener_receive(listener, SERVER_EVENTS_MAX_REQUESTS_PER_WAKEUP - i) < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERRNO("Failed to receive bytes");
+            }
+
+            break;
+        }
+        else if (listener->bytes_received < (ssize_t)sizeof(listener->request_buffer->opcode))
+        {
+            LOG_INFO("Received runt packet in requests socket.\n");
+            continue;
+        }
+
+        listener->incoming_opcode = ntohs(listener->request_buffer->opcode);
+        server_count_request(listener->incoming_opcode);
+
+        switch (listener->incoming_opcode)
+        {
+            // *** Standard request opcodes: parse and begin operation
+            case TFTP_RRQ:
+            case TFTP_WRQ:
+            case TFTP_DRQ:
+                LOG_INFO(received_packet_message_format, tftp_common.opcode_strings[listener->incoming_opcode]);
+                server_events_accept_request(loop);
+                break;
+            // *** Invalid (non-request) opcodes: send an error and move on
+            default:
+                if (listener->incoming_opcode >= TFTP_OPCODES_COUNT)
+                {
+                    listener->incoming_opcode = TFTP_NONE;
+                }
+
+                LOG_WARN(received_packet_message_format, tftp_common.opcode_strings[listener->incoming_opcode]);
+                tftp_send_error(TFTP_ERROR_ILLEGAL_OPERATION, "received packet in requests socket with opcode ", tftp_common.opcode_strings[listener->incoming_opcode], listener->requests_socket, &listener->client_address, listener->client_address_length);
+                break;
+        }
+    }
+}
+
+/**
+ * Feeds every packet waiting at a session's data socket into its transfer state machine,
+ * then either reschedules the session for its transfer's retransmission deadline, or closes it if the transfer has ended.
+ * Only packets that advance the transfer move the deadline; duplicates, strays and foreign packets do not.
+ */
+static void server_events_handle_session(ServerEventLoop_t *loop, ServerSession_t *session)
+{
+    OperationData_t *op_data = session->op_data_ptr;
+    TransferData_t *tx_data = session->tx_data_ptr;
+    TransferStatus_t status = TFTP_TRANSFER_IN_PROGRESS;
+    uint32_t packets_handled = 0;
+
+    while (status == TFTP_TRANSFER_IN_PROGRESS)
+    {
+        if (tftp_transfer_receive_packet(op_data, tx_data) < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERRNO("Failed to receive packet");
+                tftp_send_error(TFTP_ERROR_UNDEFINED, "Socket rx error", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+                status = TFTP_TRANSFER_FAILED;
+            }
+
+            break;
+        }
+
+        status = tftp_transfer_handle_packet(op_data, tx_data);
+        packets_handled++;
+    }
+
+    if (status != TFTP_TRANSFER_IN_PROGRESS)
+    {
+        server_events_close_session(loop, session, status);
+    }
+    else if (packets_handled > 0)
+    {
+        server_events_timer_schedule(loop, session);
+    }
+}
+
+/**
+ * Handles every session whose deadline has passed,
+ * letting its transfer state machine decide whether to retransmit or give up.
+ */
+static void server_events_expire_timers(ServerEventLoop_t *loop)
+{
+    uint64_t now_ms = monotonic_milliseconds();
+
+    while (loop->timer_heap_size > 0 && loop->timer_heap[0]->deadline_ms <= now_ms)
+    {
+        ServerSession_t *session = loop->timer_heap[0];
+        TransferStatus_t status = tftp_transfer_handle_timeout(session->op_data_ptr, session->tx_data_ptr);
+
+        if (status == TFTP_TRANSFER_IN_PROGRESS)
+        {
+            server_events_timer_schedule(loop, session);
+        }
+        else
+        {
+            server_events_close_session(loop, session, status);
+        }
+    }
+}
+
+/**
+ * Allocates the session table and its bookkeeping, creates the epoll instance,
+ * and registers the (now non-blocking) requests socket with it.
+ */
+static bool server_events_init(ServerEventLoop_t *loop, ServerListenerData_t *listener, uint16_t worker_idx)
+{
+    explicit_bzero(loop, sizeof(ServerEventLoop_t));
+
+    loop->worker_idx = worker_idx;
+    loop->listener = listener;
+    loop->capacity = server_config.max_sessions;
+    loop->sessions = malloc(sizeof(ServerSession_t) * loop->capacity);
+    loop->free_session_indices = malloc(sizeof(uint32_t) * loop->capacity);
+    loop->timer_heap = malloc(sizeof(ServerSession_t *) * loop->capacity);
+
+    if (loop->sessions == NULL || loop->free_session_indices == NULL || loop->timer_heap == NULL)
+    {
+        LOG_ERRNO("Failed to allocate session table");
+        return false;
+    }
+
+    // the free-list is a stack, filled in reverse so that sessions are handed out from index 0
+    for (uint32_t i = 0; i < loop->capacity; i++)
+    {
+        loop->sessions[i].session_idx = i;
+        loop->sessions[i].timer_heap_idx = SERVER_EVENTS_NOT_SCHEDULED;
+        loop->sessions[i].op_data_ptr = NULL;
+        loop->sessions[i].tx_data_ptr = NULL;
+        loop->free_session_indices[i] = loop->capacity - 1 - i;
+    }
+
+    loop->free_sessions_count = loop->capacity;
+
+    loop->epoll_fd = epoll_create1(0);
+
+    if (loop->epoll_fd < 0)
+    {
+        LOG_ERRNO("Failed to create epoll instance");
+        return false;
+    }
+
+    fcntl(listener->requests_socket, F_SETFL, fcntl(listener->requests_socket, F_GETFL) | O_NONBLOCK);
+
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = SERVER_EVENTS_LISTENER_KEY };
+
+    if (0 > epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, listener->requests_socket, &event))
+    {
+        LOG_ERRNO("Failed to register requests socket");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Aborts any sessions still in progress, notifying their peers, and releases the event loop state.
+ * The activity counters are left intact for the final report.
+ */
+static void server_events_deinit(ServerEventLoop_t *loop)
+{
+    if (loop->sessions != NULL)
+    {
+        for (uint32_t i = 0; i < loop->capacity; i++)
+        {
+            ServerSession_t *session = &loop->sessions[i];
+
+            if (session->op_data_ptr != NULL)
+            {
+                tftp_send_error(TFTP_ERROR_UNDEFINED, "Server program terminated", NULL, session->op_data_ptr->data_socket, &session->op_data_ptr->peer_address, session->op_data_ptr->peer_address_length);
+                server_events_close_session(loop, session, TFTP_TRANSFER_FAILED);
+            }
+        }
+    }
+
+    if (loop->epoll_fd > 0)
+    {
+        close(loop->epoll_fd);
+        loop->epoll_fd = 0;
+    }
+
+    free(loop->sessions);
+    free(loop->free_session_indices);
+    free(loop->timer_heap);
+    loop->sessions = NULL;
+    loop->free_session_indices = NULL;
+    loop->timer_heap = NULL;
+}
+
+/**
+ * The event loop itself: waits for socket events and session deadlines,
+ * and dispatches them until the "should_terminate" flag is set.
+ */
+static void server_events_loop(ServerEventLoop_t *loop)
+{
+    struct epoll_event events[SERVER_EVENTS_MAX_EPOLL_EVENTS];
+
+    LOG_INFO("[Worker #%u] Event loop started with capacity for %u sessions. Awaiting requests.\n", loop->worker_idx, loop->capacity);
+
+    while (!should_terminate)
+    {
+        int events_count = epoll_wait(loop->epoll_fd, events, SERVER_EVENTS_MAX_EPOLL_EVENTS, server_events_next_wait_ms(loop));
+
+        if (should_terminate) break;
+
+        if (events_count < 0)
+        {
+            if (errno == EINTR) continue;
+            LOG_ERRNO("Failed to wait for events");
+            break;
+        }
+
+        for (int i = 0; i < events_count; i++)
+        {
+            if (events[i].data.u64 == SERVER_EVENTS_LISTENER_KEY)
+            {
+                server_events_drain_requests(loop);
+            }
+            else
+            {
+                ServerSession_t *session = &loop->sessions[events[i].data.u64];
+
+                if (session->op_data_ptr != NULL)
+                {
+                    server_events_handle_session(loop, session);
+                }
+            }
+        }
+
+        server_events_expire_timers(loop);
+    }
+
+    LOG_INFO("[Worker #%u] Event loop terminated.\n", loop->worker_idx);
+}
+
+/**
+ * Entry point of an event loop worker thread.
+ * Binds the worker's own requests socket, then runs its event loop until termination.
+ * The worker's index is its position in the workers array passed along with it.
+ */
+static void* server_events_worker_start(void *args)
+{
+    ServerEventsWorker_t *worker = (ServerEventsWorker_t *)args;
+    uint16_t worker_idx = worker->loop.worker_idx;
+
+    if (!server_init_listener_data(&worker->listener))
+    {
+        LOG_ERROR("[Worker #%u] Failed to initialize requests socket.\n", worker_idx);
+        return NULL;
+    }
+
+    // every session may hold its objects at once, so that many of each are worth keeping around, large packet buffers aside
+    slab_set_init(&worker->slabs, server_config.max_sessions);
+    slab_set_attach(&worker->slabs);
+
+    // sessions only queue I/O on the ring for the duration of a single packet handled, so they can all share it
+    if (io_ring_init(&worker->ring))
+    {
+        io_ring_attach(&worker->ring);
+    }
+
+    if (server_events_init(&worker->loop, &worker->listener, worker_idx))
+    {
+        server_events_loop(&worker->loop);
+    }
+    else
+    {
+        LOG_ERROR("[Worker #%u] Failed to initialize event loop.\n", worker_idx);
+    }
+
+    server_events_deinit(&worker->loop);
+    worker->loop.counters.request_batches = worker->listener.batch_histogram;
+    server_deinit_listener_data(&worker->listener);
+    io_ring_deinit(&worker->ring);
+    slab_set_deinit(&worker->slabs);
+    return NULL;
+}
+
+/**
+ * Prints every worker's activity counters, along with its share of all received requests,
+ * followed by the object allocation counters, io_uring counters and listener batch sizes of all workers combined.
+ */
+static void server_events_print_counters(ServerEventsWorker_t *workers, uint16_t workers_count)
+{
+    uint64_t total_requests = 0;
+
+    for (uint16_t i = 0; i < workers_count; i++)
+    {
+        total_requests += workers[i].loop.counters.requests_received;
+    }
+
+    LOG_INFO("Worker activity:\n");
+
+    for (uint16_t i = 0; i < workers_count; i++)
+    {
+        ServerEventsCounters_t *counters = &workers[i].loop.counters;
+
+        LOG_INFO(" [Worker #%u] %lu requests (%.1f%%), %lu rejected, %lu answered from the storage index, %lu deletes, %lu sessions (%lu completed, %lu failed, peak %u concurrent), %lu bytes transferred.\n",
+                i, counters->requests_received,
+                total_requests == 0 ? 0.0 : (100.0 * counters->requests_received) / total_requests,
+                counters->requests_rejected, counters->requests_answered_from_index, counters->deletes_handled,
+                counters->sessions_accepted, counters->sessions_completed, counters->sessions_failed,
+                counters->peak_active_sessions, counters->file_bytes_transferred);
+    }
+
+    SlabSet_t total_slabs;
+    explicit_bzero(&total_slabs, sizeof(SlabSet_t));
+
+    for (uint16_t i = 0; i < workers_count; i++)
+    {
+        slab_set_accumulate(&total_slabs, &workers[i].slabs);
+    }
+
+    slab_set_print_counters(&total_slabs, "Object allocations, all workers");
+
+    IoRingCounters_t total_rings;
+    explicit_bzero(&total_rings, sizeof(IoRingCounters_t));
+
+    for (uint16_t i = 0; i < workers_count; i++)
+    {
+        io_ring_accumulate(&total_rings, &workers[i].ring);
+    }
+
+    io_ring_print_counters(&total_rings, "io_uring requests, all workers");
+
+    Log2Histogram_t total_request_batches;
+    explicit_bzero(&total_request_batches, sizeof(Log2Histogram_t));
+
+    for (uint16_t i = 0; i < workers_count; i++)
+    {
+        log2_histogram_merge(&total_request_batches, &workers[i].loop.counters.request_batches);
+    }
+
+    log2_histogram_print(&total_request_batches, "Requests received per listener batch, all workers", "requests");
+}
+
+/**
+ * Entry point for the event loop server.
+ * Starts the configured number of workers (by default one per core),
+ * and waits for all of them to finish after the "should_terminate" flag is set.
+ */
+void server_events_run(void)
+{
+    uint16_t workers_count = server_config.workers_count;
+    long cores_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (workers_count == 0)
+    {
+        workers_count = cores_count < 1 ? 1 : (cores_count > SERVER_EVENTS_MAX_WORKERS ? SERVER_EVENTS_MAX_WORKERS : cores_count);
+    }
+
+    ServerEventsWorker_t *workers = malloc(sizeof(ServerEventsWorker_t) * workers_count);
+
+    if (workers == NULL)
+    {
+        LOG_ERRNO("Failed to allocate event loop workers");
+        return;
+    }
+
+    explicit_bzero(workers, sizeof(ServerEventsWorker_t) * workers_count);
+    server_raise_file_limit((uint32_t)workers_count * server_config.max_sessions);
+    metrics_set_session_capacity((uint64_t)workers_count * server_config.max_sessions);
+    LOG_INFO("Starting %u event loop workers.\n", workers_count);
+
+    for (uint16_t i = 0; i < workers_count; i++)
+    {
+        workers[i].loop.worker_idx = i;
+        workers[i].thread_started = (0 == pthread_create(&workers[i].thread_handle, NULL, server_events_worker_start, &workers[i]));
+
+        if (!workers[i].thread_started)
+        {
+            LOG_ERRNO("Failed to start event loop worker");
+            continue;
+        }
+
+        // keeping each worker on its own core keeps its sessions' data in that core's caches
+        if (cores_count > 1)
+        {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(i % cores_count, &cpu_set);
+            pthread_setaffinity_np(workers[i].thread_handle, sizeof(cpu_set), &cpu_set);
+        }
+    }
+
+    for (uint16_t i = 0; i < workers_count; i++)
+    {
+        if (workers[i].thread_started)
+        {
+            pthread_join(workers[i].thread_handle, NULL);
+        }
+    }
+
+    LOG_INFO("Server event loop workers terminated.\n");
+    server_events_print_counters(workers, workers_count);
+
+    explicit_bzero(workers, sizeof(ServerEventsWorker_t) * workers_count);
+    free(workers);
+}
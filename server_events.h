@@ -0,0 +1,98 @@
+/**
+ * The Server-Events header declares the event loop flavor of the TFTP server,
+ * in which each worker thread multiplexes many concurrent client sessions via epoll,
+ * instead of dedicating a thread to each operation.
+ * Every worker binds its own SO_REUSEPORT requests socket, so the kernel spreads incoming requests
+ * across workers, and owns its own session table - workers share no mutable state at all.
+ */
+
+#ifndef SERVER_EVENTS_H
+#define SERVER_EVENTS_H
+
+#include "common.h"
+#include "networking_common.h"
+#include "tftp_common.h"
+#include "server.h"
+#include "slab.h"
+#include "io_ring.h"
+
+#include <sys/epoll.h>
+#include <fcntl.h>
+
+#define SERVER_EVENTS_MAX_EPOLL_EVENTS 256
+#define SERVER_EVENTS_MAX_REQUESTS_PER_WAKEUP 64
+#define SERVER_EVENTS_MAX_WAIT_MS 1000
+#define SERVER_EVENTS_LISTENER_KEY UINT64_MAX
+
+/**
+ * A single client-requested transfer, driven as a non-blocking state machine by the event loop.
+ * The deadline is when the session will be considered timed out, unless the peer is heard from first.
+ */
+typedef struct ServerSession
+{
+    uint32_t session_idx;
+    uint32_t timer_heap_idx;
+    uint64_t deadline_ms;
+    OperationData_t *op_data_ptr;
+    TransferData_t *tx_data_ptr;
+} ServerSession_t;
+
+/**
+ * Per-worker activity counters, reported when the server terminates
+ * to show how evenly the kernel spread the load across workers.
+ */
+typedef struct ServerEventsCounters
+{
+    uint64_t requests_received;
+    uint64_t requests_rejected;
+    uint64_t requests_answered_from_index;
+    uint64_t deletes_handled;
+    uint64_t sessions_accepted;
+    uint64_t sessions_completed;
+    uint64_t sessions_failed;
+    uint64_t file_bytes_transferred;
+    uint32_t peak_active_sessions;
+    Log2Histogram_t request_batches;
+} ServerEventsCounters_t;
+
+/**
+ * Holds all state of a single worker's event loop:
+ * the epoll instance, the session table along with its free-list,
+ * and a binary min-heap of active sessions ordered by their deadlines.
+ */
+typedef struct ServerEventLoop
+{
+    uint16_t worker_idx;
+    int epoll_fd;
+    uint32_t capacity;
+    uint32_t free_sessions_count;
+    uint32_t timer_heap_size;
+    uint32_t *free_session_indices;
+    ServerSession_t *sessions;
+    ServerSession_t **timer_heap;
+    ServerListenerData_t *listener;
+    ServerEventsCounters_t counters;
+} ServerEventLoop_t;
+
+/**
+ * A single event loop worker thread, along with its own requests socket,
+ * its own object caches for recycling session data, and its own io_uring (if built with one).
+ */
+typedef struct ServerEventsWorker
+{
+    pthread_t thread_handle;
+    bool thread_started;
+    ServerListenerData_t listener;
+    ServerEventLoop_t loop;
+    SlabSet_t slabs;
+    IoRing_t ring;
+} ServerEventsWorker_t;
+
+/**
+ * Entry point for the event loop server.
+ * Starts the configured number of workers (by default one per core),
+ * and waits for all of them to finish after the "should_terminate" flag is set.
+ */
+void server_events_run(void);
+
+#endif
@@ -0,0 +1,392 @@
+#include "server_index.h"
+#include "log.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+#define SERVER_INDEX_WATCH_MASK (IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+        | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/**
+ * The index itself: a hash table of entries by name, read by the request handling threads
+ * and written by the index thread alone, under a readers-writer lock.
+ */
+static struct
+{
+    pthread_rwlock_t lock;
+    bool valid; // cleared if the directory itself went away, after which every lookup is left to the filesystem
+    bool thread_running;
+    bool stop_requested;
+    int directory_fd;
+    int inotify_fd;
+    pthread_t thread_handle;
+    uint32_t buckets_count;
+    uint32_t entries_count;
+    ServerIndexEntry_t **buckets;
+    ServerIndexCounters_t counters;
+} server_index =
+{
+    .lock = PTHREAD_RWLOCK_INITIALIZER,
+    .directory_fd = -1,
+    .inotify_fd = -1,
+};
+
+/**
+ * FNV-1a, which is plenty for file names.
+ */
+static uint32_t server_index_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+
+    for (; *name != '\0'; name++)
+    {
+        hash = (hash ^ (uint8_t)*name) * 16777619u;
+    }
+
+    return hash;
+}
+
+static ServerIndexEntry_t **server_index_find_link(const char *name, uint32_t hash)
+{
+    ServerIndexEntry_t **link = &server_index.buckets[hash & (server_index.buckets_count - 1)];
+
+    while (*link != NULL && ((*link)->hash != hash || 0 != strcmp((*link)->name, name)))
+    {
+        link = &(*link)->next;
+    }
+
+    return link;
+}
+
+/**
+ * Doubles the bucket count once entries outnumber buckets. The caller holds the write lock.
+ */
+static void server_index_grow(void)
+{
+    uint32_t buckets_count = server_index.buckets_count * 2;
+    ServerIndexEntry_t **buckets = calloc(buckets_count, sizeof(ServerIndexEntry_t *));
+
+    // a crowded table is still correct, just slower
+    if (buckets == NULL)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < server_index.buckets_count; i++)
+    {
+        while (server_index.buckets[i] != NULL)
+        {
+            ServerIndexEntry_t *entry = server_index.buckets[i];
+            server_index.buckets[i] = entry->next;
+            entry->next = buckets[entry->hash & (buckets_count - 1)];
+            buckets[entry->hash & (buckets_count - 1)] = entry;
+        }
+    }
+
+    free(server_index.buckets);
+    server_index.buckets = buckets;
+    server_index.buckets_count = buckets_count;
+}
+
+static void server_index_clear(void)
+{
+    for (uint32_t i = 0; i < server_index.buckets_count; i++)
+    {
+        while (server_index.buckets[i] != NULL)
+        {
+            ServerIndexEntry_t *entry = server_index.buckets[i];
+            server_index.buckets[i] = entry->next;
+            free(entry);
+        }
+    }
+
+    server_index.entries_count = 0;
+}
+
+/**
+ * Brings the entry of a single file in line with the filesystem: added or updated if it is a regular file, removed otherwise.
+ * Whatever happened to the file, a fresh stat() tells where it stands now. The caller holds the write lock.
+ */
+static void server_index_refresh(const char *name)
+{
+    struct stat file_attr;
+    uint32_t hash = server_index_hash(name);
+    ServerIndexEntry_t **link = server_index_find_link(name, hash);
+    ServerIndexEntry_t *entry = *link;
+
+    if (0 > fstatat(server_index.directory_fd, name, &file_attr, 0) || !S_ISREG(file_attr.st_mode))
+    {
+        if (entry != NULL)
+        {
+            *link = entry->next;
+            free(entry);
+            server_index.entries_count--;
+        }
+
+        return;
+    }
+
+    if (entry == NULL)
+    {
+        size_t name_length = strlen(name);
+        entry = malloc(sizeof(ServerIndexEntry_t) + name_length + 1);
+
+        if (entry == NULL)
+        {
+            // an entry missing from the index would make the file look deleted, so the index gives up instead
+            LOG_ERRNO("Failed to allocate storage index entry");
+            server_index.valid = false;
+            return;
+        }
+
+        entry->next = NULL;
+        entry->hash = hash;
+        memcpy(entry->name, name, name_length + 1);
+        *link = entry;
+        server_index.entries_count++;
+    }
+
+    entry->size = file_attr.st_size;
+    entry->modification_time = file_attr.st_mtim;
+    entry->change_time = file_attr.st_ctim;
+
+    if (server_index.entries_count > server_index.buckets_count)
+    {
+        server_index_grow();
+    }
+}
+
+/**
+ * Rebuilds the index from a listing of the directory, e.g. at startup or after the kernel dropped events.
+ * The caller holds the write lock.
+ */
+static bool server_index_rescan(void)
+{
+    int directory_fd = dup(server_index.directory_fd);
+    DIR *directory = directory_fd < 0 ? NULL : fdopendir(directory_fd);
+
+    if (directory == NULL)
+    {
+        LOG_ERRNO("Failed to list storage directory");
+
+        if (directory_fd >= 0)
+        {
+            close(directory_fd);
+        }
+
+        server_index.valid = false;
+        return false;
+    }
+
+    server_index_clear();
+    server_index.valid = true;
+    server_index.counters.rescans++;
+    rewinddir(directory);
+
+    for (struct dirent *dir_entry = readdir(directory); dir_entry != NULL; dir_entry = readdir(directory))
+    {
+        if (dir_entry->d_type == DT_REG || dir_entry->d_type == DT_LNK || dir_entry->d_type == DT_UNKNOWN)
+        {
+            server_index_refresh(dir_entry->d_name);
+        }
+    }
+
+    closedir(directory);
+    return server_index.valid;
+}
+
+/**
+ * Applies every inotify event read in one go.
+ */
+static void server_index_apply_events(const uint8_t *events_buffer, ssize_t length)
+{
+    pthread_rwlock_wrlock(&server_index.lock);
+
+    for (ssize_t offset = 0; offset < length; )
+    {
+        const struct inotify_event *event = (const struct inotify_event *)(events_buffer + offset);
+        offset += sizeof(struct inotify_event) + event->len;
+        server_index.counters.events++;
+
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+            LOG_INFO("Storage index missed events, rebuilding it.\n");
+            server_index_rescan();
+        }
+        else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+        {
+            LOG_INFO("Storage directory went away, the storage index is disabled.\n");
+            server_index.valid = false;
+        }
+        else if (event->len > 0 && server_index.valid)
+        {
+            server_index_refresh(event->name);
+        }
+    }
+
+    pthread_rwlock_unlock(&server_index.lock);
+}
+
+static void* server_index_thread_start(void *args)
+{
+    (void)args;
+    uint8_t events_buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd poll_fd = { .fd = server_index.inotify_fd, .events = POLLIN };
+
+    while (!should_terminate && !__atomic_load_n(&server_index.stop_requested, __ATOMIC_ACQUIRE))
+    {
+        if (poll(&poll_fd, 1, SERVER_INDEX_POLL_MS) <= 0)
+        {
+            continue;
+        }
+
+        ssize_t length = read(server_index.inotify_fd, events_buffer, sizeof(events_buffer));
+
+        if (length > 0)
+        {
+            server_index_apply_events(events_buffer, length);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Builds the index of the given directory and starts following changes to it.
+ * The watch is set up before the directory is listed, so that no change falls in between.
+ * Returns false if the index could not be set up, in which case every lookup is left to the filesystem.
+ */
+bool server_index_init(const char *directory)
+{
+    server_index.directory_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    server_index.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    server_index.buckets_count = SERVER_INDEX_BUCKETS_INITIAL;
+    server_index.buckets = calloc(server_index.buckets_count, sizeof(ServerIndexEntry_t *));
+
+    if (server_index.directory_fd < 0 || server_index.inotify_fd < 0 || server_index.buckets == NULL)
+    {
+        LOG_ERRNO("Failed to set up storage index");
+        server_index_shutdown();
+        return false;
+    }
+
+    if (0 > inotify_add_watch(server_index.inotify_fd, directory, SERVER_INDEX_WATCH_MASK))
+    {
+        LOG_ERRNO("Failed to watch storage directory");
+        server_index_shutdown();
+        return false;
+    }
+
+    pthread_rwlock_wrlock(&server_index.lock);
+    bool scanned = server_index_rescan();
+    pthread_rwlock_unlock(&server_index.lock);
+
+    if (!scanned || 0 != pthread_create(&server_index.thread_handle, NULL, server_index_thread_start, NULL))
+    {
+        LOG_INFO("Failed to start storage index.\n");
+        server_index_shutdown();
+        return false;
+    }
+
+    server_index.thread_running = true;
+    LOG_INFO("Indexed %u files in storage directory.\n", server_index.entries_count);
+    return true;
+}
+
+/**
+ * Stops following the directory and frees the index.
+ */
+void server_index_shutdown(void)
+{
+    if (server_index.thread_running)
+    {
+        __atomic_store_n(&server_index.stop_requested, true, __ATOMIC_RELEASE);
+        pthread_join(server_index.thread_handle, NULL);
+        server_index.thread_running = false;
+    }
+
+    pthread_rwlock_wrlock(&server_index.lock);
+    server_index.valid = false;
+
+    if (server_index.buckets != NULL)
+    {
+        server_index_clear();
+        free(server_index.buckets);
+        server_index.buckets = NULL;
+        server_index.buckets_count = 0;
+    }
+
+    pthread_rwlock_unlock(&server_index.lock);
+
+    if (server_index.inotify_fd >= 0)
+    {
+        close(server_index.inotify_fd);
+        server_index.inotify_fd = -1;
+    }
+
+    if (server_index.directory_fd >= 0)
+    {
+        close(server_index.directory_fd);
+        server_index.directory_fd = -1;
+    }
+}
+
+/**
+ * Looks up a file by its name within the storage directory, without touching the filesystem.
+ * If found, its entry (less the name) is copied to entry_copy, unless that is NULL.
+ * Names reaching into other directories are left to the filesystem.
+ */
+ServerIndexLookup_t server_index_lookup(const char *name, ServerIndexEntry_t *entry_copy)
+{
+    ServerIndexLookup_t result = SERVER_INDEX_UNKNOWN;
+
+    pthread_rwlock_rdlock(&server_index.lock);
+
+    if (server_index.valid && strchr(name, '/') == NULL)
+    {
+        ServerIndexEntry_t *entry = *server_index_find_link(name, server_index_hash(name));
+        result = entry == NULL ? SERVER_INDEX_MISSING : SERVER_INDEX_FOUND;
+
+        if (entry != NULL && entry_copy != NULL)
+        {
+            memcpy(entry_copy, entry, sizeof(ServerIndexEntry_t));
+        }
+    }
+
+    pthread_rwlock_unlock(&server_index.lock);
+
+    switch (result)
+    {
+        case SERVER_INDEX_FOUND:
+            __atomic_fetch_add(&server_index.counters.found_lookups, 1, __ATOMIC_RELAXED);
+            break;
+        case SERVER_INDEX_MISSING:
+            __atomic_fetch_add(&server_index.counters.missing_lookups, 1, __ATOMIC_RELAXED);
+            break;
+        case SERVER_INDEX_UNKNOWN:
+            __atomic_fetch_add(&server_index.counters.unknown_lookups, 1, __ATOMIC_RELAXED);
+            break;
+    }
+
+    return result;
+}
+
+/**
+ * Prints how many files the index holds, and how often it was consulted.
+ */
+void server_index_print_counters(void)
+{
+    if (server_index.counters.rescans == 0)
+    {
+        return;
+    }
+
+    pthread_rwlock_rdlock(&server_index.lock);
+    LOG_INFO(" Storage index: %u files, lookups: %lu found, %lu missing, %lu left to the filesystem; %lu events applied, %lu rebuilds.\n",
+            server_index.entries_count, server_index.counters.found_lookups, server_index.counters.missing_lookups,
+            server_index.counters.unknown_lookups, server_index.counters.events, server_index.counters.rescans);
+    pthread_rwlock_unlock(&server_index.lock);
+}
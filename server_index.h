@@ -0,0 +1,54 @@
+/**
+ * The Server-Index header declares an in-memory index of the files in the storage directory (name, size, modification time),
+ * built when the server starts and kept current by a thread following inotify events on the directory.
+ * The listener consults it before dispatching a request, so reads and deletes of missing files,
+ * and writes of files that already exist, are answered with an error right away, without touching the filesystem
+ * or setting up an operation at all. Requests the index cannot vouch for (e.g. of paths into subdirectories,
+ * or while it is being rebuilt after the kernel dropped events) are served as usual.
+ */
+
+#ifndef SERVER_INDEX_H
+#define SERVER_INDEX_H
+
+#include "common.h"
+#include "networking_common.h"
+
+#define SERVER_INDEX_BUCKETS_INITIAL 256
+#define SERVER_INDEX_POLL_MS 200
+
+typedef enum ServerIndexLookup
+{
+    SERVER_INDEX_UNKNOWN = 0, // the index cannot tell, the filesystem has to
+    SERVER_INDEX_MISSING = 1,
+    SERVER_INDEX_FOUND = 2,
+} ServerIndexLookup_t;
+
+/**
+ * A regular file in the storage directory, as of the last event about it.
+ * The size and times of a file being written are only updated once it is closed.
+ */
+typedef struct ServerIndexEntry
+{
+    struct ServerIndexEntry *next; // in the same hash bucket
+    uint32_t hash;
+    uint64_t size;
+    struct timespec modification_time;
+    struct timespec change_time;
+    char name[];
+} ServerIndexEntry_t;
+
+typedef struct ServerIndexCounters
+{
+    uint64_t found_lookups;
+    uint64_t missing_lookups;
+    uint64_t unknown_lookups;
+    uint64_t events;
+    uint64_t rescans;
+} ServerIndexCounters_t;
+
+bool server_index_init(const char *directory);
+void server_index_shutdown(void);
+ServerIndexLookup_t server_index_lookup(const char *name, ServerIndexEntry_t *entry_copy);
+void server_index_print_counters(void);
+
+#endif
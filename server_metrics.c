@@ -0,0 +1,306 @@
+#include "server_metrics.h"
+#include "log.h"
+
+#include <poll.h>
+
+/**
+ * The endpoint itself, along with the file byte rates its thread works out between samples.
+ */
+static struct
+{
+    bool thread_running;
+    bool stop_requested;
+    bool http; // a TCP port answering HTTP requests, rather than a Unix socket
+    int listening_socket;
+    pthread_t thread_handle;
+    struct sockaddr_un unix_address;
+    uint64_t rate_sample_ms;
+    uint64_t sampled_bytes_sent;
+    uint64_t sampled_bytes_received;
+    double bytes_sent_per_second;
+    double bytes_received_per_second;
+} server_metrics =
+{
+    .listening_socket = -1,
+};
+
+/**
+ * Writes the lines of a Prometheus histogram from a power-of-two bucketed one,
+ * each bucket's upper bound being one less than the next power of two, the last bucket's being infinite.
+ */
+static void server_metrics_write_histogram(FILE *out, const char *name, const char *help, const Log2Histogram_t *histogram)
+{
+    uint64_t cumulative_count = 0;
+
+    fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+
+    for (uint8_t bucket = 0; bucket < LOG2_HISTOGRAM_BUCKETS - 1; bucket++)
+    {
+        cumulative_count += histogram->buckets[bucket];
+        fprintf(out, "%s_bucket{le=\"%lu\"} %lu\n", name, (1UL << bucket) - 1, cumulative_count);
+    }
+
+    fprintf(out, "%s_bucket{le=\"+Inf\"} %lu\n%s_sum %lu\n%s_count %lu\n", name, histogram->count, name, histogram->sum, name, histogram->count);
+}
+
+/**
+ * Writes every metric, aggregated from all threads as of now.
+ */
+static void server_metrics_write(FILE *out)
+{
+    MetricsCounters_t counters;
+    metrics_aggregate(&counters);
+
+    // counts are read while they are being written, so a later one may be ahead of an earlier one
+    uint64_t active_transfers = counters.transfers_started >= counters.transfers_finished ? counters.transfers_started - counters.transfers_finished : 0;
+    uint64_t failed_transfers = counters.transfers_finished >= counters.transfers_completed ? counters.transfers_finished - counters.transfers_completed : 0;
+
+    fprintf(out, "# HELP stftpu_requests_total Packets received on the requests socket, by opcode.\n# TYPE stftpu_requests_total counter\n");
+    fprintf(out, "stftpu_requests_total{opcode=\"RRQ\"} %lu\n", counters.read_requests);
+    fprintf(out, "stftpu_requests_total{opcode=\"WRQ\"} %lu\n", counters.write_requests);
+    fprintf(out, "stftpu_requests_total{opcode=\"DRQ\"} %lu\n", counters.delete_requests);
+    fprintf(out, "stftpu_requests_total{opcode=\"other\"} %lu\n", counters.invalid_requests);
+
+    fprintf(out, "# HELP stftpu_requests_rejected_total Requests turned away, by reason.\n# TYPE stftpu_requests_rejected_total counter\n");
+    fprintf(out, "stftpu_requests_rejected_total{reason=\"busy\"} %lu\n", counters.requests_rejected_busy);
+    fprintf(out, "stftpu_requests_rejected_total{reason=\"timed_out\"} %lu\n", counters.requests_rejected_timed_out);
+
+    fprintf(out, "# HELP stftpu_requests_answered_from_index_total Requests for missing (or, for writes, existing) files refused from the storage index.\n"
+            "# TYPE stftpu_requests_answered_from_index_total counter\nstftpu_requests_answered_from_index_total %lu\n", counters.requests_answered_from_index);
+
+    fprintf(out, "# HELP stftpu_sessions_active File transfers in progress.\n# TYPE stftpu_sessions_active gauge\nstftpu_sessions_active %lu\n", active_transfers);
+    fprintf(out, "# HELP stftpu_sessions_capacity File transfers the server can run at once.\n# TYPE stftpu_sessions_capacity gauge\nstftpu_sessions_capacity %lu\n",
+            metrics_session_capacity());
+
+    fprintf(out, "# HELP stftpu_sessions_total File transfers ended, by outcome.\n# TYPE stftpu_sessions_total counter\n");
+    fprintf(out, "stftpu_sessions_total{outcome=\"completed\"} %lu\n", counters.transfers_completed);
+    fprintf(out, "stftpu_sessions_total{outcome=\"failed\"} %lu\n", failed_transfers);
+
+    fprintf(out, "# HELP stftpu_file_bytes_total File contents acknowledged by peers or written to disk, by direction.\n# TYPE stftpu_file_bytes_total counter\n");
+    fprintf(out, "stftpu_file_bytes_total{direction=\"sent\"} %lu\n", counters.file_bytes_sent);
+    fprintf(out, "stftpu_file_bytes_total{direction=\"received\"} %lu\n", counters.file_bytes_received);
+
+    fprintf(out, "# HELP stftpu_file_bytes_per_second File contents moved over the last second or so, by direction.\n# TYPE stftpu_file_bytes_per_second gauge\n");
+    fprintf(out, "stftpu_file_bytes_per_second{direction=\"sent\"} %.0f\n", server_metrics.bytes_sent_per_second);
+    fprintf(out, "stftpu_file_bytes_per_second{direction=\"received\"} %.0f\n", server_metrics.bytes_received_per_second);
+
+    fprintf(out, "# HELP stftpu_retransmissions_total Windows, ACKs and OACKs sent again after a timeout.\n"
+            "# TYPE stftpu_retransmissions_total counter\nstftpu_retransmissions_total %lu\n", counters.retransmissions);
+    fprintf(out, "# HELP stftpu_timeouts_total Retransmission timeouts expired.\n# TYPE stftpu_timeouts_total counter\nstftpu_timeouts_total %lu\n", counters.timeouts);
+    fprintf(out, "# HELP stftpu_error_packets_sent_total ERROR packets sent to peers.\n"
+            "# TYPE stftpu_error_packets_sent_total counter\nstftpu_error_packets_sent_total %lu\n", counters.error_packets_sent);
+    fprintf(out, "# HELP stftpu_duplicate_packets_total ACKs and DATA blocks received again, and ignored.\n"
+            "# TYPE stftpu_duplicate_packets_total counter\nstftpu_duplicate_packets_total %lu\n", counters.duplicate_packets);
+    fprintf(out, "# HELP stftpu_dropped_packets_total Out of sequence, unexpected or truncated packets, and packets from unknown transfer IDs, ignored.\n"
+            "# TYPE stftpu_dropped_packets_total counter\nstftpu_dropped_packets_total %lu\n", counters.dropped_packets);
+
+    server_metrics_write_histogram(out, "stftpu_session_rtt_microseconds", "Smoothed round-trip time of each completed file transfer.", &counters.transfer_rtt_us);
+    server_metrics_write_histogram(out, "stftpu_session_throughput_kilobytes_per_second", "Average rate of each completed file transfer.", &counters.transfer_throughput_kbps);
+}
+
+/**
+ * Works out the file byte rates since the previous sample, once a sampling interval went by.
+ */
+static void server_metrics_sample_rates(void)
+{
+    uint64_t now_ms = monotonic_milliseconds();
+    uint64_t elapsed_ms = now_ms - server_metrics.rate_sample_ms;
+
+    if (elapsed_ms < SERVER_METRICS_RATE_INTERVAL_MS)
+    {
+        return;
+    }
+
+    MetricsCounters_t counters;
+    metrics_aggregate(&counters);
+
+    server_metrics.bytes_sent_per_second = (counters.file_bytes_sent - server_metrics.sampled_bytes_sent) * 1000.0 / elapsed_ms;
+    server_metrics.bytes_received_per_second = (counters.file_bytes_received - server_metrics.sampled_bytes_received) * 1000.0 / elapsed_ms;
+    server_metrics.sampled_bytes_sent = counters.file_bytes_sent;
+    server_metrics.sampled_bytes_received = counters.file_bytes_received;
+    server_metrics.rate_sample_ms = now_ms;
+}
+
+/**
+ * Answers a single connection with the metrics, after reading an HTTP request if the endpoint is a TCP port,
+ * and closes it. A client taking longer than SERVER_METRICS_REQUEST_TIMEOUT_MS to send its request is answered anyway.
+ */
+static void server_metrics_answer(int connection_socket)
+{
+    char *response = NULL;
+    size_t response_length = 0;
+    FILE *out = open_memstream(&response, &response_length);
+
+    if (out == NULL)
+    {
+        LOG_ERRNO("Failed to allocate metrics response");
+        close(connection_socket);
+        return;
+    }
+
+    if (server_metrics.http)
+    {
+        char request_buffer[1024];
+        struct pollfd poll_fd = { .fd = connection_socket, .events = POLLIN };
+
+        if (poll(&poll_fd, 1, SERVER_METRICS_REQUEST_TIMEOUT_MS) > 0)
+        {
+            recv(connection_socket, request_buffer, sizeof(request_buffer), MSG_DONTWAIT);
+        }
+
+        fprintf(out, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+    }
+
+    server_metrics_write(out);
+    fclose(out);
+
+    for (size_t offset = 0; offset < response_length; )
+    {
+        ssize_t bytes_sent = send(connection_socket, response + offset, response_length - offset, MSG_NOSIGNAL);
+
+        if (bytes_sent <= 0)
+        {
+            break;
+        }
+
+        offset += bytes_sent;
+    }
+
+    free(response);
+    close(connection_socket);
+}
+
+static void* server_metrics_thread_start(void *args)
+{
+    (void)args;
+    struct pollfd poll_fd = { .fd = server_metrics.listening_socket, .events = POLLIN };
+
+    server_metrics.rate_sample_ms = monotonic_milliseconds();
+
+    while (!should_terminate && !__atomic_load_n(&server_metrics.stop_requested, __ATOMIC_ACQUIRE))
+    {
+        int ready = poll(&poll_fd, 1, SERVER_METRICS_POLL_MS);
+        server_metrics_sample_rates();
+
+        if (ready <= 0)
+        {
+            continue;
+        }
+
+        int connection_socket = accept(server_metrics.listening_socket, NULL, NULL);
+
+        if (connection_socket >= 0)
+        {
+            server_metrics_answer(connection_socket);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Binds the listening socket: the Unix socket at the given path if it has a slash in it,
+ * e.g. "./stftpu.sock", or else the given TCP port on the loopback address.
+ */
+static bool server_metrics_bind(const char *endpoint)
+{
+    static const int reuse_flag = 1;
+
+    if (strchr(endpoint, '/') != NULL)
+    {
+        if (strlen(endpoint) >= sizeof(server_metrics.unix_address.sun_path))
+        {
+            LOG_ERROR("Metrics socket path '%s' is too long.\n", endpoint);
+            return false;
+        }
+
+        struct stat endpoint_attr;
+
+        // a socket left behind by a previous run would fail the bind, but anything else at the path is not ours to remove
+        if (0 == lstat(endpoint, &endpoint_attr))
+        {
+            if (!S_ISSOCK(endpoint_attr.st_mode))
+            {
+                LOG_ERROR("Metrics socket path '%s' exists and is not a socket.\n", endpoint);
+                errno = ENOTSOCK;
+                return false;
+            }
+
+            unlink(endpoint);
+        }
+
+        server_metrics.unix_address.sun_family = AF_UNIX;
+        strcpy(server_metrics.unix_address.sun_path, endpoint);
+        server_metrics.listening_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        return server_metrics.listening_socket >= 0
+            && 0 == bind(server_metrics.listening_socket, (struct sockaddr *)&server_metrics.unix_address, sizeof(server_metrics.unix_address));
+    }
+
+    char *end = NULL;
+    unsigned long port = strtoul(endpoint, &end, 10);
+
+    if (*endpoint == '\0' || *end != '\0' || port == 0 || port > UINT16_MAX)
+    {
+        LOG_ERROR("Invalid metrics endpoint '%s', expected a socket path or a port.\n", endpoint);
+        return false;
+    }
+
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    server_metrics.http = true;
+    server_metrics.listening_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    return server_metrics.listening_socket >= 0
+        && 0 == setsockopt(server_metrics.listening_socket, SOL_SOCKET, SO_REUSEADDR, &reuse_flag, sizeof(reuse_flag))
+        && 0 == bind(server_metrics.listening_socket, (struct sockaddr *)&address, sizeof(address));
+}
+
+/**
+ * Starts answering requests for metrics at the given endpoint.
+ * Returns false if the endpoint could not be set up, in which case the server runs without it.
+ */
+bool server_metrics_start(const char *endpoint)
+{
+    if (!server_metrics_bind(endpoint) || 0 > listen(server_metrics.listening_socket, 16))
+    {
+        LOG_ERRNO("Failed to set up metrics endpoint");
+        server_metrics_shutdown();
+        return false;
+    }
+
+    if (0 != pthread_create(&server_metrics.thread_handle, NULL, server_metrics_thread_start, NULL))
+    {
+        LOG_ERRNO("Failed to start metrics thread");
+        server_metrics_shutdown();
+        return false;
+    }
+
+    server_metrics.thread_running = true;
+    LOG_INFO("Serving metrics at %s%s.\n", server_metrics.http ? "http://127.0.0.1:" : "", endpoint);
+    return true;
+}
+
+/**
+ * Stops answering requests for metrics, and removes the Unix socket if there was one.
+ */
+void server_metrics_shutdown(void)
+{
+    if (server_metrics.thread_running)
+    {
+        __atomic_store_n(&server_metrics.stop_requested, true, __ATOMIC_RELEASE);
+        pthread_join(server_metrics.thread_handle, NULL);
+        server_metrics.thread_running = false;
+    }
+
+    if (server_metrics.listening_socket >= 0)
+    {
+        close(server_metrics.listening_socket);
+        server_metrics.listening_socket = -1;
+    }
+
+    if (server_metrics.unix_address.sun_family == AF_UNIX)
+    {
+        unlink(server_metrics.unix_address.sun_path);
+        server_metrics.unix_address.sun_family = AF_UNSPEC;
+    }
+}
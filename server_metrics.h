@@ -0,0 +1,27 @@
+/**
+ * The Server-Metrics header declares the endpoint exposing the server's metrics (see metrics.h) while it runs,
+ * in the Prometheus text format: request counts by opcode, rejections, active sessions against capacity,
+ * file bytes moved and the current rate, retransmissions, timeouts, ERROR packets sent,
+ * and histograms of the round-trip time and average rate of completed transfers.
+ * The endpoint is either a Unix socket, which answers every connection with the metrics and closes it
+ * (e.g. "socat - UNIX-CONNECT:/tmp/stftpu.sock"), or a TCP port on localhost answering HTTP requests,
+ * for Prometheus to scrape. Metrics are aggregated from all threads on every request, by a thread of its own.
+ */
+
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include "common.h"
+#include "networking_common.h"
+#include "metrics.h"
+
+#include <sys/un.h>
+
+#define SERVER_METRICS_POLL_MS 200
+#define SERVER_METRICS_RATE_INTERVAL_MS 1000
+#define SERVER_METRICS_REQUEST_TIMEOUT_MS 100
+
+bool server_metrics_start(const char *endpoint);
+void server_metrics_shutdown(void);
+
+#endif
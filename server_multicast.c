@@ -0,0 +1,495 @@
+#include "server_multicast.h"
+#include "log.h"
+#include "server.h"
+
+#include <poll.h>
+
+/**
+ * All multicast sessions, and the mutex guarding their states and members.
+ */
+static ServerMulticastSession_t server_multicast_sessions[SERVER_MULTICAST_SESSIONS_MAX];
+static pthread_mutex_t server_multicast_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Sends a member an OACK with the session's values of the options it asked for,
+ * which tells it the session's group, and whether it is now the master client.
+ * The caller either holds the sessions mutex, or is the session thread itself,
+ * so that the session's data socket remains open throughout.
+ */
+static bool server_multicast_send_oack(const ServerMulticastSession_t *session, const ServerMulticastMember_t *member, bool master)
+{
+    OperationData_t oack_data;
+    explicit_bzero(&oack_data, sizeof(oack_data));
+
+    // the session's timeout is its own, and not up for negotiation with every member
+    oack_data.option_flags = member->option_flags & ~TFTP_OPTION_TIMEOUT;
+    oack_data.block_size = session->op_data_ptr->block_size;
+    oack_data.window_size = member->window_size;
+    oack_data.transfer_size = session->op_data_ptr->transfer_size;
+    oack_data.multicast_address = session->op_data_ptr->multicast_address;
+    oack_data.multicast_master = master;
+    oack_data.data_socket = session->op_data_ptr->data_socket;
+    oack_data.peer_address = member->address;
+    oack_data.peer_address_length = sizeof(member->address);
+
+    return tftp_send_option_acknowledgement(&oack_data);
+}
+
+/**
+ * Returns the index of the member at the given address, or -1 if there is none.
+ * The caller must hold the sessions mutex.
+ */
+static int32_t server_multicast_find_member(const ServerMulticastSession_t *session, const struct sockaddr_in *address)
+{
+    for (uint16_t idx = 0; idx < session->members_count; idx++)
+    {
+        if (session->members[idx].address.sin_addr.s_addr == address->sin_addr.s_addr
+            && session->members[idx].address.sin_port == address->sin_port)
+        {
+            return idx;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Removes a member from its session, once it has the whole file, gave up, or stopped answering.
+ * Once the last one is gone, the session stops accepting members, so that clients asking for the file later start a new one.
+ * Returns the number of members left.
+ */
+static uint16_t server_multicast_remove_member(ServerMulticastSession_t *session, uint16_t member_idx)
+{
+    pthread_mutex_lock(&server_multicast_mutex);
+
+    session->members_count--;
+    memmove(&session->members[member_idx], &session->members[member_idx + 1], (session->members_count - member_idx) * sizeof(ServerMulticastMember_t));
+
+    if (session->members_count == 0)
+    {
+        session->accepting_members = false;
+    }
+
+    uint16_t members_count = session->members_count;
+    pthread_mutex_unlock(&server_multicast_mutex);
+
+    return members_count;
+}
+
+/**
+ * Receives the next packet at the session's data socket, waiting for up to the given timeout.
+ * Packets from members other than the master may only tell that they are done (an ACK of the final block),
+ * or that they gave up (an ERROR), either of which removes them from the session.
+ * Returns 1 if a packet from the master was received, 0 if some other packet was, or -1 on timeout.
+ */
+static int server_multicast_receive(ServerMulticastSession_t *session, const struct sockaddr_in *master_address, uint32_t timeout_ms)
+{
+    OperationData_t *op_data = session->op_data_ptr;
+    TransferData_t *tx_data = session->tx_data_ptr;
+    struct pollfd poll_fd = { .fd = op_data->data_socket, .events = POLLIN };
+
+    if (tx_data->receive_batch_next >= tx_data->receive_batch_count && poll(&poll_fd, 1, timeout_ms) <= 0)
+    {
+        return -1;
+    }
+
+    ssize_t bytes_received = tftp_transfer_receive_packet(op_data, tx_data);
+    struct sockaddr_in sender_address = tx_data->received_address;
+
+    if (bytes_received < (ssize_t)sizeof(Packet_t))
+    {
+        return 0;
+    }
+
+    if (sender_address.sin_addr.s_addr == master_address->sin_addr.s_addr && sender_address.sin_port == master_address->sin_port)
+    {
+        return 1;
+    }
+
+    uint16_t opcode = ntohs(tx_data->received_packet_ptr->opcode);
+    uint16_t final_block = op_data->transfer_size / op_data->block_size + 1;
+
+    if (opcode == TFTP_ERROR || (opcode == TFTP_ACK && ntohs(tx_data->received_packet_ptr->ack.block_number) == final_block))
+    {
+        pthread_mutex_lock(&server_multicast_mutex);
+        int32_t member_idx = server_multicast_find_member(session, &sender_address);
+        pthread_mutex_unlock(&server_multicast_mutex);
+
+        // only the session thread removes members, so the index still holds
+        if (member_idx > 0)
+        {
+            LOG_INFO("[Multicast #%u] Client %s:%u %s.\n", session->session_idx, inet_ntoa(sender_address.sin_addr), ntohs(sender_address.sin_port),
+                    opcode == TFTP_ERROR ? "gave up" : "received the whole file");
+            session->clients_served += (opcode == TFTP_ACK);
+            server_multicast_remove_member(session, member_idx);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Promotes the first member of the session to master client with an OACK, resending it on timeouts,
+ * and awaits the master's ACK of the last block it has in sequence, right after which transmission resumes.
+ * A master which already has the whole file is done with right away, and one that does not answer is dropped,
+ * in favour of the next member.
+ * Returns false once no members are left, and otherwise fills in the master's address.
+ */
+static bool server_multicast_promote_master(ServerMulticastSession_t *session, struct sockaddr_in *master_address)
+{
+    OperationData_t *op_data = session->op_data_ptr;
+    TransferData_t *tx_data = session->tx_data_ptr;
+    uint64_t total_block_count = op_data->transfer_size / op_data->block_size + 1;
+
+    while (!should_terminate)
+    {
+        pthread_mutex_lock(&server_multicast_mutex);
+        bool members_left = session->members_count > 0;
+        ServerMulticastMember_t master = session->members[0];
+        pthread_mutex_unlock(&server_multicast_mutex);
+
+        if (!members_left)
+        {
+            return false;
+        }
+
+        *master_address = master.address;
+        op_data->window_size = master.window_size;
+        LOG_INFO("[Multicast #%u] Promoting %s:%u to master client.\n", session->session_idx, inet_ntoa(master.address.sin_addr), ntohs(master.address.sin_port));
+
+        for (uint8_t attempt = 0; attempt <= tftp_common.max_retry_count && !should_terminate; attempt++)
+        {
+            // a member which was idle all along has nothing to estimate round trips with yet, so it gets the protocol's timeout
+            uint64_t deadline_us = monotonic_microseconds() + TFTP_TIMEOUT_SECONDS * 1000000;
+            server_multicast_send_oack(session, &master, true);
+
+            for (uint64_t now_us = monotonic_microseconds(); now_us < deadline_us; now_us = monotonic_microseconds())
+            {
+                if (server_multicast_receive(session, master_address, (deadline_us - now_us + 999) / 1000) <= 0)
+                {
+                    continue;
+                }
+
+                uint16_t opcode = ntohs(tx_data->received_packet_ptr->opcode);
+
+                if (opcode == TFTP_ERROR)
+                {
+                    LOG_INFO("[Multicast #%u] Master client declined with message: %s\n", session->session_idx, tx_data->received_packet_ptr->error.error_message);
+                    deadline_us = 0;
+                    attempt = tftp_common.max_retry_count;
+                }
+                else if (opcode == TFTP_ACK)
+                {
+                    // block numbers are taken to be within their first rollover, so a master beyond it may be sent more than it needs
+                    uint64_t acknowledged_block = ntohs(tx_data->received_packet_ptr->ack.block_number);
+
+                    if (acknowledged_block < total_block_count)
+                    {
+                        return tftp_transmit_resume(op_data, tx_data, acknowledged_block + 1);
+                    }
+
+                    LOG_INFO("[Multicast #%u] Master client already received the whole file.\n", session->session_idx);
+                    session->clients_served++;
+                    deadline_us = 0;
+                    attempt = tftp_common.max_retry_count;
+                }
+            }
+        }
+
+        server_multicast_remove_member(session, 0);
+    }
+
+    return false;
+}
+
+/**
+ * Handles a packet from the master client while sending it the file, as any transmitting side would,
+ * except that an ACK beyond the current window skips ahead to the next block the master is missing,
+ * since it may have picked up later blocks before it was promoted.
+ */
+static TransferStatus_t server_multicast_handle_master_packet(ServerMulticastSession_t *session)
+{
+    OperationData_t *op_data = session->op_data_ptr;
+    TransferData_t *tx_data = session->tx_data_ptr;
+    uint16_t opcode = ntohs(tx_data->received_packet_ptr->opcode);
+
+    if (opcode == TFTP_ERROR)
+    {
+        LOG_INFO("[Multicast #%u] Master client gave up with message: %s\n", session->session_idx, tx_data->received_packet_ptr->error.error_message);
+        return TFTP_TRANSFER_FAILED;
+    }
+    else if (opcode != TFTP_ACK)
+    {
+        return TFTP_TRANSFER_IN_PROGRESS;
+    }
+
+    uint64_t window_base = tx_data->window_first_block - 1;
+    uint64_t acknowledged_block = window_base + (uint16_t)(ntohs(tx_data->received_packet_ptr->ack.block_number) - (uint16_t)window_base);
+
+    if (acknowledged_block <= tx_data->window_last_block)
+    {
+        return tftp_transfer_handle_packet(op_data, tx_data);
+    }
+    else if (acknowledged_block == tx_data->total_block_count)
+    {
+        LOG_INFO("[Multicast #%u] Master client received the rest of the file.\n", session->session_idx);
+        return TFTP_TRANSFER_COMPLETE;
+    }
+    else if (acknowledged_block < tx_data->total_block_count)
+    {
+        return tftp_transmit_resume(op_data, tx_data, acknowledged_block + 1) ? TFTP_TRANSFER_IN_PROGRESS : TFTP_TRANSFER_FAILED;
+    }
+
+    // an ACK from long before the current window
+    return TFTP_TRANSFER_IN_PROGRESS;
+}
+
+/**
+ * Sends the file to the group for as long as the master client keeps acknowledging it.
+ * Timeouts resend the window to the whole group, and once the retry limit is reached,
+ * the master is taken to be gone, without notifying the rest of the group.
+ * The master is removed from the session once it has the whole file, gave up, or stopped answering.
+ */
+static void server_multicast_serve_master(ServerMulticastSession_t *session, const struct sockaddr_in *master_address)
+{
+    OperationData_t *op_data = session->op_data_ptr;
+    TransferData_t *tx_data = session->tx_data_ptr;
+    TransferStatus_t status = TFTP_TRANSFER_IN_PROGRESS;
+
+    while (status == TFTP_TRANSFER_IN_PROGRESS && !should_terminate)
+    {
+        int received = server_multicast_receive(session, master_address, tftp_transfer_timeout_ms(tx_data));
+
+        if (received > 0)
+        {
+            status = server_multicast_handle_master_packet(session);
+        }
+        else if (received < 0 && tftp_transfer_timeout_ms(tx_data) > 0)
+        {
+            // woken up before the deadline, e.g. by a signal
+            continue;
+        }
+        else if (received < 0 && tx_data->resend_counter >= tftp_common.max_retry_count)
+        {
+            LOG_INFO("[Multicast #%u] Master client stopped acknowledging.\n", session->session_idx);
+            status = TFTP_TRANSFER_FAILED;
+        }
+        else if (received < 0)
+        {
+            status = tftp_transfer_handle_timeout(op_data, tx_data);
+        }
+    }
+
+    session->clients_served += (status == TFTP_TRANSFER_COMPLETE);
+    server_multicast_remove_member(session, 0);
+}
+
+/**
+ * The session thread hands the master role from member to member, until none are left.
+ */
+static void *server_multicast_session_run(void *args)
+{
+    ServerMulticastSession_t *session = (ServerMulticastSession_t *)args;
+    OperationData_t *op_data = session->op_data_ptr;
+    struct sockaddr_in master_address;
+
+    while (!should_terminate && server_multicast_promote_master(session, &master_address))
+    {
+        server_multicast_serve_master(session, &master_address);
+    }
+
+    if (should_terminate)
+    {
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "Server program terminated", NULL, op_data->data_socket, &op_data->multicast_address, sizeof(op_data->multicast_address));
+    }
+
+    // the data socket is only closed once no more OACKs can be sent through it
+    pthread_mutex_lock(&server_multicast_mutex);
+    session->accepting_members = false;
+    pthread_mutex_unlock(&server_multicast_mutex);
+
+    LOG_INFO("[Multicast #%u] Session for '%s' ended, %u clients served.\n", session->session_idx, op_data->path, session->clients_served);
+    tftp_free_transfer_data(session->tx_data_ptr);
+    tftp_free_operation_data(op_data);
+
+    pthread_mutex_lock(&server_multicast_mutex);
+    session->tx_data_ptr = NULL;
+    session->op_data_ptr = NULL;
+    session->state = SERVER_MULTICAST_SESSION_FINISHED;
+    pthread_mutex_unlock(&server_multicast_mutex);
+
+    return NULL;
+}
+
+/**
+ * Sets up a new session sending the requested file to the session's group, with the requesting client as its only member,
+ * and starts the session thread. The group gets the same blocks as the client, which must not be fragmented
+ * on the way to any member either. The session takes the operation data along, or frees it if it could not be started.
+ */
+static void server_multicast_start_session(ServerMulticastSession_t *session, OperationData_t *op_data)
+{
+    struct stat file_attr;
+    TransferData_t *tx_data = malloc(sizeof(TransferData_t));
+
+    op_data->multicast_address.sin_family = AF_INET;
+    op_data->multicast_address.sin_addr.s_addr = htonl(ntohl(server_config.multicast_group.s_addr) + session->session_idx);
+    op_data->multicast_address.sin_port = htons(server_config.multicast_port);
+
+    if (tftp_common.path_mtu_blksize && (op_data->option_flags & TFTP_OPTION_BLKSIZE))
+    {
+        uint16_t group_block_size = tftp_path_mtu_block_size(&op_data->multicast_address);
+        op_data->block_size = op_data->block_size > group_block_size ? group_block_size : op_data->block_size;
+    }
+
+    if (tx_data == NULL || !tftp_fill_transfer_data(op_data, tx_data, false, NULL) || 0 > fstat(fileno(tx_data->file), &file_attr))
+    {
+        if (tx_data == NULL)
+        {
+            LOG_ERRNO("Failed to allocate multicast transfer data");
+            tftp_send_error(TFTP_ERROR_UNDEFINED, "Internal server error", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        }
+        else
+        {
+            tftp_free_transfer_data(tx_data);
+        }
+
+        tftp_free_operation_data(op_data);
+
+        pthread_mutex_lock(&server_multicast_mutex);
+        session->state = SERVER_MULTICAST_SESSION_FREE;
+        pthread_mutex_unlock(&server_multicast_mutex);
+        return;
+    }
+
+    op_data->transfer_size = file_attr.st_size;
+    session->op_data_ptr = op_data;
+    session->tx_data_ptr = tx_data;
+    session->clients_served = 0;
+    session->members_count = 1;
+    session->members[0] = (ServerMulticastMember_t){ .address = op_data->peer_address, .option_flags = op_data->option_flags, .window_size = op_data->window_size };
+    op_data->peer_address = op_data->multicast_address;
+
+    LOG_INFO("[Multicast #%u] Starting session for '%s' on group %s:%u.\n", session->session_idx, op_data->path,
+            inet_ntoa(op_data->multicast_address.sin_addr), server_config.multicast_port);
+
+    pthread_mutex_lock(&server_multicast_mutex);
+    session->accepting_members = true;
+    pthread_mutex_unlock(&server_multicast_mutex);
+
+    if (0 != pthread_create(&session->thread_handle, NULL, server_multicast_session_run, session))
+    {
+        LOG_ERRNO("Failed to start multicast session thread");
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "Server failed to start multicast session", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+
+        pthread_mutex_lock(&server_multicast_mutex);
+        session->accepting_members = false;
+        session->members_count = 0;
+        session->op_data_ptr = NULL;
+        session->tx_data_ptr = NULL;
+        session->state = SERVER_MULTICAST_SESSION_FREE;
+        pthread_mutex_unlock(&server_multicast_mutex);
+
+        tftp_free_transfer_data(tx_data);
+        tftp_free_operation_data(op_data);
+    }
+}
+
+/**
+ * Takes over a read request asking for the 'multicast' option (RFC 2090).
+ * The client joins the session already sending the file, and is told its group with an OACK,
+ * or a new session is started for it, with the client as its first master.
+ * A client can only join if the block size it asked for is at least the session's, since it is sent the same blocks.
+ * Returns false if the client cannot take part after all, e.g. because all sessions are busy,
+ * in which case the request is to be served as a plain unicast transfer, and the operation data is left untouched.
+ * Otherwise the operation data is consumed, either by a new session or by being freed.
+ */
+bool server_multicast_join(OperationData_t *op_data)
+{
+    ServerMulticastMember_t member = { .address = op_data->peer_address, .option_flags = op_data->option_flags, .window_size = op_data->window_size };
+    uint16_t block_size = (op_data->option_flags & TFTP_OPTION_BLKSIZE) ? op_data->block_size : TFTP_BLKSIZE_DEFAULT;
+    ServerMulticastSession_t *free_session = NULL;
+
+    pthread_mutex_lock(&server_multicast_mutex);
+
+    for (uint16_t idx = 0; idx < SERVER_MULTICAST_SESSIONS_MAX; idx++)
+    {
+        ServerMulticastSession_t *session = &server_multicast_sessions[idx];
+
+        if (session->state != SERVER_MULTICAST_SESSION_RUNNING)
+        {
+            free_session = free_session == NULL ? session : free_session;
+            continue;
+        }
+
+        if (!session->accepting_members || strcmp(session->op_data_ptr->path, op_data->path) != 0
+            || block_size < session->op_data_ptr->block_size
+            || (session->op_data_ptr->block_size != TFTP_BLKSIZE_DEFAULT && !(op_data->option_flags & TFTP_OPTION_BLKSIZE)))
+        {
+            continue;
+        }
+
+        // a client retransmitting its request is already a member, and only missed its OACK
+        int32_t member_idx = server_multicast_find_member(session, &member.address);
+
+        if (member_idx < 0 && session->members_count < SERVER_MULTICAST_MEMBERS_MAX)
+        {
+            member_idx = session->members_count++;
+            session->members[member_idx] = member;
+        }
+
+        if (member_idx >= 0)
+        {
+            LOG_INFO("[Multicast #%u] Client %s:%u joined, %u members.\n", session->session_idx, inet_ntoa(member.address.sin_addr), ntohs(member.address.sin_port), session->members_count);
+            server_multicast_send_oack(session, &session->members[member_idx], false);
+            pthread_mutex_unlock(&server_multicast_mutex);
+            tftp_free_operation_data(op_data);
+            return true;
+        }
+    }
+
+    if (free_session == NULL)
+    {
+        pthread_mutex_unlock(&server_multicast_mutex);
+        LOG_INFO("All multicast sessions are busy, serving request as a unicast transfer.\n");
+        op_data->option_flags &= ~TFTP_OPTION_MULTICAST;
+        return false;
+    }
+
+    // a finished session thread only has to be joined, which does not block
+    if (free_session->state == SERVER_MULTICAST_SESSION_FINISHED)
+    {
+        pthread_join(free_session->thread_handle, NULL);
+    }
+
+    free_session->state = SERVER_MULTICAST_SESSION_RUNNING;
+    free_session->accepting_members = false;
+    free_session->session_idx = free_session - server_multicast_sessions;
+    pthread_mutex_unlock(&server_multicast_mutex);
+
+    server_multicast_start_session(free_session, op_data);
+    return true;
+}
+
+/**
+ * Waits for every multicast session thread to end, which they do once termination is requested.
+ */
+void server_multicast_shutdown(void)
+{
+    for (uint16_t idx = 0; idx < SERVER_MULTICAST_SESSIONS_MAX; idx++)
+    {
+        ServerMulticastSession_t *session = &server_multicast_sessions[idx];
+
+        pthread_mutex_lock(&server_multicast_mutex);
+        bool started = session->state != SERVER_MULTICAST_SESSION_FREE;
+        pthread_mutex_unlock(&server_multicast_mutex);
+
+        if (started)
+        {
+            pthread_join(session->thread_handle, NULL);
+
+            pthread_mutex_lock(&server_multicast_mutex);
+            session->state = SERVER_MULTICAST_SESSION_FREE;
+            pthread_mutex_unlock(&server_multicast_mutex);
+        }
+    }
+}
@@ -0,0 +1,62 @@
+/**
+ * The Server-Multicast header declares multicast transfers (RFC 2090), which send a file to many clients at once.
+ * A read request asking for the 'multicast' option joins the session already sending that file to its group, if any,
+ * or starts a new one, each session running on a thread of its own regardless of the server mode.
+ * Only the master client acknowledges the DATA sent to the group. Once it has the whole file, the next member
+ * is promoted to master and asks for whatever it missed before it joined, until every member has the file.
+ * Disk reads and outgoing bandwidth are thus shared by all receivers, however many there are.
+ * Every session gets its own group: the configured base address, offset by the session's index.
+ */
+
+#ifndef SERVER_MULTICAST_H
+#define SERVER_MULTICAST_H
+
+#include "common.h"
+#include "networking_common.h"
+#include "tftp_common.h"
+
+#define SERVER_MULTICAST_SESSIONS_MAX 16
+#define SERVER_MULTICAST_MEMBERS_MAX 256
+#define SERVER_MULTICAST_PORT_DEFAULT 1758
+
+/**
+ * A client taking part in a multicast session, along with the options it asked for,
+ * which the OACKs it is sent echo with the session's values.
+ */
+typedef struct ServerMulticastMember
+{
+    struct sockaddr_in address;
+    uint8_t option_flags;
+    uint16_t window_size;
+} ServerMulticastMember_t;
+
+typedef enum ServerMulticastSessionState
+{
+    SERVER_MULTICAST_SESSION_FREE = 0,
+    SERVER_MULTICAST_SESSION_RUNNING = 1,
+    SERVER_MULTICAST_SESSION_FINISHED = 2, // the session thread returned, but was not joined yet
+} ServerMulticastSessionState_t;
+
+/**
+ * A file being sent to a multicast group by a session thread.
+ * The members are shared with the threads joining clients to the session, under the sessions mutex;
+ * the first of them is the master client. Everything else is set up before the session thread starts,
+ * and is then only touched by it, except for the immutable parts of the operation data the OACKs are made of.
+ */
+typedef struct ServerMulticastSession
+{
+    ServerMulticastSessionState_t state;
+    bool accepting_members;
+    uint16_t session_idx;
+    uint16_t members_count;
+    uint32_t clients_served;
+    pthread_t thread_handle;
+    OperationData_t *op_data_ptr; // of the client that started the session, its peer address being the group
+    TransferData_t *tx_data_ptr;
+    ServerMulticastMember_t members[SERVER_MULTICAST_MEMBERS_MAX];
+} ServerMulticastSession_t;
+
+bool server_multicast_join(OperationData_t *op_data);
+void server_multicast_shutdown(void);
+
+#endif
@@ -0,0 +1,186 @@
+#include "server_pool.h"
+#include "log.h"
+
+/**
+ * The pool worker thread loop: takes jobs off the queue in order and runs them,
+ * until the pool is closed and no jobs are left.
+ */
+static void* server_pool_worker_start(void *args)
+{
+    ServerPoolWorker_t *worker = (ServerPoolWorker_t *)args;
+    ServerPool_t *pool = worker->pool;
+    uint8_t *job = malloc(pool->job_size);
+
+    if (job == NULL)
+    {
+        LOG_ERRNO("Failed to allocate pool worker job buffer");
+        return NULL;
+    }
+
+    // a worker runs a single operation at a time, so only a few objects of each kind are ever worth keeping around
+    slab_set_init(&worker->slabs, SERVER_POOL_WORKER_MAX_CACHED);
+    slab_set_attach(&worker->slabs);
+
+    if (io_ring_init(&worker->ring))
+    {
+        io_ring_attach(&worker->ring);
+    }
+
+    while (true)
+    {
+        pthread_mutex_lock(&pool->mutex);
+
+        while (pool->count == 0 && !pool->closed)
+        {
+            pthread_cond_wait(&pool->not_empty, &pool->mutex);
+        }
+
+        // jobs submitted before the pool closed are still run, so that each can clean up after itself
+        if (pool->count == 0)
+        {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+
+        memcpy(job, pool->jobs + (size_t)pool->head_idx * pool->job_size, pool->job_size);
+        pool->head_idx = (pool->head_idx + 1) % pool->capacity;
+        pool->count--;
+        pthread_mutex_unlock(&pool->mutex);
+
+        pool->job_handler(job, worker);
+        worker->jobs_handled++;
+    }
+
+    io_ring_deinit(&worker->ring);
+    slab_set_deinit(&worker->slabs);
+    free(job);
+    return NULL;
+}
+
+/**
+ * Allocates the job queue and per-worker resources, and spawns all workers up front.
+ * Worker stacks are kept small, since pools may be sized to thousands of workers
+ * and the job handlers keep little on the stack.
+ * Returns false if the pool could not be set up, in which case nothing is left running.
+ */
+bool server_pool_init(ServerPool_t *pool, uint32_t workers_count, uint32_t capacity, size_t job_size, ServerPoolJobHandler_t job_handler)
+{
+    explicit_bzero(pool, sizeof(ServerPool_t));
+
+    pool->capacity = capacity;
+    pool->job_size = job_size;
+    pool->job_handler = job_handler;
+    pool->jobs = malloc(job_size * capacity);
+    pool->workers = malloc(sizeof(ServerPoolWorker_t) * workers_count);
+
+    if (pool->jobs == NULL || pool->workers == NULL)
+    {
+        LOG_ERRNO("Failed to allocate worker pool");
+        free(pool->jobs);
+        free(pool->workers);
+        return false;
+    }
+
+    explicit_bzero(pool->workers, sizeof(ServerPoolWorker_t) * workers_count);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+
+    pthread_attr_t thread_attributes;
+    pthread_attr_init(&thread_attributes);
+    pthread_attr_setstacksize(&thread_attributes, SERVER_POOL_WORKER_STACK_SIZE);
+
+    for (uint32_t i = 0; i < workers_count; i++)
+    {
+        ServerPoolWorker_t *worker = &pool->workers[i];
+        worker->worker_idx = i;
+        worker->pool = pool;
+        pool->workers_count++;
+
+        if (!tftp_init_transfer_buffers(&worker->buffers))
+        {
+            break;
+        }
+
+        worker->thread_started = (0 == pthread_create(&worker->thread_handle, &thread_attributes, server_pool_worker_start, worker));
+
+        if (!worker->thread_started)
+        {
+            LOG_ERRNO("Failed to start pool worker");
+            break;
+        }
+    }
+
+    pthread_attr_destroy(&thread_attributes);
+
+    if (!pool->workers[pool->workers_count - 1].thread_started)
+    {
+        server_pool_shutdown(pool);
+        return false;
+    }
+
+    LOG_INFO("Started %u pool workers.\n", pool->workers_count);
+    return true;
+}
+
+/**
+ * Copies a job into the tail of the queue and wakes up a worker.
+ * Returns false without blocking if the queue is full or already closed.
+ */
+bool server_pool_submit(ServerPool_t *pool, const void *job)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    if (pool->closed || pool->count == pool->capacity)
+    {
+        pthread_mutex_unlock(&pool->mutex);
+        return false;
+    }
+
+    memcpy(pool->jobs + (size_t)((pool->head_idx + pool->count) % pool->capacity) * pool->job_size, job, pool->job_size);
+    pool->count++;
+
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->mutex);
+    return true;
+}
+
+/**
+ * Closes the pool to new jobs, lets the workers finish the jobs already queued,
+ * then joins every worker that was started and releases all pool resources.
+ */
+void server_pool_shutdown(ServerPool_t *pool)
+{
+    uint64_t jobs_handled = 0;
+    SlabSet_t total_slabs;
+    IoRingCounters_t total_rings;
+    explicit_bzero(&total_slabs, sizeof(SlabSet_t));
+    explicit_bzero(&total_rings, sizeof(IoRingCounters_t));
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->closed = true;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint32_t i = 0; i < pool->workers_count; i++)
+    {
+        if (pool->workers[i].thread_started)
+        {
+            pthread_join(pool->workers[i].thread_handle, NULL);
+        }
+
+        jobs_handled += pool->workers[i].jobs_handled;
+        slab_set_accumulate(&total_slabs, &pool->workers[i].slabs);
+        io_ring_accumulate(&total_rings, &pool->workers[i].ring);
+        tftp_deinit_transfer_buffers(&pool->workers[i].buffers);
+    }
+
+    LOG_INFO("Pool workers terminated after handling %lu jobs.\n", jobs_handled);
+    slab_set_print_counters(&total_slabs, "Object allocations, all pool workers");
+    io_ring_print_counters(&total_rings, "io_uring requests, all pool workers");
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->not_empty);
+    free(pool->jobs);
+    free(pool->workers);
+    explicit_bzero(pool, sizeof(ServerPool_t));
+}
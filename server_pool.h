@@ -0,0 +1,67 @@
+/**
+ * The Server-Pool header declares a fixed pool of pre-spawned worker threads,
+ * which take jobs off a shared queue and run them one at a time,
+ * so that serving a request never pays for creating and tearing down a thread.
+ * Every worker owns a set of packet batch buffers, lent to each transfer it runs,
+ * a slab set recycling the rest of the objects its operations allocate,
+ * and, when built with io_uring support, a ring its transfers submit their file and socket I/O through.
+ */
+
+#ifndef SERVER_POOL_H
+#define SERVER_POOL_H
+
+#include "common.h"
+#include "tftp_common.h"
+#include "slab.h"
+#include "io_ring.h"
+
+#define SERVER_POOL_WORKER_STACK_SIZE (256 * 1024)
+#define SERVER_POOL_WORKER_MAX_CACHED 4
+
+struct ServerPool;
+
+/**
+ * A single pool worker thread, along with the resources it reuses across jobs.
+ */
+typedef struct ServerPoolWorker
+{
+    uint32_t worker_idx;
+    bool thread_started;
+    pthread_t thread_handle;
+    uint64_t jobs_handled;
+    TransferBuffers_t buffers;
+    SlabSet_t slabs;
+    IoRing_t ring;
+    struct ServerPool *pool;
+} ServerPoolWorker_t;
+
+/**
+ * Runs a single job on the calling worker thread.
+ * The job contents are only valid until the handler returns.
+ */
+typedef void (*ServerPoolJobHandler_t)(void *job, ServerPoolWorker_t *worker);
+
+/**
+ * A fixed set of workers, and a bounded FIFO ring of fixed-size jobs for them to take,
+ * shared with the submitting thread via mutex and condition variable.
+ */
+typedef struct ServerPool
+{
+    bool closed;
+    uint32_t workers_count;
+    uint32_t capacity;
+    uint32_t head_idx;
+    uint32_t count;
+    size_t job_size;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    uint8_t *jobs;
+    ServerPoolJobHandler_t job_handler;
+    ServerPoolWorker_t *workers;
+} ServerPool_t;
+
+bool server_pool_init(ServerPool_t *pool, uint32_t workers_count, uint32_t capacity, size_t job_size, ServerPoolJobHandler_t job_handler);
+bool server_pool_submit(ServerPool_t *pool, const void *job);
+void server_pool_shutdown(ServerPool_t *pool);
+
+#endif
@@ -0,0 +1,366 @@
+#include "server_queue.h"
+#include "log.h"
+
+/**
+ * Maps a request to its admission priority class, lower classes being admitted first.
+ * Reads are the cheapest to serve and the most latency-sensitive,
+ * deletes are quick to serve, and writes hold a slot the longest.
+ * In FIFO mode every request belongs to the same class.
+ */
+static uint8_t server_queue_priority_class(const ServerRequestQueue_t *queue, const Packet_t *packet)
+{
+    if (queue->policy == SERVER_ADMISSION_FIFO)
+    {
+        return 0;
+    }
+
+    switch (ntohs(packet->opcode))
+    {
+        case TFTP_RRQ:
+            return 0;
+        case TFTP_DRQ:
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+static ServerRequest_t *server_queue_ring_entry(const ServerRequestQueue_t *queue, const ServerRequestRing_t *ring, uint32_t offset)
+{
+    return &ring->requests[(ring->head_idx + offset) % queue->capacity];
+}
+
+/**
+ * The client set key of an address and port, never 0.
+ */
+static uint64_t server_queue_client_key(const struct sockaddr_in *client_address)
+{
+    return (1ULL << 48) | ((uint64_t)client_address->sin_addr.s_addr << 16) | client_address->sin_port;
+}
+
+/**
+ * Finds the slot holding the given key, or the free slot ending its probe sequence if it is not in the set.
+ */
+static uint32_t server_queue_client_slot(const ServerQueueClientSet_t *set, uint64_t key)
+{
+    uint32_t slot = (key * 0x9E3779B97F4A7C15ULL) >> 32 & set->mask;
+
+    while (set->keys[slot] != 0 && set->keys[slot] != key)
+    {
+        slot = (slot + 1) & set->mask;
+    }
+
+    return slot;
+}
+
+/**
+ * Removes a client from the set, moving later entries of its probe sequence back into the gap,
+ * so that lookups never need to skip over deleted slots.
+ */
+static void server_queue_client_remove(ServerQueueClientSet_t *set, const struct sockaddr_in *client_address)
+{
+    uint32_t gap = server_queue_client_slot(set, server_queue_client_key(client_address));
+
+    if (set->keys[gap] == 0)
+    {
+        return;
+    }
+
+    for (uint32_t slot = (gap + 1) & set->mask; set->keys[slot] != 0; slot = (slot + 1) & set->mask)
+    {
+        uint32_t home = (set->keys[slot] * 0x9E3779B97F4A7C15ULL) >> 32 & set->mask;
+
+        // an entry may fill the gap unless its home slot lies cyclically after the gap, up to the entry itself
+        if (((slot - home) & set->mask) >= ((slot - gap) & set->mask))
+        {
+            set->keys[gap] = set->keys[slot];
+            gap = slot;
+        }
+    }
+
+    set->keys[gap] = 0;
+}
+
+/**
+ * Copies the request at the head of the given ring out and removes it.
+ */
+static void server_queue_ring_pop(ServerRequestQueue_t *queue, ServerRequestRing_t *ring, ServerRequest_t *request_out)
+{
+    ServerRequest_t *request = server_queue_ring_entry(queue, ring, 0);
+    *request_out = *request;
+    request_out->packet_buffer[request->bytes_received] = 0;
+    ring->head_idx = (ring->head_idx + 1) % queue->capacity;
+    ring->count--;
+    queue->count--;
+    server_queue_client_remove(&queue->clients, &request->client_address);
+}
+
+/**
+ * Allocates a ring of request entries for every priority class and initializes the synchronization primitives.
+ * Each ring can hold the entire capacity, since the policy decides how requests are spread across them.
+ * The condition variable uses the monotonic clock, so that timed waits are immune to wall clock changes.
+ */
+bool server_queue_init(ServerRequestQueue_t *queue, uint32_t capacity, uint32_t max_wait_ms, ServerAdmissionPolicy_t policy)
+{
+    explicit_bzero(queue, sizeof(ServerRequestQueue_t));
+
+    for (uint8_t class_idx = 0; class_idx < SERVER_REQUEST_PRIORITY_CLASSES; class_idx++)
+    {
+        queue->rings[class_idx].requests = malloc(sizeof(ServerRequest_t) * capacity);
+
+        if (queue->rings[class_idx].requests == NULL)
+        {
+            LOG_ERRNO("Failed to allocate request queue");
+            server_queue_deinit(queue);
+            return false;
+        }
+    }
+
+    uint32_t client_slots = 2;
+
+    while (client_slots < 2 * (uint64_t)capacity)
+    {
+        client_slots *= 2;
+    }
+
+    queue->clients.mask = client_slots - 1;
+    queue->clients.keys = calloc(client_slots, sizeof(uint64_t));
+
+    if (queue->clients.keys == NULL)
+    {
+        LOG_ERRNO("Failed to allocate request queue");
+        server_queue_deinit(queue);
+        return false;
+    }
+
+    queue->capacity = capacity;
+    queue->max_wait_ms = max_wait_ms;
+    queue->policy = policy;
+
+    pthread_condattr_t condition_attributes;
+    pthread_condattr_init(&condition_attributes);
+    pthread_condattr_setclock(&condition_attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->not_empty, &condition_attributes);
+    pthread_condattr_destroy(&condition_attributes);
+    pthread_mutex_init(&queue->mutex, NULL);
+    return true;
+}
+
+void server_queue_deinit(ServerRequestQueue_t *queue)
+{
+    if (queue->capacity > 0)
+    {
+        pthread_mutex_destroy(&queue->mutex);
+        pthread_cond_destroy(&queue->not_empty);
+    }
+
+    for (uint8_t class_idx = 0; class_idx < SERVER_REQUEST_PRIORITY_CLASSES; class_idx++)
+    {
+        free(queue->rings[class_idx].requests);
+    }
+
+    free(queue->clients.keys);
+
+    explicit_bzero(queue, sizeof(ServerRequestQueue_t));
+}
+
+/**
+ * Copies a received request packet into the tail of its priority class ring and wakes up a consumer.
+ * Never blocks: reports back if the queue is full or closed,
+ * or if the same client already has a request waiting (in which case the retransmission is dropped).
+ */
+ServerQueuePushResult_t server_queue_push(ServerRequestQueue_t *queue, const Packet_t *packet, ssize_t bytes_received, const struct sockaddr_in *client_address, socklen_t client_address_length)
+{
+    if (bytes_received < 0 || (size_t)bytes_received > SERVER_REQUEST_BUFFER_SIZE)
+    {
+        return SERVER_QUEUE_FULL;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+
+    if (queue->closed)
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        return SERVER_QUEUE_CLOSED;
+    }
+
+    uint64_t client_key = server_queue_client_key(client_address);
+    uint32_t client_slot = server_queue_client_slot(&queue->clients, client_key);
+    bool duplicate = queue->clients.keys[client_slot] == client_key;
+
+    // a retransmission is told apart even when the queue is full, since rejecting it would fail a request waiting to be served
+    if (queue->count == queue->capacity && !duplicate)
+    {
+        queue->statistics.rejected_queue_full++;
+        pthread_mutex_unlock(&queue->mutex);
+        return SERVER_QUEUE_FULL;
+    }
+
+    if (duplicate)
+    {
+        queue->statistics.duplicates_dropped++;
+        pthread_mutex_unlock(&queue->mutex);
+        return SERVER_QUEUE_DUPLICATE;
+    }
+
+    queue->clients.keys[client_slot] = client_key;
+
+    log2_histogram_add(&queue->statistics.depth_histogram, queue->count);
+
+    ServerRequestRing_t *ring = &queue->rings[server_queue_priority_class(queue, packet)];
+    ServerRequest_t *request = server_queue_ring_entry(queue, ring, ring->count);
+    request->client_address = *client_address;
+    request->client_address_length = client_address_length;
+    request->bytes_received = bytes_received;
+    clock_gettime(CLOCK_MONOTONIC, &request->received_clock);
+    memcpy(request->packet_buffer, packet, bytes_received);
+    request->packet_buffer[bytes_received] = 0;
+    ring->count++;
+    queue->count++;
+    queue->statistics.requests_enqueued++;
+
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+    return SERVER_QUEUE_PUSHED;
+}
+
+/**
+ * Copies the next request to be admitted out of the queue and removes it,
+ * blocking until a request is available or the (monotonic clock) deadline passes.
+ * A NULL deadline waits indefinitely.
+ * Returns false on timeout, or once the queue is closed, without handing out any requests left in it.
+ */
+bool server_queue_pop(ServerRequestQueue_t *queue, ServerRequest_t *request_out, const struct timespec *deadline)
+{
+    pthread_mutex_lock(&queue->mutex);
+
+    while (queue->count == 0 && !queue->closed)
+    {
+        if (deadline == NULL)
+        {
+            pthread_cond_wait(&queue->not_empty, &queue->mutex);
+        }
+        else if (pthread_cond_timedwait(&queue->not_empty, &queue->mutex, deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+
+    if (queue->closed || queue->count == 0)
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        return false;
+    }
+
+    for (uint8_t class_idx = 0; class_idx < SERVER_REQUEST_PRIORITY_CLASSES; class_idx++)
+    {
+        if (queue->rings[class_idx].count > 0)
+        {
+            server_queue_ring_pop(queue, &queue->rings[class_idx], request_out);
+            break;
+        }
+    }
+
+    queue->statistics.requests_admitted++;
+    log2_histogram_add(&queue->statistics.wait_ms_histogram, seconds_since_clock(request_out->received_clock) * 1000);
+
+    pthread_mutex_unlock(&queue->mutex);
+    return true;
+}
+
+/**
+ * Removes a single request that has been waiting longer than the queue's maximum wait time, if there is one,
+ * so that the caller can reject it - its client has likely given up by now anyway.
+ * Since every ring is in arrival order, only ring heads need to be checked.
+ */
+bool server_queue_pop_expired(ServerRequestQueue_t *queue, ServerRequest_t *request_out)
+{
+    bool found = false;
+    pthread_mutex_lock(&queue->mutex);
+
+    for (uint8_t class_idx = 0; class_idx < SERVER_REQUEST_PRIORITY_CLASSES && !found; class_idx++)
+    {
+        ServerRequestRing_t *ring = &queue->rings[class_idx];
+
+        if (ring->count > 0 && seconds_since_clock(server_queue_ring_entry(queue, ring, 0)->received_clock) * 1000 >= queue->max_wait_ms)
+        {
+            server_queue_ring_pop(queue, ring, request_out);
+            queue->statistics.rejected_timed_out++;
+            found = true;
+        }
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+    return found;
+}
+
+/**
+ * Computes the (monotonic clock) time at which the oldest queued request expires,
+ * capped at the given maximum delay from now.
+ */
+void server_queue_next_deadline(ServerRequestQueue_t *queue, struct timespec *deadline_out, uint32_t max_delay_ms)
+{
+    struct timespec now_clock;
+    clock_gettime(CLOCK_MONOTONIC, &now_clock);
+    *deadline_out = clock_after_milliseconds(now_clock, max_delay_ms);
+
+    pthread_mutex_lock(&queue->mutex);
+
+    for (uint8_t class_idx = 0; class_idx < SERVER_REQUEST_PRIORITY_CLASSES; class_idx++)
+    {
+        ServerRequestRing_t *ring = &queue->rings[class_idx];
+
+        if (ring->count == 0)
+        {
+            continue;
+        }
+
+        struct timespec expiry_clock = clock_after_milliseconds(server_queue_ring_entry(queue, ring, 0)->received_clock, queue->max_wait_ms);
+
+        if (expiry_clock.tv_sec < deadline_out->tv_sec
+            || (expiry_clock.tv_sec == deadline_out->tv_sec && expiry_clock.tv_nsec < deadline_out->tv_nsec))
+        {
+            *deadline_out = expiry_clock;
+        }
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+bool server_queue_is_closed(ServerRequestQueue_t *queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    bool closed = queue->closed;
+    pthread_mutex_unlock(&queue->mutex);
+    return closed;
+}
+
+/**
+ * Marks the queue as closed and wakes up all blocked consumers, so they can terminate.
+ */
+void server_queue_close(ServerRequestQueue_t *queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+/**
+ * Prints the admission counters, along with the distributions of queue depth on arrival and of time spent waiting.
+ */
+void server_queue_print_statistics(ServerRequestQueue_t *queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    ServerQueueStatistics_t *stats = &queue->statistics;
+
+    LOG_INFO("Request queue (%s admission, capacity %u, max wait %u ms): %u waiting, %lu enqueued, %lu admitted, "
+            "%lu rejected as queue full, %lu rejected as timed out, %lu duplicates dropped.\n",
+            queue->policy == SERVER_ADMISSION_PRIORITY ? "priority" : "fifo", queue->capacity, queue->max_wait_ms, queue->count,
+            stats->requests_enqueued, stats->requests_admitted, stats->rejected_queue_full, stats->rejected_timed_out, stats->duplicates_dropped);
+
+    log2_histogram_print(&stats->depth_histogram, "Queue depth on arrival", "requests");
+    log2_histogram_print(&stats->wait_ms_histogram, "Time waiting in queue", "ms");
+
+    pthread_mutex_unlock(&queue->mutex);
+}
@@ -0,0 +1,117 @@
+/**
+ * The Server-Queue header declares the admission queue through which the listener thread
+ * hands raw incoming requests over to be set up and served by other threads,
+ * so that the listener itself never does more than receive, classify and enqueue.
+ * Requests wait in the queue until a connection slot frees up, or until they time out.
+ */
+
+#ifndef SERVER_QUEUE_H
+#define SERVER_QUEUE_H
+
+#include "common.h"
+#include "networking_common.h"
+#include "tftp_common.h"
+
+#define SERVER_REQUEST_BUFFER_SIZE (sizeof(Packet_t) + TFTP_FILENAME_MAX * 2)
+#define SERVER_REQUEST_QUEUE_CAPACITY_DEFAULT 256
+#define SERVER_REQUEST_QUEUE_MAX_WAIT_MS_DEFAULT 3000
+#define SERVER_REQUEST_PRIORITY_CLASSES 3
+
+/**
+ * The order in which queued requests are admitted:
+ * either strictly in order of arrival, or by priority class first (see server_queue_priority_class()).
+ */
+typedef enum ServerAdmissionPolicy
+{
+    SERVER_ADMISSION_FIFO = 0,
+    SERVER_ADMISSION_PRIORITY = 1,
+} ServerAdmissionPolicy_t;
+
+typedef enum ServerQueuePushResult
+{
+    SERVER_QUEUE_PUSHED = 0,
+    SERVER_QUEUE_FULL = 1,
+    SERVER_QUEUE_DUPLICATE = 2,
+    SERVER_QUEUE_CLOSED = 3,
+} ServerQueuePushResult_t;
+
+/**
+ * A raw request packet as received by the listener, along with where and when it came from.
+ * The packet buffer has room for one extra byte, which is always zero,
+ * so that the request string fields are guaranteed to be terminated.
+ */
+typedef struct ServerRequest
+{
+    struct sockaddr_in client_address;
+    socklen_t client_address_length;
+    ssize_t bytes_received;
+    struct timespec received_clock;
+    uint8_t packet_buffer[SERVER_REQUEST_BUFFER_SIZE + 1];
+} ServerRequest_t;
+
+/**
+ * A FIFO ring of pending requests belonging to a single priority class.
+ */
+typedef struct ServerRequestRing
+{
+    uint32_t head_idx;
+    uint32_t count;
+    ServerRequest_t *requests;
+} ServerRequestRing_t;
+
+/**
+ * Open addressing (linear probing) hash set of the clients, by address and port, with a request waiting in the queue,
+ * so that spotting a retransmitted request takes no scan of the queue.
+ * It has at least twice as many slots as the queue has capacity, which keeps probe sequences short.
+ */
+typedef struct ServerQueueClientSet
+{
+    uint32_t mask; // slots - 1, the slot count being a power of two
+    uint64_t *keys; // 0 marks a free slot
+} ServerQueueClientSet_t;
+
+/**
+ * Admission statistics, updated under the queue mutex:
+ * the queue depth seen by every arriving request, and how long every request waited in the queue.
+ */
+typedef struct ServerQueueStatistics
+{
+    uint64_t requests_enqueued;
+    uint64_t requests_admitted;
+    uint64_t rejected_queue_full;
+    uint64_t rejected_timed_out;
+    uint64_t duplicates_dropped;
+    Log2Histogram_t depth_histogram;
+    Log2Histogram_t wait_ms_histogram;
+} ServerQueueStatistics_t;
+
+/**
+ * Bounded queue of pending requests, shared between the listener thread (producer)
+ * and the dispatcher thread (consumer), via mutex and condition variable.
+ * The capacity bounds the total number of requests across all priority classes.
+ */
+typedef struct ServerRequestQueue
+{
+    bool closed;
+    ServerAdmissionPolicy_t policy;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t max_wait_ms;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    ServerRequestRing_t rings[SERVER_REQUEST_PRIORITY_CLASSES];
+    ServerQueueClientSet_t clients;
+    ServerQueueStatistics_t statistics;
+} ServerRequestQueue_t;
+
+bool server_queue_init(ServerRequestQueue_t *queue, uint32_t capacity, uint32_t max_wait_ms, ServerAdmissionPolicy_t policy);
+void server_queue_deinit(ServerRequestQueue_t *queue);
+ServerQueuePushResult_t server_queue_push(ServerRequestQueue_t *queue, const Packet_t *packet, ssize_t bytes_received, const struct sockaddr_in *client_address, socklen_t client_address_length);
+bool server_queue_pop(ServerRequestQueue_t *queue, ServerRequest_t *request_out, const struct timespec *deadline);
+bool server_queue_pop_expired(ServerRequestQueue_t *queue, ServerRequest_t *request_out);
+void server_queue_next_deadline(ServerRequestQueue_t *queue, struct timespec *deadline_out, uint32_t max_delay_ms);
+bool server_queue_is_closed(ServerRequestQueue_t *queue);
+void server_queue_close(ServerRequestQueue_t *queue);
+void server_queue_print_statistics(ServerRequestQueue_t *queue);
+
+#endif
@@ -0,0 +1,228 @@
+#include "slab.h"
+#include "log.h"
+
+/**
+ * Payload sizes of the packet buffer classes, each holding batches of packets adding up to its size:
+ * the smallest fits a single short packet, and the largest fits any batch.
+ */
+static const uint32_t slab_packet_class_payloads[SLAB_PACKET_CLASSES_COUNT] =
+{
+    TFTP_ERROR_MESSAGE_MAX_LENGTH, 512, 1024, 2048, 4096, 8192, 16384, 32768, TFTP_BLKSIZE_MAX, TFTP_BATCH_MAX_BYTES
+};
+
+/**
+ * The slab set attached to the calling thread, or NULL if it has none.
+ */
+static __thread SlabSet_t *slab_thread_set = NULL;
+
+static void slab_cache_init(SlabCache_t *cache, size_t object_size, uint32_t max_cached)
+{
+    explicit_bzero(cache, sizeof(SlabCache_t));
+    cache->object_size = object_size;
+    cache->max_cached = max_cached;
+}
+
+static void slab_cache_deinit(SlabCache_t *cache)
+{
+    while (cache->free_list != NULL)
+    {
+        void *next = *(void **)cache->free_list;
+        free(cache->free_list);
+        cache->free_list = next;
+    }
+
+    cache->cached_count = 0;
+}
+
+/**
+ * Looks up the cache responsible for objects of the given kind and size in the calling thread's slab set.
+ * Returns NULL if the thread has no slab set, or if the size exceeds what the cache holds.
+ */
+static SlabCache_t *slab_find_cache(SlabObjectKind_t kind, size_t size)
+{
+    SlabSet_t *set = slab_thread_set;
+    SlabCache_t *cache = NULL;
+
+    if (set == NULL)
+    {
+        return NULL;
+    }
+
+    switch (kind)
+    {
+        case SLAB_OPERATION_DATA:
+            cache = &set->operation_data;
+            break;
+        case SLAB_TRANSFER_DATA:
+            cache = &set->transfer_data;
+            break;
+        case SLAB_PACKET_BUFFER:
+            for (uint8_t i = 0; i < SLAB_PACKET_CLASSES_COUNT; i++)
+            {
+                if (size <= set->packet_buffers[i].object_size)
+                {
+                    cache = &set->packet_buffers[i];
+                    break;
+                }
+            }
+            break;
+    }
+
+    return (cache != NULL && size <= cache->object_size) ? cache : NULL;
+}
+
+/**
+ * Initializes all caches of a slab set, each retaining up to the given number of released objects,
+ * and packet buffer classes no more than SLAB_PACKET_CLASS_MAX_CACHED_BYTES worth of them:
+ * after a burst of uploads, a cache of the largest class sized for every session would hold on to gigabytes.
+ */
+void slab_set_init(SlabSet_t *set, uint32_t max_cached)
+{
+    slab_cache_init(&set->operation_data, SLAB_OPERATION_DATA_SIZE, max_cached);
+    slab_cache_init(&set->transfer_data, sizeof(TransferData_t), max_cached);
+
+    for (uint8_t i = 0; i < SLAB_PACKET_CLASSES_COUNT; i++)
+    {
+        size_t object_size = sizeof(Packet_t) + slab_packet_class_payloads[i];
+        size_t budget_count = SLAB_PACKET_CLASS_MAX_CACHED_BYTES / object_size;
+        slab_cache_init(&set->packet_buffers[i], object_size, budget_count < max_cached ? budget_count : max_cached);
+    }
+}
+
+/**
+ * Frees all cached objects of a slab set. Counters are left intact for reporting.
+ */
+void slab_set_deinit(SlabSet_t *set)
+{
+    slab_cache_deinit(&set->operation_data);
+    slab_cache_deinit(&set->transfer_data);
+
+    for (uint8_t i = 0; i < SLAB_PACKET_CLASSES_COUNT; i++)
+    {
+        slab_cache_deinit(&set->packet_buffers[i]);
+    }
+
+    if (slab_thread_set == set)
+    {
+        slab_thread_set = NULL;
+    }
+}
+
+/**
+ * Makes the given slab set serve all slab allocations of the calling thread.
+ */
+void slab_set_attach(SlabSet_t *set)
+{
+    slab_thread_set = set;
+}
+
+static void slab_counters_accumulate(SlabCounters_t *total, const SlabCounters_t *counters)
+{
+    total->allocations += counters->allocations;
+    total->heap_allocations += counters->heap_allocations;
+    total->releases += counters->releases;
+    total->heap_frees += counters->heap_frees;
+}
+
+/**
+ * Adds the counters of a slab set to those of another, e.g. to total them over all worker threads.
+ */
+void slab_set_accumulate(SlabSet_t *total, const SlabSet_t *set)
+{
+    slab_counters_accumulate(&total->operation_data.counters, &set->operation_data.counters);
+    slab_counters_accumulate(&total->transfer_data.counters, &set->transfer_data.counters);
+
+    for (uint8_t i = 0; i < SLAB_PACKET_CLASSES_COUNT; i++)
+    {
+        slab_counters_accumulate(&total->packet_buffers[i].counters, &set->packet_buffers[i].counters);
+    }
+}
+
+static void slab_print_cache_counters(const SlabCache_t *cache, const char *name)
+{
+    if (cache->counters.allocations == 0)
+    {
+        return;
+    }
+
+    LOG_INFO("   %-24s %10lu allocations, %6lu from heap, %10lu releases, %6lu to heap\n", name,
+            cache->counters.allocations, cache->counters.heap_allocations, cache->counters.releases, cache->counters.heap_frees);
+}
+
+/**
+ * Prints the counters of every cache that has been allocated from at least once.
+ */
+void slab_set_print_counters(const SlabSet_t *set, const char *title)
+{
+    char name[32];
+
+    LOG_INFO(" %s:\n", title);
+    slab_print_cache_counters(&set->operation_data, "operation data");
+    slab_print_cache_counters(&set->transfer_data, "transfer data");
+
+    for (uint8_t i = 0; i < SLAB_PACKET_CLASSES_COUNT; i++)
+    {
+        snprintf(name, sizeof(name), "buffers up to %u bytes", slab_packet_class_payloads[i]);
+        slab_print_cache_counters(&set->packet_buffers[i], name);
+    }
+}
+
+/**
+ * Allocates an object of the given kind and size, preferably by reusing a cached one.
+ * A cache miss allocates the cache's full object size from the heap, so that the object can later be cached.
+ */
+void *slab_allocate(SlabObjectKind_t kind, size_t size)
+{
+    SlabCache_t *cache = slab_find_cache(kind, size);
+
+    if (cache == NULL)
+    {
+        return malloc(size);
+    }
+
+    cache->counters.allocations++;
+
+    if (cache->free_list != NULL)
+    {
+        void *object = cache->free_list;
+        cache->free_list = *(void **)object;
+        cache->cached_count--;
+        return object;
+    }
+
+    cache->counters.heap_allocations++;
+    return malloc(cache->object_size);
+}
+
+/**
+ * Releases an object previously returned by slab_allocate() with the same kind and size,
+ * keeping it cached for reuse unless the cache is already full.
+ */
+void slab_release(SlabObjectKind_t kind, void *object, size_t size)
+{
+    if (object == NULL)
+    {
+        return;
+    }
+
+    SlabCache_t *cache = slab_find_cache(kind, size);
+
+    if (cache == NULL)
+    {
+        free(object);
+        return;
+    }
+
+    cache->counters.releases++;
+
+    if (cache->cached_count >= cache->max_cached)
+    {
+        cache->counters.heap_frees++;
+        free(object);
+        return;
+    }
+
+    *(void **)object = cache->free_list;
+    cache->free_list = object;
+    cache->cached_count++;
+}
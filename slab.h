@@ -0,0 +1,71 @@
+/**
+ * The Slab header declares per-thread object caches for the objects every operation allocates:
+ * operation data, transfer data, and packet batch buffers (grouped into size classes).
+ * A thread attaches its own slab set, after which released objects are kept on free-lists for reuse
+ * instead of being handed back to the heap, so a warmed-up server makes no heap allocations per request.
+ * Threads without an attached slab set (e.g. the client) simply fall through to malloc() and free().
+ * Slab sets are not thread-safe: objects must be released by the thread that allocated them.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "common.h"
+#include "tftp_common.h"
+
+#define SLAB_PACKET_CLASSES_COUNT 10
+#define SLAB_OPERATION_DATA_SIZE (sizeof(OperationData_t) + TFTP_FILENAME_MAX * 2 + 1)
+#define SLAB_PACKET_CLASS_MAX_CACHED_BYTES (4 * 1024 * 1024) // per class and thread, so that large buffers are not kept around by the thousand
+
+typedef enum SlabObjectKind
+{
+    SLAB_OPERATION_DATA = 0,
+    SLAB_TRANSFER_DATA = 1,
+    SLAB_PACKET_BUFFER = 2,
+} SlabObjectKind_t;
+
+/**
+ * Allocation counters of a single cache.
+ * Every allocation not served from the free-list is a heap allocation,
+ * so in steady state heap_allocations stops growing while allocations keeps counting requests.
+ */
+typedef struct SlabCounters
+{
+    uint64_t allocations;
+    uint64_t heap_allocations;
+    uint64_t releases;
+    uint64_t heap_frees;
+} SlabCounters_t;
+
+/**
+ * A free-list of same-sized objects, linked through their own first bytes while cached.
+ */
+typedef struct SlabCache
+{
+    size_t object_size;
+    uint32_t cached_count;
+    uint32_t max_cached;
+    void *free_list;
+    SlabCounters_t counters;
+} SlabCache_t;
+
+/**
+ * All caches owned by a single thread.
+ */
+typedef struct SlabSet
+{
+    SlabCache_t operation_data;
+    SlabCache_t transfer_data;
+    SlabCache_t packet_buffers[SLAB_PACKET_CLASSES_COUNT];
+} SlabSet_t;
+
+void slab_set_init(SlabSet_t *set, uint32_t max_cached);
+void slab_set_deinit(SlabSet_t *set);
+void slab_set_attach(SlabSet_t *set);
+void slab_set_accumulate(SlabSet_t *total, const SlabSet_t *set);
+void slab_set_print_counters(const SlabSet_t *set, const char *title);
+
+void *slab_allocate(SlabObjectKind_t kind, size_t size);
+void slab_release(SlabObjectKind_t kind, void *object, size_t size);
+
+#endif
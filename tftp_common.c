@@ -1,4 +1,19 @@
 #include "tftp_common.h"
+#include "log.h"
+#include "slab.h"
+#include "io_ring.h"
+#include "metrics.h"
+#include "impair.h"
+
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/statvfs.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <linux/errqueue.h>
 
 /**
  * This macro is used to check for a user termination signal at multiple points during file transfer,
@@ -6,7 +21,7 @@
  */
 #define CHECK_SIGTERM_DURING_TRANSFER \
         if (should_terminate) { \
-        printf("User requested termination - aborting.\n"); \
+        LOG_INFO("User requested termination - aborting.\n"); \
         tftp_send_error(TFTP_ERROR_UNDEFINED, \
         tftp_common.is_server ? "Server program terminated" : "Client program terminated", \
         NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length); \
@@ -14,18 +29,26 @@
 
 /**
  * This struct holds data common to TFTP client and server operations.
- * The 'is_server' flag is the only non-const field, as it relies on user input.
+ * The fields up to the retransmission settings rely on user input, the rest are const.
  */
 TFTPCommonData_t tftp_common =
 {
     .is_server = false,
-    .max_retry_count = 5,
+    .requests_port = TFTP_REQUESTS_PORT_DEFAULT,
+    .transmit_method = TFTP_TRANSMIT_COPY,
+    .segmentation_offload = true,
+    .path_mtu_blksize = true,
+    .max_retry_count = TFTP_RETRIES_DEFAULT,
+    .rto_min_ms = TFTP_RTO_MIN_MS_DEFAULT,
+    .rto_max_ms = TFTP_RTO_MAX_MS_DEFAULT,
     .operation_modes =
     {
-        { 2, "serve", "Serve storage folder to clients", "%s %s" },
-        { 4, "write", "Write named file to server", "%s %s <server ip> <filename> [transfer mode] [block size]" },
-        { 4, "read", "Read named file from server", "%s %s <server ip> <filename> [transfer mode] [block size]" },
-        { 4, "delete", "Erase named file from server", "%s %s <server ip> <filename>" },
+        { 2, "serve", "Serve storage folder to clients", "%s %s [option=value ...]" },
+        { 4, "write", "Write named file to server", "%s %s <server ip[:port]> <filename> [transfer mode] [block size|auto] [window size]" },
+        { 4, "read", "Read named file from server", "%s %s <server ip[:port]> <filename> [transfer mode] [block size|auto] [window size]" },
+        { 4, "delete", "Erase named file from server", "%s %s <server ip[:port]> <filename>" },
+        { 4, "mread", "Read named file over multicast", "%s %s <server ip[:port]> <filename> [transfer mode] [block size|auto] [window size]" },
+        { 4, "load", "Load server with many clients", "%s %s <server ip[:port]> <file[:weight],...> [option=value ...]" },
     },
     .transfer_mode_strings =
     {
@@ -41,6 +64,7 @@ TFTPCommonData_t tftp_common =
         "DATA",
         "ACK",
         "ERROR",
+        "OACK",
         "DRQ",
     },
 };
@@ -63,42 +87,37 @@ struct sockaddr_in init_peer_socket_address(struct in_addr peer_address_bin, in_
 /**
  * initializes a socket for TFTP data operations, binds it to a random ephemeral port,
  * and sets some convenient flags for consistent operation.
+ * Data sockets are deliberately not flagged for address/port reuse:
+ * with either flag set, a second session could bind a port that is already in use
+ * and the two would end up stealing each other's packets.
+ * If the random port range looks exhausted, the kernel is left to pick any free port.
+ * Returns false if the socket could not be set up (e.g. out of file descriptors), in which case none is left open.
  */
-void tftp_init_bound_data_socket(int *socket_ptr, struct sockaddr_in *address_ptr)
+bool tftp_init_bound_data_socket(int *socket_ptr, struct sockaddr_in *address_ptr)
 {
-    static const int reuse_flag = 1;
-    static const struct timeval socket_timeout = { .tv_sec = 1, .tv_usec = 0 };
+    static const uint8_t max_random_bind_attempts = 64;
+    static const struct timeval socket_timeout = { .tv_sec = TFTP_TIMEOUT_SECONDS, .tv_usec = 0 };
 
     *socket_ptr = socket(AF_INET, SOCK_DGRAM, 0);
 
     if (*socket_ptr < 0)
     {
-        perror("Failed to create data socket");
-        exit(EXIT_FAILURE);
-    }
-
-    if(0 > setsockopt(*socket_ptr, SOL_SOCKET, SO_REUSEADDR,  &reuse_flag, sizeof(reuse_flag)))
-    {
-        perror("Failed to set socket 'reuse address' option");
-        exit(EXIT_FAILURE);
-    }
-
-    if(0 > setsockopt(*socket_ptr, SOL_SOCKET, SO_REUSEPORT,  &reuse_flag, sizeof(reuse_flag)))
-    {
-        perror("Failed to set socket 'reuse port' option");
-        exit(EXIT_FAILURE);
+        LOG_ERRNO("Failed to create data socket");
+        return false;
     }
 
     if(0 > setsockopt(*socket_ptr, SOL_SOCKET, SO_RCVTIMEO,  &socket_timeout, sizeof(socket_timeout)))
     {
-        perror("Failed to set socket timeout");
-        exit(EXIT_FAILURE);
+        LOG_ERRNO("Failed to set socket timeout");
+        close(*socket_ptr);
+        *socket_ptr = -1;
+        return false;
     }
 
     uint16_t rx_port;
     int bind_result = -1;
 
-    while (bind_result < 0)
+    for (uint8_t attempt = 0; bind_result < 0 && attempt < max_random_bind_attempts; attempt++)
     {
         rx_port = random_range(tftp_common.is_server ? SERVER_DATA_PORT_MIN : CLIENT_DATA_PORT_MIN,
                 tftp_common.is_server ? SERVER_DATA_PORT_MAX : CLIENT_DATA_PORT_MAX);
@@ -110,25 +129,203 @@ void tftp_init_bound_data_socket(int *socket_ptr, struct sockaddr_in *address_pt
 
     if (bind_result < 0)
     {
-        perror("Somehow failed to bind to an ephemeral socket");
-        exit(EXIT_FAILURE);
+        address_ptr->sin_port = 0;
+        bind_result = bind(*socket_ptr,
+                (struct sockaddr*)address_ptr,
+                sizeof(*address_ptr));
+
+        socklen_t address_length = sizeof(*address_ptr);
+        getsockname(*socket_ptr, (struct sockaddr*)address_ptr, &address_length);
+        rx_port = ntohs(address_ptr->sin_port);
+    }
+
+    if (bind_result < 0)
+    {
+        LOG_ERRNO("Somehow failed to bind to an ephemeral socket");
+        close(*socket_ptr);
+        *socket_ptr = -1;
+        return false;
+    }
+
+    LOG_DEBUG("Created data socket and randomly bound to port %u.\n", rx_port);
+    return true;
+}
+
+/**
+ * Parses the decimal value of an option, which must consist of digits only.
+ */
+static bool tftp_parse_option_value(const char *value_string, uint64_t *value)
+{
+    char *end = NULL;
+
+    if (*value_string < '0' || *value_string > '9')
+    {
+        return false;
+    }
+
+    errno = 0;
+    *value = strtoull(value_string, &end, 10);
+    return errno == 0 && *end == '\0';
+}
+
+/**
+ * Works out the largest block size whose DATA packets fit within the MTU of the route to the peer (or multicast group),
+ * i.e. which are never fragmented on the way, since losing any one fragment loses the whole block.
+ * The route MTU is only reported for connected sockets, so a throwaway one is connected to the peer.
+ * Falls back to the default block size if the MTU cannot be determined.
+ */
+uint16_t tftp_path_mtu_block_size(const struct sockaddr_in *peer_address)
+{
+    static const int discover_mode = IP_PMTUDISC_DO;
+    int mtu = 0;
+    socklen_t mtu_length = sizeof(mtu);
+    int probe_socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (probe_socket < 0)
+    {
+        LOG_ERRNO("Failed to create path MTU probe socket");
+        return TFTP_BLKSIZE_DEFAULT;
+    }
+
+    if (0 > setsockopt(probe_socket, IPPROTO_IP, IP_MTU_DISCOVER, &discover_mode, sizeof(discover_mode))
+        || 0 > connect(probe_socket, (const struct sockaddr *)peer_address, sizeof(struct sockaddr_in))
+        || 0 > getsockopt(probe_socket, IPPROTO_IP, IP_MTU, &mtu, &mtu_length))
+    {
+        LOG_ERRNO("Failed to query path MTU");
+        close(probe_socket);
+        return TFTP_BLKSIZE_DEFAULT;
+    }
+
+    close(probe_socket);
+
+    int block_size = mtu - (int)(sizeof(struct iphdr) + sizeof(struct udphdr) + sizeof(Packet_t));
+    block_size = block_size < TFTP_BLKSIZE_DEFAULT ? TFTP_BLKSIZE_DEFAULT : (block_size > TFTP_BLKSIZE_MAX ? TFTP_BLKSIZE_MAX : block_size);
+
+    LOG_DEBUG("Path MTU to %s is %d bytes, fitting blocks of %d bytes.\n", inet_ntoa(peer_address->sin_addr), mtu, block_size);
+    return block_size;
+}
+
+/**
+ * Takes up a single requested option (RFC 2347), flagging it to be acknowledged.
+ * Block and window sizes beyond what we support are lowered to our maximum (RFC 2348, RFC 7440),
+ * and a timeout out of range is not acknowledged (RFC 2349), nor is any option we do not know.
+ * Returns false if the option's value is malformed or cannot be honored at all, e.g. a block size below the minimum.
+ */
+bool tftp_negotiate_option(OperationData_t *data, const TFTPOption_t *option)
+{
+    uint64_t value;
+
+    if (strcasecmp(option->name, TFTP_BLKSIZE_STRING) == 0)
+    {
+        // "auto" asks for the largest block size that still fits within a single datagram on the route to the peer
+        if (strcasecmp(option->value, TFTP_BLKSIZE_AUTO_STRING) == 0)
+        {
+            data->block_size = tftp_path_mtu_block_size(&data->peer_address);
+            data->option_flags |= TFTP_OPTION_BLKSIZE;
+            return true;
+        }
+
+        if (!tftp_parse_option_value(option->value, &value) || (value > 0 && value < TFTP_BLKSIZE_MIN))
+        {
+            return false;
+        }
+
+        // a zero block size is how our own client has always asked for the default
+        if (value > 0)
+        {
+            data->block_size = value > TFTP_BLKSIZE_MAX ? TFTP_BLKSIZE_MAX : value;
+            data->option_flags |= TFTP_OPTION_BLKSIZE;
+        }
+    }
+    else if (strcasecmp(option->name, TFTP_WINDOWSIZE_STRING) == 0)
+    {
+        if (!tftp_parse_option_value(option->value, &value))
+        {
+            return false;
+        }
+
+        if (value > 0)
+        {
+            data->window_size = value > TFTP_WINDOWSIZE_MAX ? TFTP_WINDOWSIZE_MAX : value;
+            data->option_flags |= TFTP_OPTION_WINDOWSIZE;
+        }
+    }
+    else if (strcasecmp(option->name, TFTP_TIMEOUT_STRING) == 0)
+    {
+        if (!tftp_parse_option_value(option->value, &value))
+        {
+            return false;
+        }
+
+        if (value >= TFTP_TIMEOUT_MIN && value <= TFTP_TIMEOUT_MAX)
+        {
+            data->timeout_seconds = value;
+            data->option_flags |= TFTP_OPTION_TIMEOUT;
+        }
+    }
+    else if (strcasecmp(option->name, TFTP_TSIZE_STRING) == 0)
+    {
+        if (!tftp_parse_option_value(option->value, &value))
+        {
+            return false;
+        }
+
+        data->transfer_size = value;
+        data->option_flags |= TFTP_OPTION_TSIZE;
+    }
+    else if (strcasecmp(option->name, TFTP_MULTICAST_STRING) == 0)
+    {
+        // a client asks with an empty value, while the server answers with "<group address>,<port>,<master flag>"
+        if (option->value[0] != '\0')
+        {
+            char address_string[ADDRESS_BUFF_LENGTH];
+            unsigned int port;
+            unsigned int master;
+            char trailing;
+
+            if (3 != sscanf(option->value, "%39[0-9.],%u,%u%c", address_string, &port, &master, &trailing)
+                || port == 0 || port > UINT16_MAX || master > 1
+                || !parse_address(address_string, &data->multicast_address.sin_addr)
+                || !IN_MULTICAST(ntohl(data->multicast_address.sin_addr.s_addr)))
+            {
+                return false;
+            }
+
+            data->multicast_address.sin_family = AF_INET;
+            data->multicast_address.sin_port = htons(port);
+            data->multicast_master = master;
+        }
+
+        data->option_flags |= TFTP_OPTION_MULTICAST;
+    }
+    else
+    {
+        LOG_INFO("Ignoring unknown option '%s'.\n", option->name);
     }
 
-    printf("Created data socket and randomly bound to port %u.\n", rx_port);
+    return true;
 }
 
 /**
  * This function allocates and initializes an OperationData_t struct which is used to define all TFTP operations,
  * whether they eventually involve a file transfer or not.
+ * The given options are those requested by the client, or on the client side, those it is about to request.
  */
-OperationData_t *tftp_init_operation_data(OperationId_t operation, struct sockaddr_in peer_address, char *filename, char *mode_string, char *blocksize_string)
+OperationData_t *tftp_init_operation_data(OperationId_t operation, struct sockaddr_in peer_address, char *filename, char *mode_string, const TFTPOptionList_t *options)
 {
     bool is_delete = false;
     uint16_t filename_length = strlen(filename) + 1;
 
-    OperationData_t *data = malloc(sizeof(OperationData_t) + filename_length);
+    OperationData_t *data = slab_allocate(SLAB_OPERATION_DATA, sizeof(OperationData_t) + filename_length);
+
+    if (data == NULL)
+    {
+        LOG_ERRNO("Failed to allocate operation data");
+        return NULL;
+    }
 
     explicit_bzero(data, sizeof(OperationData_t) + filename_length);
+    data->path_len = filename_length;
 
     // initializing addresses and binding the socket first,
     // so that we can send an error later if required
@@ -138,7 +335,12 @@ OperationData_t *tftp_init_operation_data(OperationId_t operation, struct sockad
     data->peer_address = peer_address;
     data->peer_address_length = sizeof(data->peer_address);
 
-    tftp_init_bound_data_socket(&data->data_socket, &data->local_address);
+    // without a data socket, there is no way to answer the peer from its own transfer ID, so the request is dropped
+    if (!tftp_init_bound_data_socket(&data->data_socket, &data->local_address))
+    {
+        tftp_free_operation_data(data);
+        return NULL;
+    }
 
     // filling in the rest of the data
     data->operation_id = operation;
@@ -164,7 +366,6 @@ OperationData_t *tftp_init_operation_data(OperationId_t operation, struct sockad
     }
 
     strcpy(data->path, filename);
-    data->path_len = filename_length;
 
     if (!is_delete)
     {
@@ -172,7 +373,7 @@ OperationData_t *tftp_init_operation_data(OperationId_t operation, struct sockad
         if (mode_string == NULL || strlen(mode_string) == 0)
         {
             data->transfer_mode = TFTP_MODE_OCTET;
-            printf("Transfer mode unspecified - defaulting to octet (binary) mode.\n");
+            LOG_DEBUG("Transfer mode unspecified - defaulting to octet (binary) mode.\n");
         }
         // if the transfer mode IS specified, we try to match it to one we recognize
         else
@@ -205,7 +406,7 @@ OperationData_t *tftp_init_operation_data(OperationId_t operation, struct sockad
             // this program will NEVER support TFTP e-mail forwarding. unless I get paid to implement it.
             // please contact me ASAP if you would like to pay me to implement TFTP e-mail forwarding in the current year.
             case TFTP_MODE_MAIL:
-                printf("Invalid transfer mode (%s) specified! Aborting.\n", mode_string == NULL ? "NULL" : mode_string);
+                LOG_WARN("Invalid transfer mode (%s) specified! Aborting.\n", mode_string == NULL ? "NULL" : mode_string);
                 tftp_send_error(TFTP_ERROR_ILLEGAL_OPERATION, "invalid transfer mode: ", mode_string, data->data_socket, &data->peer_address, data->peer_address_length); 
                 tftp_free_operation_data(data);
                 return NULL;
@@ -214,37 +415,50 @@ OperationData_t *tftp_init_operation_data(OperationId_t operation, struct sockad
                 break;
         }
 
-        printf("Transfer mode: (%s).\n", mode_string);
+        LOG_DEBUG("Transfer mode: (%s).\n", mode_string);
 
-        // determine requested block size
-        data->block_size = 0;
+        data->block_size = TFTP_BLKSIZE_DEFAULT;
+        data->window_size = TFTP_WINDOWSIZE_DEFAULT;
 
-        if (blocksize_string != NULL)
+        for (uint8_t idx = 0; options != NULL && idx < options->count; idx++)
         {
-            data->block_size = atoi(blocksize_string);
+            if (!tftp_negotiate_option(data, &options->options[idx]))
+            {
+                LOG_WARN("Requested option '%s' with value '%s' not supported! Aborting.\n", options->options[idx].name, options->options[idx].value);
+                tftp_send_error(TFTP_ERROR_OPTION_NEGOTIATION, "unsupported option value: ", options->options[idx].name, data->data_socket, &data->peer_address, data->peer_address_length);
+                tftp_free_operation_data(data);
+                return NULL;
+            }
         }
 
-        if (data->block_size == 0)
+        // the server never agrees to blocks which would have to be fragmented on the way to the peer
+        if (tftp_common.is_server && tftp_common.path_mtu_blksize && (data->option_flags & TFTP_OPTION_BLKSIZE))
         {
-            printf("Block size unspecified, defaulting to %d (this is normal!).\n", TFTP_BLKSIZE_DEFAULT);
-            data->block_size = TFTP_BLKSIZE_DEFAULT;
+            uint16_t path_block_size = tftp_path_mtu_block_size(&data->peer_address);
+            data->block_size = data->block_size > path_block_size ? path_block_size : data->block_size;
         }
-        else if (data->block_size < TFTP_BLKSIZE_MIN || data->block_size > TFTP_BLKSIZE_MAX)
+
+        if (data->option_flags & TFTP_OPTION_BLKSIZE)
         {
-            printf("Requested block size (%u bytes) not supported! aborting.\n", data->block_size);
-            char range_str[16];
-            sprintf(range_str, "%d-%d", TFTP_BLKSIZE_MIN, TFTP_BLKSIZE_MAX);
-            tftp_send_error(TFTP_ERROR_ILLEGAL_OPERATION, "unsupported block size. Valid range is ", range_str, data->data_socket, &data->peer_address, data->peer_address_length); 
-            tftp_free_operation_data(data);
-            return NULL;
+            LOG_DEBUG("Transfer block size: %u bytes.\n", data->block_size);
         }
         else
         {
-            printf("Transfer block size: %u bytes.\n", data->block_size);
+            LOG_DEBUG("Block size unspecified, defaulting to %d (this is normal!).\n", TFTP_BLKSIZE_DEFAULT);
+        }
+
+        if (data->option_flags & TFTP_OPTION_WINDOWSIZE)
+        {
+            LOG_DEBUG("Transfer window size: %u blocks.\n", data->window_size);
+        }
+
+        if (data->option_flags & TFTP_OPTION_TIMEOUT)
+        {
+            LOG_DEBUG("Transfer timeout: %u seconds.\n", data->timeout_seconds);
         }
     }
 
-    printf("Initialized operation data: %s | %s | %s\n",
+    LOG_INFO("Initialized operation data: %s | %s | %s\n",
             data->request_description, inet_ntoa(data->peer_address.sin_addr), data->path);
 
     return data;
@@ -255,14 +469,180 @@ OperationData_t *tftp_init_operation_data(OperationId_t operation, struct sockad
  */
 void tftp_free_operation_data(OperationData_t *data)
 {
-    printf("Deallocating '%s' operation data.\n", data->request_description);
+    LOG_DEBUG("Deallocating '%s' operation data.\n", data->request_description);
 
     if (data->data_socket > 0)
     {
         close(data->data_socket);
     }
 
-    free(data);
+    slab_release(SLAB_OPERATION_DATA, data, sizeof(OperationData_t) + data->path_len);
+}
+
+/**
+ * Clamps a retransmission timeout to the configured bounds.
+ */
+static uint32_t tftp_clamp_rto(uint64_t rto_us)
+{
+    uint64_t min_us = (uint64_t)tftp_common.rto_min_ms * 1000;
+    uint64_t max_us = (uint64_t)tftp_common.rto_max_ms * 1000;
+    return rto_us < min_us ? min_us : (rto_us > max_us ? max_us : rto_us);
+}
+
+/**
+ * Starts timing a round trip, from a window or ACK that was just sent for the first time.
+ * Anything retransmitted cancels the measurement instead, since its reply could answer either copy (Karn's rule).
+ */
+static void tftp_rtt_start(TransferData_t *tx_data, bool retransmission)
+{
+    tx_data->rtt_sample_start_us = monotonic_microseconds();
+    tx_data->rtt_sample_pending = !retransmission;
+}
+
+/**
+ * Completes the pending round trip measurement, if any, and updates the smoothed RTT, its variance,
+ * and the retransmission timeout derived from them (RFC 6298), which also ends any backoff.
+ * A negotiated timeout is left as it is.
+ */
+static void tftp_rtt_sample(TransferData_t *tx_data)
+{
+    if (!tx_data->rtt_sample_pending)
+    {
+        return;
+    }
+
+    uint64_t rtt_us = monotonic_microseconds() - tx_data->rtt_sample_start_us;
+    rtt_us = rtt_us > UINT32_MAX ? UINT32_MAX : rtt_us;
+    tx_data->rtt_sample_pending = false;
+
+    if (tx_data->rtt_samples_count == 0)
+    {
+        tx_data->srtt_us = rtt_us;
+        tx_data->rttvar_us = rtt_us / 2;
+    }
+    else
+    {
+        uint32_t deviation_us = rtt_us > tx_data->srtt_us ? rtt_us - tx_data->srtt_us : tx_data->srtt_us - rtt_us;
+        tx_data->rttvar_us = (3 * (uint64_t)tx_data->rttvar_us + deviation_us) / 4;
+        tx_data->srtt_us = (7 * (uint64_t)tx_data->srtt_us + rtt_us) / 8;
+    }
+
+    tx_data->rtt_samples_count++;
+    tx_data->rtt_min_us = rtt_us < tx_data->rtt_min_us ? rtt_us : tx_data->rtt_min_us;
+    tx_data->rtt_max_us = rtt_us > tx_data->rtt_max_us ? rtt_us : tx_data->rtt_max_us;
+
+    if (!tx_data->rto_fixed)
+    {
+        tx_data->rto_us = tftp_clamp_rto((uint64_t)tx_data->srtt_us + 4 * (uint64_t)tx_data->rttvar_us);
+    }
+}
+
+/**
+ * Ends any backoff once the peer acknowledged new data, restoring the retransmission timeout from the estimates so far.
+ * With duplicate ACKs ignored, lost packets are only recovered from by timeouts, and resent blocks yield no samples (Karn's rule),
+ * so waiting for a sample could leave a lossy transfer crawling along at the backed-off maximum.
+ */
+static void tftp_rtt_end_backoff(TransferData_t *tx_data)
+{
+    if (!tx_data->rto_fixed && tx_data->rtt_samples_count > 0)
+    {
+        tx_data->rto_us = tftp_clamp_rto((uint64_t)tx_data->srtt_us + 4 * (uint64_t)tx_data->rttvar_us);
+    }
+}
+
+/**
+ * Doubles the retransmission timeout after it expired, up to the configured maximum, unless it was negotiated.
+ * The backed-off timeout stays in effect until a round trip is measured, or the peer makes progress.
+ * Returns whether the expired timeout counts towards the retry limit: only those at least as long as
+ * the classic TFTP timeout (or the maximum, if lower) do, so that a peer stalling for a moment
+ * is not given up on after a few quick backoffs from a short RTO.
+ */
+static bool tftp_rtt_backoff(TransferData_t *tx_data)
+{
+    uint32_t counted_rto_us = tftp_clamp_rto(TFTP_TIMEOUT_SECONDS * 1000000);
+    bool counted = tx_data->rto_us >= counted_rto_us;
+
+    tx_data->timeouts_count++;
+    tx_data->rtt_sample_pending = false;
+    METRICS_ADD(timeouts, 1);
+
+    if (tx_data->rto_fixed)
+    {
+        return true;
+    }
+
+    tx_data->rto_us = tftp_clamp_rto(2 * (uint64_t)tx_data->rto_us);
+    return counted;
+}
+
+/**
+ * Sets the retransmission deadline one retransmission timeout from now.
+ * This happens whenever a window, OACK or ACK goes out, and whenever the peer makes progress;
+ * duplicates, stray and foreign packets leave the deadline where it is, so they cannot put off a retransmission.
+ */
+static void tftp_arm_retransmit_deadline(TransferData_t *tx_data)
+{
+    tx_data->retransmit_deadline_us = monotonic_microseconds() + tx_data->rto_us;
+}
+
+/**
+ * Prints the round-trip time estimate the transfer ended with, along with the range of samples it was based on.
+ */
+static void tftp_print_rtt_statistics(const TransferData_t *tx_data)
+{
+    if (tx_data->rtt_samples_count == 0)
+    {
+        LOG_INFO("Round-trip time: no samples, %u timeouts, final RTO %.3f ms.\n", tx_data->timeouts_count, tx_data->rto_us / 1000.0);
+        return;
+    }
+
+    LOG_INFO("Round-trip time: smoothed %.3f ms, variance %.3f ms, min %.3f ms, max %.3f ms over %u samples, %u timeouts, final RTO %.3f ms.\n",
+            tx_data->srtt_us / 1000.0, tx_data->rttvar_us / 1000.0, tx_data->rtt_min_us / 1000.0, tx_data->rtt_max_us / 1000.0,
+            tx_data->rtt_samples_count, tx_data->timeouts_count, tx_data->rto_us / 1000.0);
+}
+
+/**
+ * Reserves disk space for a file about to be received, when its size is announced by the peer (RFC 2349 'tsize'),
+ * so that it is laid out in as few extents as possible instead of growing block by block,
+ * and an upload which would not fit is refused with DISK FULL before any of it is sent.
+ * Filesystems that do not support fallocate() simply go without.
+ */
+static bool tftp_receive_preallocate(const OperationData_t *operation_data, TransferData_t *transfer_data)
+{
+    struct statvfs fs_attr;
+    int fd = fileno(transfer_data->file);
+    char size_string[24];
+
+    if (!(operation_data->option_flags & TFTP_OPTION_TSIZE) || operation_data->transfer_size == 0)
+    {
+        return true;
+    }
+
+    snprintf(size_string, sizeof(size_string), "%lu", operation_data->transfer_size);
+
+    if (0 == fstatvfs(fd, &fs_attr) && (uint64_t)fs_attr.f_bavail * fs_attr.f_frsize < operation_data->transfer_size)
+    {
+        LOG_WARN("Not enough disk space for %s bytes, %lu available. Aborting receive operation.\n", size_string, (uint64_t)fs_attr.f_bavail * fs_attr.f_frsize);
+        tftp_send_error(TFTP_ERROR_OUT_OF_SPACE, "Not enough disk space, file size: ", size_string, operation_data->data_socket, &operation_data->peer_address, operation_data->peer_address_length);
+        return false;
+    }
+
+    if (0 == fallocate(fd, 0, 0, operation_data->transfer_size))
+    {
+        LOG_DEBUG("Preallocated %s bytes for file.\n", size_string);
+        transfer_data->file_preallocated = true;
+        return true;
+    }
+
+    if (errno == ENOSPC || errno == EFBIG)
+    {
+        LOG_ERRNO("Failed to preallocate file");
+        tftp_send_error(TFTP_ERROR_OUT_OF_SPACE, "Not enough disk space, file size: ", size_string, operation_data->data_socket, &operation_data->peer_address, operation_data->peer_address_length);
+        return false;
+    }
+
+    LOG_ERRNO("Failed to preallocate file, continuing without");
+    return true;
 }
 
 /**
@@ -270,299 +650,1665 @@ void tftp_free_operation_data(OperationData_t *data)
  * which is used during file transfers.
  * The same structure is used to handle both transmission and reception operations.
  */
-bool tftp_fill_transfer_data(OperationData_t *operation_data, TransferData_t *transfer_data, bool receiver)
+bool tftp_fill_transfer_data(OperationData_t *operation_data, TransferData_t *transfer_data, bool receiver, const TransferBuffers_t *buffers)
 {
     if (transfer_data == NULL)
     {
-        printf("Passed null TransferData_t pointer! Aborting.\n");
+        LOG_ERROR("Passed null TransferData_t pointer! Aborting.\n");
         tftp_send_error(TFTP_ERROR_UNDEFINED, "Internal server error", NULL, operation_data->data_socket, &operation_data->peer_address, operation_data->peer_address_length);
         return false;
     }
 
     explicit_bzero(transfer_data, sizeof(TransferData_t));
-
-    // receiving-end specific checks
-    if (receiver)
+    transfer_data->is_receiver = receiver;
+    METRICS_ADD(transfers_started, 1);
+    transfer_data->rto_us = tftp_clamp_rto(TFTP_TIMEOUT_SECONDS * 1000000);
+    transfer_data->socket_timeout_us = TFTP_TIMEOUT_SECONDS * 1000000;
+    transfer_data->rtt_min_us = UINT32_MAX;
+
+    // a timeout negotiated with the peer (RFC 2349) is used as is
+    if (operation_data->option_flags & TFTP_OPTION_TIMEOUT)
     {
-        transfer_data->file = fopen(operation_data->path, "rb");
+        transfer_data->rto_us = operation_data->timeout_seconds * 1000000;
+        transfer_data->rto_fixed = true;
+    }
 
-        // when trying to receive a file that already exists,
-        // it makes sense to notify our peer of the file's last modified date,
-        // so they can reason about requesting deletion to effectively overwrite it.
-        if (transfer_data->file != NULL)
-        {
-            char timestamp[32];
-            struct stat file_attr;
-            stat(operation_data->path, &file_attr);
+    LOG_INFO("%s file: '%s'\n", receiver ? "Creating" : "Opening", operation_data->path);
 
-            struct tm tm;
-            localtime_r(&file_attr.st_ctim.tv_sec, &tm);
-            strftime(timestamp, 32, "%Y-%m-%d %H:%M:%S.", &tm);
+    // a file to be received must not exist yet, which creating it exclusively checks in the same go
+    transfer_data->file = fopen(operation_data->path, receiver ? "wxb" : "rb");
 
-            printf("File already exists since %s. Aborting receive operation.\n", timestamp);
-            tftp_send_error(operation_data->data_socket, "File already exists! To overwrite, request deletion then try again. Creation date: ", timestamp, operation_data->data_socket, &operation_data->peer_address, operation_data->peer_address_length);
-            return false;
-        }
-    }
+    // when trying to receive a file that already exists,
+    // it makes sense to notify our peer of the file's last modified date,
+    // so they can reason about requesting deletion to effectively overwrite it.
+    if (transfer_data->file == NULL && receiver && errno == EEXIST)
+    {
+        char timestamp[32];
+        struct stat file_attr;
+        stat(operation_data->path, &file_attr);
 
-    printf("%s file: '%s'\n", receiver ? "Creating" : "Opening", operation_data->path);
-    transfer_data->file = fopen(operation_data->path, receiver ? "wb" : "rb");
+        struct tm tm;
+        localtime_r(&file_attr.st_ctim.tv_sec, &tm);
+        strftime(timestamp, 32, "%Y-%m-%d %H:%M:%S.", &tm);
+
+        LOG_INFO("File already exists since %s. Aborting receive operation.\n", timestamp);
+        tftp_send_error(TFTP_ERROR_FILE_EXISTS, "File already exists! To overwrite, request deletion then try again. Creation date: ", timestamp, operation_data->data_socket, &operation_data->peer_address, operation_data->peer_address_length);
+        return false;
+    }
 
     if (transfer_data->file == NULL)
     {
-        perror("Failed to acquire file descriptor");
+        LOG_ERRNO("Failed to acquire file descriptor");
         tftp_send_error(TFTP_ERROR_UNDEFINED, "Failed to acquire file descriptor, details: ", strerror(errno), operation_data->data_socket, &operation_data->peer_address, operation_data->peer_address_length);
         return false;
     }
 
+    if (receiver && !tftp_receive_preallocate(operation_data, transfer_data))
+    {
+        fclose(transfer_data->file);
+        transfer_data->file = NULL;
+        remove(operation_data->path);
+        return false;
+    }
+
     // The TFTP default block size is 512 bytes, but we support the BLKSIZE extension.
     // A value of 0 means that no BLKSIZE field was passed, so it is interpreted as the default value.
     if (operation_data->block_size == 0)
     {
         operation_data->block_size = TFTP_BLKSIZE_DEFAULT;
-        printf("Block size unspecified, defaulting to %d bytes.\n", TFTP_BLKSIZE_DEFAULT);
+        LOG_DEBUG("Block size unspecified, defaulting to %d bytes.\n", TFTP_BLKSIZE_DEFAULT);
     }
     // Else, we apply the requested block size, given that it fits within the permitted range.
     // If it exceeds the permitted range we simply reject the request.
     else if (operation_data->block_size < TFTP_BLKSIZE_MIN || operation_data->block_size > TFTP_BLKSIZE_MAX)
     {
-        printf("Invalid block size specified");
+        LOG_WARN("Invalid block size specified.\n");
         tftp_send_error(TFTP_ERROR_ILLEGAL_OPERATION, "Invalid block size specified", NULL, operation_data->data_socket, &operation_data->peer_address, operation_data->peer_address_length);
         return false;
     }
     else
     {
-        printf("Specified block size: %d bytes.\n", operation_data->block_size);
+        LOG_DEBUG("Specified block size: %d bytes.\n", operation_data->block_size);
     }
 
     transfer_data->data_packet_max_size = sizeof(Packet_t) + operation_data->block_size;
-    transfer_data->response_packet_max_size = sizeof(Packet_t) + 32;
 
-    transfer_data->data_packet_ptr = malloc(transfer_data->data_packet_max_size);
-    transfer_data->response_packet_ptr = malloc(transfer_data->response_packet_max_size);
+    // a batch never spans more than a window, since no more packets than that are ever in flight at once.
+    // received packets get one spare byte each, so that error messages can always be terminated.
+    uint16_t batch_max_packets = operation_data->window_size < TFTP_BATCH_MAX_PACKETS ? operation_data->window_size : TFTP_BATCH_MAX_PACKETS;
 
-    if (transfer_data->data_packet_ptr == NULL || transfer_data->response_packet_ptr == NULL)
+    if (batch_max_packets == 0)
     {
-        perror("Failed to allocate packet buffers");
-        tftp_send_error(TFTP_ERROR_OUT_OF_SPACE, "Failed to allocate packet buffers: ", strerror(errno), operation_data->data_socket, &operation_data->peer_address, operation_data->peer_address_length);
-        return false;
+        batch_max_packets = 1;
     }
 
-    return true;
-}
+    transfer_data->receive_slot_size = (receiver ? transfer_data->data_packet_max_size : TFTP_RESPONSE_PACKET_MAX_SIZE) + 1;
 
-/**
- * Frees a TransferData_t struct after a file transfer operation was either completed or aborted.
- */
-void tftp_free_transfer_data(TransferData_t *data)
-{
-    printf("Deallocating transfer data.\n");
+    // with receive offload, a window's worth of DATA packets may arrive coalesced into datagrams of up to 64K,
+    // which is only worth the larger receive slots if more than a single block is ever in flight
+    if (receiver && tftp_common.segmentation_offload && batch_max_packets > 1)
+    {
+        static const int enable_flag = 1;
 
-    if (data->file != NULL)
+        if (0 > setsockopt(operation_data->data_socket, SOL_UDP, UDP_GRO, &enable_flag, sizeof(enable_flag)))
+        {
+            LOG_ERRNO("Failed to enable receive offload");
+        }
+        else
+        {
+            transfer_data->gro_enabled = true;
+            transfer_data->receive_slot_size = TFTP_GRO_MAX_DATAGRAM + 1;
+        }
+    }
+
+    // a whole window of blocks may arrive before the receiver gets to read any of it, which with large blocks
+    // (e.g. picked to fit a loopback or jumbo frame MTU) easily overflows the default socket buffer.
+    // the kernel doubles the requested size to cover its bookkeeping, and caps it at net.core.rmem_max.
+    if (receiver && operation_data->window_size > 1)
     {
-        fclose(data->file);
+        // the window and block sizes are up to the peer, so their product may well not fit an int
+        uint64_t wanted_size = (uint64_t)operation_data->window_size * transfer_data->data_packet_max_size;
+        int receive_buffer_size = wanted_size > INT_MAX / 2 ? INT_MAX / 2 : (int)wanted_size;
+        int current_size = 0;
+        socklen_t current_size_length = sizeof(current_size);
+
+        if (0 == getsockopt(operation_data->data_socket, SOL_SOCKET, SO_RCVBUF, &current_size, &current_size_length)
+            && current_size < 2 * receive_buffer_size
+            && 0 > setsockopt(operation_data->data_socket, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof(receive_buffer_size)))
+        {
+            LOG_ERRNO("Failed to enlarge socket receive buffer");
+        }
     }
 
-    if (data->data_packet_ptr != NULL) free(data->data_packet_ptr);
-    if (data->response_packet_ptr != NULL) free(data->response_packet_ptr);
+    transfer_data->receive_batch_capacity = TFTP_BATCH_MAX_BYTES / transfer_data->receive_slot_size;
 
-    free(data);
-}
+    if (transfer_data->receive_batch_capacity > batch_max_packets)
+    {
+        transfer_data->receive_batch_capacity = batch_max_packets;
+    }
 
-/**
- * This function implements the core of a file transfer operation,
- * from the transmitting side.
- */
-bool tftp_transmit_file(OperationData_t *op_data, TransferData_t *tx_data)
-{
-    CHECK_SIGTERM_DURING_TRANSFER
+    // only the transmitting side sends DATA packets
+    if (!receiver)
+    {
+        transfer_data->send_slot_size = transfer_data->data_packet_max_size;
+        transfer_data->send_batch_capacity = TFTP_BATCH_MAX_BYTES / transfer_data->send_slot_size;
 
-    uint64_t total_file_size;
-    uint32_t total_block_count;
-    uint8_t block_overflow_multiplier = 0;
+        if (transfer_data->send_batch_capacity > batch_max_packets)
+        {
+            transfer_data->send_batch_capacity = batch_max_packets;
+        }
 
-    fseek(tx_data->file, 0L, SEEK_END);
-    total_file_size = ftell(tx_data->file);
-    rewind(tx_data->file);
+        // segmentation offload is limited to a single maximal IP datagram worth of segments
+        transfer_data->gso_segments_max = TFTP_GSO_MAX_BYTES / transfer_data->send_slot_size;
 
-    total_block_count = (total_file_size / op_data->block_size) + 1;
+        if (transfer_data->gso_segments_max > TFTP_GSO_MAX_SEGMENTS)
+        {
+            transfer_data->gso_segments_max = TFTP_GSO_MAX_SEGMENTS;
+        }
 
-    tx_data->data_packet_ptr->data.opcode = htons(TFTP_DATA);
-    tx_data->bytes_sent = tx_data->data_packet_max_size;
-    printf("Beginning transmission of file with total size of %lu bytes, in %u blocks.\n", total_file_size, total_block_count);
-    clock_gettime(CLOCK_MONOTONIC, &tx_data->start_clock);
+        // impairment acts on whole datagrams, so each packet has to be one of its own
+        transfer_data->gso_enabled = tftp_common.segmentation_offload && !impair_enabled()
+                && transfer_data->gso_segments_max > 1 && transfer_data->send_batch_capacity > 1;
+    }
 
-    while (tx_data->bytes_sent == tx_data->data_packet_max_size)
+    // buffers lent by the caller are already large enough for the largest batches
+    if (buffers != NULL)
     {
-        CHECK_SIGTERM_DURING_TRANSFER
+        transfer_data->packet_buffers_borrowed = true;
+        transfer_data->send_batch_buffer = receiver ? NULL : buffers->send_batch_buffer;
+        transfer_data->receive_batch_buffer = buffers->receive_batch_buffer;
+        return true;
+    }
 
-        tx_data->current_block_number++;
-        tx_data->resend_counter = 0;
-        tx_data->data_packet_ptr->data.block_number = htons(tx_data->current_block_number);
-        tx_data->latest_file_bytes_read = fread(tx_data->data_packet_ptr->data.data, 1, op_data->block_size, tx_data->file);
+    transfer_data->receive_batch_buffer = slab_allocate(SLAB_PACKET_BUFFER, (size_t)transfer_data->receive_batch_capacity * transfer_data->receive_slot_size);
 
-        if (tx_data->current_block_number == 0)
-        {
-            block_overflow_multiplier++;
-        }
+    if (!receiver)
+    {
+        transfer_data->send_batch_buffer = slab_allocate(SLAB_PACKET_BUFFER, (size_t)transfer_data->send_batch_capacity * transfer_data->send_slot_size);
+    }
 
-        printf("\r[%.2fs] Read %d bytes to transmission buffer -> ", seconds_since_clock(tx_data->start_clock), tx_data->latest_file_bytes_read);
+    if (transfer_data->receive_batch_buffer == NULL || (!receiver && transfer_data->send_batch_buffer == NULL))
+    {
+        LOG_ERRNO("Failed to allocate packet buffers");
+        tftp_send_error(TFTP_ERROR_OUT_OF_SPACE, "Failed to allocate packet buffers: ", strerror(errno), operation_data->data_socket, &operation_data->peer_address, operation_data->peer_address_length);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Reads all pending MSG_ZEROCOPY completion notifications off the data socket's error queue without blocking.
+ * Each notification covers a range of sends, and tells whether the kernel ended up copying them after all
+ * (which it does e.g. for loopback peers). The header slots of the completed sends are free to be written again.
+ */
+static void tftp_drain_zerocopy_completions(TransferData_t *tx_data)
+{
+    uint8_t control_buffer[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in))];
+    TFTPZerocopyHeaders_t *headers = tx_data->zerocopy_headers;
+    struct msghdr message;
+
+    while (tx_data->zerocopy_completions < tx_data->zerocopy_sends)
+    {
+        explicit_bzero(&message, sizeof(message));
+        message.msg_control = control_buffer;
+        message.msg_controllen = sizeof(control_buffer);
+
+        if (0 > recvmsg(headers->socket, &message, MSG_ERRQUEUE | MSG_DONTWAIT))
+        {
+            break;
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(&message, cmsg))
+        {
+            struct sock_extended_err *extended_error = (struct sock_extended_err *)CMSG_DATA(cmsg);
+
+            if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR || extended_error->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+
+            uint32_t sends_completed = extended_error->ee_data - extended_error->ee_info + 1;
+            tx_data->zerocopy_completions += sends_completed;
+
+            if (extended_error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                tx_data->zerocopy_copied += sends_completed;
+            }
+
+            for (uint32_t send_id = extended_error->ee_info; send_id != extended_error->ee_data + 1; send_id++)
+            {
+                headers->send_completed[send_id % TFTP_ZEROCOPY_HEADER_SLOTS] = true;
+            }
+        }
+    }
+}
+
+/**
+ * Blocks until more completion notifications arrive at the data socket's error queue, or the given time passes,
+ * and reads those that did. Returns false if the time passed without any.
+ */
+static bool tftp_await_zerocopy_completions(TransferData_t *tx_data, uint64_t deadline_ms)
+{
+    struct pollfd poll_fd = { .fd = tx_data->zerocopy_headers->socket, .events = 0 };
+    uint64_t now_ms = monotonic_milliseconds();
+
+    while (now_ms < deadline_ms)
+    {
+        int ready = poll(&poll_fd, 1, (int)(deadline_ms - now_ms));
+
+        if (ready > 0 && (poll_fd.revents & POLLERR))
+        {
+            tftp_drain_zerocopy_completions(tx_data);
+            return true;
+        }
+
+        if (ready < 0 && errno != EINTR)
+        {
+            return false;
+        }
+
+        now_ms = monotonic_milliseconds();
+    }
+
+    return false;
+}
+
+/**
+ * Sets aside the next count header slots for a batch of zero-copy sends, waiting for the sends each slot
+ * last went out with to complete, for at most TFTP_ZEROCOPY_HEADER_WAIT_MS in total.
+ * The wait holds up only this transfer in threads mode, but every transfer of the event loop in events mode,
+ * which is why it is bounded; completions normally trail their sends by far less.
+ * Returns false if the slots could not all be freed in time.
+ */
+static bool tftp_reserve_zerocopy_headers(TransferData_t *tx_data, uint16_t count)
+{
+    TFTPZerocopyHeaders_t *headers = tx_data->zerocopy_headers;
+    uint64_t deadline_ms = monotonic_milliseconds() + TFTP_ZEROCOPY_HEADER_WAIT_MS;
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        uint32_t slot = (headers->next_slot + i) % TFTP_ZEROCOPY_HEADER_SLOTS;
+
+        while (headers->slot_in_flight[slot] && !headers->send_completed[headers->send_ids[slot] % TFTP_ZEROCOPY_HEADER_SLOTS])
+        {
+            tftp_drain_zerocopy_completions(tx_data);
+
+            if (headers->send_completed[headers->send_ids[slot] % TFTP_ZEROCOPY_HEADER_SLOTS])
+            {
+                break;
+            }
+
+            if (!tftp_await_zerocopy_completions(tx_data, deadline_ms))
+            {
+                return false;
+            }
+        }
+
+        // the slot's completion flag belongs to a later send from now on
+        headers->slot_in_flight[slot] = false;
+    }
+
+    return true;
+}
+
+/**
+ * Releases the resources held by a TransferData_t struct after a file transfer operation was either completed or aborted,
+ * without freeing the struct itself. Borrowed packet buffers are left to their owner.
+ */
+void tftp_release_transfer_data(TransferData_t *data)
+{
+    LOG_DEBUG("Deallocating transfer data.\n");
+
+    // writes of an aborted transfer may still be queued, pointing into the buffers about to be released
+    if (data->ring_writes_queued > 0 && io_ring_attached() != NULL)
+    {
+        io_ring_submit_and_wait(io_ring_attached());
+    }
+
+    if (data->cache_entry != NULL)
+    {
+        file_cache_release(data->cache_entry, data->total_file_bytes_transmitted);
+    }
+    else if (data->file_mapping != NULL)
+    {
+        munmap(data->file_mapping, data->total_file_size);
+    }
+
+    if (data->file != NULL)
+    {
+        fclose(data->file);
+    }
+
+    // the kernel may still be reading headers of sends that have not completed, which must not be handed out again
+    if (data->zerocopy_headers != NULL)
+    {
+        uint64_t deadline_ms = monotonic_milliseconds() + TFTP_ZEROCOPY_LINGER_MS;
+        tftp_drain_zerocopy_completions(data);
+
+        while (data->zerocopy_completions < data->zerocopy_sends)
+        {
+            if (!tftp_await_zerocopy_completions(data, deadline_ms))
+            {
+                break;
+            }
+        }
+
+        if (data->zerocopy_completions < data->zerocopy_sends)
+        {
+            LOG_WARN("%lu zero-copy sends never completed, leaving their headers allocated.\n", data->zerocopy_sends - data->zerocopy_completions);
+        }
+        else
+        {
+            free(data->zerocopy_headers);
+        }
+    }
+
+    if (!data->packet_buffers_borrowed)
+    {
+        slab_release(SLAB_PACKET_BUFFER, data->send_batch_buffer, (size_t)data->send_batch_capacity * data->send_slot_size);
+        slab_release(SLAB_PACKET_BUFFER, data->receive_batch_buffer, (size_t)data->receive_batch_capacity * data->receive_slot_size);
+    }
+
+    explicit_bzero(data, sizeof(TransferData_t));
+    METRICS_ADD(transfers_finished, 1);
+}
+
+/**
+ * Frees a TransferData_t struct after a file transfer operation was either completed or aborted.
+ */
+void tftp_free_transfer_data(TransferData_t *data)
+{
+    tftp_release_transfer_data(data);
+    slab_release(SLAB_TRANSFER_DATA, data, sizeof(TransferData_t));
+}
+
+/**
+ * Allocates a set of batch buffers large enough for transfers of any block and window size,
+ * to be lent to transfers via tftp_fill_transfer_data().
+ */
+bool tftp_init_transfer_buffers(TransferBuffers_t *buffers)
+{
+    buffers->send_batch_buffer = malloc(TFTP_BATCH_MAX_BYTES);
+    buffers->receive_batch_buffer = malloc(TFTP_BATCH_MAX_BYTES);
+
+    if (buffers->send_batch_buffer == NULL || buffers->receive_batch_buffer == NULL)
+    {
+        LOG_ERRNO("Failed to allocate packet buffers");
+        tftp_deinit_transfer_buffers(buffers);
+        return false;
+    }
+
+    return true;
+}
+
+void tftp_deinit_transfer_buffers(TransferBuffers_t *buffers)
+{
+    free(buffers->send_batch_buffer);
+    free(buffers->receive_batch_buffer);
+    buffers->send_batch_buffer = NULL;
+    buffers->receive_batch_buffer = NULL;
+}
+
+/**
+ * Hands the prepared packets of a batch to the kernel: one message per packet,
+ * or with segmentation offload, one message per run of up to tx_data->gso_segments_max packets,
+ * which the kernel (or the NIC) splits back into datagrams of the send slot size.
+ * Only the last packet of a run may be shorter than that, which only ever is the final block of the file.
+ * The messages go out with a single sendmmsg() call, unless the blocks still have to be read (read_bytes > 0),
+ * in which case the read and the sends are submitted together on the thread's io_uring, each send linked behind the read.
+ * A failed read is reported through *read_failed, in which case nothing was sent.
+ * Returns the number of packets handed to the kernel, or -1 with errno set by the first send that failed.
+ */
+static int tftp_send_batch_messages(OperationData_t *op_data, TransferData_t *tx_data, struct iovec *iovecs, const uint8_t *packet_iov_counts, uint16_t count,
+        const struct iovec *read_iovecs, uint64_t read_offset, size_t read_bytes, bool *read_failed)
+{
+    struct mmsghdr messages[TFTP_BATCH_MAX_PACKETS];
+    uint16_t message_packets[TFTP_BATCH_MAX_PACKETS];
+    uint64_t control_buffers[TFTP_BATCH_MAX_PACKETS][CMSG_SPACE(sizeof(uint16_t)) / sizeof(uint64_t)];
+    uint16_t segments_per_message = tx_data->gso_enabled ? tx_data->gso_segments_max : 1;
+    int send_flags = tx_data->zerocopy_enabled ? MSG_ZEROCOPY : 0;
+    uint16_t messages_count = 0;
+    uint16_t packet = 0;
+    size_t iov_idx = 0;
+    int sent = 0;
+
+    while (packet < count)
+    {
+        struct msghdr *header = &messages[messages_count].msg_hdr;
+        uint16_t packets = count - packet < segments_per_message ? count - packet : segments_per_message;
+
+        explicit_bzero(&messages[messages_count], sizeof(struct mmsghdr));
+        header->msg_name = &op_data->peer_address;
+        header->msg_namelen = op_data->peer_address_length;
+        header->msg_iov = &iovecs[iov_idx];
+
+        for (uint16_t i = 0; i < packets; i++)
+        {
+            header->msg_iovlen += packet_iov_counts[packet + i];
+        }
+
+        if (packets > 1)
+        {
+            header->msg_control = control_buffers[messages_count];
+            header->msg_controllen = sizeof(control_buffers[messages_count]);
+
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(header);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            *(uint16_t *)CMSG_DATA(cmsg) = tx_data->send_slot_size;
+        }
+
+        iov_idx += header->msg_iovlen;
+        message_packets[messages_count++] = packets;
+        packet += packets;
+    }
+
+    if (read_bytes > 0)
+    {
+        // a batch takes one entry more than it has packets at most, which always fits an empty ring
+        IoRing_t *ring = io_ring_attached();
+        int32_t read_idx = io_ring_queue_readv(ring, fileno(tx_data->file), read_iovecs, count, read_offset, true);
+
+        for (uint16_t i = 0; i < messages_count; i++)
+        {
+            io_ring_queue_sendmsg(ring, op_data->data_socket, &messages[i].msg_hdr, send_flags, true);
+        }
+
+        if (!io_ring_submit_and_wait(ring))
+        {
+            *read_failed = true;
+            return -1;
+        }
+
+        tx_data->send_syscalls++;
+
+        if (ring->results[read_idx] != (int32_t)read_bytes)
+        {
+            errno = ring->results[read_idx] < 0 ? -ring->results[read_idx] : EIO;
+            *read_failed = true;
+            return -1;
+        }
+
+        // the sends were linked too, so the ones that made it are those before the first failure
+        while (sent < messages_count && ring->results[read_idx + 1 + sent] >= 0)
+        {
+            sent++;
+        }
+
+        if (sent == 0)
+        {
+            errno = -ring->results[read_idx + 1];
+            return -1;
+        }
+    }
+    else
+    {
+        sent = impair_sendmmsg(op_data->data_socket, messages, messages_count, send_flags);
+        tx_data->send_syscalls++;
+
+        if (sent < 0)
+        {
+            return sent;
+        }
+    }
+
+    int packets_sent = 0;
+
+    for (int i = 0; i < sent; i++)
+    {
+        packets_sent += message_packets[i];
+
+        if (message_packets[i] > 1)
+        {
+            tx_data->gso_datagrams++;
+            tx_data->gso_packets += message_packets[i];
+        }
+    }
+
+    // every message counts as a single send towards zero-copy completion notifications,
+    // and holds on to the header slots of all its packets until its own notification
+    if (tx_data->zerocopy_enabled)
+    {
+        TFTPZerocopyHeaders_t *headers = tx_data->zerocopy_headers;
+
+        for (int i = 0; i < sent; i++)
+        {
+            uint32_t send_id = (uint32_t)(tx_data->zerocopy_sends + i);
+            headers->send_completed[send_id % TFTP_ZEROCOPY_HEADER_SLOTS] = false;
+
+            for (uint16_t j = 0; j < message_packets[i]; j++)
+            {
+                headers->send_ids[headers->next_slot] = send_id;
+                headers->slot_in_flight[headers->next_slot] = true;
+                headers->next_slot = (headers->next_slot + 1) % TFTP_ZEROCOPY_HEADER_SLOTS;
+            }
+        }
+
+        tx_data->zerocopy_sends += sent;
+    }
+
+    return packets_sent;
+}
+
+/**
+ * Sends a batch of consecutive blocks, starting at the given absolute (non-wrapping) block number, with a single system call where possible.
+ * Each DATA header is written into its own send slot, or for zero-copy sends, into a slot of tx_data->zerocopy_headers
+ * that is not written again before the kernel reported the send complete. The blocks themselves are either read into the slots right behind their headers,
+ * with a single preadv() call for the whole batch (or a single io_uring submission along with the sends, if the thread has a ring),
+ * or sent straight out of the file mapping, in which case the kernel gathers header and block from separate buffers
+ * and file contents are never copied in user space.
+ * If the kernel rejects segmentation offload (e.g. the segments do not fit the path MTU), it is disabled for the rest of the transfer.
+ * The kernel running out of buffer space partway through only loses the rest of the batch, just like the network would.
+ */
+static bool tftp_transmit_batch(OperationData_t *op_data, TransferData_t *tx_data, uint64_t first_block, uint16_t count)
+{
+    struct iovec iovecs[TFTP_BATCH_MAX_PACKETS * 2];
+    struct iovec read_iovecs[TFTP_BATCH_MAX_PACKETS];
+    uint8_t packet_iov_counts[TFTP_BATCH_MAX_PACKETS];
+    uint64_t first_offset = (first_block - 1) * op_data->block_size;
+    size_t batch_file_bytes = 0;
+    size_t iov_idx = 0;
+    bool read_failed = false;
+
+    if (tx_data->zerocopy_enabled && !tftp_reserve_zerocopy_headers(tx_data, count))
+    {
+        LOG_WARN("Zero-copy sends are not completing, copying packets for the rest of the transfer.\n");
+        tx_data->zerocopy_enabled = false;
+    }
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        uint64_t file_offset = first_offset + (uint64_t)i * op_data->block_size;
+        uint64_t bytes_left = tx_data->total_file_size - file_offset;
+        size_t block_bytes = bytes_left < op_data->block_size ? bytes_left : op_data->block_size;
+        uint8_t *slot = tx_data->send_batch_buffer + (size_t)i * tx_data->send_slot_size;
+
+        // headers the kernel reads from until the send completes go in a slot of their own, left alone until then
+        if (tx_data->zerocopy_enabled)
+        {
+            slot = tx_data->zerocopy_headers->headers[(tx_data->zerocopy_headers->next_slot + i) % TFTP_ZEROCOPY_HEADER_SLOTS];
+        }
+
+        Packet_t *header = (Packet_t *)slot;
+
+        header->data.opcode = htons(TFTP_DATA);
+        header->data.block_number = htons((uint16_t)(first_block + i));
+
+        if (tx_data->file_mapping != NULL)
+        {
+            iovecs[iov_idx++] = (struct iovec){ .iov_base = slot, .iov_len = sizeof(Packet_t) };
+            iovecs[iov_idx++] = (struct iovec){ .iov_base = tx_data->file_mapping + file_offset, .iov_len = block_bytes };
+            packet_iov_counts[i] = 2;
+        }
+        else
+        {
+            read_iovecs[i] = (struct iovec){ .iov_base = header->data.data, .iov_len = block_bytes };
+            iovecs[iov_idx++] = (struct iovec){ .iov_base = slot, .iov_len = sizeof(Packet_t) + block_bytes };
+            packet_iov_counts[i] = 1;
+        }
+
+        batch_file_bytes += block_bytes;
+    }
+
+    bool read_needed = tx_data->file_mapping == NULL && batch_file_bytes > 0;
+    bool read_by_ring = read_needed && io_ring_attached() != NULL;
+
+    if (read_needed && !read_by_ring
+        && (ssize_t)batch_file_bytes != preadv(fileno(tx_data->file), read_iovecs, count, (off_t)first_offset))
+    {
+        read_failed = true;
+    }
+
+    int sent = read_failed ? -1 : tftp_send_batch_messages(op_data, tx_data, iovecs, packet_iov_counts, count,
+            read_iovecs, first_offset, read_by_ring ? batch_file_bytes : 0, &read_failed);
+
+    if (read_failed)
+    {
+        LOG_ERRNO("Failed to read from file");
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "File error", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        return false;
+    }
+
+    // the blocks were read by now either way, so only the sends are retried
+    if (sent < 0 && tx_data->gso_enabled && (errno == EINVAL || errno == EMSGSIZE || errno == EIO || errno == ENOPROTOOPT))
+    {
+        LOG_WARN("Segmentation offload rejected (%s), sending packets separately.\n", strerror(errno));
+        tx_data->gso_enabled = false;
+        sent = tftp_send_batch_messages(op_data, tx_data, iovecs, packet_iov_counts, count, NULL, 0, 0, &read_failed);
+    }
+
+    // a datagram can only pin so many pages, which blocks close to the maximum size may straddle more of
+    if (sent < 0 && tx_data->zerocopy_enabled && errno == EMSGSIZE)
+    {
+        LOG_WARN("Zero-copy send rejected (%s), copying packets for the rest of the transfer.\n", strerror(errno));
+        tx_data->zerocopy_enabled = false;
+        sent = tftp_send_batch_messages(op_data, tx_data, iovecs, packet_iov_counts, count, NULL, 0, 0, &read_failed);
+    }
+
+    if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+    {
+        LOG_ERRNO("Failed to send packet");
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "Socket tx error", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        return false;
+    }
+
+    if (sent > 0)
+    {
+        tx_data->packets_sent += sent;
+        tx_data->current_block_number = (uint16_t)(first_block + sent - 1);
+    }
+
+    return true;
+}
+
+/**
+ * Maps the 16 bit block number of an incoming ACK onto the absolute block numbers of the current window,
+ * accounting for block number rollover.
+ * An ACK for the block preceding the window resolves too, though it only repeats what was acknowledged already.
+ * Offsets of half the block number range or more are taken to be behind the window, however large the window.
+ * Returns false if the ACK does not belong to the current window at all.
+ */
+static bool tftp_resolve_window_ack(const TransferData_t *tx_data, uint16_t ack_block_number, uint64_t *acknowledged_block)
+{
+    uint64_t window_base = tx_data->window_first_block - 1;
+    uint16_t offset = ack_block_number - (uint16_t)window_base;
+
+    if (offset >= 0x8000 || offset > tx_data->window_last_block - window_base)
+    {
+        return false;
+    }
+
+    *acknowledged_block = window_base + offset;
+    return true;
+}
+
+/**
+ * Sends the current window of blocks, starting at tx_data->window_first_block (RFC 7440), in as few batches as fit the send buffer.
+ * The window is cut short at the final block of the file.
+ * The CPU time spent sending is accounted, to compare the cost of the transmit methods.
+ * The round trip until the ACK of a block sent for the first time is timed, so that windows resent from
+ * a gap still yield samples from their new blocks. A window made up of resent blocks only yields none (Karn's rule).
+ */
+static TransferStatus_t tftp_transmit_window(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    uint64_t cpu_start_ns = thread_cpu_nanoseconds();
+    tx_data->transmit_state = TFTP_TRANSMIT_STATE_AWAITING_WINDOW_ACK;
+    tx_data->window_last_block = tx_data->window_first_block + op_data->window_size - 1;
+
+    if (tx_data->window_last_block > tx_data->total_block_count)
+    {
+        tx_data->window_last_block = tx_data->total_block_count;
+    }
+
+    tftp_rtt_start(tx_data, tx_data->window_last_block <= tx_data->highest_block_sent);
+    tx_data->rtt_sample_block = tx_data->window_first_block > tx_data->highest_block_sent ? tx_data->window_first_block : tx_data->highest_block_sent + 1;
+    tx_data->highest_block_sent = tx_data->window_last_block > tx_data->highest_block_sent ? tx_data->window_last_block : tx_data->highest_block_sent;
+
+    for (uint64_t block = tx_data->window_first_block; block <= tx_data->window_last_block; block += tx_data->send_batch_capacity)
+    {
+        uint64_t blocks_left = tx_data->window_last_block - block + 1;
+
+        if (!tftp_transmit_batch(op_data, tx_data, block, blocks_left < tx_data->send_batch_capacity ? blocks_left : tx_data->send_batch_capacity))
+        {
+            return TFTP_TRANSFER_FAILED;
+        }
+    }
+
+    tx_data->transmit_cpu_ns += thread_cpu_nanoseconds() - cpu_start_ns;
+    tftp_arm_retransmit_deadline(tx_data);
+    return TFTP_TRANSFER_IN_PROGRESS;
+}
+
+/**
+ * Resends the current window after it went unacknowledged,
+ * or aborts the transfer once the retry limit is reached, if this attempt is 'counted' towards it.
+ */
+static TransferStatus_t tftp_transmit_retry(OperationData_t *op_data, TransferData_t *tx_data, bool counted)
+{
+    if (counted && tx_data->resend_counter >= tftp_common.max_retry_count)
+    {
+        LOG_WARN("Block #%u unacknowledged and retry limit reached. Aborting.\n", (uint16_t)tx_data->window_last_block);
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "Timed out waiting for acknowledgement", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        return TFTP_TRANSFER_FAILED;
+    }
+
+    tx_data->resend_counter += counted;
+    METRICS_ADD(retransmissions, 1);
+    LOG_INFO("Block #%u still unacknowledged, resending window from block #%u (attempt #%d).\n", (uint16_t)tx_data->window_last_block, (uint16_t)tx_data->window_first_block, tx_data->resend_counter);
+    return tftp_transmit_window(op_data, tx_data);
+}
+
+/**
+ * Points the transfer at the file's contents in the shared file cache if it is enabled and the file fits,
+ * or else maps the file to be transmitted into memory if the configured transmit method calls for it.
+ * Either way blocks are then sent straight out of memory; MSG_ZEROCOPY is enabled on the data socket
+ * if that is called for too and the block size makes it worthwhile.
+ * Falls back to reading blocks into the packet buffer if the file is neither cached nor can be mapped.
+ */
+static void tftp_transmit_map_file(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    static const int enable_flag = 1;
+
+    if (tx_data->total_file_size == 0)
+    {
+        return;
+    }
+
+    tx_data->cache_entry = file_cache_acquire(op_data->path, fileno(tx_data->file));
+
+    // the file may have changed since it was measured, in which case the cached version is of no use
+    if (tx_data->cache_entry != NULL && tx_data->cache_entry->size != tx_data->total_file_size)
+    {
+        file_cache_release(tx_data->cache_entry, 0);
+        tx_data->cache_entry = NULL;
+    }
+
+    if (tx_data->cache_entry != NULL)
+    {
+        tx_data->file_mapping = tx_data->cache_entry->contents;
+    }
+    else if (tftp_common.transmit_method == TFTP_TRANSMIT_COPY)
+    {
+        return;
+    }
+    else
+    {
+        void *mapping = mmap(NULL, tx_data->total_file_size, PROT_READ, MAP_SHARED, fileno(tx_data->file), 0);
+
+        if (mapping == MAP_FAILED)
+        {
+            LOG_ERRNO("Failed to map file, reading it instead");
+            return;
+        }
+
+        madvise(mapping, tx_data->total_file_size, MADV_SEQUENTIAL);
+        tx_data->file_mapping = mapping;
+    }
+
+    // packets lost or delayed by the impairment layer would never have their completions reported
+    if (tftp_common.transmit_method == TFTP_TRANSMIT_ZEROCOPY && op_data->block_size >= TFTP_ZEROCOPY_MIN_BLKSIZE && !impair_enabled())
+    {
+        tx_data->zerocopy_headers = calloc(1, sizeof(TFTPZerocopyHeaders_t));
+
+        if (tx_data->zerocopy_headers == NULL)
+        {
+            LOG_ERRNO("Failed to allocate zero-copy headers");
+        }
+        else if (0 > setsockopt(op_data->data_socket, SOL_SOCKET, SO_ZEROCOPY, &enable_flag, sizeof(enable_flag)))
+        {
+            LOG_ERRNO("Failed to enable zero-copy sends");
+            free(tx_data->zerocopy_headers);
+            tx_data->zerocopy_headers = NULL;
+        }
+        else
+        {
+            tx_data->zerocopy_headers->socket = op_data->data_socket;
+            tx_data->zerocopy_enabled = true;
+        }
+    }
+}
+
+/**
+ * Logs how far along a transfer is and its average rate so far, at most once every TFTP_PROGRESS_INTERVAL_MS,
+ * rather than on every block or window.
+ */
+static void tftp_report_progress(const OperationData_t *op_data, TransferData_t *tx_data)
+{
+    uint64_t now_ms = monotonic_milliseconds();
+
+    if (now_ms - tx_data->progress_reported_ms < TFTP_PROGRESS_INTERVAL_MS)
+    {
+        return;
+    }
+
+    tx_data->progress_reported_ms = now_ms;
+    float seconds = seconds_since_clock(tx_data->start_clock);
+    double megabytes_per_second = seconds > 0 ? tx_data->total_file_bytes_transmitted / 1000000.0 / seconds : 0.0;
+    uint64_t total_bytes = tx_data->is_receiver ? op_data->transfer_size : tx_data->total_file_size;
+
+    if (total_bytes > 0)
+    {
+        LOG_INFO("[%.2fs] %lu/%lu bytes %s (%.0f%%), %.2f MB/s.\n", seconds, tx_data->total_file_bytes_transmitted, total_bytes,
+                tx_data->is_receiver ? "received" : "sent", (100.0 * tx_data->total_file_bytes_transmitted) / total_bytes, megabytes_per_second);
+    }
+    else
+    {
+        LOG_INFO("[%.2fs] %lu bytes %s, %.2f MB/s.\n", seconds, tx_data->total_file_bytes_transmitted,
+                tx_data->is_receiver ? "received" : "sent", megabytes_per_second);
+    }
+}
+
+/**
+ * Prints how much CPU time the transmitting side spent sending, normalized per GB of file contents,
+ * and how the kernel treated zero-copy sends, if any were made.
+ */
+static void tftp_print_transmit_statistics(const TransferData_t *tx_data)
+{
+    static const char *method_strings[] = { "copy", "mmap", "zerocopy" };
+    double gigabytes = (double)tx_data->total_file_size / 1000000000.0;
+
+    LOG_INFO("Send path CPU time: %.1f ms total, %.1f ms per GB (%s transmit method).\n",
+            tx_data->transmit_cpu_ns / 1000000.0, gigabytes > 0 ? (tx_data->transmit_cpu_ns / 1000000.0) / gigabytes : 0.0,
+            tx_data->cache_entry != NULL ? "cached"
+            : tx_data->file_mapping == NULL ? method_strings[TFTP_TRANSMIT_COPY] : method_strings[tftp_common.transmit_method]);
+
+    if (tx_data->zerocopy_sends > 0)
+    {
+        LOG_INFO("Zero-copy sends: %lu, completed: %lu, of which the kernel copied: %lu.\n",
+                tx_data->zerocopy_sends, tx_data->zerocopy_completions, tx_data->zerocopy_copied);
+    }
+}
+
+/**
+ * Prints how many received packets were ignored, if any were.
+ */
+static void tftp_print_packet_statistics(const TransferData_t *tx_data)
+{
+    if (tx_data->duplicate_packets + tx_data->dropped_packets + tx_data->foreign_packets > 0)
+    {
+        LOG_INFO("Ignored packets: %lu duplicates, %lu dropped, %lu from unknown transfer IDs.\n",
+                tx_data->duplicate_packets, tx_data->dropped_packets, tx_data->foreign_packets);
+    }
+}
+
+/**
+ * Prints how many packets each batched send system call carried on average, and how many datagrams each receive did,
+ * and how many packets were coalesced into datagrams by segmentation or receive offload.
+ */
+static void tftp_print_batch_statistics(const TransferData_t *tx_data)
+{
+    if (tx_data->send_syscalls > 0)
+    {
+        LOG_INFO("Batched sends: %lu packets in %lu calls, %.1f packets per call (up to %u).\n", tx_data->packets_sent, tx_data->send_syscalls,
+                (double)tx_data->packets_sent / tx_data->send_syscalls, tx_data->send_batch_capacity);
+    }
+
+    if (tx_data->receive_syscalls > 0)
+    {
+        LOG_INFO("Batched receives: %lu packets in %lu datagrams over %lu calls, %.1f datagrams per call (up to %u).\n", tx_data->packets_received,
+                tx_data->datagrams_received, tx_data->receive_syscalls, (double)tx_data->datagrams_received / tx_data->receive_syscalls, tx_data->receive_batch_capacity);
+    }
+
+    if (tx_data->gso_datagrams > 0)
+    {
+        LOG_INFO("Segmentation offload: %lu packets sent as %lu datagrams.\n", tx_data->gso_packets, tx_data->gso_datagrams);
+    }
+
+    if (tx_data->gro_datagrams > 0)
+    {
+        LOG_INFO("Receive offload: %lu packets received as %lu datagrams.\n", tx_data->gro_packets, tx_data->gro_datagrams);
+    }
+}
+
+/**
+ * Measures the file to be transmitted, and maps it into memory if called for.
+ */
+static void tftp_transmit_prepare(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    fseek(tx_data->file, 0L, SEEK_END);
+    tx_data->total_file_size = ftell(tx_data->file);
+    rewind(tx_data->file);
+
+    // the final block is always shorter than the block size, even if that means it is empty
+    tx_data->total_block_count = (tx_data->total_file_size / op_data->block_size) + 1;
+    tftp_transmit_map_file(op_data, tx_data);
+}
+
+/**
+ * Prepares the transmitting side of a file transfer and sends the first window of blocks,
+ * or on the server side, an OACK for the request's options first, with the file size filled in if asked for.
+ */
+static bool tftp_transmit_begin(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    CHECK_SIGTERM_DURING_TRANSFER
+
+    tftp_transmit_prepare(op_data, tx_data);
+
+    tx_data->window_first_block = 1;
+    tx_data->resend_counter = 0;
+    LOG_INFO("Beginning transmission of file with total size of %lu bytes, in %lu blocks, %u blocks per window.\n", tx_data->total_file_size, tx_data->total_block_count, op_data->window_size);
+    clock_gettime(CLOCK_MONOTONIC, &tx_data->start_clock);
+    tx_data->progress_reported_ms = monotonic_milliseconds();
+
+    if (tftp_common.is_server && op_data->option_flags != 0)
+    {
+        op_data->transfer_size = tx_data->total_file_size;
+        tx_data->transmit_state = TFTP_TRANSMIT_STATE_AWAITING_OPTION_ACK;
+        tftp_rtt_start(tx_data, false);
+        return tftp_send_option_acknowledgement(op_data);
+    }
+
+    return tftp_transmit_window(op_data, tx_data) == TFTP_TRANSFER_IN_PROGRESS;
+}
+
+/**
+ * (Re)starts the transmitting side of a file transfer at the given block, regardless of where it stands,
+ * e.g. once a new master client of a multicast transfer (RFC 2090) told which block it is missing first.
+ * The file is prepared first if the transfer was never begun.
+ */
+bool tftp_transmit_resume(OperationData_t *op_data, TransferData_t *tx_data, uint64_t first_block)
+{
+    if (tx_data->total_block_count == 0)
+    {
+        tftp_transmit_prepare(op_data, tx_data);
+        clock_gettime(CLOCK_MONOTONIC, &tx_data->start_clock);
+        tx_data->progress_reported_ms = monotonic_milliseconds();
+    }
+
+    tx_data->window_first_block = first_block;
+    tx_data->resend_counter = 0;
+    LOG_INFO("Resuming transmission of file with total size of %lu bytes at block #%lu/%lu, %u blocks per window.\n", tx_data->total_file_size, first_block, tx_data->total_block_count, op_data->window_size);
+    return tftp_transmit_window(op_data, tx_data) == TFTP_TRANSFER_IN_PROGRESS;
+}
+
+/**
+ * Handles an ACK received by the transmitting side while its OACK is pending,
+ * which is expected to be of block 0, upon which the first window is sent.
+ */
+static TransferStatus_t tftp_transmit_handle_option_ack(OperationData_t *op_data, TransferData_t *tx_data, uint16_t ack_block_number)
+{
+    if (ack_block_number != 0)
+    {
+        LOG_DEBUG("Ignoring ACK of block #%u while awaiting the ACK of the OACK.\n", ack_block_number);
+        tx_data->dropped_packets++;
+        METRICS_ADD(dropped_packets, 1);
+        return TFTP_TRANSFER_IN_PROGRESS;
+    }
+
+    LOG_DEBUG("Options acknowledged by peer.\n");
+    tftp_rtt_sample(tx_data);
+    tx_data->resend_counter = 0;
+    return tftp_transmit_window(op_data, tx_data);
+}
+
+/**
+ * Handles an ACK received by the transmitting side while awaiting the ACK of the current window.
+ * An ACK for an earlier block of the window means the peer saw a gap,
+ * in which case the window is rolled back to start right after the acknowledged block.
+ * An ACK of the block preceding the window, or of any earlier one, is a duplicate (delayed, or sent again by the peer),
+ * and ACKs of blocks not sent yet cannot be right: both are ignored, leaving any resend to the retransmission timeout.
+ */
+static TransferStatus_t tftp_transmit_handle_window_ack(OperationData_t *op_data, TransferData_t *tx_data, uint16_t ack_block_number)
+{
+    uint64_t acknowledged_block;
+
+    if (!tftp_resolve_window_ack(tx_data, ack_block_number, &acknowledged_block) || acknowledged_block < tx_data->window_first_block)
+    {
+        // block numbers up to half their range behind the window are taken as old news, the rest as nonsense
+        bool duplicate = (uint16_t)((uint16_t)(tx_data->window_first_block - 1) - ack_block_number) < 0x8000;
+
+        LOG_DEBUG("Ignoring %s ACK of block #%u, awaiting blocks #%u-#%u.\n", duplicate ? "duplicate" : "unexpected",
+                ack_block_number, (uint16_t)tx_data->window_first_block, (uint16_t)tx_data->window_last_block);
+        tx_data->duplicate_packets += duplicate;
+        tx_data->dropped_packets += !duplicate;
+        METRICS_ADD(duplicate_packets, duplicate);
+        METRICS_ADD(dropped_packets, !duplicate);
+        return TFTP_TRANSFER_IN_PROGRESS;
+    }
+
+    uint64_t bytes_acknowledged_before = tx_data->total_file_bytes_transmitted;
+    tx_data->total_file_bytes_transmitted = acknowledged_block == tx_data->total_block_count
+        ? tx_data->total_file_size : acknowledged_block * op_data->block_size;
+    METRICS_ADD(file_bytes_sent, tx_data->total_file_bytes_transmitted - bytes_acknowledged_before);
+
+    if (acknowledged_block == tx_data->window_last_block)
+    {
+        LOG_TRACE("Block #%u acknowledged, %lu/%lu bytes sent.\n", (uint16_t)acknowledged_block, tx_data->total_file_bytes_transmitted, tx_data->total_file_size);
+        tftp_report_progress(op_data, tx_data);
+    }
+    else
+    {
+        LOG_DEBUG("Block #%u acknowledged mid-window, rolling back to block #%u.\n", (uint16_t)acknowledged_block, (uint16_t)(acknowledged_block + 1));
+    }
+
+    if (acknowledged_block >= tx_data->rtt_sample_block)
+    {
+        tftp_rtt_sample(tx_data);
+    }
+
+    tftp_rtt_end_backoff(tx_data);
+    tx_data->window_first_block = acknowledged_block + 1;
+    tx_data->resend_counter = 0;
+
+    if (tx_data->window_first_block > tx_data->total_block_count)
+    {
+        tx_data->transmit_state = TFTP_TRANSMIT_STATE_COMPLETE;
+        LOG_INFO("File transmission completed in %.2fs.\n", seconds_since_clock(tx_data->start_clock));
+        metrics_record_transfer(tx_data->srtt_us, tx_data->total_file_size, seconds_since_clock(tx_data->start_clock));
+        tftp_drain_zerocopy_completions(tx_data);
+        tftp_print_transmit_statistics(tx_data);
+        tftp_print_batch_statistics(tx_data);
+        tftp_print_packet_statistics(tx_data);
+        tftp_print_rtt_statistics(tx_data);
+        return TFTP_TRANSFER_COMPLETE;
+    }
+
+    return tftp_transmit_window(op_data, tx_data);
+}
+
+/**
+ * Handles a packet received by the transmitting side, according to the state of the transmission.
+ * An ERROR ends the transfer in any state; the peer may decline the options with one (RFC 2347).
+ * Anything but an ACK is ignored.
+ */
+static TransferStatus_t tftp_transmit_handle_packet(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    uint16_t opcode = ntohs(tx_data->received_packet_ptr->opcode);
+
+    if (opcode == TFTP_ERROR)
+    {
+        LOG_INFO("%s (code %u) with message: %s\n",
+                tx_data->transmit_state == TFTP_TRANSMIT_STATE_AWAITING_OPTION_ACK ? "Peer declined the options" : "Received error message from peer",
+                ntohs(tx_data->received_packet_ptr->error.error_code), tx_data->received_packet_ptr->error.error_message);
+        return TFTP_TRANSFER_FAILED;
+    }
+    else if (opcode != TFTP_ACK)
+    {
+        LOG_DEBUG("Ignoring packet with opcode %u, expected %d (ACK).\n", opcode, TFTP_ACK);
+        tx_data->dropped_packets++;
+        METRICS_ADD(dropped_packets, 1);
+        return TFTP_TRANSFER_IN_PROGRESS;
+    }
+
+    uint16_t ack_block_number = ntohs(tx_data->received_packet_ptr->ack.block_number);
+
+    switch (tx_data->transmit_state)
+    {
+        case TFTP_TRANSMIT_STATE_AWAITING_OPTION_ACK:
+            return tftp_transmit_handle_option_ack(op_data, tx_data, ack_block_number);
+        case TFTP_TRANSMIT_STATE_AWAITING_WINDOW_ACK:
+            return tftp_transmit_handle_window_ack(op_data, tx_data, ack_block_number);
+        default:
+            tx_data->dropped_packets++;
+            METRICS_ADD(dropped_packets, 1);
+            return TFTP_TRANSFER_IN_PROGRESS;
+    }
+}
+
+/**
+ * Submits the block writes queued on the thread's io_uring, and waits for all of them to complete.
+ * Given a block number to acknowledge (ack_block >= 0), the ACK is submitted along with them,
+ * linked behind the writes so that it only goes out once all of them succeeded.
+ * Returns false if any write failed, after notifying the peer.
+ */
+static bool tftp_receive_flush_writes(OperationData_t *op_data, TransferData_t *tx_data, int32_t ack_block)
+{
+    IoRing_t *ring = io_ring_attached();
+    Packet_t ack_packet = { .ack.opcode = htons(TFTP_ACK), .ack.block_number = htons((uint16_t)ack_block) };
+    struct iovec ack_iovec = { .iov_base = &ack_packet, .iov_len = sizeof(ack_packet) };
+    struct msghdr ack_message =
+    {
+        .msg_name = &op_data->peer_address,
+        .msg_namelen = op_data->peer_address_length,
+        .msg_iov = &ack_iovec,
+        .msg_iovlen = 1,
+    };
+
+    uint16_t writes_count = tx_data->ring_writes_queued;
+    uint64_t expected_bytes = tx_data->ring_write_bytes_queued;
+    uint64_t written_bytes = 0;
+    bool writes_failed = false;
+
+    tx_data->ring_writes_queued = 0;
+    tx_data->ring_write_bytes_queued = 0;
+
+    if (ack_block >= 0)
+    {
+        LOG_TRACE("Sending ACK with block number %u.\n", (uint16_t)ack_block);
+        io_ring_queue_sendmsg(ring, op_data->data_socket, &ack_message, 0, false);
+    }
+
+    if (!io_ring_submit_and_wait(ring))
+    {
+        writes_failed = writes_count > 0;
+    }
+
+    for (uint16_t i = 0; i < writes_count && !writes_failed; i++)
+    {
+        if (ring->results[i] < 0)
+        {
+            errno = -ring->results[i];
+            writes_failed = true;
+        }
+        else
+        {
+            written_bytes += ring->results[i];
+        }
+    }
+
+    if (!writes_failed && written_bytes != expected_bytes)
+    {
+        errno = EIO;
+        writes_failed = true;
+    }
+
+    if (writes_failed)
+    {
+        LOG_ERRNO("Writing to file failed");
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "Writing to file failed", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        return false;
+    }
+
+    if (ack_block >= 0 && ring->results[writes_count] < 0)
+    {
+        errno = -ring->results[writes_count];
+        LOG_ERRNO("Failed to send ack");
+    }
+
+    return true;
+}
+
+/**
+ * Prepares the receiving side of a file transfer.
+ * Nothing is sent here: the peer either starts sending right away (read request)
+ * or after the request was acknowledged by the caller (write request).
+ */
+static bool tftp_receive_begin(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    CHECK_SIGTERM_DURING_TRANSFER
+
+    tx_data->current_block_number = 1;
+    tx_data->blocks_since_ack = 0;
+    tx_data->resend_counter = 0;
+    tx_data->gap_acknowledged = false;
+    LOG_INFO("Beginning file reception, %u blocks per window.\n", op_data->window_size);
+    clock_gettime(CLOCK_MONOTONIC, &tx_data->start_clock);
+    tx_data->progress_reported_ms = monotonic_milliseconds();
+
+    return true;
+}
+
+/**
+ * Handles a packet received by the receiving side, expected to be the next DATA block.
+ * Blocks are acknowledged once per window of op_data->window_size blocks (RFC 7440),
+ * and once more for the final block.
+ * When a block arrives out of order, the last block received in order is acknowledged
+ * so that the peer rolls its window back to it.
+ * On a thread with an io_uring, blocks are queued as file writes instead of being written one by one,
+ * and submitted along with the window's ACK, which is linked behind them.
+ */
+static TransferStatus_t tftp_receive_handle_packet(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    IoRing_t *ring = io_ring_attached();
+    ssize_t bytes_written = 0;
+
+    if (ntohs(tx_data->received_packet_ptr->opcode) == TFTP_ERROR)
+    {
+        LOG_INFO("Received error message (code %u) from peer with message: %s\n", ntohs(tx_data->received_packet_ptr->error.error_code), tx_data->received_packet_ptr->error.error_message);
+        return TFTP_TRANSFER_FAILED;
+    }
+    else if (ntohs(tx_data->received_packet_ptr->opcode) != TFTP_DATA)
+    {
+        tx_data->dropped_packets++;
+        METRICS_ADD(dropped_packets, 1);
+        return TFTP_TRANSFER_IN_PROGRESS;
+    }
+
+    if (ntohs(tx_data->received_packet_ptr->data.block_number) != tx_data->current_block_number)
+    {
+        // blocks up to half the block number range behind are ones received already, the rest are ahead of a gap
+        bool duplicate = (uint16_t)(tx_data->current_block_number - 1 - ntohs(tx_data->received_packet_ptr->data.block_number)) < 0x8000;
+        tx_data->duplicate_packets += duplicate;
+        tx_data->dropped_packets += !duplicate;
+        METRICS_ADD(duplicate_packets, duplicate);
+        METRICS_ADD(dropped_packets, !duplicate);
+
+        // either a gap in the current window, or a retransmission of blocks we already have -
+        // acknowledging the last block received in order makes the peer resume right after it.
+        // a gap is acknowledged once, to avoid answering every remaining block of the window.
+        // blocks we already have are answered only until any of the next window comes in, i.e. while our ACK seems lost:
+        // the peer ignores the extra copies of that ACK, but one sent mid-window would roll it back over blocks in flight.
+        if (duplicate ? tx_data->blocks_since_ack == 0 : !tx_data->gap_acknowledged)
+        {
+            LOG_DEBUG("Block #%u received out of order, acknowledging block #%u.\n", ntohs(tx_data->received_packet_ptr->data.block_number), (uint16_t)(tx_data->current_block_number - 1));
+            tftp_rtt_start(tx_data, true);
+            tftp_send_ack(tx_data->current_block_number - 1, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+            tx_data->blocks_since_ack = 0;
+            tx_data->gap_acknowledged = true;
+        }
+
+        return TFTP_TRANSFER_IN_PROGRESS;
+    }
+
+    if (ring != NULL)
+    {
+        // the block stays in the receive batch buffer until the writes are flushed, at the latest before it is reused
+        if (tx_data->ring_writes_queued >= TFTP_BATCH_MAX_PACKETS && !tftp_receive_flush_writes(op_data, tx_data, -1))
+        {
+            return TFTP_TRANSFER_FAILED;
+        }
+
+        bytes_written = tx_data->bytes_received - sizeof(Packet_t);
+        io_ring_queue_write(ring, fileno(tx_data->file), tx_data->received_packet_ptr->data.data, bytes_written, tx_data->total_file_bytes_transmitted, true);
+        tx_data->ring_writes_queued++;
+        tx_data->ring_write_bytes_queued += bytes_written;
+    }
+    else
+    {
+        bytes_written = fwrite(tx_data->received_packet_ptr->data.data, 1, tx_data->bytes_received - sizeof(Packet_t), tx_data->file); 
+    }
+
+    if (bytes_written < tx_data->bytes_received - (ssize_t)sizeof(Packet_t))
+    {
+        LOG_ERRNO("Writing to file failed");
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "Writing to file failed", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        return TFTP_TRANSFER_FAILED;
+    }
+
+    // the first block in order since the last window was acknowledged ends its round trip
+    tftp_rtt_sample(tx_data);
+    tftp_rtt_end_backoff(tx_data);
+    tftp_arm_retransmit_deadline(tx_data);
+
+    bool final_block_received = tx_data->bytes_received < tx_data->data_packet_max_size;
+    tx_data->total_file_bytes_transmitted += bytes_written;
+    tx_data->total_block_count++;
+    METRICS_ADD(file_bytes_received, bytes_written);
+    tx_data->resend_counter = 0;
+    tx_data->blocks_since_ack++;
+    tx_data->gap_acknowledged = false;
+
+    // acknowledge the window once its last block is in, or the transfer once the final block is
+    if (final_block_received || tx_data->blocks_since_ack >= op_data->window_size)
+    {
+        LOG_TRACE("Block #%u received, %lu bytes so far.\n", tx_data->current_block_number, tx_data->total_file_bytes_transmitted);
+        tftp_report_progress(op_data, tx_data);
+
+        // timed from before sending, since the peer may well answer before the send call even returns
+        tftp_rtt_start(tx_data, false);
+
+        if (ring != NULL)
+        {
+            if (!tftp_receive_flush_writes(op_data, tx_data, tx_data->current_block_number))
+            {
+                return TFTP_TRANSFER_FAILED;
+            }
+        }
+        else
+        {
+            tftp_send_ack(tx_data->current_block_number, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        }
+
+        tx_data->blocks_since_ack = 0;
+    }
+
+    tx_data->current_block_number++;
+
+    if (final_block_received)
+    {
+        // a peer may well send less (or more) than it announced, in which case the reserved extent is trimmed to fit
+        if (tx_data->file_preallocated && tx_data->total_file_bytes_transmitted != op_data->transfer_size
+            && (0 != fflush(tx_data->file) || 0 > ftruncate(fileno(tx_data->file), tx_data->total_file_bytes_transmitted)))
+        {
+            LOG_ERRNO("Failed to trim preallocated file");
+        }
+
+        LOG_INFO("File reception complete in %0.2fs.\n", seconds_since_clock(tx_data->start_clock));
+        metrics_record_transfer(tx_data->srtt_us, tx_data->total_file_bytes_transmitted, seconds_since_clock(tx_data->start_clock));
+        tftp_print_batch_statistics(tx_data);
+        tftp_print_packet_statistics(tx_data);
+        tftp_print_rtt_statistics(tx_data);
+        return TFTP_TRANSFER_COMPLETE;
+    }
+
+    return TFTP_TRANSFER_IN_PROGRESS;
+}
+
+/**
+ * Handles the receiving side timing out while waiting for the next DATA block,
+ * by re-acknowledging the last block received in order, or aborting once the retry limit is reached,
+ * if this timeout is 'counted' towards it.
+ */
+static TransferStatus_t tftp_receive_handle_timeout(OperationData_t *op_data, TransferData_t *tx_data, bool counted)
+{
+    if (counted && tx_data->resend_counter >= tftp_common.max_retry_count)
+    {
+        LOG_WARN("[%0.2fs] Block #%u still not received, max retransmission limit reached. Aborting.\n", seconds_since_clock(tx_data->start_clock), tx_data->current_block_number);
+        tftp_send_error(TFTP_ERROR_UNDEFINED, "Timed out waiting for data packet", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        return TFTP_TRANSFER_FAILED;
+    }
+
+    tx_data->resend_counter += counted;
+    tx_data->blocks_since_ack = 0;
+
+    // the server answered the request with an OACK rather than ACK 0 if it acknowledged any options
+    if (tx_data->total_block_count == 0 && tftp_common.is_server)
+    {
+        LOG_INFO("[%0.2fs] Block #1 still not received, resending request acknowledgement.\n", seconds_since_clock(tx_data->start_clock));
+        tftp_acknowledge_request(op_data);
+        METRICS_ADD(retransmissions, 1);
+    }
+    // a reading client only learns the server's data port from the first DATA packet (or OACK),
+    // so before that there is nobody to re-acknowledge to
+    else if (tx_data->total_block_count > 0 || op_data->option_flags != 0)
+    {
+        LOG_INFO("[%0.2fs] Block #%u still not received, resending acknowledgement of block #%u.\n", seconds_since_clock(tx_data->start_clock), tx_data->current_block_number, (uint16_t)(tx_data->current_block_number - 1));
+        tftp_send_ack(tx_data->current_block_number - 1, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+        METRICS_ADD(retransmissions, 1);
+    }
+
+    return TFTP_TRANSFER_IN_PROGRESS;
+}
+
+/**
+ * Starts a file transfer on either side, sending whatever has to be sent first.
+ * After this, the transfer is driven by tftp_transfer_handle_packet() and tftp_transfer_handle_timeout()
+ * until either of them reports it as complete or failed.
+ */
+bool tftp_transfer_begin(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    tftp_arm_retransmit_deadline(tx_data);
+    return tx_data->is_receiver ? tftp_receive_begin(op_data, tx_data) : tftp_transmit_begin(op_data, tx_data);
+}
+
+/**
+ * Receives as many packets as are already queued at the data socket, up to the receive batch capacity,
+ * with a single recvmmsg() call that only waits for the first of them.
+ * Each datagram is terminated right behind its contents, in the spare byte of its slot.
+ * With receive offload, the segment size of every coalesced datagram is picked up from its control message.
+ * Returns the recvmmsg() result, with errno intact on failure.
+ */
+static int tftp_receive_batch(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    struct mmsghdr messages[TFTP_BATCH_MAX_PACKETS];
+    struct iovec iovecs[TFTP_BATCH_MAX_PACKETS];
+    uint64_t control_buffers[TFTP_BATCH_MAX_PACKETS][CMSG_SPACE(sizeof(int)) / sizeof(uint64_t)];
+
+    explicit_bzero(messages, sizeof(struct mmsghdr) * tx_data->receive_batch_capacity);
 
-        if (tx_data->latest_file_bytes_read <= 0)
+    for (uint16_t i = 0; i < tx_data->receive_batch_capacity; i++)
+    {
+        iovecs[i].iov_base = tx_data->receive_batch_buffer + (size_t)i * tx_data->receive_slot_size;
+        iovecs[i].iov_len = tx_data->receive_slot_size - 1;
+        messages[i].msg_hdr.msg_name = &tx_data->receive_addresses[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(tx_data->receive_addresses[i]);
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+
+        if (tx_data->gro_enabled)
         {
-            if (feof(tx_data->file) != 0)
-            {
-                printf("Sending final block: %u/%u.\n", tx_data->current_block_number + (UINT16_MAX * block_overflow_multiplier), total_block_count);
-                tx_data->latest_file_bytes_read = 0;
-            }
-            else
+            messages[i].msg_hdr.msg_control = control_buffers[i];
+            messages[i].msg_hdr.msg_controllen = sizeof(control_buffers[i]);
+        }
+    }
+
+    int received = recvmmsg(op_data->data_socket, messages, tx_data->receive_batch_capacity, MSG_WAITFORONE, NULL);
+    tx_data->receive_batch_next = 0;
+    tx_data->receive_batch_count = 0;
+    tx_data->receive_offset = 0;
+
+    if (received <= 0)
+    {
+        return received;
+    }
+
+    tx_data->receive_syscalls++;
+    tx_data->datagrams_received += received;
+    tx_data->receive_batch_count = received;
+
+    for (int i = 0; i < received; i++)
+    {
+        tx_data->receive_lengths[i] = messages[i].msg_len;
+        tx_data->receive_segment_sizes[i] = 0;
+        tx_data->receive_batch_buffer[(size_t)i * tx_data->receive_slot_size + messages[i].msg_len] = 0;
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&messages[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&messages[i].msg_hdr, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
             {
-                perror("Failed to read from file");
-                tftp_send_error(TFTP_ERROR_UNDEFINED, "File error", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
-                return false;
+                int segment_size;
+                memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+
+                if (segment_size > 0 && (uint32_t)segment_size < messages[i].msg_len)
+                {
+                    tx_data->receive_segment_sizes[i] = segment_size;
+                    tx_data->gro_datagrams++;
+                    tx_data->gro_packets += (messages[i].msg_len + segment_size - 1) / segment_size;
+                }
             }
         }
-        else if (tx_data->latest_file_bytes_read < op_data->block_size)
+    }
+
+    return received;
+}
+
+/**
+ * Hands out the next packet received at the data socket, receiving a new batch once the previous one is used up.
+ * Datagrams coalesced by receive offload are split back into packets of their segment size, in order.
+ * The packet is pointed at by tx_data->received_packet_ptr, and its source by tx_data->received_address.
+ * Returns the size of the packet, or -1 with errno set by recvmmsg() if nothing could be received.
+ */
+ssize_t tftp_transfer_receive_packet(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    if (tx_data->receive_batch_next >= tx_data->receive_batch_count)
+    {
+        // completion notifications pile up on the error queue, and would keep the socket flagged as readable
+        if (tx_data->zerocopy_sends > tx_data->zerocopy_completions)
         {
-            printf("Sending final block: %u/%u.\n", tx_data->current_block_number + (UINT16_MAX * block_overflow_multiplier), total_block_count);
+            tftp_drain_zerocopy_completions(tx_data);
         }
 
-        while (tx_data->resend_counter < tftp_common.max_retry_count)
+        if (tftp_receive_batch(op_data, tx_data) <= 0)
         {
-            CHECK_SIGTERM_DURING_TRANSFER
+            tx_data->bytes_received = -1;
+            return -1;
+        }
+    }
 
-            tx_data->bytes_sent = sendto(op_data->data_socket, tx_data->data_packet_ptr, (sizeof(Packet_t) + tx_data->latest_file_bytes_read), 0, (struct sockaddr *)&(op_data->peer_address), op_data->peer_address_length);
+    uint16_t datagram_idx = tx_data->receive_batch_next;
+    uint32_t datagram_length = tx_data->receive_lengths[datagram_idx];
+    uint32_t packet_length = datagram_length - tx_data->receive_offset;
 
-            if (tx_data->bytes_sent < 0)
-            {
-                perror("Failed to send packet");
-                tftp_send_error(TFTP_ERROR_UNDEFINED, "Socket tx error", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
-                return false;
-            }
+    if (tx_data->receive_segment_sizes[datagram_idx] > 0 && packet_length > tx_data->receive_segment_sizes[datagram_idx])
+    {
+        packet_length = tx_data->receive_segment_sizes[datagram_idx];
+    }
 
-            if (tx_data->resend_counter == 0)
-            {
-                tx_data->total_file_bytes_transmitted += tx_data->latest_file_bytes_read;
-            }
+    tx_data->received_packet_ptr = (Packet_t *)(tx_data->receive_batch_buffer + (size_t)datagram_idx * tx_data->receive_slot_size + tx_data->receive_offset);
+    tx_data->bytes_received = packet_length;
+    tx_data->packets_received++;
+    tx_data->receive_offset += packet_length;
 
-            printf("Sent %lu/%lu bytes of block %u/%u -> ", tx_data->total_file_bytes_transmitted, total_file_size, tx_data->current_block_number + (UINT16_MAX * block_overflow_multiplier), total_block_count);
-            fflush(stdout);
+    if (tx_data->receive_offset >= datagram_length)
+    {
+        tx_data->receive_batch_next++;
+        tx_data->receive_offset = 0;
+    }
 
-            tx_data->bytes_received = recvfrom(op_data->data_socket, tx_data->response_packet_ptr, tx_data->response_packet_max_size, 0, (struct sockaddr *)&(op_data->peer_address), &(op_data->peer_address_length));
+    tx_data->received_address = tx_data->receive_addresses[datagram_idx];
+    return tx_data->bytes_received;
+}
 
-            if (tx_data->bytes_received < 0)
-            {
-                if (errno == ETIMEDOUT)
-                {
-                    printf("\nSocket timed out.\n");
-                }
-                else
-                {
-                    perror("Failed to receive packet");
-                    tftp_send_error(TFTP_ERROR_UNDEFINED, "Socket rx error", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
-                    return false;
-                }
-            }
-            else if (ntohs(tx_data->response_packet_ptr->opcode == TFTP_ERROR))
-            {
-                printf("\nReceived error message (code %u) from peer with message: %s\n", ntohs(tx_data->response_packet_ptr->error.error_code), tx_data->response_packet_ptr->error.error_message);
-                return false;
-            }
-            else if (ntohs(tx_data->response_packet_ptr->opcode) == TFTP_ACK
-                    && ntohs(tx_data->response_packet_ptr->ack.block_number) == tx_data->current_block_number)
-            {
-                printf ("Block #%u acknowledged!\r", tx_data->current_block_number);
-                break;
-            }
+/**
+ * Whether the packet last received came from the peer's transfer ID, i.e. its address and port.
+ * Transfers to a multicast group take ACKs from whichever member is master, which the caller picks out itself.
+ */
+static bool tftp_packet_from_peer(const OperationData_t *op_data, const TransferData_t *tx_data)
+{
+    return IN_MULTICAST(ntohl(op_data->peer_address.sin_addr.s_addr))
+        || (tx_data->received_address.sin_addr.s_addr == op_data->peer_address.sin_addr.s_addr
+            && tx_data->received_address.sin_port == op_data->peer_address.sin_port);
+}
 
-            if (tx_data->resend_counter > tftp_common.max_retry_count)
-            {
-                printf ("\nBlock #%u unacknowledged and retry limit reached. Aborting.\n", tx_data->current_block_number);
-                tftp_send_error(TFTP_ERROR_UNDEFINED, "Timed out waiting for acknowledgement", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
-                return false;
-            }
+/**
+ * Advances a file transfer with the packet last received by tftp_transfer_receive_packet().
+ * A packet from any other source than the peer is answered with an ERROR, without disturbing the transfer (RFC 1350),
+ * unless it is an ERROR itself. Packets too short to hold an opcode and block number are ignored.
+ */
+TransferStatus_t tftp_transfer_handle_packet(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    if (!tftp_packet_from_peer(op_data, tx_data))
+    {
+        LOG_DEBUG("Ignoring packet from unknown transfer ID %s:%u.\n", inet_ntoa(tx_data->received_address.sin_addr), ntohs(tx_data->received_address.sin_port));
+        tx_data->foreign_packets++;
+        METRICS_ADD(dropped_packets, 1);
 
-            tx_data->resend_counter++;
-            printf ("Block #%u still unacknowledged, resending (attempt #%d).\n", tx_data->current_block_number, tx_data->resend_counter);
+        if (tx_data->bytes_received < (int32_t)sizeof(tx_data->received_packet_ptr->opcode) || ntohs(tx_data->received_packet_ptr->opcode) != TFTP_ERROR)
+        {
+            tftp_send_error(TFTP_ERROR_UNKNOWN_TRANSFER, "Unknown transfer ID", NULL, op_data->data_socket, &tx_data->received_address, sizeof(tx_data->received_address));
         }
+
+        return TFTP_TRANSFER_IN_PROGRESS;
     }
 
-    printf("\nFile transmission completed in %.2fs.\n", seconds_since_clock(tx_data->start_clock));
-    return true;
+    if (tx_data->bytes_received < (int32_t)sizeof(Packet_t))
+    {
+        tx_data->dropped_packets++;
+        METRICS_ADD(dropped_packets, 1);
+        return TFTP_TRANSFER_IN_PROGRESS;
+    }
+
+    if (!tx_data->is_receiver)
+    {
+        return tftp_transmit_handle_packet(op_data, tx_data);
+    }
+
+    TransferStatus_t status = tftp_receive_handle_packet(op_data, tx_data);
+
+    // block writes still queued on the thread's io_uring point into the receive batch buffer,
+    // so they are flushed once the whole batch is handled, before the buffer is received into again
+    if (status == TFTP_TRANSFER_IN_PROGRESS && tx_data->ring_writes_queued > 0
+        && tx_data->receive_batch_next >= tx_data->receive_batch_count && !tftp_receive_flush_writes(op_data, tx_data, -1))
+    {
+        status = TFTP_TRANSFER_FAILED;
+    }
+
+    return status;
 }
 
 /**
- * This function implements the core of a file transfer operation,
- * from the receiving side.
+ * Advances a file transfer once its retransmission deadline passed without the peer making progress,
+ * backing the timeout off before whatever is resent.
  */
-bool tftp_receive_file(OperationData_t *op_data, TransferData_t *tx_data)
+TransferStatus_t tftp_transfer_handle_timeout(OperationData_t *op_data, TransferData_t *tx_data)
 {
-    CHECK_SIGTERM_DURING_TRANSFER
+    bool counted = tftp_rtt_backoff(tx_data);
 
-    bool received = false;
-    uint16_t prev_block_number = 0;
-    ssize_t bytes_written = 0;
+    // whatever is resent waits for the backed-off timeout, even if nothing could be resent
+    tftp_arm_retransmit_deadline(tx_data);
 
-    tx_data->current_block_number = 1;
-    printf("Beginning file reception.\n");
-    clock_gettime(CLOCK_MONOTONIC, &tx_data->start_clock);
+    if (tx_data->is_receiver)
+    {
+        return tftp_receive_handle_timeout(op_data, tx_data, counted);
+    }
+
+    LOG_DEBUG("Socket timed out.\n");
+
+    if (tx_data->transmit_state == TFTP_TRANSMIT_STATE_AWAITING_OPTION_ACK)
+    {
+        if (counted && tx_data->resend_counter >= tftp_common.max_retry_count)
+        {
+            LOG_WARN("OACK unacknowledged and retry limit reached. Aborting.\n");
+            tftp_send_error(TFTP_ERROR_UNDEFINED, "Timed out waiting for acknowledgement", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+            return TFTP_TRANSFER_FAILED;
+        }
 
-    do
+        tx_data->resend_counter += counted;
+        METRICS_ADD(retransmissions, 1);
+        return tftp_send_option_acknowledgement(op_data) ? TFTP_TRANSFER_IN_PROGRESS : TFTP_TRANSFER_FAILED;
+    }
+
+    return tftp_transmit_retry(op_data, tx_data, counted);
+}
+
+/**
+ * Returns how long to wait for the peer before tftp_transfer_handle_timeout() is due, in milliseconds (rounded up),
+ * or 0 if it is due already.
+ */
+uint32_t tftp_transfer_timeout_ms(const TransferData_t *tx_data)
+{
+    uint64_t now_us = monotonic_microseconds();
+    return now_us >= tx_data->retransmit_deadline_us ? 0 : (tx_data->retransmit_deadline_us - now_us + 999) / 1000;
+}
+
+/**
+ * Keeps the data socket's receive timeout in line with the time left until the retransmission deadline,
+ * for transfers driven by blocking receives.
+ * The timeout is only changed if it would overshoot the deadline by more than TFTP_SOCKET_TIMEOUT_SLACK_US,
+ * or fall short of it by more than half, rather than on every receive; waking up early only means waiting again.
+ */
+static void tftp_apply_socket_timeout(OperationData_t *op_data, TransferData_t *tx_data, uint32_t timeout_us)
+{
+    if (tx_data->socket_timeout_us <= (uint64_t)timeout_us + TFTP_SOCKET_TIMEOUT_SLACK_US && tx_data->socket_timeout_us >= timeout_us / 2)
+    {
+        return;
+    }
+
+    struct timeval socket_timeout = { .tv_sec = timeout_us / 1000000, .tv_usec = timeout_us % 1000000 };
+
+    if (0 > setsockopt(op_data->data_socket, SOL_SOCKET, SO_RCVTIMEO, &socket_timeout, sizeof(socket_timeout)))
+    {
+        LOG_ERRNO("Failed to set socket timeout");
+        return;
+    }
+
+    tx_data->socket_timeout_us = timeout_us;
+}
+
+/**
+ * Drives a file transfer to completion on the calling thread,
+ * blocking on the data socket (which times out at the retransmission deadline at the latest) for every batch of packets.
+ * Packets already received are handled before a deadline that passed meanwhile.
+ */
+static bool tftp_run_transfer(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    TransferStatus_t status = TFTP_TRANSFER_IN_PROGRESS;
+
+    if (!tftp_transfer_begin(op_data, tx_data))
+    {
+        return false;
+    }
+
+    while (status == TFTP_TRANSFER_IN_PROGRESS)
     {
         CHECK_SIGTERM_DURING_TRANSFER
 
-        received = false;
+        uint64_t now_us = monotonic_microseconds();
+
+        if (tx_data->receive_batch_next >= tx_data->receive_batch_count && now_us >= tx_data->retransmit_deadline_us)
+        {
+            status = tftp_transfer_handle_timeout(op_data, tx_data);
+            continue;
+        }
 
-        while (!received)
+        if (now_us < tx_data->retransmit_deadline_us)
         {
-            tx_data->bytes_received = recvfrom(op_data->data_socket, tx_data->data_packet_ptr, tx_data->data_packet_max_size, 0, (struct sockaddr *)&(op_data->peer_address), &(op_data->peer_address_length));
+            tftp_apply_socket_timeout(op_data, tx_data, tx_data->retransmit_deadline_us - now_us);
+        }
 
-            if (tx_data->bytes_received > 0)
-            {
-                if (ntohs(tx_data->data_packet_ptr->opcode) == TFTP_ERROR)
-                {
-                    printf("\nReceived error message (code %u) from peer with message: %s\n", ntohs(tx_data->data_packet_ptr->error.error_code), tx_data->data_packet_ptr->error.error_message);
-                    return false;
-                }
-                else if  (ntohs(tx_data->data_packet_ptr->opcode) == TFTP_DATA && ntohs(tx_data->data_packet_ptr->data.block_number) == tx_data->current_block_number)
-                {
-                    printf ("[%0.2fs] Block #%u received! -> ", seconds_since_clock(tx_data->start_clock), tx_data->current_block_number);
-                    bytes_written = fwrite(tx_data->data_packet_ptr->data.data, 1, tx_data->bytes_received - sizeof(Packet_t), tx_data->file); 
-
-                    if (bytes_written <= 0)
-                    {
-                        perror("Writing to file failed");
-                        tftp_send_error(TFTP_ERROR_UNDEFINED, "Writing to file failed", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
-                        return false;
-                    }
-
-                    // acknowledge received block
-                    tftp_send_ack(tx_data->current_block_number, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
-
-                    tx_data->resend_counter = 0;
-                    tx_data->current_block_number++;
-                    prev_block_number++;
-                    received = true;
-                }
-            }
-            else if (tx_data->resend_counter < tftp_common.max_retry_count)
-            {
-                perror("Receive attempt failed");
-                tx_data->resend_counter++;
-                printf ("[%0.2fs] Block #%u still not received, resending acknowledgement of block #%u.\n", seconds_since_clock(tx_data->start_clock), tx_data->current_block_number, prev_block_number);
-            }
-            else
-            {
-                printf ("[%0.2fs] Block #%u still not received, max retransmission limit reached. Aborting.\n", seconds_since_clock(tx_data->start_clock), tx_data->current_block_number);
-                tftp_send_error(TFTP_ERROR_UNDEFINED, "Timed out waiting for data packet", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
-                return false;
-            }
+        if (tftp_transfer_receive_packet(op_data, tx_data) >= 0)
+        {
+            status = tftp_transfer_handle_packet(op_data, tx_data);
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ETIMEDOUT && errno != EINTR)
+        {
+            LOG_ERRNO("Failed to receive packet");
+            tftp_send_error(TFTP_ERROR_UNDEFINED, "Socket rx error", NULL, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+            return false;
         }
     }
-    while (tx_data->bytes_received == tx_data->data_packet_max_size);
 
-    printf("File reception complete in %0.2fs.\n", seconds_since_clock(tx_data->start_clock));
-    return true;
+    return status == TFTP_TRANSFER_COMPLETE;
+}
+
+/**
+ * This function implements the core of a file transfer operation,
+ * from the transmitting side, blocking until it completes or fails.
+ */
+bool tftp_transmit_file(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    return tftp_run_transfer(op_data, tx_data);
+}
+
+/**
+ * This function implements the core of a file transfer operation,
+ * from the receiving side, blocking until it completes or fails.
+ */
+bool tftp_receive_file(OperationData_t *op_data, TransferData_t *tx_data)
+{
+    return tftp_run_transfer(op_data, tx_data);
 }
 
 /**
@@ -572,12 +2318,12 @@ bool tftp_receive_file(OperationData_t *op_data, TransferData_t *tx_data)
  */
 bool tftp_send_ack(uint16_t block_number, int socket, const struct sockaddr_in *peer_address_ptr, socklen_t peer_address_length)
 {
-    printf("Sending ACK with block number %u.\n", block_number);
+    LOG_TRACE("Sending ACK with block number %u.\n", block_number);
     Packet_t ack_packet = { .ack.opcode = htons(TFTP_ACK), .ack.block_number = htons(block_number) };
 
-    if (0 > sendto(socket, &ack_packet, sizeof(ack_packet), 0, (struct sockaddr *)peer_address_ptr, peer_address_length))
+    if (0 > impair_sendto(socket, &ack_packet, sizeof(ack_packet), 0, (struct sockaddr *)peer_address_ptr, peer_address_length))
     {
-        perror("Failed to send ack");
+        LOG_ERRNO("Failed to send ack");
         return false;
     }
 
@@ -585,44 +2331,206 @@ bool tftp_send_ack(uint16_t block_number, int socket, const struct sockaddr_in *
 }
 
 /**
- * This function sends an error packet to the specified peer.
+ * Splits the option fields of a request or OACK packet into name & value pairs (RFC 2347), without copying them.
+ * Every field must be null-terminated within the given length; an empty name ends the options early,
+ * since some clients pad their requests with extra terminators. Pairs beyond TFTP_OPTIONS_MAX are ignored.
+ * Returns false if the fields are malformed, i.e. an unterminated field, or a name without a value.
  */
-void tftp_send_error(TFTPErrorCode_t error_code, const char *error_message, const char *error_item, int data_socket, const struct sockaddr_in *peer_address_ptr, socklen_t peer_address_length)
+bool tftp_parse_options(const char *fields, size_t length, TFTPOptionList_t *list)
 {
-    if (peer_address_ptr->sin_port == htons(69))
+    size_t index = 0;
+    list->count = 0;
+
+    while (index < length && fields[index] != '\0')
     {
-        printf("Errors during request phase not forwarded to peer (no peer yet).\n");
-        return;
+        const char *name = fields + index;
+        const char *name_end = memchr(name, '\0', length - index);
+
+        if (name_end == NULL || (size_t)(name_end - fields) + 1 >= length)
+        {
+            return false;
+        }
+
+        index = (name_end - fields) + 1;
+        const char *value = fields + index;
+        const char *value_end = memchr(value, '\0', length - index);
+
+        if (value_end == NULL)
+        {
+            return false;
+        }
+
+        index = (value_end - fields) + 1;
+
+        if (list->count < TFTP_OPTIONS_MAX)
+        {
+            list->options[list->count].name = name;
+            list->options[list->count].value = value;
+            list->count++;
+        }
     }
 
-    size_t error_message_len = (error_message == NULL ? 0 : strlen(error_message) + (error_item == NULL ? 0 : strlen(error_item)));
-    size_t packet_size = sizeof(Packet_t) + error_message_len + 2;
-    Packet_t *error_packet = malloc(packet_size);
-    explicit_bzero(error_packet, packet_size);
+    return true;
+}
 
-    error_packet->opcode = htons(TFTP_ERROR);
-    error_packet->error.error_code = htons(error_code);
+/**
+ * Appends a single "name\0value\0" option pair to the given packet fields,
+ * or only measures the space it would take if the fields pointer is NULL.
+ * Returns the number of bytes the option pair takes up.
+ */
+static size_t tftp_append_option_string(char *fields, const char *option_name, const char *option_value)
+{
+    size_t option_name_len = strlen(option_name) + 1;
+    size_t option_value_len = strlen(option_value) + 1;
+
+    if (fields != NULL)
+    {
+        memcpy(fields, option_name, option_name_len);
+        memcpy(fields + option_name_len, option_value, option_value_len);
+    }
+
+    return option_name_len + option_value_len;
+}
+
+/**
+ * Appends a single option pair with a numeric value, as tftp_append_option_string() does.
+ */
+static size_t tftp_append_option(char *fields, const char *option_name, uint64_t option_value)
+{
+    char option_value_str[24] = {0};
+    sprintf(option_value_str, "%lu", option_value);
+    return tftp_append_option_string(fields, option_name, option_value_str);
+}
+
+/**
+ * Appends every flagged option of an operation to the given packet fields: the options a client requests,
+ * or the options a server acknowledges. Only measures the space they would take if the fields pointer is NULL.
+ * Returns the number of bytes the options take up.
+ */
+size_t tftp_append_options(char *fields, const OperationData_t *op_data)
+{
+    size_t options_len = 0;
+
+    if (op_data->option_flags & TFTP_OPTION_BLKSIZE)
+    {
+        options_len += tftp_append_option(fields == NULL ? NULL : fields + options_len, TFTP_BLKSIZE_STRING, op_data->block_size);
+    }
+
+    if (op_data->option_flags & TFTP_OPTION_WINDOWSIZE)
+    {
+        options_len += tftp_append_option(fields == NULL ? NULL : fields + options_len, TFTP_WINDOWSIZE_STRING, op_data->window_size);
+    }
+
+    if (op_data->option_flags & TFTP_OPTION_TIMEOUT)
+    {
+        options_len += tftp_append_option(fields == NULL ? NULL : fields + options_len, TFTP_TIMEOUT_STRING, op_data->timeout_seconds);
+    }
+
+    if (op_data->option_flags & TFTP_OPTION_TSIZE)
+    {
+        options_len += tftp_append_option(fields == NULL ? NULL : fields + options_len, TFTP_TSIZE_STRING, op_data->transfer_size);
+    }
+
+    // the group is only filled in by the server, and a client asks for one with an empty value
+    if (op_data->option_flags & TFTP_OPTION_MULTICAST)
+    {
+        char multicast_str[ADDRESS_BUFF_LENGTH + 16] = {0};
+
+        if (op_data->multicast_address.sin_port != 0)
+        {
+            snprintf(multicast_str, sizeof(multicast_str), "%s,%u,%u", inet_ntoa(op_data->multicast_address.sin_addr),
+                    ntohs(op_data->multicast_address.sin_port), op_data->multicast_master);
+        }
+
+        options_len += tftp_append_option_string(fields == NULL ? NULL : fields + options_len, TFTP_MULTICAST_STRING, multicast_str);
+    }
+
+    return options_len;
+}
+
+/**
+ * Sends an OACK packet (RFC 2347) to the peer, listing every option that was acknowledged, with its final value.
+ */
+bool tftp_send_option_acknowledgement(OperationData_t *op_data)
+{
+    uint8_t packet_buffer[TFTP_RESPONSE_PACKET_MAX_SIZE];
+    Packet_t *oack_packet = (Packet_t *)packet_buffer;
+    explicit_bzero(packet_buffer, sizeof(packet_buffer));
+
+    oack_packet->opcode = htons(TFTP_OACK);
+    size_t options_len = tftp_append_options(oack_packet->oack.options, op_data);
+    size_t packet_size = sizeof(oack_packet->opcode) + options_len;
+
+    TFTPOptionList_t acknowledged;
+    tftp_parse_options(oack_packet->oack.options, options_len, &acknowledged);
+    char options_string[TFTP_RESPONSE_PACKET_MAX_SIZE] = "";
+    size_t options_string_length = 0;
+
+    for (uint8_t idx = 0; idx < acknowledged.count && options_string_length < sizeof(options_string); idx++)
+    {
+        options_string_length += snprintf(options_string + options_string_length, sizeof(options_string) - options_string_length,
+                " %s=%s", acknowledged.options[idx].name, acknowledged.options[idx].value);
+    }
+
+    LOG_INFO("Sending OACK with options:%s.\n", options_string);
+
+    if (0 > impair_sendto(op_data->data_socket, oack_packet, packet_size, 0, (struct sockaddr *)&op_data->peer_address, op_data->peer_address_length))
+    {
+        LOG_ERRNO("Failed to send OACK");
+        return false;
+    }
+
+    return true;
+}
 
-    if (error_message != NULL)
+/**
+ * Answers a write request on the server side: with an OACK if any of its options were acknowledged,
+ * or else with a plain ACK of block 0, upon which the client starts sending.
+ */
+bool tftp_acknowledge_request(OperationData_t *op_data)
+{
+    if (op_data->option_flags != 0)
     {
-        strcpy(error_packet->error.error_message, error_message);
+        return tftp_send_option_acknowledgement(op_data);
     }
 
-    if (error_item != NULL)
+    return tftp_send_ack(0, op_data->data_socket, &op_data->peer_address, op_data->peer_address_length);
+}
+
+/**
+ * This function sends an error packet to the specified peer.
+ */
+void tftp_send_error(TFTPErrorCode_t error_code, const char *error_message, const char *error_item, int data_socket, const struct sockaddr_in *peer_address_ptr, socklen_t peer_address_length)
+{
+    if (peer_address_ptr->sin_port == htons(tftp_common.requests_port))
     {
-        strcat(error_packet->error.error_message, error_item);
+        LOG_INFO("Errors during request phase not forwarded to peer (no peer yet).\n");
+        return;
     }
 
-    printf("Sending error packet with code %d, message: %s%s\n", error_code, error_message, error_item);
+    // the message is truncated to what a peer's response buffer can hold, which also bounds it for the stack
+    uint8_t packet_buffer[TFTP_RESPONSE_PACKET_MAX_SIZE];
+    Packet_t *error_packet = (Packet_t *)packet_buffer;
+    explicit_bzero(packet_buffer, sizeof(packet_buffer));
+
+    error_packet->opcode = htons(TFTP_ERROR);
+    error_packet->error.error_code = htons(error_code);
+    snprintf(error_packet->error.error_message, TFTP_ERROR_MESSAGE_MAX_LENGTH, "%s%s",
+            error_message == NULL ? "" : error_message, (error_message == NULL || error_item == NULL) ? "" : error_item);
+
+    size_t packet_size = sizeof(Packet_t) + strlen(error_packet->error.error_message) + 1;
+
+    LOG_INFO("Sending error packet with code %d, message: %s%s\n", error_code, error_message, error_item);
 
-    ssize_t bytes_sent = sendto(data_socket, error_packet, packet_size, 0, (struct sockaddr *)peer_address_ptr, peer_address_length);
+    ssize_t bytes_sent = impair_sendto(data_socket, error_packet, packet_size, 0, (struct sockaddr *)peer_address_ptr, peer_address_length);
 
     if (bytes_sent <= 0)
     {
-        perror("Failed to send error");
+        LOG_ERRNO("Failed to send error");
+        return;
     }
 
-    free(error_packet);
+    METRICS_ADD(error_packets_sent, 1);
 }
 
 /**
@@ -636,13 +2544,14 @@ bool tftp_await_acknowledgement(uint16_t block_number, OperationData_t *op_data)
     ssize_t bytes_received = 0;
     TFTPOpcode_t incoming_opcode;
 
-    // dynamically allocating the packet to allow extra space for error packet message field
-    Packet_t *incoming_packet = malloc(TFTP_RESPONSE_PACKET_MAX_SIZE);
+    // the buffer has extra space for the error packet message field, plus a terminator in case the peer omits it
+    uint8_t packet_buffer[TFTP_RESPONSE_PACKET_MAX_SIZE + 1] = { 0 };
+    Packet_t *incoming_packet = (Packet_t *)packet_buffer;
 
     while (retry_counter < tftp_common.max_retry_count)
     {
         retry_counter++;
-        printf("Awaiting ACK packet (attempt #%d).\n", retry_counter);
+        LOG_DEBUG("Awaiting ACK packet (attempt #%d).\n", retry_counter);
         bytes_received = recvfrom(op_data->data_socket, incoming_packet, TFTP_RESPONSE_PACKET_MAX_SIZE, 0, (struct sockaddr *)&(op_data->peer_address), &(op_data->peer_address_length));
 
         if (bytes_received > 0)
@@ -651,24 +2560,20 @@ bool tftp_await_acknowledgement(uint16_t block_number, OperationData_t *op_data)
 
             if (incoming_opcode == TFTP_ACK && ntohs(incoming_packet->ack.block_number) == block_number)
             {
-                free(incoming_packet);
                 return true;
             }
             else if (incoming_opcode == TFTP_ERROR)
             {
-                printf("Received error message (code %u) from peer with message: %s\n", ntohs(incoming_packet->error.error_code), incoming_packet->error.error_message);
-                free(incoming_packet);
+                LOG_INFO("Received error message (code %u) from peer with message: %s\n", ntohs(incoming_packet->error.error_code), incoming_packet->error.error_message);
                 return false;
             }
             else
             {
-                printf("Received packet with opcode %d, expected %d (ACK) or %d (ERROR)!\n", incoming_opcode, TFTP_ACK, TFTP_ERROR);
+                LOG_WARN("Received packet with opcode %d, expected %d (ACK) or %d (ERROR)!\n", incoming_opcode, TFTP_ACK, TFTP_ERROR);
             }
         }
     }
 
-    printf("ACK reception retry limit (%u) reached.\n", tftp_common.max_retry_count);
-
-    free(incoming_packet);
+    LOG_WARN("ACK reception retry limit (%u) reached.\n", tftp_common.max_retry_count);
     return false;
 }
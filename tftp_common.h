@@ -7,20 +7,43 @@
 
 #include "common.h"
 #include "networking_common.h"
+#include "file_cache.h"
 
-#define TFTP_OPERATION_MODES_COUNT 4
+#define TFTP_OPERATION_MODES_COUNT 6
 #define TFTP_OPERATION_MODE_STRING_MAXLENGTH 8
 
 #define TFTP_TRANSFER_MODES_COUNT 3
 #define TFTP_TRANSFER_MODE_STRING_MAXLENGTH 9
 
-#define TFTP_OPCODES_COUNT 7
+#define TFTP_OPCODES_COUNT 8
 #define TFTP_OPCODE_STRING_MAXLENGTH 6
 
 #define TFTP_BLKSIZE_STRING "blksize"
+#define TFTP_BLKSIZE_AUTO_STRING "auto"
+#define TFTP_WINDOWSIZE_STRING "windowsize"
+#define TFTP_TIMEOUT_STRING "timeout"
+#define TFTP_TSIZE_STRING "tsize"
+#define TFTP_MULTICAST_STRING "multicast"
+#define TFTP_OPTIONS_MAX 8
+#define TFTP_REQUESTS_PORT_DEFAULT 69
+#define TFTP_TIMEOUT_SECONDS 1
+#define TFTP_RTO_MIN_MS_DEFAULT 10
+#define TFTP_RTO_MAX_MS_DEFAULT 4000
+#define TFTP_RETRIES_DEFAULT 5
+#define TFTP_SOCKET_TIMEOUT_SLACK_US 1000
+#define TFTP_ZEROCOPY_MIN_BLKSIZE 16384
+#define TFTP_ZEROCOPY_HEADER_SLOTS 1024 // a power of two
+#define TFTP_ZEROCOPY_HEADER_WAIT_MS 100
+#define TFTP_ZEROCOPY_LINGER_MS 1000
 #define TFTP_FILENAME_MAX 255
 #define TFTP_ERROR_MESSAGE_MAX_LENGTH 128
 #define TFTP_RESPONSE_PACKET_MAX_SIZE (sizeof(Packet_t) + TFTP_ERROR_MESSAGE_MAX_LENGTH)
+#define TFTP_BATCH_MAX_PACKETS 64
+#define TFTP_BATCH_MAX_BYTES (256 * 1024)
+#define TFTP_GSO_MAX_SEGMENTS 64
+#define TFTP_GSO_MAX_BYTES (65535 - 20 - 8)
+#define TFTP_GRO_MAX_DATAGRAM 65535
+#define TFTP_PROGRESS_INTERVAL_MS 1000
 
 typedef enum TFTPOpcode
 {
@@ -30,7 +53,8 @@ typedef enum TFTPOpcode
     TFTP_DATA = 3, // data packet
     TFTP_ACK = 4, // acknowledgement packet
     TFTP_ERROR = 5, // error packet
-    TFTP_DRQ = 6, // delete request
+    TFTP_OACK = 6, // option acknowledgement packet (RFC 2347)
+    TFTP_DRQ = 7, // delete request
 } TFTPOpcode_t;
 
 typedef enum TFTPTransferMode
@@ -51,6 +75,7 @@ typedef enum TFTPErrorCode
     TFTP_ERROR_UNKNOWN_TRANSFER = 5,
     TFTP_ERROR_FILE_EXISTS = 6,
     TFTP_ERROR_UNKNOWN_USER = 7,
+    TFTP_ERROR_OPTION_NEGOTIATION = 8,
 } TFTPErrorCode_t;
 
 typedef enum TFTPBlocksize
@@ -61,6 +86,72 @@ typedef enum TFTPBlocksize
     TFTP_BLKSIZE_MAX = 65464
 } TFTPBlocksize_t;
 
+/**
+ * Permitted range for the RFC 7440 'windowsize' option,
+ * i.e. the number of consecutive DATA blocks sent before an ACK is expected.
+ * The default window of 1 block is plain lock-step TFTP.
+ * A window must span less than half the 16 bit block number range, or a late ACK from an earlier window
+ * could not be told apart from one within the current window.
+ */
+typedef enum TFTPWindowsize
+{
+    TFTP_WINDOWSIZE_UNSPECIFIED = 0,
+    TFTP_WINDOWSIZE_MIN = 1,
+    TFTP_WINDOWSIZE_DEFAULT = 1,
+    TFTP_WINDOWSIZE_MAX = 32767
+} TFTPWindowsize_t;
+
+/**
+ * Permitted range for the RFC 2349 'timeout' option, in seconds.
+ */
+typedef enum TFTPTimeout
+{
+    TFTP_TIMEOUT_MIN = 1,
+    TFTP_TIMEOUT_MAX = 255
+} TFTPTimeout_t;
+
+/**
+ * Flags of the options a request asked for, and later of those its peer acknowledged (RFC 2347).
+ */
+typedef enum TFTPOptionFlag
+{
+    TFTP_OPTION_BLKSIZE = 1 << 0,
+    TFTP_OPTION_WINDOWSIZE = 1 << 1,
+    TFTP_OPTION_TIMEOUT = 1 << 2,
+    TFTP_OPTION_TSIZE = 1 << 3,
+    TFTP_OPTION_MULTICAST = 1 << 4,
+} TFTPOptionFlag_t;
+
+/**
+ * A single option name & value pair, pointing into the packet it was parsed from.
+ */
+typedef struct TFTPOption
+{
+    const char *name;
+    const char *value;
+} TFTPOption_t;
+
+/**
+ * The option pairs of a request or OACK packet, in the order they appeared.
+ */
+typedef struct TFTPOptionList
+{
+    uint8_t count;
+    TFTPOption_t options[TFTP_OPTIONS_MAX];
+} TFTPOptionList_t;
+
+/**
+ * How the transmitting side gets file contents into DATA packets:
+ * by reading each block into the packet buffer, or by sending blocks straight out of a memory mapping of the file,
+ * optionally asking the kernel to skip its own copy as well (MSG_ZEROCOPY, for large enough block sizes).
+ */
+typedef enum TFTPTransmitMethod
+{
+    TFTP_TRANSMIT_COPY = 0,
+    TFTP_TRANSMIT_MMAP = 1,
+    TFTP_TRANSMIT_ZEROCOPY = 2,
+} TFTPTransmitMethod_t;
+
 typedef union Packet
 {
 #pragma pack(push, 1)
@@ -69,7 +160,7 @@ typedef union Packet
     struct
     {
         uint16_t opcode; // RRQ, WRQ, or DRQ
-        char contents[]; // null-terminated fields: file name, transfer mode, (optional) block size
+        char contents[]; // null-terminated fields: file name, transfer mode, (optional) option name & value pairs
     } request;
 
     struct
@@ -91,9 +182,39 @@ typedef union Packet
         uint16_t error_code;
         char error_message[];
     } error;
+
+    struct
+    {
+        uint16_t opcode; // OACK
+        char options[]; // null-terminated option name & value pairs, as acknowledged
+    } oack;
 #pragma pack(pop)
 } Packet_t;
 
+/**
+ * Where the transmitting side of a transfer stands, which decides what an incoming ACK means to it.
+ * Only an ACK that moves the transfer forward has anything sent in response; everything else is ignored,
+ * and what went unacknowledged is only resent once the retransmission timeout expires,
+ * so that duplicated or delayed ACKs never multiply the DATA sent (the Sorcerer's Apprentice bug, RFC 1123 4.2.3.1).
+ */
+typedef enum TFTPTransmitState
+{
+    TFTP_TRANSMIT_STATE_IDLE = 0, // nothing sent yet
+    TFTP_TRANSMIT_STATE_AWAITING_OPTION_ACK = 1, // an OACK was sent, and the peer's ACK of block 0 is awaited before any DATA
+    TFTP_TRANSMIT_STATE_AWAITING_WINDOW_ACK = 2, // the current window was sent, and an ACK of any of its blocks is awaited
+    TFTP_TRANSMIT_STATE_COMPLETE = 3, // the final block was acknowledged
+} TFTPTransmitState_t;
+
+/**
+ * Outcome of a single step of a file transfer, as reported to whoever drives it.
+ */
+typedef enum TransferStatus
+{
+    TFTP_TRANSFER_FAILED = -1,
+    TFTP_TRANSFER_IN_PROGRESS = 0,
+    TFTP_TRANSFER_COMPLETE = 1,
+} TransferStatus_t;
+
 typedef enum OperationId
 {
     TFTP_OPERATION_UNDEFINED = 0,
@@ -113,19 +234,27 @@ typedef struct OperationMode
     const uint8_t min_argument_count;
     const char input_string[TFTP_OPERATION_MODE_STRING_MAXLENGTH];
     const char description_string[32];
-    const char usage_format_string[64];
+    const char usage_format_string[96];
 
 } OperationMode_t;
 
 /**
  * This struct holds data defining TFTP operations.
+ * The option flags tell which options were requested, and once negotiated, which were acknowledged;
+ * options that were not keep their protocol defaults.
  */
 typedef struct OperationData
 {
     OperationId_t operation_id;
     TFTPTransferMode_t transfer_mode;
+    uint8_t option_flags;
+    uint8_t timeout_seconds;
     uint16_t block_size;
+    uint16_t window_size;
     uint16_t path_len;
+    uint64_t transfer_size; // the 'tsize' option: the size of the file, if known to either side
+    bool multicast_master; // the 'multicast' option (RFC 2090): whether this client acknowledges for the group
+    struct sockaddr_in multicast_address; // the group DATA is sent to, left blank in the request
     int data_socket;
     struct sockaddr_in local_address;
     struct sockaddr_in peer_address;
@@ -134,34 +263,132 @@ typedef struct OperationData
     char path[];
 } OperationData_t;
 
+/**
+ * DATA headers sent with MSG_ZEROCOPY, which the kernel keeps reading from until it reports the send completed.
+ * Slots are used in turn, and each remembers the send it went out with; a slot is only written again
+ * once that send completed. Completions are flagged by send ID, modulo the number of slots:
+ * a send's ID cannot come round again before all the slots in between, its own included, were reused.
+ */
+typedef struct TFTPZerocopyHeaders
+{
+    int socket; // the data socket the sends were made on, whose error queue reports their completion
+    uint32_t next_slot;
+    uint32_t send_ids[TFTP_ZEROCOPY_HEADER_SLOTS];
+    bool slot_in_flight[TFTP_ZEROCOPY_HEADER_SLOTS];
+    bool send_completed[TFTP_ZEROCOPY_HEADER_SLOTS];
+    uint8_t headers[TFTP_ZEROCOPY_HEADER_SLOTS][sizeof(Packet_t)];
+} TFTPZerocopyHeaders_t;
+
 /**
  * This struct holds data used during TFTP file transfer operations.
  * It is separate from the Operation Data struct since not every operation involves a file transfer,
  * and some that potentially do may be aborted before it occurs.
+ * Packets are sent and received in batches of up to a window (sendmmsg/recvmmsg),
+ * with counters of the packets and system calls involved.
+ * Runs of equal-size DATA packets may be further coalesced into single datagrams
+ * by UDP segmentation offload when sending (UDP_SEGMENT), and receive offload when receiving (UDP_GRO).
+ * Each side estimates the round-trip time to its peer (RFC 6298), from a window being sent until its ACK
+ * when transmitting, and from an ACK being sent until the next window's first block when receiving.
+ * The retransmission timeout follows the estimate, and doubles after every timeout until the next valid sample.
  */
 typedef struct TransferData
 {
+    bool is_receiver;
+    bool packet_buffers_borrowed;
+    bool zerocopy_enabled;
+    bool gso_enabled;
+    bool gro_enabled;
+    bool file_preallocated; // the file's announced size was reserved on disk up front, and is trimmed to what was received
+    bool gap_acknowledged;
+    bool rto_fixed; // the peer negotiated a fixed timeout, which is neither estimated nor backed off
+    bool rtt_sample_pending; // a round trip is being timed, and nothing sent since was a retransmission (Karn's rule)
     uint8_t resend_counter;
-    uint8_t response_packet_max_size;
+    TFTPTransmitState_t transmit_state;
     uint16_t data_packet_max_size;
     uint16_t current_block_number;
+    uint16_t blocks_since_ack;
+    uint16_t send_slot_size;
+    uint16_t send_batch_capacity;
+    uint16_t gso_segments_max;
+    uint16_t receive_batch_capacity;
+    uint16_t receive_batch_count;
+    uint16_t receive_batch_next;
+    uint16_t ring_writes_queued; // block writes queued on the thread's io_uring, not yet submitted
+    uint32_t receive_slot_size;
+    uint32_t receive_offset; // of the next packet within a coalesced datagram
     int32_t bytes_received;
-    int32_t bytes_sent;
-    int32_t latest_file_bytes_read;
+    uint32_t timeouts_count;
+    uint32_t rtt_samples_count;
+    uint32_t srtt_us;
+    uint32_t rttvar_us;
+    uint32_t rtt_min_us;
+    uint32_t rtt_max_us;
+    uint32_t rto_us;
+    uint32_t socket_timeout_us; // receive timeout currently set on the data socket, in blocking mode
+    uint64_t retransmit_deadline_us; // when tftp_transfer_handle_timeout() is due, moved only by what is sent and by progress
+    uint64_t total_file_size;
+    uint64_t total_block_count; // blocks in the file when transmitting, blocks received so far when receiving
     uint64_t total_file_bytes_transmitted;
+    uint64_t window_first_block;
+    uint64_t window_last_block;
+    uint64_t highest_block_sent;
+    uint64_t rtt_sample_block; // the first block of the window never sent before, whose ACK (or a later one's) ends the round trip being timed
+    uint64_t send_syscalls;
+    uint64_t packets_sent;
+    uint64_t receive_syscalls;
+    uint64_t packets_received;
+    uint64_t datagrams_received; // as returned by recvmmsg(), which receive offload may have coalesced from several packets each
+    uint64_t ring_write_bytes_queued;
+    uint64_t gso_datagrams;
+    uint64_t gso_packets;
+    uint64_t gro_datagrams;
+    uint64_t gro_packets;
+    uint64_t zerocopy_sends;
+    uint64_t zerocopy_completions;
+    uint64_t zerocopy_copied;
+    uint64_t transmit_cpu_ns;
+    uint64_t rtt_sample_start_us;
+    uint64_t duplicate_packets; // ACKs of blocks already acknowledged, or DATA blocks already received
+    uint64_t dropped_packets; // ACKs ahead of what was sent, DATA blocks out of sequence, unexpected opcodes, truncated packets
+    uint64_t foreign_packets; // from other than the peer's transfer ID (RFC 1350), answered with an ERROR
     struct timespec start_clock;
+    uint64_t progress_reported_ms; // when progress was last logged, which is at most every TFTP_PROGRESS_INTERVAL_MS
     FILE *file;
-    Packet_t *response_packet_ptr;
-    Packet_t *data_packet_ptr;
+    uint8_t *file_mapping;
+    FileCacheEntry_t *cache_entry; // the shared contents the file mapping points into, if the file was cached
+    TFTPZerocopyHeaders_t *zerocopy_headers; // where DATA headers are written instead of the send slots while sends are zero-copy
+    uint8_t *send_batch_buffer; // slots of a DATA header followed by its block, one per packet sent in a batch
+    uint8_t *receive_batch_buffer; // slots of a single received packet plus a terminator, one per packet received in a batch
+    Packet_t *received_packet_ptr; // the slot of the packet last handed out by tftp_transfer_receive_packet()
+    uint32_t receive_lengths[TFTP_BATCH_MAX_PACKETS];
+    uint16_t receive_segment_sizes[TFTP_BATCH_MAX_PACKETS]; // 0 unless the datagram was coalesced from several packets
+    struct sockaddr_in receive_addresses[TFTP_BATCH_MAX_PACKETS];
+    struct sockaddr_in received_address; // the source of the packet last handed out, which need not be the peer
 } TransferData_t;
 
+/**
+ * Batch buffers large enough for any transfer, owned by a long-living thread
+ * and lent to each of the transfers it runs, instead of allocating buffers per transfer.
+ */
+typedef struct TransferBuffers
+{
+    uint8_t *send_batch_buffer;
+    uint8_t *receive_batch_buffer;
+} TransferBuffers_t;
+
 /**
  * This struct holds common data used by both TFTP client and server operations.
  */
 typedef struct TFTPCommonData
 {
     bool is_server;
-    const uint8_t max_retry_count;
+    uint16_t requests_port; // the port the server receives requests on
+    TFTPTransmitMethod_t transmit_method;
+    bool segmentation_offload;
+    bool path_mtu_blksize;
+    uint8_t max_retry_count;
+    uint32_t rto_min_ms;
+    uint32_t rto_max_ms;
     const OperationMode_t operation_modes[TFTP_OPERATION_MODES_COUNT];
     const char transfer_mode_strings[TFTP_TRANSFER_MODES_COUNT][TFTP_TRANSFER_MODE_STRING_MAXLENGTH];
     const char opcode_strings[TFTP_OPCODES_COUNT][TFTP_OPCODE_STRING_MAXLENGTH];
@@ -170,17 +397,34 @@ typedef struct TFTPCommonData
 extern TFTPCommonData_t tftp_common;
 
 struct sockaddr_in init_peer_socket_address(struct in_addr peer_address_bin, in_port_t peer_port_bin);
-void tftp_init_bound_data_socket(int *socket_ptr, struct sockaddr_in *address_ptr);
+bool tftp_init_bound_data_socket(int *socket_ptr, struct sockaddr_in *address_ptr);
 
-OperationData_t *tftp_init_operation_data(OperationId_t operation, struct sockaddr_in peer_address, char *filename, char *mode_string, char *blocksize_string);
+OperationData_t *tftp_init_operation_data(OperationId_t operation, struct sockaddr_in peer_address, char *filename, char *mode_string, const TFTPOptionList_t *options);
 void tftp_free_operation_data(OperationData_t *data);
 
-bool tftp_fill_transfer_data(OperationData_t *operation_data, TransferData_t *transfer_data, bool receiver);
+bool tftp_fill_transfer_data(OperationData_t *operation_data, TransferData_t *transfer_data, bool receiver, const TransferBuffers_t *buffers);
+void tftp_release_transfer_data(TransferData_t *data);
 void tftp_free_transfer_data(TransferData_t *data);
 
+bool tftp_init_transfer_buffers(TransferBuffers_t *buffers);
+void tftp_deinit_transfer_buffers(TransferBuffers_t *buffers);
+
+bool tftp_transfer_begin(OperationData_t *operation_data, TransferData_t *transfer_data);
+ssize_t tftp_transfer_receive_packet(OperationData_t *operation_data, TransferData_t *transfer_data);
+TransferStatus_t tftp_transfer_handle_packet(OperationData_t *operation_data, TransferData_t *transfer_data);
+TransferStatus_t tftp_transfer_handle_timeout(OperationData_t *operation_data, TransferData_t *transfer_data);
+uint32_t tftp_transfer_timeout_ms(const TransferData_t *transfer_data);
+
+bool tftp_transmit_resume(OperationData_t *operation_data, TransferData_t *transfer_data, uint64_t first_block);
 bool tftp_transmit_file(OperationData_t *operation_data, TransferData_t *transfer_data);
 bool tftp_receive_file(OperationData_t *operation_data, TransferData_t *transfer_data);
 bool tftp_await_acknowledgement(uint16_t block_number, OperationData_t *op_data);
+bool tftp_parse_options(const char *fields, size_t length, TFTPOptionList_t *list);
+bool tftp_negotiate_option(OperationData_t *operation_data, const TFTPOption_t *option);
+uint16_t tftp_path_mtu_block_size(const struct sockaddr_in *peer_address);
+size_t tftp_append_options(char *fields, const OperationData_t *operation_data);
+bool tftp_acknowledge_request(OperationData_t *operation_data);
+bool tftp_send_option_acknowledgement(OperationData_t *operation_data);
 bool tftp_send_ack(uint16_t block_number, int socket, const struct sockaddr_in *peer_address_ptr, socklen_t peer_address_length);
 void tftp_send_error(TFTPErrorCode_t error_code, const char *error_message, const char *error_item, int data_socket, const struct sockaddr_in *peer_address_ptr, socklen_t peer_address_length);
 